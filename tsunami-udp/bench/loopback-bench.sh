@@ -0,0 +1,129 @@
+#!/bin/bash
+#
+# Loopback benchmark of the Tsunami client and server.
+#
+# Runs the client and server against each other over loopback, for every
+# combination of impairment profile, block size and target rate, and
+# writes one CSV line per run.  The server sends a synthetic '!zero:'
+# source and the client drops the data into its '/dev/null' sink, so no
+# disk I/O is involved.
+#
+# Settings (environment variables, defaults in brackets):
+#   BLOCKSIZES  block sizes in bytes               ["1024 8192 32768"]
+#   RATES       client target rates                ["200M 500M 1G"]
+#   IMPAIRS     impairment profiles, 'none' or a server --impair
+#               setting like loss=0.01,delay=20,rate=800M  ["none"]
+#   SIZE        size of the synthetic source       [500M]
+#   PORT        TCP port of the benchmark server   [46500]
+#   UDPPORT     UDP port of the benchmark client   [46501]
+#   TIMEOUT     timeout per run in seconds         [300]
+#   OUT         CSV output file                    [bench-results.csv]
+#   SERVER, CLIENT  the binaries to run    [../server/tsunamid, ../client/tsunami]
+#
+# CSV columns:
+#   impair, blocksize, target_rate, duration_s, throughput_mbps,
+#   goodput_mbps, retransmit_ratio, client_cpu_s, server_cpu_s,
+#   cpu_s_per_gbit, status
+#
+# Throughput counts every received datagram, goodput only the file data.
+# The CPU time is user+system of both processes, including the impairment
+# layer (which only copies datagrams when delay, jitter, reordering or a
+# rate limit is configured).
+#
+
+BLOCKSIZES=${BLOCKSIZES:-"1024 8192 32768"}
+RATES=${RATES:-"200M 500M 1G"}
+IMPAIRS=${IMPAIRS:-"none"}
+SIZE=${SIZE:-500M}
+PORT=${PORT:-46500}
+UDPPORT=${UDPPORT:-46501}
+TIMEOUT=${TIMEOUT:-300}
+OUT=${OUT:-bench-results.csv}
+SERVER=$(readlink -f ${SERVER:-../server/tsunamid})
+CLIENT=$(readlink -f ${CLIENT:-../client/tsunami})
+CLK_TCK=$(getconf CLK_TCK)
+
+WORK=$(mktemp -d /tmp/tsunami-bench.XXXXXX)
+SERVER_PID=""
+
+cleanup() {
+    [ -n "$SERVER_PID" ] && kill $SERVER_PID 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# cumulative CPU seconds of the reaped children (the per-client
+# processes) of the server, fields cutime and cstime of /proc/pid/stat
+server_cpu() {
+    sed 's/.*) //' /proc/$SERVER_PID/stat | awk -v hz=$CLK_TCK '{ printf "%.3f", ($14 + $15) / hz }'
+}
+
+# value of a line "Name : value unit" in the client output
+client_value() {
+    grep "^$1 *:" "$WORK/client.log" | tail -1 | awk -F: '{ print $2 }' | awk '{ print $1 }'
+}
+
+# the byte count of SIZE, with the suffixes of the synthetic source
+BYTES=$(echo $SIZE | awk '{ n = $0 + 0; s = toupper(substr($0, length($0)));
+        m = (s == "K") ? 1 : (s == "M") ? 2 : (s == "G") ? 3 : (s == "T") ? 4 : 0;
+        printf "%.0f", n * 1024 ^ m }')
+
+echo "impair,blocksize,target_rate,duration_s,throughput_mbps,goodput_mbps,retransmit_ratio,client_cpu_s,server_cpu_s,cpu_s_per_gbit,status" > "$OUT"
+
+for impair in $IMPAIRS; do
+
+    [ "$impair" = "none" ] && option="" || option="--impair=$impair"
+
+    # one server per impairment profile
+    (cd "$WORK" && exec "$SERVER" --port=$PORT $option > "$WORK/server.log" 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    for bs in $BLOCKSIZES; do
+        for rate in $RATES; do
+
+            cpu_before=$(server_cpu)
+            TIMEFORMAT="%U %S"
+            { time timeout $TIMEOUT "$CLIENT" \
+                set port $PORT set udpport $UDPPORT set blocksize $bs set rate $rate \
+                set verbose no set output line \
+                connect localhost get '!zero:'$SIZE /dev/null close quit \
+                > "$WORK/client.log" 2>&1 < /dev/null ; } 2> "$WORK/time.log"
+            status=$?
+
+            # wait for the server child to exit so that its CPU time is accounted
+            for i in $(seq 50); do
+                pgrep -P $SERVER_PID > /dev/null || break
+                sleep 0.1
+            done
+            cpu_after=$(server_cpu)
+
+            duration=$(client_value "Transfer duration")
+            total=$(client_value "Total packet data")
+            good=$(client_value "Goodput data")
+            thru=$(client_value "Throughput")
+            goodput=$(client_value "Final file rate")
+            result="ok"
+            [ -z "$duration" ] && result="failed"
+            [ $status -eq 124 ] && result="timeout"
+
+            awk -v impair="$impair" -v bs=$bs -v rate=$rate -v duration="$duration" \
+                -v total="$total" -v good="$good" -v thru="$thru" -v goodput="$goodput" \
+                -v ctime="$(tail -1 "$WORK/time.log")" -v sb=$cpu_before -v sa=$cpu_after \
+                -v bytes=$BYTES -v result=$result 'BEGIN {
+                split(ctime, c, " ");
+                ccpu = c[1] + c[2];
+                scpu = sa - sb;
+                ratio = (total > 0) ? (total - good) / total : 0;
+                gbit = bytes * 8 / 1e9;
+                printf "\"%s\",%d,%s,%s,%s,%s,%.4f,%.3f,%.3f,%.3f,%s\n",
+                       impair, bs, rate, duration, thru, goodput, ratio, ccpu, scpu,
+                       (result == "ok") ? (ccpu + scpu) / gbit : 0, result;
+            }' | tee -a "$OUT"
+        done
+    done
+
+    kill $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    SERVER_PID=""
+done
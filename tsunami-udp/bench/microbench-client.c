@@ -0,0 +1,470 @@
+/*========================================================================
+ * microbench-client.c  --  Microbenchmarks of the Tsunami client hot paths.
+ *
+ * This measures the per-block costs of the client data structures: the
+ * ring buffer operations, got_block() and the gapless scan, the queueing
+ * of retransmission requests (with or without RETX_REQBLOCK_SORTING,
+ * depending on the build) and accept_block() into a file on tmpfs.  The
+ * results are printed as CSV lines with the cost in nanoseconds per
+ * operation, for several block counts and loss patterns.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <pthread.h>     /* for the pthreads library        */
+#include <sched.h>       /* for sched_yield()               */
+#include <stdlib.h>      /* for malloc(), atoi(), etc.      */
+#include <string.h>      /* for memset(), memcpy(), etc.    */
+#include <sys/time.h>    /* for gettimeofday()              */
+#include <unistd.h>      /* for unlink()                    */
+
+#include <tsunami-client.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope constants.
+ *------------------------------------------------------------------------*/
+
+#define MAX_FILE_BYTES  (256LL * 1024 * 1024)  /* the largest file for accept_block() */
+
+static const u_int32_t BLOCK_COUNTS[] = { 10000, 100000, 1000000 };
+static const char     *PATTERNS[]     = { "none", "random1%", "burst1%" };
+
+#define NUM_COUNTS    (sizeof(BLOCK_COUNTS) / sizeof(BLOCK_COUNTS[0]))
+#define NUM_PATTERNS  (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+static volatile u_int32_t sink;               /* keeps lookups from being optimized away */
+
+#ifdef RETX_REQBLOCK_SORTING
+static const char     *VARIANT = "sorting";
+#else
+static const char     *VARIANT = "plain";
+#endif
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static void           bench_ring       (ttp_session_t *session, u_int32_t ops);
+static void           bench_ring_thread(ttp_session_t *session, u_int32_t ops);
+static void           bench_got_block  (ttp_session_t *session, int pattern);
+static void           bench_gapless    (ttp_session_t *session, int pattern);
+static void           bench_retransmit (ttp_session_t *session, int pattern);
+static void           bench_accept     (ttp_session_t *session, const char *directory);
+static int            is_lost          (int pattern, u_int32_t block);
+static ttp_session_t *make_session     (u_int32_t block_size, u_int32_t block_count);
+static void           free_session     (ttp_session_t *session);
+static void          *ring_consumer    (void *arg);
+static void           report           (const char *name, const ttp_session_t *session, const char *pattern, u_int64_t ops, u_int64_t usec);
+
+
+/*------------------------------------------------------------------------
+ * MAIN PROGRAM
+ *------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    u_int32_t      block_size = (argc > 1) ? atoi(argv[1]) : DEFAULT_BLOCK_SIZE;
+    const char    *directory  = (argc > 2) ? argv[2] : "/dev/shm";
+    ttp_session_t *session;
+    u_int32_t      c;
+    int            p;
+
+    if ((block_size == 0) || (block_size > MAX_BLOCK_SIZE)) {
+        fprintf(stderr, "Usage: %s [blocksize] [tmpfs-directory]\n", argv[0]);
+        return 1;
+    }
+
+    printf("benchmark,variant,blocks,blocksize,pattern,ops,ns_per_op\n");
+
+    for (c = 0; c < NUM_COUNTS; ++c) {
+        session = make_session(block_size, BLOCK_COUNTS[c]);
+
+        bench_ring(session, BLOCK_COUNTS[c]);
+        bench_ring_thread(session, BLOCK_COUNTS[c]);
+        for (p = 0; p < NUM_PATTERNS; ++p) {
+            bench_got_block(session, p);
+            bench_gapless(session, p);
+            bench_retransmit(session, p);
+        }
+        bench_accept(session, directory);
+
+        free_session(session);
+    }
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void bench_ring(ttp_session_t *session, u_int32_t ops);
+ *
+ * Times a reserve / copy / confirm / peek / pop cycle of the ring
+ * buffer in a single thread, so without any waiting on the other side.
+ *------------------------------------------------------------------------*/
+static void bench_ring(ttp_session_t *session, u_int32_t ops)
+{
+    ring_buffer_t  *ring = session->transfer.ring_buffer;
+    u_char         *datagram;
+    u_char         *source;
+    struct timeval  start;
+    u_int32_t       i;
+
+    source = (u_char *) calloc(1, ring->datagram_size);
+    gettimeofday(&start, NULL);
+    for (i = 1; i <= ops; ++i) {
+        datagram = ring_reserve(ring);
+        memcpy(datagram, source, ring->datagram_size);
+        ring_confirm(ring);
+        datagram = ring_peek(ring);
+        ring_pop(ring);
+    }
+    report("ring_cycle", session, "none", ops, get_usec_since(&start));
+    free(source);
+}
+
+
+/*------------------------------------------------------------------------
+ * static void bench_ring_thread(ttp_session_t *session, u_int32_t ops);
+ *
+ * Times the ring buffer with a producer and a consumer thread, like the
+ * network and disk threads of a transfer.
+ *------------------------------------------------------------------------*/
+static void bench_ring_thread(ttp_session_t *session, u_int32_t ops)
+{
+    ring_buffer_t  *ring = session->transfer.ring_buffer;
+    u_char         *datagram;
+    pthread_t       consumer;
+    struct timeval  start;
+    u_int32_t       i;
+
+    gettimeofday(&start, NULL);
+    pthread_create(&consumer, NULL, ring_consumer, ring);
+    for (i = 1; i <= ops + 1; ++i) {
+        /* like command_get(), never block in ring_reserve() on a full ring */
+        while (ring_full(ring))
+            sched_yield();
+        datagram = ring_reserve(ring);
+        *((u_int32_t *) datagram) = htonl((i <= ops) ? i : 0);
+        ring_confirm(ring);
+    }
+    pthread_join(consumer, NULL);
+    report("ring_threaded", session, "none", ops, get_usec_since(&start));
+}
+
+
+/*------------------------------------------------------------------------
+ * static void bench_got_block(ttp_session_t *session, int pattern);
+ *
+ * Times got_block() lookups in block order, on a bitfield with the
+ * given loss pattern.
+ *------------------------------------------------------------------------*/
+static void bench_got_block(ttp_session_t *session, int pattern)
+{
+    ttp_transfer_t *xfer  = &session->transfer;
+    struct timeval  start;
+    u_int32_t       block, found = 0;
+
+    memset(xfer->received, 0, xfer->block_count / 8 + 2);
+    for (block = 1; block <= xfer->block_count; ++block)
+        if (!is_lost(pattern, block))
+            xfer->received[block / 8] |= (1 << (block % 8));
+
+    gettimeofday(&start, NULL);
+    for (block = 1; block <= xfer->block_count; ++block)
+        found += (got_block(session, block) != 0);
+    report("got_block", session, PATTERNS[pattern], xfer->block_count, get_usec_since(&start));
+    sink = found;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void bench_gapless(ttp_session_t *session, int pattern);
+ *
+ * Times the receive-side bookkeeping of command_get(): marking each
+ * arriving block and advancing the gapless_to_block index.  Lost blocks
+ * arrive after the original pass, as retransmissions would.
+ *------------------------------------------------------------------------*/
+static void bench_gapless(ttp_session_t *session, int pattern)
+{
+    ttp_transfer_t *xfer  = &session->transfer;
+    struct timeval  start;
+    u_int32_t       block, pass;
+
+    memset(xfer->received, 0, xfer->block_count / 8 + 2);
+    xfer->gapless_to_block = 0;
+
+    gettimeofday(&start, NULL);
+    for (pass = 0; pass < 2; ++pass) {
+        for (block = 1; block <= xfer->block_count; ++block) {
+            if ((pass == 0) == (is_lost(pattern, block) != 0))
+                continue;
+            xfer->received[block / 8] |= (1 << (block % 8));
+            while (got_block(session, xfer->gapless_to_block + 1) && (xfer->gapless_to_block < xfer->block_count))
+                xfer->gapless_to_block++;
+        }
+    }
+    report("gapless_scan", session, PATTERNS[pattern], xfer->block_count, get_usec_since(&start));
+}
+
+
+/*------------------------------------------------------------------------
+ * static void bench_retransmit(ttp_session_t *session, int pattern);
+ *
+ * Times ttp_request_retransmit() for every block lost in the original
+ * pass, starting from an empty table as in command_get().
+ *------------------------------------------------------------------------*/
+static void bench_retransmit(ttp_session_t *session, int pattern)
+{
+    ttp_transfer_t *xfer   = &session->transfer;
+    retransmit_t   *rexmit = &xfer->retransmit;
+    struct timeval  start;
+    u_int32_t       block, ops = 0;
+    u_int64_t       usec;
+
+    /* the bitfield after the original pass */
+    memset(xfer->received, 0, xfer->block_count / 8 + 2);
+    for (block = 1; block <= xfer->block_count; ++block)
+        if (!is_lost(pattern, block))
+            xfer->received[block / 8] |= (1 << (block % 8));
+
+    rexmit->table      = (u_int32_t *) calloc(DEFAULT_TABLE_SIZE, sizeof(u_int32_t));
+    rexmit->requested  = (u_int64_t *) calloc(DEFAULT_TABLE_SIZE, sizeof(u_int64_t));
+    rexmit->queued     = (u_char *)    calloc(xfer->block_count / 8 + 2, sizeof(u_char));
+    if ((rexmit->table == NULL) || (rexmit->requested == NULL) || (rexmit->queued == NULL))
+        error("Could not allocate retransmission table");
+    rexmit->table_size = DEFAULT_TABLE_SIZE;
+    rexmit->index_max  = 0;
+
+    gettimeofday(&start, NULL);
+    for (block = 1; block <= xfer->block_count; ++block) {
+        if (is_lost(pattern, block)) {
+            ttp_request_retransmit(session, block);
+            ++ops;
+        }
+    }
+    usec = get_usec_since(&start);
+    if (ops > 0)
+        report("request_retransmit", session, PATTERNS[pattern], ops, usec);
+
+    free(rexmit->table);
+    free(rexmit->requested);
+    free(rexmit->queued);
+    memset(rexmit, 0, sizeof(*rexmit));
+}
+
+
+/*------------------------------------------------------------------------
+ * static void bench_accept(ttp_session_t *session, const char *directory);
+ *
+ * Times accept_block() into a file in the given directory, which should
+ * be on tmpfs, first in block order and then in a scattered order.
+ *------------------------------------------------------------------------*/
+static void bench_accept(ttp_session_t *session, const char *directory)
+{
+    ttp_transfer_t *xfer       = &session->transfer;
+    u_int32_t       block_size = session->parameter->block_size;
+    u_int32_t       saved      = xfer->block_count;
+    u_int32_t       count, i, block;
+    u_char         *data;
+    char            filename[MAX_COMMAND_LENGTH];
+    struct timeval  start;
+
+    /* keep the file small enough for tmpfs */
+    count = (u_int32_t) min((u_int64_t) saved, MAX_FILE_BYTES / block_size);
+    xfer->block_count = count;
+    xfer->file_size   = (u_int64_t) count * block_size;
+
+    snprintf(filename, sizeof(filename), "%s/tsunami-microbench.%d", directory, (int) getpid());
+    xfer->file = fopen(filename, "wb");
+    data       = (u_char *) calloc(1, block_size);
+    if ((xfer->file == NULL) || (data == NULL)) {
+        warn("Could not open the accept_block() test file");
+        xfer->block_count = saved;
+        return;
+    }
+
+    gettimeofday(&start, NULL);
+    for (block = 1; block <= count; ++block)
+        accept_block(session, block, data);
+    fflush(xfer->file);
+    report("accept_block_seq", session, "none", count, get_usec_since(&start));
+
+    /* a full-period walk through the blocks with a large odd stride */
+    gettimeofday(&start, NULL);
+    for (i = 0, block = 0; i < count; ++i) {
+        block = (block + 7919) % count;
+        accept_block(session, block + 1, data);
+    }
+    fflush(xfer->file);
+    report("accept_block_scattered", session, "none", count, get_usec_since(&start));
+
+    fclose(xfer->file);
+    xfer->file = NULL;
+    unlink(filename);
+    free(data);
+    xfer->block_count = saved;
+}
+
+
+/*------------------------------------------------------------------------
+ * static int is_lost(int pattern, u_int32_t block);
+ *
+ * Returns nonzero if the block is lost in the original pass under the
+ * given loss pattern: none, 1% random, or 1% in bursts of 100 blocks.
+ *------------------------------------------------------------------------*/
+static int is_lost(int pattern, u_int32_t block)
+{
+    u_int32_t hash;
+
+    switch (pattern) {
+        case 1:
+            hash  = block * 2654435761U;
+            hash ^= hash >> 16;
+            return (hash % 100) == 0;
+        case 2:
+            return (block % 10000) < 100;
+        default:
+            return 0;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * static ttp_session_t *make_session(u_int32_t block_size,
+ *                                    u_int32_t block_count);
+ *
+ * Sets up a client session for a transfer of the given size, with the
+ * received bitfield and the ring buffer allocated.
+ *------------------------------------------------------------------------*/
+static ttp_session_t *make_session(u_int32_t block_size, u_int32_t block_count)
+{
+    ttp_session_t   *session;
+    ttp_parameter_t *parameter;
+
+    session   = (ttp_session_t *)   calloc(1, sizeof(ttp_session_t));
+    parameter = (ttp_parameter_t *) calloc(1, sizeof(ttp_parameter_t));
+    if ((session == NULL) || (parameter == NULL))
+        error("Could not allocate session");
+
+    reset_client(parameter);
+    parameter->block_size  = block_size;
+    session->parameter     = parameter;
+
+    session->transfer.block_count = block_count;
+    session->transfer.file_size   = (u_int64_t) block_count * block_size;
+    session->transfer.received    = (u_char *) calloc(block_count / 8 + 2, sizeof(u_char));
+    if (session->transfer.received == NULL)
+        error("Could not allocate received-data bitfield");
+    session->transfer.ring_slots  = MAX_BLOCKS_QUEUED;
+    session->transfer.ring_buffer = ring_create(session);
+
+    return session;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void free_session(ttp_session_t *session);
+ *
+ * Releases a session made by make_session().
+ *------------------------------------------------------------------------*/
+static void free_session(ttp_session_t *session)
+{
+    ring_destroy(session->transfer.ring_buffer);
+    free(session->transfer.received);
+    free(session->parameter->server_name);
+    free(session->parameter);
+    free(session);
+}
+
+
+/*------------------------------------------------------------------------
+ * static void *ring_consumer(void *arg);
+ *
+ * Pops blocks off the ring until the block with number 0 arrives, like
+ * the disk thread of the client does.
+ *------------------------------------------------------------------------*/
+static void *ring_consumer(void *arg)
+{
+    ring_buffer_t *ring = (ring_buffer_t *) arg;
+    u_int32_t      block;
+
+    do {
+        block = ntohl(*((u_int32_t *) ring_peek(ring)));
+        ring_pop(ring);
+    } while (block != 0);
+
+    return NULL;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void report(const char *name, const ttp_session_t *session,
+ *                    const char *pattern, u_int64_t ops, u_int64_t usec);
+ *
+ * Prints one CSV result line.
+ *------------------------------------------------------------------------*/
+static void report(const char *name, const ttp_session_t *session, const char *pattern, u_int64_t ops, u_int64_t usec)
+{
+    printf("%s,%s,%u,%u,%s,%llu,%.1f\n", name, VARIANT, session->transfer.block_count,
+           session->parameter->block_size, pattern, (ull_t) ops, (ops > 0) ? (1000.0 * usec / ops) : 0.0);
+    fflush(stdout);
+}
+
+
+/*========================================================================
+ * $Log$
+ */
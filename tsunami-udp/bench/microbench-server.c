@@ -0,0 +1,154 @@
+/*========================================================================
+ * microbench-server.c  --  Microbenchmarks of the Tsunami server hot paths.
+ *
+ * This measures the cost of build_datagram() reading blocks from a file
+ * on tmpfs, in block order as in the original pass and in a scattered
+ * order as for retransmissions.  The results are printed as CSV lines in
+ * the same format as those of microbench-client.c.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <stdlib.h>      /* for malloc(), atoi(), etc.      */
+#include <string.h>      /* for memset()                    */
+#include <sys/time.h>    /* for gettimeofday()              */
+#include <unistd.h>      /* for unlink()                    */
+
+#include <tsunami-server.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope constants.
+ *------------------------------------------------------------------------*/
+
+#define MAX_FILE_BYTES  (256LL * 1024 * 1024)  /* the largest test file */
+
+static const u_int32_t BLOCK_COUNTS[] = { 10000, 100000, 1000000 };
+
+#define NUM_COUNTS  (sizeof(BLOCK_COUNTS) / sizeof(BLOCK_COUNTS[0]))
+
+
+/*------------------------------------------------------------------------
+ * MAIN PROGRAM
+ *------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    u_int32_t        block_size = (argc > 1) ? atoi(argv[1]) : 1024;
+    const char      *directory  = (argc > 2) ? argv[2] : "/dev/shm";
+    ttp_parameter_t  parameter;
+    ttp_session_t    session;
+    u_char          *datagram;
+    char             filename[MAX_FILENAME_LENGTH];
+    struct timeval   start;
+    u_int32_t        c, i, block, count;
+    u_int64_t        usec;
+
+    if ((block_size == 0) || (block_size > MAX_BLOCK_SIZE)) {
+        fprintf(stderr, "Usage: %s [blocksize] [tmpfs-directory]\n", argv[0]);
+        return 1;
+    }
+
+    reset_server(&parameter);
+    memset(&session, 0, sizeof(session));
+    session.parameter      = &parameter;
+    parameter.block_size   = block_size;
+    datagram = (u_char *) calloc(1, block_size + 6 + TS_STAMP_SIZE);
+    snprintf(filename, sizeof(filename), "%s/tsunamid-microbench.%d", directory, (int) getpid());
+
+    printf("benchmark,variant,blocks,blocksize,pattern,ops,ns_per_op\n");
+
+    for (c = 0; c < NUM_COUNTS; ++c) {
+
+        /* write a test file that fits on tmpfs */
+        count = (u_int32_t) min((u_int64_t) BLOCK_COUNTS[c], MAX_FILE_BYTES / block_size);
+        session.transfer.file = fopen(filename, "w+b");
+        if (session.transfer.file == NULL)
+            return error("Could not create the build_datagram() test file");
+        for (block = 0; block < count; ++block)
+            fwrite(datagram + 6 + TS_STAMP_SIZE, 1, block_size, session.transfer.file);
+        fflush(session.transfer.file);
+        parameter.block_count = count;
+        parameter.file_size   = (u_int64_t) count * block_size;
+
+        /* in block order */
+        gettimeofday(&start, NULL);
+        for (block = 1; block <= count; ++block)
+            build_datagram(&session, block, TS_BLOCK_ORIGINAL, datagram);
+        usec = get_usec_since(&start);
+        printf("build_datagram_seq,plain,%u,%u,none,%u,%.1f\n", count, block_size, count, 1000.0 * usec / count);
+
+        /* a full-period walk through the blocks with a large odd stride */
+        gettimeofday(&start, NULL);
+        for (i = 0, block = 0; i < count; ++i) {
+            block = (block + 7919) % count;
+            build_datagram(&session, block + 1, TS_BLOCK_RETRANSMISSION, datagram);
+        }
+        usec = get_usec_since(&start);
+        printf("build_datagram_scattered,plain,%u,%u,none,%u,%.1f\n", count, block_size, count, 1000.0 * usec / count);
+        fflush(stdout);
+
+        fclose(session.transfer.file);
+        unlink(filename);
+    }
+
+    free(datagram);
+    return 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
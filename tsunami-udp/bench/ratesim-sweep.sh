@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Sweep of the rate control simulator over path profiles and controller
+# settings, for tuning the slowdown, speedup and error rate defaults.
+#
+# Runs tsunami-ratesim for every combination of path profile and
+# controller setting and writes one CSV line per run with the summary
+# of the simulated transfer.  The time series of each run are kept in
+# DIR when it is set.
+#
+# Settings (environment variables, defaults in brackets):
+#   PATHS       path profiles, each a comma separated list of simulator
+#               options without the dashes
+#               ["capacity=1G,rtt=50 capacity=1G,rtt=200,loss=0.001 capacity=10G,rtt=100,buffer=10M"]
+#   CONTROLS    controller settings in the same form, 'default' for the
+#               client defaults  ["default slowdown=26/24 speedup=9/10 error=5"]
+#   SIZE        size of the simulated transfer      [100G]
+#   RATE        the client target rate              [1G]
+#   BLOCKSIZE   the block size in bytes             [32768]
+#   OUT         CSV output file                     [ratesim-results.csv]
+#   DIR         directory for the time series       [none]
+#   SIM         the simulator binary                [./tsunami-ratesim]
+#
+# CSV columns:
+#   path, control, simulated_s, goodput_mbps, retransmitted_pct, lost,
+#   queue_drops, restarts, run_s
+#
+
+PATHS=${PATHS:-"capacity=1G,rtt=50 capacity=1G,rtt=200,loss=0.001 capacity=10G,rtt=100,buffer=10M"}
+CONTROLS=${CONTROLS:-"default slowdown=26/24 speedup=9/10 error=5"}
+SIZE=${SIZE:-100G}
+RATE=${RATE:-1G}
+BLOCKSIZE=${BLOCKSIZE:-32768}
+OUT=${OUT:-ratesim-results.csv}
+SIM=$(readlink -f ${SIM:-./tsunami-ratesim})
+
+# "a=1,b=2" -> "--a=1 --b=2"
+options() {
+    [ "$1" = "default" ] && return
+    echo "--${1//,/ --}"
+}
+
+echo "path,control,simulated_s,goodput_mbps,retransmitted_pct,lost,queue_drops,restarts,run_s" > "$OUT"
+
+run=0
+for p in $PATHS; do
+    for c in $CONTROLS; do
+        series=/dev/null
+        [ -n "$DIR" ] && series="$DIR/run$run.csv"
+        summary=$("$SIM" --size=$SIZE --rate=$RATE --blocksize=$BLOCKSIZE $(options $p) $(options $c) 2>&1 > "$series")
+        echo "$summary" | awk -v p="$p" -v c="$c" '{
+            for (i = 1; i <= NF; ++i) { split($i, kv, "="); v[kv[1]] = kv[2]; }
+            printf "\"%s\",\"%s\",%s,%s,%s,%s,%s,%s,%s\n", p, c, v["simulated_s"], v["goodput_mbps"],
+                   v["retransmitted_pct"], v["lost"], v["queue_drops"], v["restarts"], v["run_s"];
+        }' | tee -a "$OUT"
+        run=$((run + 1))
+    done
+done
@@ -0,0 +1,613 @@
+/*========================================================================
+ * ratesim.c  --  Discrete-event simulator of the Tsunami rate control.
+ *
+ * This runs the rate control loop of a lossless transfer on a virtual
+ * clock: the server paced by its inter-packet delay and serving one
+ * request per packet slot, a bottleneck link with a drop-tail queue,
+ * random loss and a fixed round-trip time, and the client detecting
+ * gaps, repeating its retransmission requests once their timeout has
+ * expired and reporting its error rate every UPDATE_PERIOD.  The
+ * controller itself is the code of common/ratecontrol.c, and the
+ * defaults are those of the client.  A time series of the rate, IPD and
+ * error rate is written as CSV, and a summary line of "key=value" pairs
+ * goes to stderr.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <getopt.h>      /* for getopt_long()               */
+#include <stdlib.h>      /* for malloc(), strtod(), etc.    */
+#include <string.h>      /* for memcpy(), strchr(), etc.    */
+#include <sys/time.h>    /* for gettimeofday()              */
+
+#include <tsunami-client.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope constants and data structures.
+ *------------------------------------------------------------------------*/
+
+#define SIM_HEADER_BYTES  (6 + 28)   /* the Tsunami, UDP and IPv4 headers of a datagram */
+
+/* the path and controller settings */
+typedef struct {
+    u_int64_t           size;              /* the size of the transfer (bytes)             */
+    double              capacity;          /* the bottleneck capacity (bps), 0 for none    */
+    double              buffer;            /* the bottleneck queue length (bytes)          */
+    double              rtt;               /* the round-trip time (usec)                   */
+    double              loss;              /* the random loss probability                  */
+    double              disk;              /* the client disk rate (bps), 0 for unlimited  */
+    u_int32_t           seed;              /* the seed of the random generator             */
+} sim_path_t;
+
+/* a datagram or a request on its way */
+typedef struct {
+    double              time;              /* when it arrives (usec)                       */
+    u_int32_t           block;             /* the block number                             */
+    u_int16_t           type;              /* the block or request type                    */
+} sim_message_t;
+
+/* a first-in first-out queue of messages */
+typedef struct {
+    sim_message_t      *items;
+    u_int32_t           head;
+    u_int32_t           count;
+    u_int32_t           size;
+} sim_fifo_t;
+
+
+/*------------------------------------------------------------------------
+ * Module-scope variables.
+ *------------------------------------------------------------------------*/
+
+static ttp_parameter_t   param;            /* the client settings, also used by the server */
+static sim_path_t        path;
+static u_int32_t         block_count;
+static u_int32_t         random_state = 1;
+
+static sim_fifo_t        datagrams;        /* datagrams on their way to the client */
+static sim_fifo_t        requests;         /* requests on their way to the server  */
+
+/* server state */
+static double            ipd_current;      /* the inter-packet delay (usec)          */
+static u_int32_t         ipd_time;         /* the delay of the target rate (usec)    */
+static u_int32_t         server_block;     /* the last original block sent           */
+static double            link_free;        /* when the bottleneck is idle again      */
+
+/* client state */
+static u_char           *received;         /* bitfield of the received blocks        */
+static u_int32_t         next_block, gapless_to_block, blocks_left;
+static u_int32_t        *table;            /* the retransmission table               */
+static double           *requested;        /* when each entry was requested, or 0    */
+static u_char           *queued;           /* bitfield of the blocks in the table    */
+static u_int32_t         index_max;
+static rtt_estimator_t   rtt;              /* the request turnaround estimate        */
+static u_int32_t         probe_block;      /* the block timed for an RTT sample      */
+static double            probe_time, last_repeat;
+static u_char            restart_pending;
+static u_int32_t         restart_lastidx, restart_wireclearidx, on_wire_estimate;
+static double            ring_level, ring_time;
+static double            ipd_disk;         /* the delay of the client's disk ceiling */
+static double            error_rate;
+static double            last_update;
+
+/* counters */
+static u_int64_t         total_blocks, this_blocks, this_retransmits;
+static u_int64_t         sent_blocks, this_sent, sent_retransmits;
+static u_int64_t         lost, queue_drops, restarts;
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static void    client_receive   (sim_message_t *datagram, FILE *out);
+static void    client_request   (u_int32_t block);
+static void    client_repeat    (double now);
+static void    server_slot      (double now);
+static void    network_send     (double now, u_int32_t block, u_int16_t type);
+static void    fifo_push        (sim_fifo_t *fifo, double time, u_int32_t block, u_int16_t type);
+static int     have_block       (u_int32_t block);
+static double  parse_number     (const char *text, double unit);
+static double  uniform          (void);
+
+
+/*------------------------------------------------------------------------
+ * MAIN PROGRAM
+ *------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    struct option long_options[] = { { "size",      1, NULL, 'S' },
+                                     { "blocksize", 1, NULL, 'b' },
+                                     { "rate",      1, NULL, 'r' },
+                                     { "capacity",  1, NULL, 'c' },
+                                     { "buffer",    1, NULL, 'q' },
+                                     { "rtt",       1, NULL, 't' },
+                                     { "loss",      1, NULL, 'l' },
+                                     { "disk",      1, NULL, 'd' },
+                                     { "error",     1, NULL, 'e' },
+                                     { "slowdown",  1, NULL, 's' },
+                                     { "speedup",   1, NULL, 'f' },
+                                     { "history",   1, NULL, 'h' },
+                                     { "seed",      1, NULL, 'x' },
+                                     { "start",     1, NULL, 'i' },
+                                     { NULL,        0, NULL, 0 } };
+    struct timeval  start;
+    sim_message_t   datagram;
+    double          send_time = 0.0;
+    double          start_rate = 0.0;
+    int             which;
+
+    /* the client defaults, and a 1 Gbps path with 50 ms RTT */
+    reset_client(&param);
+    memset(&path, 0, sizeof(path));
+    path.size     = 1024LL * 1024 * 1024 * 1024;
+    path.capacity = 1e9;
+    path.buffer   = 1000000;
+    path.rtt      = 50000;
+    path.seed     = 1;
+
+    while ((which = getopt_long(argc, argv, "+", long_options, NULL)) > 0) {
+        switch (which) {
+            case 'S': path.size           = (u_int64_t) parse_number(optarg, 1024); break;
+            case 'b': param.block_size    = atoi(optarg);                           break;
+            case 'r': param.target_rate   = (u_int32_t) parse_number(optarg, 1000); break;
+            case 'c': path.capacity       = parse_number(optarg, 1000);             break;
+            case 'q': path.buffer         = parse_number(optarg, 1000);             break;
+            case 't': path.rtt            = 1000.0 * atof(optarg);                  break;
+            case 'l': path.loss           = atof(optarg);                           break;
+            case 'd': path.disk           = parse_number(optarg, 1000);             break;
+            case 'e': param.error_rate    = atof(optarg) * 1000.0;                  break;
+            case 's': sscanf(optarg, "%hu/%hu", &param.slower_num, &param.slower_den); break;
+            case 'f': sscanf(optarg, "%hu/%hu", &param.faster_num, &param.faster_den); break;
+            case 'h': param.history       = atoi(optarg);                           break;
+            case 'x': path.seed           = atoi(optarg);                           break;
+            case 'i': start_rate          = parse_number(optarg, 1000);             break;
+            default:
+                fprintf(stderr, "Usage: tsunami-ratesim [--size=bytes] [--blocksize=bytes] [--rate=bps]\n");
+                fprintf(stderr, "                       [--capacity=bps] [--buffer=bytes] [--rtt=msec] [--loss=p]\n");
+                fprintf(stderr, "                       [--disk=bps] [--error=percent] [--slowdown=n/d]\n");
+                fprintf(stderr, "                       [--speedup=n/d] [--history=percent] [--seed=n]\n");
+                fprintf(stderr, "                       [--start=bps]\n\n");
+                fprintf(stderr, "Sizes take K, M, G or T suffixes (powers of 1024), rates k, M or G\n");
+                fprintf(stderr, "(powers of 1000).  A capacity or disk rate of 0 is unlimited.\n");
+                fprintf(stderr, "Defaults: size 1T, capacity 1G, buffer 1M, rtt 50, loss 0, disk 0,\n");
+                fprintf(stderr, "          and the client defaults for everything else.  A start rate\n");
+                fprintf(stderr, "          is the REQUEST_START_RATE of a cached path profile.\n");
+                return 1;
+        }
+    }
+
+    if ((param.block_size == 0) || (param.block_size > MAX_BLOCK_SIZE) || (param.target_rate == 0) ||
+        (param.slower_den == 0) || (param.faster_den == 0))
+        return error("Invalid settings");
+
+    /* set up the transfer as ttp_open_transfer() does on both sides */
+    block_count = (u_int32_t) ((path.size / param.block_size) + ((path.size % param.block_size) != 0));
+    received    = (u_char *) calloc(block_count / 8 + 2, sizeof(u_char));
+    queued      = (u_char *) calloc(block_count / 8 + 2, sizeof(u_char));
+    table       = (u_int32_t *) calloc(32 * MAX_RETRANSMISSION_BUFFER, sizeof(u_int32_t));
+    requested   = (double *) calloc(32 * MAX_RETRANSMISSION_BUFFER, sizeof(double));
+    if ((block_count == 0) || (received == NULL) || (queued == NULL) || (table == NULL) || (requested == NULL))
+        return error("Could not allocate the simulated transfer");
+    ipd_time         = (u_int32_t) ((1000000LL * 8 * param.block_size) / param.target_rate);
+    ipd_current      = ipd_time * 3;
+    if (start_rate > 0)
+        ipd_current  = min(max((1e6 * 8 * param.block_size) / start_rate, ipd_time), 10000.0);
+    on_wire_estimate = min(block_count, (u_int32_t) (0.5 * param.target_rate / (8 * param.block_size)));
+    next_block       = 1;
+    blocks_left      = block_count;
+    random_state     = (path.seed != 0) ? path.seed : 1;
+    ratecontrol_rtt_init(&rtt, path.rtt);
+
+    printf("time_s,ipd_us,send_mbps,recv_mbps,error_pct,retransmits,queue_bytes,lost,queue_drops,restarts\n");
+    gettimeofday(&start, NULL);
+
+    /* run the server packet slots and the client arrivals in time order */
+    while (blocks_left > 0) {
+
+        /* deliver the datagrams that arrive before the next slot */
+        while ((datagrams.count > 0) && (datagrams.items[datagrams.head].time <= send_time) && (blocks_left > 0)) {
+            datagram = datagrams.items[datagrams.head];
+            datagrams.head = (datagrams.head + 1) % datagrams.size;
+            --datagrams.count;
+            client_receive(&datagram, stdout);
+        }
+        if (blocks_left == 0)
+            break;
+
+        /* the server sends the next packet and sleeps */
+        server_slot(send_time);
+        send_time += ipd_current;
+        if (server_block == block_count)
+            send_time += 10 * ipd_current;
+    }
+
+    /* the summary */
+    fprintf(stderr, "blocks=%u simulated_s=%.1f goodput_mbps=%.1f sent=%llu retransmitted_pct=%.2f "
+            "lost=%llu queue_drops=%llu restarts=%llu srtt_ms=%.1f rto_ms=%.1f run_s=%.2f\n",
+            block_count, last_update / 1e6,
+            8.0 * path.size / last_update,
+            (ull_t) sent_blocks, 100.0 * sent_retransmits / sent_blocks,
+            (ull_t) lost, (ull_t) queue_drops, (ull_t) restarts,
+            rtt.srtt / 1e3, rtt.rto / 1e3, get_usec_since(&start) / 1e6);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void client_receive(sim_message_t *datagram, FILE *out);
+ *
+ * Handles the arrival of a datagram at the client, like the receive
+ * loop of command_get() in lossless mode.  At the end of each update
+ * period the retransmission requests are repeated and the error rate
+ * is reported, and a line of the time series is written.
+ *------------------------------------------------------------------------*/
+static void client_receive(sim_message_t *datagram, FILE *out)
+{
+    double     now   = datagram->time;
+    u_int32_t  block = datagram->block;
+    u_int16_t  type  = datagram->type;
+    u_int32_t  i;
+    int        ring_full;
+
+    ++total_blocks;
+
+    /* time the turnaround of a request that was sent only once */
+    if ((type == TS_BLOCK_RETRANSMISSION) && (block == probe_block)) {
+        ratecontrol_rtt_sample(&rtt, now - probe_time);
+        probe_block = 0;
+    }
+
+    /* drain the ring buffer at the disk rate */
+    if (path.disk > 0) {
+        ring_level = max(0.0, ring_level - (now - ring_time) * path.disk / (8e6 * param.block_size));
+        ring_time  = now;
+    }
+    ring_full = ((int) ring_level >= MAX_BLOCKS_QUEUED);
+
+    if (!ring_full && (!have_block(block) || (type == TS_BLOCK_TERMINATE) || restart_pending)) {
+
+        /* accept a new block */
+        if (!have_block(block)) {
+            received[block / 8] |= (1 << (block % 8));
+            --blocks_left;
+            if (path.disk > 0)
+                ring_level += 1.0;
+            if (blocks_left == 0) {
+                last_update = now;
+                return;
+            }
+        }
+
+        /* ignore the blocks still on the wire after a restart */
+        if (restart_pending && (type != TS_BLOCK_TERMINATE) &&
+            (block > restart_lastidx) && (block <= restart_wireclearidx))
+            goto send_stats;
+
+        /* request the blocks in the gap */
+        for (i = next_block; i < block; ++i)
+            client_request(i);
+
+        while (have_block(gapless_to_block + 1) && (gapless_to_block < block_count))
+            ++gapless_to_block;
+        if (type == TS_BLOCK_ORIGINAL)
+            next_block = block + 1;
+        if (restart_pending && (next_block >= restart_lastidx))
+            restart_pending = 0;
+
+        /* at the end, request everything still missing */
+        if (type == TS_BLOCK_TERMINATE) {
+            for (i = gapless_to_block + 1; i < block_count; ++i)
+                client_request(i);
+            client_repeat(now);
+        }
+    }
+
+ send_stats:
+
+    /* the requests whose timeout expired between the updates */
+    if (!(total_blocks % 50) && (now - last_update <= UPDATE_PERIOD) && (now - last_repeat > rtt.rto / 4))
+        client_repeat(now);
+
+    /* the periodic update of ttp_update_stats() */
+    if (!(total_blocks % 50) && (now - last_update > UPDATE_PERIOD)) {
+        double interval = now - last_update;
+        double blocks   = total_blocks - this_blocks;
+        double queue    = (path.capacity > 0) ? max(0.0, link_free - now) * path.capacity / 8e6 : 0.0;
+        double ringfill = ring_level / MAX_BLOCKS_QUEUED;
+
+        client_repeat(now);
+        error_rate = ratecontrol_error(error_rate, param.history,
+                                       this_retransmits / (1.0 + this_retransmits + blocks), ringfill);
+        fifo_push(&requests, now + path.rtt / 2, (u_int32_t) error_rate, REQUEST_ERROR_RATE);
+
+        /* the disk ceiling, from the disk rate that the client would measure */
+        if (path.disk > 0)
+            fifo_push(&requests, now + path.rtt / 2, ratecontrol_disk_ceiling(path.disk, ringfill), REQUEST_DISK_RATE);
+
+        fprintf(out, "%.3f,%.2f,%.1f,%.1f,%.3f,%llu,%.0f,%llu,%llu,%llu\n",
+                now / 1e6, ipd_current,
+                8.0 * this_sent * param.block_size / interval,
+                8.0 * blocks * param.block_size / interval,
+                error_rate / 1000.0, (ull_t) this_retransmits, queue,
+                (ull_t) lost, (ull_t) queue_drops, (ull_t) restarts);
+
+        this_blocks = total_blocks;
+        this_sent   = 0;
+        last_update = now;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * static void client_request(u_int32_t block);
+ *
+ * Adds a block to the retransmission table, as ttp_request_retransmit().
+ *------------------------------------------------------------------------*/
+static void client_request(u_int32_t block)
+{
+    if (have_block(block) || (queued[block / 8] & (1 << (block % 8))) || (index_max >= 32 * MAX_RETRANSMISSION_BUFFER))
+        return;
+    queued[block / 8] |= (1 << (block % 8));
+    requested[index_max] = 0;
+    table[index_max++]   = block;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void client_repeat(double now);
+ *
+ * Sends the new and the timed out retransmission requests to the
+ * server, or a restart request if there are too many, as
+ * ttp_repeat_retransmit().
+ *------------------------------------------------------------------------*/
+static void client_repeat(double now)
+{
+    u_int32_t entry, count = 0, block;
+
+    last_repeat = now;
+    for (entry = 0; (entry < index_max) && (count < MAX_RETRANSMISSION_BUFFER); ++entry)
+        if (table[entry] && !have_block(table[entry])) {
+            requested[count] = requested[entry];
+            table[count++]   = table[entry];
+        }
+
+    if (count >= MAX_RETRANSMISSION_BUFFER) {
+        block = min(block_count, gapless_to_block + 1);
+        fifo_push(&requests, now + path.rtt / 2, block, REQUEST_RESTART);
+        restart_pending      = 1;
+        restart_lastidx      = table[index_max - 1];
+        restart_wireclearidx = min(block_count, restart_lastidx + on_wire_estimate);
+        for (entry = 0; entry < index_max; ++entry)
+            queued[table[entry] / 8] &= ~(1 << (table[entry] % 8));
+        probe_block          = 0;
+        index_max            = 0;
+        next_block           = block;
+        this_retransmits     = MAX_RETRANSMISSION_BUFFER;
+        ++restarts;
+    } else {
+        index_max        = count;
+        this_retransmits = count;
+        for (entry = 0; entry < count; ++entry) {
+            if ((requested[entry] > 0) && (now - requested[entry] < rtt.rto))
+                continue;
+            if (table[entry] == probe_block) {
+                probe_block = 0;
+                ratecontrol_rtt_backoff(&rtt);
+            } else if ((probe_block == 0) && (requested[entry] == 0)) {
+                probe_block = table[entry];
+                probe_time  = now;
+            }
+            requested[entry] = now;
+            fifo_push(&requests, now + path.rtt / 2, table[entry], REQUEST_RETRANSMIT);
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * static void server_slot(double now);
+ *
+ * One pass of the server loop in client_handler(): handle one request
+ * that has arrived, or else send the next original block.  As in the
+ * server, the disk ceiling of the client bounds the rate.
+ *------------------------------------------------------------------------*/
+static void server_slot(double now)
+{
+    sim_message_t request;
+
+    if ((requests.count > 0) && (requests.items[requests.head].time <= now)) {
+        request = requests.items[requests.head];
+        requests.head = (requests.head + 1) % requests.size;
+        --requests.count;
+
+        if (request.type == REQUEST_ERROR_RATE) {
+            ipd_current = ratecontrol_ipd(ipd_current, request.block, param.error_rate,
+                                          param.slower_num, param.slower_den,
+                                          param.faster_num, param.faster_den, ipd_time);
+            ipd_current = max(ipd_current, ipd_disk);
+        } else if (request.type == REQUEST_DISK_RATE) {
+            ipd_disk    = (8000.0 * param.block_size) / request.block;
+            ipd_current = max(ipd_current, ipd_disk);
+        } else if (request.type == REQUEST_RESTART) {
+            server_block = request.block;
+        } else {
+            network_send(now, request.block, TS_BLOCK_RETRANSMISSION);
+            ++sent_retransmits;
+        }
+        return;
+    }
+
+    server_block = min(server_block + 1, block_count);
+    network_send(now, server_block, (server_block == block_count) ? TS_BLOCK_TERMINATE : TS_BLOCK_ORIGINAL);
+}
+
+
+/*------------------------------------------------------------------------
+ * static void network_send(double now, u_int32_t block, u_int16_t type);
+ *
+ * Passes a datagram through random loss and the drop-tail bottleneck
+ * queue, and sends it on to the client.
+ *------------------------------------------------------------------------*/
+static void network_send(double now, u_int32_t block, u_int16_t type)
+{
+    double arrival = now;
+
+    ++sent_blocks;
+    ++this_sent;
+
+    if ((path.loss > 0) && (uniform() < path.loss)) {
+        ++lost;
+        return;
+    }
+
+    if (path.capacity > 0) {
+        if (link_free < now)
+            link_free = now;
+        if ((link_free - now) * path.capacity / 8e6 > path.buffer) {
+            ++queue_drops;
+            return;
+        }
+        link_free += 8e6 * (param.block_size + SIM_HEADER_BYTES) / path.capacity;
+        arrival = link_free;
+    }
+
+    fifo_push(&datagrams, arrival + path.rtt / 2, block, type);
+}
+
+
+/*------------------------------------------------------------------------
+ * static void fifo_push(sim_fifo_t *fifo, double time,
+ *                       u_int32_t block, u_int16_t type);
+ *
+ * Appends a message to the queue, growing it as needed.
+ *------------------------------------------------------------------------*/
+static void fifo_push(sim_fifo_t *fifo, double time, u_int32_t block, u_int16_t type)
+{
+    sim_message_t *grown;
+    u_int32_t      i;
+
+    if (fifo->count == fifo->size) {
+        grown = (sim_message_t *) malloc(2 * max(fifo->size, 1024) * sizeof(sim_message_t));
+        if (grown == NULL)
+            error("Could not grow the simulator queue");
+        for (i = 0; i < fifo->count; ++i)
+            grown[i] = fifo->items[(fifo->head + i) % fifo->size];
+        free(fifo->items);
+        fifo->items = grown;
+        fifo->head  = 0;
+        fifo->size  = 2 * max(fifo->size, 1024);
+    }
+
+    i = (fifo->head + fifo->count++) % fifo->size;
+    fifo->items[i].time  = time;
+    fifo->items[i].block = block;
+    fifo->items[i].type  = type;
+}
+
+
+/*------------------------------------------------------------------------
+ * static int have_block(u_int32_t block);
+ *
+ * Returns nonzero if the client has received the given block.
+ *------------------------------------------------------------------------*/
+static int have_block(u_int32_t block)
+{
+    return (block > block_count) || (received[block / 8] & (1 << (block % 8)));
+}
+
+
+/*------------------------------------------------------------------------
+ * static double parse_number(const char *text, double unit);
+ *
+ * Parses a number with an optional k, M, G or T suffix, which scale it
+ * by powers of the given unit (1000 or 1024).
+ *------------------------------------------------------------------------*/
+static double parse_number(const char *text, double unit)
+{
+    static const char  suffixes[] = "KkMmGgTt";
+    const char        *suffix;
+    char              *end;
+    double             number = strtod(text, &end);
+    int                scale;
+
+    /* each suffix is one more power of the unit than the one before it */
+    if ((*end != '\0') && ((suffix = strchr(suffixes, *end)) != NULL))
+        for (scale = (suffix - suffixes) / 2; scale >= 0; --scale)
+            number *= unit;
+    return number;
+}
+
+
+/*------------------------------------------------------------------------
+ * static double uniform(void);
+ *
+ * Returns a pseudo-random number in [0, 1) from a xorshift generator,
+ * so that a given seed always reproduces the same run.
+ *------------------------------------------------------------------------*/
+static double uniform(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state / 4294967296.0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
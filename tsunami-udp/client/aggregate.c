@@ -0,0 +1,301 @@
+/*========================================================================
+ * aggregate.c  --  Small-file aggregation routines for Tsunami client.
+ *
+ * This contains the routines that split an aggregated block stream
+ * back into the member files listed in the manifest sent by the server.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <errno.h>     /* for the errno variable       */
+#include <limits.h>    /* for PATH_MAX                 */
+#include <stdlib.h>    /* for malloc(), free(), etc.   */
+#include <string.h>    /* for string-handling routines */
+#include <sys/stat.h>  /* for mkdir() and chmod()      */
+#include <unistd.h>    /* for truncate()               */
+
+#include <tsunami-client.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static int make_parents(char *path);
+
+
+/*------------------------------------------------------------------------
+ * int aggregate_open(ttp_session_t *session, char *manifest,
+ *                    const char *directory);
+ *
+ * Parses the manifest of an aggregated transfer, which holds one line
+ * of "offset size mode name" per member file, and creates every member
+ * file with its final size below the given local directory.  Absolute
+ * member names are made relative and names that climb out of the
+ * directory with ".." are refused, as are members that overlap, are
+ * out of order or run past the end of the stream.  Only the permission
+ * bits are taken from the mode, less those of our umask.  Returns 0 on
+ * success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int aggregate_open(ttp_session_t *session, char *manifest, const char *directory)
+{
+    aggregate_t       *aggregate;
+    aggregate_entry_t *entry;
+    u_int32_t          allocated = 0;
+    ull_t              offset, size;
+    u_int64_t          end       = 0;
+    u_int64_t          total     = session->transfer.file_size;
+    unsigned int       mode;
+    mode_t             mask;
+    char              *line, *next, *name, *part;
+    FILE              *file;
+    int                skip;
+
+    /* allocate the aggregate */
+    aggregate = (aggregate_t *) calloc(1, sizeof(aggregate_t));
+    if (aggregate == NULL)
+        return warn("Could not allocate aggregate");
+    aggregate->current = -1;
+    session->transfer.aggregate = aggregate;
+
+    /* the permission bits are limited like those of any file we create */
+    mask = umask(0);
+    umask(mask);
+
+    /* for each line of the manifest */
+    for (line = manifest; (line != NULL) && (*line != '\0'); line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *(next++) = '\0';
+
+        /* parse the member description */
+        if (sscanf(line, "%llu %llu %o %n", &offset, &size, &mode, &skip) < 3)
+            return warn("Malformed aggregate manifest");
+        name = line + skip;
+        while (*name == '/')
+            ++name;
+        if (strlen(name) >= PATH_MAX)
+            return warn("Refusing aggregate member with an overlong name");
+        for (part = name; part != NULL; part = strchr(part, '/')) {
+            if (*part == '/')
+                ++part;
+            if (!strncmp(part, "..", 2) && ((part[2] == '/') || (part[2] == '\0'))) {
+                snprintf(g_error, MAX_ERROR_MESSAGE, "Refusing unsafe aggregate member name '%s'", name);
+                return warn(g_error);
+            }
+        }
+
+        /* the members follow each other within the stream */
+        if ((offset < end) || (size > total) || (offset > total - size)) {
+            snprintf(g_error, MAX_ERROR_MESSAGE, "Refusing aggregate member '%s' at bytes %llu to %llu of %llu",
+                     name, offset, offset + size, (ull_t) total);
+            return warn(g_error);
+        }
+        end = offset + size;
+
+        /* grow the member table if needed */
+        if (aggregate->count == allocated) {
+            allocated = (allocated == 0) ? 64 : (2 * allocated);
+            entry = (aggregate_entry_t *) realloc(aggregate->entries, allocated * sizeof(aggregate_entry_t));
+            if (entry == NULL)
+                return warn("Could not grow aggregate member table");
+            aggregate->entries = entry;
+        }
+
+        /* store the member under its local path */
+        entry         = &aggregate->entries[aggregate->count];
+        entry->name   = (char *) malloc(strlen(directory) + strlen(name) + 2);
+        if (entry->name == NULL)
+            return warn("Memory allocation error");
+        sprintf(entry->name, "%s/%s", directory, name);
+        entry->offset = offset;
+        entry->size   = size;
+        entry->mode   = mode & 0777 & ~mask;
+        aggregate->count++;
+
+        /* create the member file with its final size */
+        make_parents(entry->name);
+        if (!access(entry->name, F_OK))
+            printf("Warning: overwriting existing file '%s'\n", entry->name);
+        file = fopen(entry->name, "wb");
+        if ((file == NULL) || (fclose(file) != 0) || (truncate(entry->name, size) < 0)) {
+            snprintf(g_error, MAX_ERROR_MESSAGE, "Could not create aggregate member '%s'", entry->name);
+            return warn(g_error);
+        }
+    }
+
+    if (session->parameter->verbose_yn)
+        printf("Receiving %u files as one aggregated stream\n", aggregate->count);
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int aggregate_write(ttp_session_t *session, u_int32_t block_index,
+ *                     u_char *block, u_int32_t write_size);
+ *
+ * Writes the given block of an aggregated stream into the member files
+ * that it covers.  The member file that was written last is kept open,
+ * so that the blocks of large members do not cost an open each.
+ * Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int aggregate_write(ttp_session_t *session, u_int32_t block_index, u_char *block, u_int32_t write_size)
+{
+    aggregate_t       *aggregate = session->transfer.aggregate;
+    aggregate_entry_t *entry;
+    u_int64_t          offset    = ((u_int64_t) session->parameter->block_size) * (block_index - 1);
+    u_int64_t          position;
+    u_int32_t          chunk;
+    int32_t            i;
+
+    for (i = aggregate_find(aggregate, offset); (i >= 0) && (i < (int32_t) aggregate->count) && (write_size > 0); ++i) {
+
+        /* find how much of the block falls into this member */
+        entry = &aggregate->entries[i];
+        if (offset >= entry->offset + entry->size)
+            continue;
+        position = offset - entry->offset;
+        chunk    = (u_int32_t) min((u_int64_t) write_size, entry->size - position);
+
+        /* switch to the member file if it is not open yet */
+        if (aggregate->current != i) {
+            if (aggregate->file != NULL)
+                fclose(aggregate->file);
+            aggregate->current = i;
+            aggregate->file    = fopen(entry->name, "r+b");
+            if (aggregate->file == NULL) {
+                aggregate->current = -1;
+                snprintf(g_error, MAX_ERROR_MESSAGE, "Could not open aggregate member '%s'", entry->name);
+                return warn(g_error);
+            }
+            aggregate->position = 0;
+        }
+
+        /* write the part of the block that belongs to this member */
+        if ((aggregate->position != position) && (fseeko(aggregate->file, position, SEEK_SET) < 0)) {
+            sprintf(g_error, "Could not seek at block %d of aggregate", block_index);
+            return warn(g_error);
+        }
+        if (fwrite(block, 1, chunk, aggregate->file) < chunk) {
+            sprintf(g_error, "Could not write block %d of aggregate", block_index);
+            return warn(g_error);
+        }
+        aggregate->position = position + chunk;
+
+        offset     += chunk;
+        block      += chunk;
+        write_size -= chunk;
+    }
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void aggregate_close(ttp_session_t *session);
+ *
+ * Closes the open member file, applies the permission bits of the
+ * member files and releases the aggregate of the current transfer.
+ *------------------------------------------------------------------------*/
+void aggregate_close(ttp_session_t *session)
+{
+    aggregate_t *aggregate = session->transfer.aggregate;
+    u_int32_t    i;
+
+    if (aggregate == NULL)
+        return;
+
+    if (aggregate->file != NULL)
+        fclose(aggregate->file);
+    for (i = 0; i < aggregate->count; ++i) {
+        chmod(aggregate->entries[i].name, aggregate->entries[i].mode);
+        free(aggregate->entries[i].name);
+    }
+    free(aggregate->entries);
+    free(aggregate);
+
+    session->transfer.aggregate = NULL;
+}
+
+
+/*------------------------------------------------------------------------
+ * static int make_parents(char *path);
+ *
+ * Creates the missing parent directories of the given path.  Returns 0
+ * on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+static int make_parents(char *path)
+{
+    char *slash;
+
+    for (slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if ((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+            *slash = '/';
+            return -1;
+        }
+        *slash = '/';
+    }
+    return 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
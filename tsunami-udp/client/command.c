@@ -61,6 +61,7 @@
  * INFORMATION GENERATED USING SOFTWARE.
  *========================================================================*/
 
+#include <arpa/inet.h>    /* for inet_ntoa()                       */
 #include <pthread.h>      /* for the pthreads library              */
 #include <stdlib.h>       /* for *alloc() and free()               */
 #include <string.h>       /* for standard string routines          */
@@ -186,6 +187,10 @@ ttp_session_t *command_connect(command_t *command, ttp_parameter_t *parameter)
 	return NULL;
     }
 
+    /* have the server tell us our place in line when it is busy, old servers just decline */
+    if ((ttp_request_queue_notices(session) < 0) && session->parameter->verbose_yn)
+	printf("Server does not report its transfer queue\n");
+
     /* we succeeded */
     if (session->parameter->verbose_yn)
 	printf("Connected.\n\n");
@@ -253,10 +258,16 @@ int command_get(command_t *command, ttp_session_t *session)
 {
     u_char         *datagram = NULL;            /* the buffer (in ring) for incoming blocks       */
     u_char         *local_datagram = NULL;      /* the local temp space for incoming block        */
+    bufpool_t       local_pool;                 /* the aligned memory of that temp space          */
+    u_int32_t       local_size = 0;             /* the largest datagram that fits in it           */
+    u_char         *received = NULL;            /* the datagram, there or in an AF_XDP frame      */
+    u_char         *payload = NULL;             /* the block data in that temp space              */
+    u_int64_t       sent_usec;                  /* the time the server stamped the block with     */
     u_int32_t       this_block = 0;             /* the block number for the block just received   */
     u_int16_t       this_type = 0;              /* the block type for the block just received     */
     u_int64_t       delta = 0;                  /* generic holder of elapsed times                */
     u_int32_t       block = 0;                  /* generic holder of a block number               */
+    u_int32_t       path = 0;                   /* the data path of the block just received       */
     u_int32_t       dumpcount = 0;
 
     double          mbit_thru, mbit_good;       /* helpers for final statistics                   */
@@ -272,9 +283,20 @@ int command_get(command_t *command, ttp_session_t *session)
      * session they are used to recieve the file names and other parameters
      */
     int             multimode = 0;
+    int             aggregatemode = 0;
     char          **file_names = NULL;
     u_int32_t       f_counter = 0, f_total = 0, f_arrsize = 0;
 
+    /* the cached operating point of the path to the server */
+    profile_t       profile;
+
+    /* the CPUs of the receive loop, and the description of the placement */
+    affinity_t      rx_affinity;
+    char            rx_where[320], disk_where[320];
+
+    /* the arrival time of a datagram taken from an AF_XDP frame */
+    struct timeval  now;
+
     /* this struct wil hold the RTT time */
     struct timeval ping_s, ping_e;
     long wait_u_sec = 1;
@@ -290,8 +312,15 @@ int command_get(command_t *command, ttp_session_t *session)
     /* reinitialize the transfer data */
     memset(xfer, 0, sizeof(*xfer));
 
+    /* if the client asks for all files as one aggregated stream */
+    if(!strcmp("*",command->text[1]) && session->parameter->aggregate) {
+
+       aggregatemode = 1;
+       f_total = 1;
+       printf("Requesting all available files as one aggregated stream\n");
+
     /* if the client asking for multiple files to be transfered */
-    if(!strcmp("*",command->text[1])) {
+    } else if(!strcmp("*",command->text[1])) {
        char  filearray_size[10];
        char  file_count[10];
 
@@ -358,13 +387,18 @@ int command_get(command_t *command, ttp_session_t *session)
     {
 
     /* store the remote filename */
-    if(!multimode)
+    if(aggregatemode)
+       xfer->remote_filename = TS_AGGREGATE_CMD;
+    else if(!multimode)
        xfer->remote_filename = command->text[1];
     else
        xfer->remote_filename = file_names[f_counter];
 
     /* store the local filename */
-    if(!multimode) {
+    if(aggregatemode) {
+       /* aggregated GET* writes below the given directory, otherwise into CWD */
+       xfer->local_filename = (command->count >= 3) ? command->text[2] : ".";
+    } else if(!multimode) {
        if (command->count >= 3) {
           /* command was in "GET remotefile localfile" style */
           xfer->local_filename = command->text[2];
@@ -383,39 +417,129 @@ int command_get(command_t *command, ttp_session_t *session)
     }
 
     /* negotiate the file request with the server */
-    if (ttp_open_transfer(session, xfer->remote_filename, xfer->local_filename) < 0)
+    if (ttp_open_transfer(session, xfer->remote_filename, xfer->local_filename) < 0) {
+	if (aggregatemode)
+	    warn("Server has no files to aggregate or does not support 'set aggregate yes'");
 	return warn("File transfer request failed");
+    }
 
     /* create the UDP data socket */
     if (ttp_open_port(session) < 0)
 	return warn("Creation of data socket failed");
 
-    /* allocate the retransmission table */
-    rexmit->table = (u_int32_t *) calloc(DEFAULT_TABLE_SIZE, sizeof(u_int32_t));
-    if (rexmit->table == NULL)
+    /* pin the receive loop and the disk thread before their buffers are touched, so those stay on their node */
+    if ((affinity_resolve(session->parameter->rx_cpus, fileno(session->server), &rx_affinity) < 0) ||
+        (affinity_pin(&rx_affinity) < 0)) {
+        warn("Could not place the receive loop, it runs on any CPU");
+        rx_affinity.cpus[0] = '\0';
+    }
+    if (affinity_resolve(session->parameter->disk_cpus, fileno(session->server), &xfer->disk_affinity) < 0)
+        warn("Could not place the disk thread, it runs on any CPU");
+    if (session->parameter->verbose_yn)
+        printf("Receive loop on %s, disk thread on %s\n",
+               affinity_describe(&rx_affinity, rx_where, sizeof(rx_where)),
+               affinity_describe(&xfer->disk_affinity, disk_where, sizeof(disk_where)));
+
+    /* busy-poll the data socket and time stamp the blocks, if asked to */
+    if (busypoll_setup(&xfer->rx, xfer->udp_fd, session->parameter->busypoll, session->parameter->rxlatency,
+                       session->parameter->timestamps) < 0)
+        warn("Receive mode only partly set up");
+
+    /* stripe the transfer over the extra data paths, if asked to */
+    if (session->parameter->paths != NULL) {
+        if (ttp_open_paths(session) < 0)
+            warn("Not all data paths could be set up");
+        for (path = 1; path < xfer->path_count; ++path)
+            if (busypoll_add(&xfer->rx, xfer->path_fd[path]) < 0)
+                warn("Receive mode only partly set up on a data path");
+        if ((xfer->path_count > 1) && session->parameter->verbose_yn)
+            printf("Receiving on %u data paths\n", xfer->path_count);
+    }
+
+    /* or bypass the socket layer, the UDP socket stays for the fallback */
+    if (session->parameter->xdp_mode != XDP_MODE_OFF) {
+        if (xfer->path_count > 1) {
+            warn("AF_XDP does not stripe over several data paths, receiving on the UDP sockets");
+        } else if (6 + TS_STAMP_SIZE + session->parameter->block_size > XDP_DATAGRAM_MAX) {
+            sprintf(g_error, "Blocks of %u bytes do not fit AF_XDP frames, receiving on the UDP socket", session->parameter->block_size);
+            warn(g_error);
+        } else if (xdp_open(&xfer->xdp, fileno(session->server), xfer->udp_fd, session->parameter->xdp_mode,
+                            session->parameter->xdp_queue, 1) < 0) {
+            warn("Could not set up AF_XDP, receiving on the UDP socket");
+        } else if (session->parameter->verbose_yn) {
+            printf("Receiving over AF_XDP on %s queue %u (%s mode)\n", xfer->xdp.device, xfer->xdp.queue,
+                   xdp_mode_name(session->parameter->xdp_mode));
+        }
+    }
+
+    /* restart the impairment of the data path, if any */
+    if (impair_start() < 0)
+	warn("Could not start the impairment layer");
+
+    /* the server tells us when it stalls on reading the file, which is not loss */
+    if (ttp_request_stall_notices(session) < 0)
+        warn("Could not request read stall notices");
+
+    /* and stamps the blocks with their send time, so that we can follow the queueing delay */
+    if (session->parameter->timestamps && (ttp_request_timestamps(session) < 0))
+        warn("Could not request block time stamps");
+
+    /* start near the rate that this path reached last time, if we know it */
+    if (session->parameter->faststart && (profile_load(session, &profile) == 0)) {
+        printf("Fast start: path ran at %0.1f Mbps over %u transfers, starting at %0.1f Mbps\n",
+               profile.rate / 1e6, profile.transfers, profile_start_rate(session->parameter, &profile) / 1e6);
+        if (ttp_request_start_rate(session, profile_start_rate(session->parameter, &profile)) < 0)
+            warn("Could not request the start rate of the path");
+    }
+
+    /* allocate the retransmission table and the request times of its entries */
+    rexmit->table     = (u_int32_t *) calloc(rexmit->table_size, sizeof(u_int32_t));
+    rexmit->requested = (u_int64_t *) calloc(rexmit->table_size, sizeof(u_int64_t));
+    if ((rexmit->table == NULL) || (rexmit->requested == NULL))
 	error("Could not allocate retransmission table");
 
-    /* allocate the received bitfield */
+    /* allocate the table of gaps that are held back as suspected reordering */
+    xfer->reorder.gaps = (suspect_t *) calloc(SUSPECT_TABLE_SIZE, sizeof(suspect_t));
+    if (xfer->reorder.gaps == NULL)
+	error("Could not allocate table of suspected gaps");
+
+    /* allocate the received bitfield, and the one of the blocks in the retransmission table */
     xfer->received = (u_char *) calloc(xfer->block_count / 8 + 2, sizeof(u_char));
-    if (xfer->received == NULL)
+    rexmit->queued = (u_char *) calloc(xfer->block_count / 8 + 2, sizeof(u_char));
+    if ((xfer->received == NULL) || (rexmit->queued == NULL))
 	error("Could not allocate received-data bitfield");
 
-    /* allocate the ring buffer */
-    xfer->ring_buffer = ring_create(session);
-
-    /* allocate the faster local buffer */
-    local_datagram = (u_char *) calloc(6 + session->parameter->block_size, sizeof(u_char));
-    if (local_datagram == NULL)
+    /* allocate the faster local buffer, with room for the send time if we asked for it */
+    local_size = (session->parameter->timestamps ? 6 + TS_STAMP_SIZE : 6) + session->parameter->block_size;
+    if (bufpool_create(&local_pool, 1, session->parameter->block_size, local_size - session->parameter->block_size) < 0)
         error("Could not allocate fast local datagram buffer in command_get()");
+    local_datagram = bufpool_slot(&local_pool, 0);
 
-    /* start up the disk I/O thread */
-    status = pthread_create(&disk_thread_id, NULL, disk_thread, session);
-    if (status != 0)
-	error("Could not create I/O thread");
+    /* the null sink drops the blocks without a ring buffer or disk thread */
+    if (xfer->sink != SINK_NULL) {
 
-    /* Finish initializing the retransmission object */
-    rexmit->table_size = DEFAULT_TABLE_SIZE;
-    rexmit->index_max  = 0;
+	/* allocate the ring buffer */
+	xfer->ring_buffer = ring_create(session);
+
+	/* start up the disk I/O thread */
+	status = pthread_create(&disk_thread_id, NULL, disk_thread, session);
+	if (status != 0)
+	    error("Could not create I/O thread");
+    }
+
+    /* Finish initializing the retransmission object, the timeout starts from the RTT of the file request */
+    rexmit->index_max   = 0;
+    rexmit->probe_block = 0;
+    rexmit->server_busy = 0;
+    ratecontrol_rtt_init(&rexmit->rtt, xfer->rtt_usec);
+    gettimeofday(&rexmit->last_repeat, NULL);
+
+    /* and the reordering window starts at the configured one */
+    xfer->reorder.size   = SUSPECT_TABLE_SIZE;
+    xfer->reorder.head   = 0;
+    xfer->reorder.count  = 0;
+    xfer->reorder.extent = 0;
+    xfer->reorder.window = session->parameter->reorder;
 
     /* we start by expecting block #1 */
     xfer->next_block = 1;
@@ -436,11 +560,28 @@ int command_get(command_t *command, ttp_session_t *session)
    /* until we break out of the transfer */
    while (1) {
 
-      /* try to receive a datagram */
-      status = recvfrom(xfer->udp_fd, local_datagram, 6 + session->parameter->block_size, 0, NULL, 0);
+      /* try to receive a datagram, AF_XDP frames are taken in place and have no kernel time stamp */
+      received = local_datagram;
+      if (xfer->xdp.active) {
+          status = xdp_recv(&xfer->xdp, xfer->udp_fd, local_datagram, local_size, &received);
+          if (xfer->rx.stamps) {
+              gettimeofday(&now, NULL);
+              xfer->rx.stamp = (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+          }
+      } else if (xfer->path_count > 1) {
+          status = busypoll_recv_any(&xfer->rx, xfer->path_fd, xfer->path_count, local_datagram, local_size, &path);
+          if (status >= 0)
+              ++xfer->path_blocks[path];
+      } else {
+          status = busypoll_recv(&xfer->rx, xfer->udp_fd, local_datagram, local_size);
+      }
       if (status < 0) {
           warn("UDP data transmission error");
           printf("Apparently frozen transfer, trying to do retransmit request\n");
+          if (reorder_release(session, 1) < 0) {      /* stop waiting for reordered blocks */
+             warn("Release of suspected gaps failed");
+             goto abort;
+          }
           if (ttp_repeat_retransmit(session) < 0) {  /* repeat our requests */
              warn("Repeat of retransmission requests failed");
              goto abort;
@@ -448,8 +589,45 @@ int command_get(command_t *command, ttp_session_t *session)
       }
 
       /* retrieve the block number and block type */
-      this_block = ntohl(*((u_int32_t *) local_datagram));       // in range of 1..xfer->block_count
-      this_type  = ntohs(*((u_int16_t *) (local_datagram + 4))); // TS_BLOCK_ORIGINAL etc
+      this_block = ntohl(*((u_int32_t *) received));       // in range of 1..xfer->block_count
+      this_type  = ntohs(*((u_int16_t *) (received + 4))); // TS_BLOCK_ORIGINAL etc
+      payload    = received + 6;
+
+      /* the probe of an extra data path, which we answer to have the server use the path */
+      if (this_type == TS_BLOCK_PATH_PROBE) {
+          if ((xfer->path_count > 1) && (path > 0)) {
+              --xfer->path_blocks[path];
+              if (ttp_confirm_path(session, path, this_block) < 0)
+                  warn("Could not answer the probe of a data path");
+          }
+          continue;
+      }
+
+      /* a block with the send time in it gives a sample of the one-way delay, unless
+         we did not ask for it and it did not fit into the local buffer */
+      if (this_type & TS_BLOCK_STAMPED) {
+          if (!session->parameter->timestamps)
+              continue;
+          this_type &= ~TS_BLOCK_STAMPED;
+          payload   += TS_STAMP_SIZE;
+          memcpy(&sent_usec, received + 6, sizeof(sent_usec));
+          if (xfer->rx.stamps)
+              ratecontrol_owd_sample(&xfer->stats.owd, xfer->rx.stamp - (int64_t) ntohll(sent_usec));
+      }
+
+      /* a notice that the server stalled reading the file, the silence was not loss */
+      if (this_type == TS_BLOCK_STALL) {
+          xfer->stats.this_stalls++;
+          xfer->stats.total_stalls++;
+          xfer->stats.total_stall_usec += this_block;
+          rexmit->probe_block = 0;   /* its turnaround includes the stall */
+          continue;
+      }
+
+      /* the impairment layer may drop the block as if it was lost, or record its arrival */
+      if (impair_drop(this_block, this_type))
+          continue;
+      impair_record(this_block, this_type);
 
       /* keep statistics on received blocks */
       xfer->stats.total_blocks++;
@@ -458,10 +636,22 @@ int command_get(command_t *command, ttp_session_t *session)
       } else {
           xfer->stats.this_flow_retransmitteds++;
           xfer->stats.total_recvd_retransmits++;
+
+          /* time the turnaround of a request that was sent only once */
+          if (this_block == rexmit->probe_block) {
+              ratecontrol_rtt_sample(&rexmit->rtt, get_usec_since(&rexmit->probe_time));
+              rexmit->probe_block = 0;
+          }
+      }
+
+      /* a block we already have was retransmitted in vain, or duplicated on the way */
+      if (got_block(session, this_block) && (this_type != TS_BLOCK_TERMINATE) && !xfer->restart_pending) {
+          xfer->stats.this_spurious++;
+          xfer->stats.total_spurious++;
       }
 
       /* main transfer control logic */
-      if (!ring_full(xfer->ring_buffer)) /* don't let disk-I/O freeze stop feedback of stats to server */
+      if ((xfer->ring_buffer == NULL) || !ring_full(xfer->ring_buffer)) /* don't let disk-I/O freeze stop feedback of stats to server */
       if (!got_block(session, this_block) || this_type == TS_BLOCK_TERMINATE || xfer->restart_pending)
       {
 
@@ -469,11 +659,15 @@ int command_get(command_t *command, ttp_session_t *session)
           if (!got_block(session, this_block)) {
 
               /* reserve ring space, copy the data in, confirm the reservation */
-              datagram = ring_reserve(xfer->ring_buffer);
-              memcpy(datagram, local_datagram, 6 + session->parameter->block_size);
-              if (ring_confirm(xfer->ring_buffer) < 0) {
-                  warn("Error in accepting block");
-                  goto abort;
+              if (xfer->ring_buffer != NULL) {
+                  datagram = ring_reserve(xfer->ring_buffer);
+                  *((u_int32_t *) datagram)       = htonl(this_block);
+                  *((u_int16_t *) (datagram + 4)) = htons(this_type);
+                  memcpy(datagram + 6, payload, session->parameter->block_size);
+                  if (ring_confirm(xfer->ring_buffer) < 0) {
+                      warn("Error in accepting block");
+                      goto abort;
+                  }
               }
 
               /* mark the block as received */
@@ -521,17 +715,20 @@ int command_get(command_t *command, ttp_session_t *session)
                     xfer->gapless_to_block = earliest_block;
                 }
 
-             /* lossless transfer mode, request all missing data to be resent */
+             /* lossless transfer mode, request all missing data to be resent once it is not just reordered */
              } else {
-                for (block = xfer->next_block; block < this_block; ++block) {
-                    if (ttp_request_retransmit(session, block) < 0) {
-                        warn("Retransmission request failed");
-                        goto abort;
-                    }
+                if (reorder_suspect(session, xfer->next_block, this_block - 1) < 0) {
+                    warn("Could not hold back a suspected gap");
+                    goto abort;
                 }
              }
           }//if(missing blocks)
 
+          /* an original older than the newest one was reordered on the way */
+          if ((this_type == TS_BLOCK_ORIGINAL) && (this_block < xfer->next_block) && !xfer->restart_pending) {
+              reorder_arrival(session, this_block);
+          }
+
           /* advance the index of the gapless section going from start block to highest block  */
           while (got_block(session, xfer->gapless_to_block + 1) && (xfer->gapless_to_block < xfer->block_count)) {
               xfer->gapless_to_block++;
@@ -539,10 +736,15 @@ int command_get(command_t *command, ttp_session_t *session)
 
           /* if this is an orignal, we expect to receive the successor to this block next */
           /* transmit restart note: these resent blocks are labeled original as well      */
-          if (this_type == TS_BLOCK_ORIGINAL) {
+          if ((this_type == TS_BLOCK_ORIGINAL) && ((this_block >= xfer->next_block) || xfer->restart_pending)) {
               xfer->next_block = this_block + 1;
           }
 
+          /* we are done as soon as we have every block, without waiting for a terminate block */
+          if (xfer->blocks_left == 0) {
+              break;
+          }
+
           /* transmit restart: already got out of the missing blocks range? */
           if (xfer->restart_pending && (xfer->next_block >= xfer->restart_lastidx)) {
               xfer->restart_pending = 0;
@@ -556,21 +758,21 @@ int command_get(command_t *command, ttp_session_t *session)
                       this_block, xfer->block_count, xfer->blocks_left, xfer->gapless_to_block, xfer->next_block);
               #endif
 
-              /* got all blocks by now */
-              if (xfer->blocks_left == 0) {
-                  break;
-              } else if (!session->parameter->lossless) {
+              /* stop in the data rate priority modes if nothing is pending */
+              if (!session->parameter->lossless) {
                   if ((rexmit->index_max==0) && !(xfer->restart_pending)) {
                       break;
                   }
               }
 
-              /* add possible still missing blocks to retransmit list */
-              for (block = xfer->gapless_to_block+1; block < xfer->block_count; ++block) {
-                  if (ttp_request_retransmit(session, block) < 0) {
-                      warn("Retransmission request failed");
-                      goto abort;
-                  }
+              /* ask for the still missing tail in one go, without waiting for reordering */
+              if (ttp_request_range(session, xfer->gapless_to_block + 1, xfer->block_count - 1) < 0) {
+                  warn("Retransmission request failed");
+                  goto abort;
+              }
+              if (reorder_release(session, 1) < 0) {
+                  warn("Release of suspected gaps failed");
+                  goto abort;
               }
 
               /* send the retransmit request list again */
@@ -581,8 +783,23 @@ int command_get(command_t *command, ttp_session_t *session)
 
     send_stats:
 
-      /* repeat our server feedback and requests if it's time */
-      if (!(xfer->stats.total_blocks % 50)) {
+      /* request the suspected gaps that were not filled by reordering */
+      if ((xfer->reorder.count > 0) && (reorder_release(session, 0) < 0)) {
+          warn("Release of suspected gaps failed");
+          goto abort;
+      }
+
+      /* repeat our server feedback and requests if it's time, the terminate blocks are sparse */
+      if (!(xfer->stats.total_blocks % 50) || (this_type == TS_BLOCK_TERMINATE)) {
+
+          /* between the updates, request the blocks whose timeout expired at a quarter of the timeout */
+          if ((get_usec_since(&rexmit->last_repeat) > rexmit->rtt.rto / 4) &&
+              (get_usec_since(&(xfer->stats.this_time)) <= UPDATE_PERIOD)) {
+            if (ttp_repeat_retransmit(session) < 0) {
+                warn("Repeat of retransmission requests failed");
+                goto abort;
+            }
+          }
 
           /* if it's been at least 350ms */
           if (get_usec_since(&(xfer->stats.this_time)) > UPDATE_PERIOD) {
@@ -593,8 +810,15 @@ int command_get(command_t *command, ttp_session_t *session)
                 goto abort;
             }
 
-            /* send and show our current statistics */
+            /* send and show our current statistics, and let the reordering window shrink */
             ttp_update_stats(session);
+            reorder_decay(session);
+
+            /* tell the server which blocks we have */
+            if (ttp_acknowledge(session) < 0) {
+                warn("Acknowledgement of received blocks failed");
+                goto abort;
+            }
 
             /* progress blockmap (DEBUG) */
             if (session->parameter->blockdump) {
@@ -615,20 +839,25 @@ int command_get(command_t *command, ttp_session_t *session)
 
     /* tell the server to quit transmitting */
     close(xfer->udp_fd);
+    for (path = 1; path < xfer->path_count; ++path)
+        close(xfer->path_fd[path]);
     if (ttp_request_stop(session) < 0) {
 	warn("Could not request end of transfer");
 	goto abort;
     }
 
-    /* add a stop block to the ring buffer */
-    datagram = ring_reserve(xfer->ring_buffer);
-    *((u_int32_t *) datagram) = 0;
-    if (ring_confirm(xfer->ring_buffer) < 0)
-	warn("Error in terminating disk thread");
+    if (xfer->ring_buffer != NULL) {
 
-    /* wait for the disk thread to die */
-    if (pthread_join(disk_thread_id, NULL) < 0)
-	warn("Disk thread terminated with error");
+	/* add a stop block to the ring buffer */
+	datagram = ring_reserve(xfer->ring_buffer);
+	*((u_int32_t *) datagram) = 0;
+	if (ring_confirm(xfer->ring_buffer) < 0)
+	    warn("Error in terminating disk thread");
+
+	/* wait for the disk thread to die */
+	if (pthread_join(disk_thread_id, NULL) < 0)
+	    warn("Disk thread terminated with error");
+    }
 
     /*------------------------------------
      * MORE TRUE POINT TO STOP TIMING ;-)
@@ -663,6 +892,9 @@ int command_get(command_t *command, ttp_session_t *session)
     printf("Throughput            : %0.2f Mbps\n", mbit_thru / time_secs);
     printf("Goodput w/ restarts   : %0.2f Mbps\n", mbit_good / time_secs);
     printf("Final file rate       : %0.2f Mbps\n", mbit_file / time_secs);
+    printf("Request turnaround    : %0.2f ms smoothed, %0.2f ms timeout\n", rexmit->rtt.srtt / 1e3, rexmit->rtt.rto / 1e3);
+    printf("Reordering            : %u blocks late, window %u blocks, %u spurious retransmissions\n",
+           xfer->stats.total_reordered, xfer->reorder.window, xfer->stats.total_spurious);
     printf("Transfer mode         : ");
     if (session->parameter->lossless) {
         if (xfer->stats.total_lost == 0) {
@@ -679,6 +911,44 @@ int command_get(command_t *command, ttp_session_t *session)
         printf("Data blocks lost      : %llu (%.2f%% of data) per user-specified time window constraint\n",
                   (ull_t)xfer->stats.total_lost, ( 100.0 * xfer->stats.total_lost ) / xfer->block_count );
     }
+    if (xfer->sink == SINK_NULL) {
+        printf("Data sink             : null, no disk I/O\n");
+    } else if (xfer->sink == SINK_VERIFY) {
+        printf("Data sink             : verify, %u of %u blocks failed to verify\n", xfer->verify_errors, xfer->block_count - xfer->stats.total_lost);
+    }
+    if (xfer->stats.total_stalls > 0) {
+        printf("Server read stalls    : %u, %0.2f seconds in total\n", xfer->stats.total_stalls, xfer->stats.total_stall_usec / 1e6);
+    }
+    if (xfer->stats.disk_ceiling > 0) {
+        printf("Disk write rate       : %0.2f Mbps sustained, ceiling %0.2f Mbps\n", xfer->stats.disk_rate / (1024.0*1024.0), xfer->stats.disk_ceiling * 1000.0 / (1024.0*1024.0));
+    }
+    if (xfer->stats.queueing_intervals > 0) {
+        printf("Queueing delay        : mean %0.2f ms, max %0.2f ms, blocks stamped by the %s\n",
+               xfer->stats.queueing_sum / xfer->stats.queueing_intervals / 1e3, xfer->stats.queueing_max / 1e3,
+               xfer->xdp.active ? "receive loop" : (xfer->rx.hardware > 0) ? "NIC" : "kernel");
+    }
+    if (xfer->xdp.active) {
+        printf("Data path             : AF_XDP on %s queue %u (%s mode), %llu blocks, %llu through the UDP socket\n",
+               xfer->xdp.device, xfer->xdp.queue, xdp_mode_name(session->parameter->xdp_mode),
+               (ull_t) xfer->xdp.frames, (ull_t) xfer->xdp.fallback);
+    }
+    if (xfer->path_count > 1) {
+        printf("Data paths            : primary %llu blocks", (ull_t) xfer->path_blocks[0]);
+        for (path = 1; path < xfer->path_count; ++path)
+            printf(", %s %llu blocks", inet_ntoa(xfer->path_address[path]), (ull_t) xfer->path_blocks[path]);
+        printf("\n");
+    }
+    busypoll_report(&xfer->rx);
+
+    /* remember the operating point of this path for the next session, short transfers are mostly ramp */
+    if (session->parameter->faststart && (time_secs >= PROFILE_MIN_SECONDS)) {
+        profile.rate     = (u_int32_t) min(8.0 * xfer->file_size / time_secs, 4294967295.0);
+        profile.rtt_usec = xfer->rtt_usec;
+        profile.loss     = (u_int32_t) ((100000.0 * xfer->stats.total_recvd_retransmits) / (1.0 + xfer->stats.total_blocks));
+        if (profile_save(session, &profile) == 0)
+            printf("Path profile          : %0.1f Mbps, RTT %0.2f ms, %0.2f%% retransmitted, %u transfers\n",
+                   profile.rate / 1e6, profile.rtt_usec / 1e3, profile.loss / 1000.0, profile.transfers);
+    }
     printf("\n");
 
     /* update the transcript */
@@ -687,6 +957,9 @@ int command_get(command_t *command, ttp_session_t *session)
         xscript_close(session, delta);
     }
 
+    /* report the impairment of the data path, if any */
+    impair_finish();
+
     /* dump the received packet bitfield to a file, with added filename prefix ".blockmap" */
     if (session->parameter->blockdump) {
        dump_blockmap(".blockmap", xfer);
@@ -694,12 +967,18 @@ int command_get(command_t *command, ttp_session_t *session)
 
     /* close our open files */
     if (xfer->file     != NULL) { fclose(xfer->file);    xfer->file     = NULL; }
+    if (xfer->aggregate != NULL)  aggregate_close(session);
 
-    /* deallocate memory */
-    ring_destroy(xfer->ring_buffer);
+    /* deallocate memory, and let the console run anywhere again */
+    affinity_restore();
+    if (xfer->ring_buffer != NULL)  ring_destroy(xfer->ring_buffer);
     if (rexmit->table != NULL)  { free(rexmit->table);   rexmit->table  = NULL; }
+    if (rexmit->requested != NULL) { free(rexmit->requested); rexmit->requested = NULL; }
+    if (rexmit->queued != NULL) { free(rexmit->queued);  rexmit->queued = NULL; }
+    if (xfer->reorder.gaps != NULL) { free(xfer->reorder.gaps); xfer->reorder.gaps = NULL; }
     if (xfer->received != NULL) { free(xfer->received);  xfer->received = NULL; }
-    if (local_datagram != NULL) { free(local_datagram);  local_datagram = NULL; }
+    if (local_datagram != NULL) { bufpool_destroy(&local_pool);  local_datagram = NULL; }
+    if (xfer->xdp.active)         xdp_close(&xfer->xdp);
 
     /* update the target rate */
     if (session->parameter->rate_adjust) {
@@ -724,11 +1003,20 @@ int command_get(command_t *command, ttp_session_t *session)
  abort:
     fprintf(stderr, "Transfer not successful.  (WARNING: You may need to reconnect.)\n\n");
     close(xfer->udp_fd);
-    ring_destroy(xfer->ring_buffer);
+    for (path = 1; path < xfer->path_count; ++path)
+        close(xfer->path_fd[path]);
+    impair_finish();
+    affinity_restore();
+    if (xfer->ring_buffer != NULL)  ring_destroy(xfer->ring_buffer);
     if (xfer->file     != NULL) { fclose(xfer->file);    xfer->file     = NULL; }
+    if (xfer->aggregate != NULL)  aggregate_close(session);
     if (rexmit->table  != NULL) { free(rexmit->table);   rexmit->table  = NULL; }
+    if (rexmit->requested != NULL) { free(rexmit->requested); rexmit->requested = NULL; }
+    if (rexmit->queued != NULL) { free(rexmit->queued);  rexmit->queued = NULL; }
+    if (xfer->reorder.gaps != NULL) { free(xfer->reorder.gaps); xfer->reorder.gaps = NULL; }
     if (xfer->received != NULL) { free(xfer->received);  xfer->received = NULL; }
-    if (local_datagram != NULL) { free(local_datagram);  local_datagram = NULL; }    
+    if (local_datagram != NULL) { bufpool_destroy(&local_pool);  local_datagram = NULL; }
+    if (xfer->xdp.active)         xdp_close(&xfer->xdp);
     return -1;
 }
 
@@ -772,6 +1060,12 @@ int command_help(command_t *command, ttp_session_t *session)
 	printf("Tsunami file transfer protocol.  If the local filename is not\n");
 	printf("specified, the final part of the remote filename (after the last path\n");
 	printf("separator) will be used.\n\n");
+	printf("Use 'get *' to retrieve all files shared by the server.  With 'set\n");
+	printf("aggregate yes' the files are sent as one continuous stream and are\n");
+	printf("written below the directory given as the local filename.\n\n");
+	printf("A local filename of '/dev/null' discards the data without any disk\n");
+	printf("I/O, and '!verify' checks the data of a synthetic '!zero:' or\n");
+	printf("'!random:' source instead of writing it.\n\n");
 
     /* handle the DIR command */
     } else if (!strcasecmp(command->text[1], "dir")) {
@@ -851,8 +1145,13 @@ int command_set(command_t *command, ttp_parameter_t *parameter)
         if (parameter->server_name == NULL) error("Could not update server name");
     } else if (!strcasecmp(command->text[1], "port"))       parameter->server_port   = atoi(command->text[2]);
       else if (!strcasecmp(command->text[1], "udpport"))    parameter->client_port   = atoi(command->text[2]);
-      else if (!strcasecmp(command->text[1], "buffer"))     parameter->udp_buffer    = atol(command->text[2]);
-      else if (!strcasecmp(command->text[1], "blocksize"))  parameter->block_size    = atol(command->text[2]);
+      else if (!strcasecmp(command->text[1], "buffer"))     parameter->udp_buffer    = atol(command->text[2]);  /* 'auto' is 0 */
+      else if (!strcasecmp(command->text[1], "buffermax"))  parameter->buffer_max    = atol(command->text[2]);
+      else if (!strcasecmp(command->text[1], "blocksize"))  {
+        parameter->blocksize_auto = (strcasecmp(command->text[2], "auto") == 0);
+        if (!parameter->blocksize_auto)
+            parameter->block_size = atol(command->text[2]);
+      }
       else if (!strcasecmp(command->text[1], "verbose"))    parameter->verbose_yn    = (strcmp(command->text[2], "yes") == 0);
       else if (!strcasecmp(command->text[1], "transcript")) parameter->transcript_yn = (strcmp(command->text[2], "yes") == 0);
       else if (!strcasecmp(command->text[1], "ip"))         parameter->ipv6_yn       = (strcmp(command->text[2], "v6")  == 0);
@@ -878,6 +1177,41 @@ int command_set(command_t *command, ttp_parameter_t *parameter)
       else if (!strcasecmp(command->text[1], "lossless"))     parameter->lossless      = (strcmp(command->text[2], "yes") == 0);
       else if (!strcasecmp(command->text[1], "losswindow"))   parameter->losswindow_ms = atol(command->text[2]);
       else if (!strcasecmp(command->text[1], "blockdump"))    parameter->blockdump     = (strcmp(command->text[2], "yes") == 0);    
+      else if (!strcasecmp(command->text[1], "aggregate"))    parameter->aggregate     = (strcmp(command->text[2], "yes") == 0);
+      else if (!strcasecmp(command->text[1], "faststart"))    parameter->faststart     = (strcmp(command->text[2], "yes") == 0);
+      else if (!strcasecmp(command->text[1], "reorder"))      parameter->reorder       = atol(command->text[2]);
+      else if (!strcasecmp(command->text[1], "reorderwait"))  parameter->reorder_ms    = atol(command->text[2]);
+      else if (!strcasecmp(command->text[1], "busypoll"))     parameter->busypoll      = atol(command->text[2]);  /* 'off' is 0 */
+      else if (!strcasecmp(command->text[1], "rxlatency"))    parameter->rxlatency     = (strcmp(command->text[2], "yes") == 0);
+      else if (!strcasecmp(command->text[1], "timestamps"))   parameter->timestamps    = (strcmp(command->text[2], "yes") == 0);
+      else if (!strcasecmp(command->text[1], "delaytarget"))  parameter->delay_target  = atol(command->text[2]);  /* 'off' is 0 */
+      else if (!strcasecmp(command->text[1], "xdpqueue"))     parameter->xdp_queue     = atol(command->text[2]);
+      else if (!strcasecmp(command->text[1], "xdp")) {
+        if (xdp_parse_mode(command->text[2]) < 0)
+          fprintf(stderr, "Invalid AF_XDP mode '%s', use off, skb or native\n", command->text[2]);
+        else
+          parameter->xdp_mode = xdp_parse_mode(command->text[2]);
+      }
+      else if (!strcasecmp(command->text[1], "rxcpus")) {
+        if (parameter->rx_cpus != NULL) free(parameter->rx_cpus);
+        parameter->rx_cpus = strdup(command->text[2]);
+        if (parameter->rx_cpus == NULL) error("Could not update receive CPUs");
+      }
+      else if (!strcasecmp(command->text[1], "diskcpus")) {
+        if (parameter->disk_cpus != NULL) free(parameter->disk_cpus);
+        parameter->disk_cpus = strdup(command->text[2]);
+        if (parameter->disk_cpus == NULL) error("Could not update disk CPUs");
+      }
+      else if (!strcasecmp(command->text[1], "impair")) {
+        if (impair_setup(command->text[2]) == 0) {
+            if (parameter->impair != NULL) free(parameter->impair);
+            parameter->impair = strcmp(command->text[2], "none") ? strdup(command->text[2]) : NULL;
+        }
+      }
+      else if (!strcasecmp(command->text[1], "paths")) {
+        if (parameter->paths != NULL) free(parameter->paths);
+        parameter->paths = strcmp(command->text[2], "none") ? strdup(command->text[2]) : NULL;
+      }
       else if (!strcasecmp(command->text[1], "passphrase")) {
         if (parameter->passphrase != NULL) free(parameter->passphrase);
         parameter->passphrase = strdup(command->text[2]);
@@ -889,8 +1223,19 @@ int command_set(command_t *command, ttp_parameter_t *parameter)
     if (do_all || !strcasecmp(command->text[1], "server"))     printf("server = %s\n",      parameter->server_name);
     if (do_all || !strcasecmp(command->text[1], "port"))       printf("port = %u\n",        parameter->server_port);
     if (do_all || !strcasecmp(command->text[1], "udpport"))    printf("udpport = %u\n",     parameter->client_port);
-    if (do_all || !strcasecmp(command->text[1], "buffer"))     printf("buffer = %u\n",      parameter->udp_buffer);
-    if (do_all || !strcasecmp(command->text[1], "blocksize"))  printf("blocksize = %u\n",   parameter->block_size);
+    if (do_all || !strcasecmp(command->text[1], "buffer")) {
+        if (parameter->udp_buffer == 0)
+            printf("buffer = auto\n");
+        else
+            printf("buffer = %u\n", parameter->udp_buffer);
+    }
+    if (do_all || !strcasecmp(command->text[1], "buffermax"))  printf("buffermax = %u\n",   parameter->buffer_max);
+    if (do_all || !strcasecmp(command->text[1], "blocksize")) {
+        if (parameter->blocksize_auto)
+            printf("blocksize = auto\n");
+        else
+            printf("blocksize = %u\n", parameter->block_size);
+    }
     if (do_all || !strcasecmp(command->text[1], "verbose"))    printf("verbose = %s\n",     parameter->verbose_yn    ? "yes" : "no");
     if (do_all || !strcasecmp(command->text[1], "transcript")) printf("transcript = %s\n",  parameter->transcript_yn ? "yes" : "no");
     if (do_all || !strcasecmp(command->text[1], "ip"))         printf("ip = %s\n",          parameter->ipv6_yn       ? "v6"  : "v4");
@@ -904,6 +1249,30 @@ int command_set(command_t *command, ttp_parameter_t *parameter)
     if (do_all || !strcasecmp(command->text[1], "lossless"))   printf("lossless = %s\n",    parameter->lossless ? "yes" : "no");
     if (do_all || !strcasecmp(command->text[1], "losswindow")) printf("losswindow = %d msec\n", parameter->losswindow_ms);
     if (do_all || !strcasecmp(command->text[1], "blockdump"))  printf("blockdump = %s\n",   parameter->blockdump ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "aggregate"))  printf("aggregate = %s\n",   parameter->aggregate ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "faststart"))  printf("faststart = %s\n",   parameter->faststart ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "reorder"))    printf("reorder = %u blocks\n", parameter->reorder);
+    if (do_all || !strcasecmp(command->text[1], "reorderwait")) printf("reorderwait = %u msec\n", parameter->reorder_ms);
+    if (do_all || !strcasecmp(command->text[1], "rxcpus"))     printf("rxcpus = %s\n",      parameter->rx_cpus);
+    if (do_all || !strcasecmp(command->text[1], "diskcpus"))   printf("diskcpus = %s\n",    parameter->disk_cpus);
+    if (do_all || !strcasecmp(command->text[1], "busypoll")) {
+        if (parameter->busypoll == 0)
+            printf("busypoll = off\n");
+        else
+            printf("busypoll = %u usec\n", parameter->busypoll);
+    }
+    if (do_all || !strcasecmp(command->text[1], "rxlatency"))  printf("rxlatency = %s\n",   parameter->rxlatency ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "timestamps")) printf("timestamps = %s\n",  parameter->timestamps ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "delaytarget")) {
+        if (parameter->delay_target == 0)
+            printf("delaytarget = off\n");
+        else
+            printf("delaytarget = %u msec\n", parameter->delay_target);
+    }
+    if (do_all || !strcasecmp(command->text[1], "xdp"))        printf("xdp = %s\n",         xdp_mode_name(parameter->xdp_mode));
+    if (do_all || !strcasecmp(command->text[1], "xdpqueue"))   printf("xdpqueue = %u\n",    parameter->xdp_queue);
+    if (do_all || !strcasecmp(command->text[1], "paths"))      printf("paths = %s\n",       (parameter->paths == NULL) ? "none" : parameter->paths);
+    if (do_all || !strcasecmp(command->text[1], "impair"))     printf("impair = %s\n",      (parameter->impair == NULL) ? "none" : parameter->impair);
     if (do_all || !strcasecmp(command->text[1], "passphrase")) printf("passphrase = %s\n",  (parameter->passphrase == NULL) ? "default" : "<user-specified>");
     printf("\n");
 
@@ -926,6 +1295,11 @@ void *disk_thread(void *arg)
     int            status;
     u_int32_t      block_index;
     u_int16_t      block_type;
+    struct timeval write_start;
+
+    /* run where the receive loop placed us */
+    if (affinity_pin(&session->transfer.disk_affinity) < 0)
+	warn("Could not pin the disk thread");
 
     /* while the world is turning */
     while (1) {
@@ -941,12 +1315,15 @@ void *disk_thread(void *arg)
 	    return NULL;
 	}
 
-	/* save it to disk */
+	/* save it to disk, timing the write for the rate ceiling */
+	gettimeofday(&write_start, NULL);
 	status = accept_block(session, block_index, datagram + 6);
 	if (status < 0) {
 	    warn("Block accept failed");
 	    return NULL;
 	}
+	session->transfer.ring_buffer->disk_usec += get_usec_since(&write_start);
+	session->transfer.ring_buffer->disk_blocks++;
 
 	/* pop the block */
 	ring_pop(session->transfer.ring_buffer);
@@ -71,11 +71,13 @@
  *------------------------------------------------------------------------*/
 
 const u_int32_t  DEFAULT_BLOCK_SIZE    = 1024;         /* default size of a single file block          */
+const u_char     DEFAULT_BLOCKSIZE_AUTO = 1;           /* on default fit the blocks into the path MTU  */
 const int        DEFAULT_TABLE_SIZE    = 4096;         /* initial size of the retransmission table     */
 const char      *DEFAULT_SERVER_NAME   = "localhost";  /* default name of the remote server            */
 const u_int16_t  DEFAULT_SERVER_PORT   = TS_TCP_PORT;  /* default TCP port of the remote server        */
 const u_int16_t  DEFAULT_CLIENT_PORT   = TS_UDP_PORT;  /* default UDP port of the client               */
-const u_int32_t  DEFAULT_UDP_BUFFER    = 20000000;     /* default size of the UDP receive buffer       */
+const u_int32_t  DEFAULT_UDP_BUFFER    = 0;            /* size the UDP receive buffer from the BDP     */
+const u_int32_t  DEFAULT_BUFFER_MAX    = 268435456;    /* to 256 MB at most, likewise the ring buffer  */
 const u_char     DEFAULT_VERBOSE_YN    = 1;            /* the default verbosity setting                */
 const u_char     DEFAULT_TRANSCRIPT_YN = 0;            /* the default transcript setting               */
 const u_char     DEFAULT_IPV6_YN       = 0;            /* the default IPv6 setting                     */
@@ -93,6 +95,17 @@ const u_char     DEFAULT_LOSSLESS      = 1;            /* default to lossless tr
 const u_int32_t  DEFAULT_LOSSWINDOW_MS = 1000;         /* default time window (msec) for semi-lossless */
 
 const u_char     DEFAULT_BLOCKDUMP     = 0;            /* on default do not write bitmap dump to file  */
+const u_char     DEFAULT_AGGREGATE     = 0;            /* on default fetch 'get *' file by file        */
+const u_char     DEFAULT_FASTSTART     = 1;            /* on default start at the cached path rate     */
+const u_int32_t  DEFAULT_REORDER       = 3;            /* NACK a gap after 3 later blocks at the least */
+const u_int32_t  DEFAULT_REORDER_MS    = 20;           /* or at the latest 20 msec after it was seen   */
+const char      *DEFAULT_CPUS          = "auto";       /* on the NUMA node of the network interface   */
+const u_int32_t  DEFAULT_BUSYPOLL      = 0;            /* on default block in recvfrom()              */
+const u_char     DEFAULT_RXLATENCY     = 0;            /* on default do not time stamp the datagrams   */
+const u_char     DEFAULT_TIMESTAMPS    = 1;            /* on default follow the one-way delay          */
+const u_int32_t  DEFAULT_DELAY_TARGET  = 100;          /* and back off at 100 msec of queueing delay   */
+const int        DEFAULT_XDP_MODE      = XDP_MODE_OFF; /* on default receive on the UDP socket        */
+const u_int32_t  DEFAULT_XDP_QUEUE     = 0;            /* or else on the first queue of the interface  */
 
 const int        MAX_COMMAND_LENGTH    = 1024;         /* maximum length of a single command           */
 
@@ -104,19 +117,25 @@ const int        MAX_COMMAND_LENGTH    = 1024;         /* maximum length of a si
  *------------------------------------------------------------------------*/
 void reset_client(ttp_parameter_t *parameter)
 {
-    /* free the previous hostname if necessary */
+    /* free the previous hostname and CPU lists if necessary */
     if (parameter->server_name != NULL)
 	free(parameter->server_name);
+    if (parameter->rx_cpus != NULL)
+	free(parameter->rx_cpus);
+    if (parameter->disk_cpus != NULL)
+	free(parameter->disk_cpus);
 
     /* zero out the memory structure */
     memset(parameter, 0, sizeof(*parameter));
 
     /* fill the fields with their defaults */
     parameter->block_size    = DEFAULT_BLOCK_SIZE;
+    parameter->blocksize_auto = DEFAULT_BLOCKSIZE_AUTO;
     parameter->server_name   = strdup(DEFAULT_SERVER_NAME);
     parameter->server_port   = DEFAULT_SERVER_PORT;
     parameter->client_port   = DEFAULT_CLIENT_PORT;
     parameter->udp_buffer    = DEFAULT_UDP_BUFFER;
+    parameter->buffer_max    = DEFAULT_BUFFER_MAX;
     parameter->verbose_yn    = DEFAULT_VERBOSE_YN;
     parameter->transcript_yn = DEFAULT_TRANSCRIPT_YN;
     parameter->ipv6_yn       = DEFAULT_IPV6_YN;
@@ -132,10 +151,24 @@ void reset_client(ttp_parameter_t *parameter)
     parameter->lossless      = DEFAULT_LOSSLESS;
     parameter->losswindow_ms = DEFAULT_LOSSWINDOW_MS;
     parameter->blockdump     = DEFAULT_BLOCKDUMP;
+    parameter->aggregate     = DEFAULT_AGGREGATE;
+    parameter->faststart     = DEFAULT_FASTSTART;
+    parameter->reorder       = DEFAULT_REORDER;
+    parameter->reorder_ms    = DEFAULT_REORDER_MS;
+    parameter->rx_cpus       = strdup(DEFAULT_CPUS);
+    parameter->disk_cpus     = strdup(DEFAULT_CPUS);
+    parameter->busypoll      = DEFAULT_BUSYPOLL;
+    parameter->rxlatency     = DEFAULT_RXLATENCY;
+    parameter->timestamps    = DEFAULT_TIMESTAMPS;
+    parameter->delay_target  = DEFAULT_DELAY_TARGET;
+    parameter->xdp_mode      = DEFAULT_XDP_MODE;
+    parameter->xdp_queue     = DEFAULT_XDP_QUEUE;
 
     /* make sure the strdup() worked */
     if (parameter->server_name == NULL)
       error("Could not reset default server name");
+    if ((parameter->rx_cpus == NULL) || (parameter->disk_cpus == NULL))
+      error("Could not reset default CPU lists");
 }
 
 
@@ -99,7 +99,19 @@ int accept_block(ttp_session_t *session, u_int32_t block_index, u_char *block)
     write_vsib_block(session, block, write_size);
     #endif
  
+    /* verify sinks only check the block against the synthetic pattern */
+    if (transfer->sink == SINK_VERIFY) {
+        if (synthetic_verify(transfer->synthetic, transfer->synthetic_seed,
+                             ((u_int64_t) block_size) * (block_index - 1), block, write_size))
+            ++(transfer->verify_errors);
+        return 0;
+    }
+
     #ifndef DEBUG_DISKLESS
+    /* aggregated transfers split the block over the member files */
+    if (transfer->aggregate != NULL)
+        return aggregate_write(session, block_index, block, write_size);
+
     /* seek to the proper location */
     status = fseeko(transfer->file, ((u_int64_t) block_size) * (block_index - 1), SEEK_SET);
     if (status < 0) {
@@ -64,11 +64,13 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>        /* for DNS resolver functions     */
+#include <netinet/in.h>   /* for IP_MTU_DISCOVER, etc.      */
 #include <netinet/tcp.h>  /* for TCP_NODELAY, etc.          */
 #include <string.h>       /* for standard string routines   */
 #include <sys/socket.h>   /* for the BSD socket library     */
 #include <sys/types.h>    /* for standard system data types */
 #include <unistd.h>       /* for standard Unix system calls */
+#include <poll.h>         /* for poll()                     */
 #include <stdlib.h>       /* for *alloc() and free()        */
 
 #include <tsunami-client.h>
@@ -163,8 +165,8 @@ int create_tcp_socket(ttp_session_t *session, const char *server_name, u_int16_t
  * int create_udp_socket(ttp_parameter_t *parameter);
  *
  * Establishes a new UDP socket for data transfer, returning the file
- * descriptor of the socket on success and -1 on error.  The parameter
- * structure is used for setting the size of the UDP receive buffer.
+ * descriptor of the socket on success and -1 on error.  The size of
+ * the UDP receive buffer is set by ttp_open_port() afterwards.
  * This will be an IPv6 socket if ipv6_yn is true and an IPv4 socket
  * otherwise. The next available port starting from parameter->client_port 
  * will be taken, and the value of client_port is updated.
@@ -205,12 +207,6 @@ int create_udp_socket(ttp_parameter_t *parameter)
                 continue;
             }
             
-            /* set the receive buffer size */
-            status = setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &parameter->udp_buffer, sizeof(parameter->udp_buffer));
-            if (status < 0) {
-                warn("Error in resizing UDP receive buffer");
-            }
-            
             /* and try to bind it */
             status = bind(socket_fd, info->ai_addr, info->ai_addrlen);
             if (status == 0) {
@@ -239,6 +235,77 @@ int create_udp_socket(ttp_parameter_t *parameter)
 }
 
 
+/*------------------------------------------------------------------------
+ * int probe_path_mtu(ttp_session_t *session, u_int32_t wait_usec);
+ *
+ * Finds the MTU of the path to the server of the given session.  This
+ * sends UDP datagrams as large as the MTU the kernel knows of, with the
+ * don't-fragment bit set, to the discard port of the server and waits
+ * for the given time for the ICMP "fragmentation needed" of a router
+ * that lowers it, or for the "port unreachable" of the server, until
+ * the MTU holds.  The path is assumed to be the same in both ways.
+ * Returns the MTU (in bytes) or -1 if it can't be found.
+ *------------------------------------------------------------------------*/
+int probe_path_mtu(ttp_session_t *session, u_int32_t wait_usec)
+{
+#if defined(IP_MTU_DISCOVER) && defined(IP_MTU) && defined(IPV6_MTU_DISCOVER) && defined(IPV6_MTU)
+    struct sockaddr_storage address;
+    struct pollfd           event;
+    u_char                  probe[MAX_AUTO_MTU];
+    int                     ipv6  = (session->server_address->sa_family == AF_INET6);
+    int                     level = ipv6 ? IPPROTO_IPV6 : IPPROTO_IP;
+    int                     value = ipv6 ? IPV6_PMTUDISC_DO : IP_PMTUDISC_DO;
+    int                     mtu   = -1;
+    int                     last  = 0;
+    int                     socket_fd, i;
+    socklen_t               length;
+
+    /* aim at the discard port of the server */
+    memset(&address, 0, sizeof(address));
+    memcpy(&address, session->server_address, session->server_address_length);
+    if (ipv6)
+        ((struct sockaddr_in6 *) &address)->sin6_port = htons(MTU_PROBE_PORT);
+    else
+        ((struct sockaddr_in *)  &address)->sin_port  = htons(MTU_PROBE_PORT);
+
+    /* with a socket that doesn't fragment */
+    socket_fd = socket(session->server_address->sa_family, SOCK_DGRAM, 0);
+    if (socket_fd < 0)
+        return -1;
+    if ((setsockopt(socket_fd, level, ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER, &value, sizeof(value)) < 0) ||
+        (connect(socket_fd, (struct sockaddr *) &address, session->server_address_length) < 0)) {
+        close(socket_fd);
+        return -1;
+    }
+    memset(probe, 0, sizeof(probe));
+
+    /* probe until no ICMP lowers the MTU any more */
+    for (i = 0; i < MTU_PROBES; ++i) {
+        length = sizeof(mtu);
+        if (getsockopt(socket_fd, level, ipv6 ? IPV6_MTU : IP_MTU, &mtu, &length) < 0) {
+            mtu = -1;
+            break;
+        }
+        if (mtu == last)
+            break;
+        last = mtu;
+
+        /* send a probe that fills the frame, and take in the ICMP reply, if any */
+        send(socket_fd, probe, min(mtu, MAX_AUTO_MTU) - (ipv6 ? 40 : 20) - 8, 0);
+        event.fd     = socket_fd;
+        event.events = POLLIN;
+        if (poll(&event, 1, wait_usec / 1000) > 0)
+            recv(socket_fd, probe, sizeof(probe), MSG_DONTWAIT);
+    }
+
+    close(socket_fd);
+    return mtu;
+#else
+    return -1;
+#endif
+}
+
+
 /*========================================================================
  * $Log$
  * Revision 1.9  2007/12/07 18:10:28  jwagnerhki
@@ -0,0 +1,229 @@
+/*========================================================================
+ * profile.c  --  per-path profile cache for the Tsunami client.
+ *
+ * This keeps the operating point that the transfers to each server
+ * reached, i.e. the file rate, the control channel round trip time and
+ * the share of retransmissions, in a small text file in the home
+ * directory, so that the next session to that server can start near
+ * that rate instead of climbing up from a third of the target rate.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <stdlib.h>    /* for getenv()                 */
+#include <string.h>    /* for string-handling routines */
+#include <time.h>      /* for time()                   */
+#include <unistd.h>    /* for getpid() and unlink()    */
+
+#include <tsunami-client.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static int profile_path(char *path, size_t length);
+
+
+/*------------------------------------------------------------------------
+ * int profile_load(ttp_session_t *session, profile_t *profile);
+ *
+ * Looks up the cached profile of the path to the server of the given
+ * session, i.e. of its server name and port.  Entries that were not
+ * updated for PROFILE_MAX_AGE seconds are ignored.  Returns 0 if an
+ * entry was found and nonzero otherwise.
+ *------------------------------------------------------------------------*/
+int profile_load(ttp_session_t *session, profile_t *profile)
+{
+    char         path[1024];
+    char         line[1024];
+    char         host[1024];
+    unsigned int port;
+    long         updated;
+    FILE        *file;
+    int          found = -1;
+
+    /* open the cache, if there is one */
+    if (profile_path(path, sizeof(path)) < 0)
+        return -1;
+    file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    /* look for the line of this server */
+    while ((found < 0) && (fgets(line, sizeof(line), file) != NULL)) {
+        if ((line[0] == '#') ||
+            (sscanf(line, "%1023s %u %u %u %u %u %ld", host, &port, &profile->rate, &profile->rtt_usec,
+                    &profile->loss, &profile->transfers, &updated) < 7))
+            continue;
+        if (!strcmp(host, session->parameter->server_name) && (port == session->parameter->server_port))
+            found = 0;
+    }
+    fclose(file);
+
+    /* forget about paths that were not used for a long time */
+    if (found == 0) {
+        profile->updated = (time_t) updated;
+        if ((profile->rate == 0) || (time(NULL) - profile->updated > PROFILE_MAX_AGE))
+            found = -1;
+    }
+    return found;
+}
+
+
+/*------------------------------------------------------------------------
+ * int profile_save(ttp_session_t *session, profile_t *sample);
+ *
+ * Folds the operating point that the last transfer reached into the
+ * cached profile of the path to the server of the given session, as the
+ * mean of the old and the new values, and rewrites the cache.  The
+ * merged profile is returned in the sample.  Returns 0 on success and
+ * nonzero on failure.
+ *------------------------------------------------------------------------*/
+int profile_save(ttp_session_t *session, profile_t *sample)
+{
+    ttp_parameter_t *param = session->parameter;
+    profile_t        old;
+    char             path[1024];
+    char             temp[1040];
+    char             line[1024];
+    char             host[1024];
+    unsigned int     port;
+    FILE            *in, *out;
+
+    /* merge with what we knew about this path before */
+    if (profile_load(session, &old) == 0) {
+        sample->rate      = (u_int32_t) (((u_int64_t) old.rate + sample->rate) / 2);
+        sample->rtt_usec  = (u_int32_t) (((u_int64_t) old.rtt_usec + sample->rtt_usec) / 2);
+        sample->loss      = (old.loss + sample->loss) / 2;
+        sample->transfers = old.transfers + 1;
+    } else {
+        sample->transfers = 1;
+    }
+    sample->updated = time(NULL);
+
+    /* write the other paths and this one to a new file */
+    if (profile_path(path, sizeof(path)) < 0)
+        return warn("Could not locate the profile cache, $HOME is not set");
+    sprintf(temp, "%s.%d", path, (int) getpid());
+    out = fopen(temp, "w");
+    if (out == NULL)
+        return warn("Could not create the profile cache");
+    fprintf(out, "# Tsunami path profiles: server port rate_bps rtt_usec loss(%%x1000) transfers updated\n");
+    in = fopen(path, "r");
+    if (in != NULL) {
+        while (fgets(line, sizeof(line), in) != NULL) {
+            if ((line[0] == '#') || (sscanf(line, "%1023s %u", host, &port) < 2))
+                continue;
+            if (!strcmp(host, param->server_name) && (port == param->server_port))
+                continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s %u %u %u %u %u %ld\n", param->server_name, param->server_port, sample->rate,
+            sample->rtt_usec, sample->loss, sample->transfers, (long) sample->updated);
+
+    /* and replace the old cache in one go */
+    if (fclose(out) || rename(temp, path)) {
+        unlink(temp);
+        return warn("Could not update the profile cache");
+    }
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int32_t profile_start_rate(ttp_parameter_t *parameter,
+ *                              const profile_t *profile);
+ *
+ * Returns the rate (in bps) that a transfer on a path with the given
+ * profile should start at.  This is a bit below the rate reached last
+ * time, and further below it if that needed more retransmissions than
+ * the threshhold error rate, so that the rate control can probe its
+ * way up from there.  The target rate is never exceeded.
+ *------------------------------------------------------------------------*/
+u_int32_t profile_start_rate(ttp_parameter_t *parameter, const profile_t *profile)
+{
+    double rate;
+
+    rate = profile->rate * ((profile->loss > parameter->error_rate) ? PROFILE_LOSSY_START : PROFILE_START);
+    return (rate > parameter->target_rate) ? parameter->target_rate : (u_int32_t) rate;
+}
+
+
+/*------------------------------------------------------------------------
+ * int profile_path(char *path, size_t length);
+ *
+ * Stores the name of the profile cache in the home directory of the
+ * user into the given buffer.  Returns 0 on success and nonzero if
+ * there is no home directory or the name is too long.
+ *------------------------------------------------------------------------*/
+int profile_path(char *path, size_t length)
+{
+    const char *home = getenv("HOME");
+
+    if ((home == NULL) || (*home == '\0'))
+        return -1;
+    if (snprintf(path, length, "%s/%s", home, PROFILE_FILE_NAME) >= (int) length)
+        return -1;
+    return 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
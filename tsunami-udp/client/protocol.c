@@ -61,6 +61,7 @@
  * INFORMATION GENERATED USING SOFTWARE.
  *========================================================================*/
 
+#include <arpa/inet.h>    /* for inet_pton()                       */
 #include <stdlib.h>       /* for *alloc() and free()               */
 #include <string.h>       /* for standard string routines          */
 #include <sys/socket.h>   /* for the BSD socket library            */
@@ -69,6 +70,14 @@
 #include <unistd.h>       /* for standard Unix system calls        */
 
 #include <tsunami-client.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static int    request_block  (ttp_session_t *session, u_int32_t block, u_int64_t requested);
+static double request_spacing(ttp_session_t *session);
 //#define DEBUG_RETX xxx // enable to show retransmit debug infos
 
 /*------------------------------------------------------------------------
@@ -170,11 +179,23 @@ int ttp_open_transfer(ttp_session_t *session, const char *remote_filename, const
     u_char           result;    /* the result byte from the server     */
     u_int32_t        temp;      /* used for transmitting 32-bit values */
     u_int16_t        temp16;    /* used for transmitting 16-bit values */
+    char            *manifest;  /* the manifest of an aggregate        */
+    u_int64_t        size;      /* the size of a synthetic source      */
+    struct timeval   ping;      /* the time the request was sent       */
+    u_int32_t        rtt_usec;  /* the round trip time of the request  */
+    u_int32_t        bdp;       /* the bandwidth-delay product (bytes) */
+    int              mtu;       /* the MTU of the path to the server   */
     int              status;
     ttp_transfer_t  *xfer  = &session->transfer;
     ttp_parameter_t *param =  session->parameter;
 
+    /* a verify sink needs a synthetic source to check against */
+    if (!strcmp(local_filename, SINK_VERIFY_NAME) &&
+        (synthetic_parse(remote_filename, &size, &xfer->synthetic_seed) == TS_SYNTHETIC_NONE))
+	return warn("Only the synthetic '!zero:' and '!random:' sources can be verified");
+
     /* submit the transfer request */
+    gettimeofday(&ping, NULL);
     status = fprintf(session->server, "%s\n", remote_filename);
     if ((status <= 0) || fflush(session->server))
 	return warn("Could not request file");
@@ -183,11 +204,37 @@ int ttp_open_transfer(ttp_session_t *session, const char *remote_filename, const
     status = fread(&result, 1, 1, session->server);
     if (status < 1)
 	return warn("Could not read response to file request");
+    rtt_usec = (u_int32_t) get_usec_since(&ping);
+
+    /* a busy server queues the request, and tells us our place in line until it starts */
+    while (session->queue_notices && (result == TS_QUEUED)) {
+	if (fread(&temp, 4, 1, session->server) < 1)
+	    return warn("Could not read place in the transfer queue");
+	printf("Queued by the server, place %u in line\n", ntohl(temp));
+	fflush(stdout);
+	if (fread(&result, 1, 1, session->server) < 1)
+	    return warn("Could not read response to file request");
+    }
 
     /* make sure the result was a good one */
     if (result != 0)
 	return warn("Server: File does not exist or cannot be transmitted");
 
+    /* fit each block into one frame of the path, headers and send time stamp included, if we're asked to */
+    if (param->blocksize_auto) {
+        mtu = probe_path_mtu(session, max(MTU_PROBE_WAIT_MIN, min(2 * rtt_usec, MTU_PROBE_WAIT_MAX)));
+        if (mtu > 0) {
+            param->block_size = min(mtu, MAX_AUTO_MTU) - ((session->server_address->sa_family == AF_INET6) ? 40 : 20) - 8 - 6
+                              - (param->timestamps ? TS_STAMP_SIZE : 0);
+            if (param->verbose_yn)
+                printf("Path MTU is %d bytes, using blocks of %u bytes\n", mtu, param->block_size);
+        } else {
+            param->block_size = DEFAULT_BLOCK_SIZE;
+            if (param->verbose_yn)
+                printf("Path MTU is unknown, using blocks of %u bytes\n", param->block_size);
+        }
+    }
+
     /* Submit the block size, target bitrate, and maximum error rate */
     temp = htonl(param->block_size);   if (fwrite(&temp, 4, 1, session->server) < 1) return warn("Could not submit block size");
     temp = htonl(param->target_rate);  if (fwrite(&temp, 4, 1, session->server) < 1) return warn("Could not submit target rate");
@@ -207,6 +254,7 @@ int ttp_open_transfer(ttp_session_t *session, const char *remote_filename, const
     memset(xfer, 0, sizeof(*xfer));
     xfer->remote_filename = remote_filename;
     xfer->local_filename  = local_filename;
+    xfer->rtt_usec        = rtt_usec;
 
     /* read in the file length, block size, block count, and run epoch */
     if (fread(&xfer->file_size,   8, 1, session->server) < 1) return warn("Could not read file size");         xfer->file_size   = ntohll(xfer->file_size);
@@ -217,21 +265,59 @@ int ttp_open_transfer(ttp_session_t *session, const char *remote_filename, const
     /* we start out with every block yet to transfer */
     xfer->blocks_left = xfer->block_count;
 
-    /* try to open the local file for writing */
-    if (!access(xfer->local_filename, F_OK))
-        printf("Warning: overwriting existing file '%s'\n", local_filename);     
-    xfer->file = fopen(xfer->local_filename, "wb");
-    if (xfer->file == NULL) {
-        char * trimmed = rindex(xfer->local_filename, '/');
-        if ((trimmed != NULL) && (strlen(trimmed)>1)) {
-           printf("Warning: could not open file %s for writing, trying local directory instead.\n", xfer->local_filename);
-           xfer->local_filename = trimmed + 1;
-           if (!access(xfer->local_filename, F_OK))
-              printf("Warning: overwriting existing file '%s'\n", xfer->local_filename);     
-           xfer->file = fopen(xfer->local_filename, "wb");
+    if (!strcmp(remote_filename, TS_AGGREGATE_CMD)) {
+
+        /* read the manifest of an aggregated transfer and create the member files */
+        if (fread(&temp, 4, 1, session->server) < 1) return warn("Could not read manifest length");
+        temp = ntohl(temp);
+        if (temp > TS_MANIFEST_MAX) {
+            sprintf(g_error, "Manifest of %u bytes is too long", temp);
+            return warn(g_error);
+        }
+        manifest = (char *) malloc(temp + 1);
+        if (manifest == NULL)
+            return warn("Could not allocate manifest");
+        if (fread(manifest, 1, temp, session->server) < temp) {
+            free(manifest);
+            return warn("Could not read manifest");
         }
-        if(xfer->file == NULL) {
-           return warn("Could not open local file for writing");
+        manifest[temp] = '\0';
+        status = aggregate_open(session, manifest, xfer->local_filename);
+        free(manifest);
+        if (status < 0) {
+            aggregate_close(session);
+            return warn("Could not create the aggregated files");
+        }
+
+    } else if (!strcmp(xfer->local_filename, SINK_NULL_NAME)) {
+
+        /* drop the data without a ring buffer or disk thread */
+        xfer->sink = SINK_NULL;
+
+    } else if (!strcmp(xfer->local_filename, SINK_VERIFY_NAME)) {
+
+        /* only check the data against the synthetic pattern */
+        xfer->sink      = SINK_VERIFY;
+        xfer->synthetic = synthetic_parse(remote_filename, &size, &xfer->synthetic_seed);
+
+    } else {
+
+        /* try to open the local file for writing */
+        if (!access(xfer->local_filename, F_OK))
+            printf("Warning: overwriting existing file '%s'\n", local_filename);     
+        xfer->file = fopen(xfer->local_filename, "wb");
+        if (xfer->file == NULL) {
+            char * trimmed = rindex(xfer->local_filename, '/');
+            if ((trimmed != NULL) && (strlen(trimmed)>1)) {
+               printf("Warning: could not open file %s for writing, trying local directory instead.\n", xfer->local_filename);
+               xfer->local_filename = trimmed + 1;
+               if (!access(xfer->local_filename, F_OK))
+                  printf("Warning: overwriting existing file '%s'\n", xfer->local_filename);     
+               xfer->file = fopen(xfer->local_filename, "wb");
+            }
+            if(xfer->file == NULL) {
+               return warn("Could not open local file for writing");
+            }
         }
     }
 
@@ -247,8 +333,17 @@ int ttp_open_transfer(ttp_session_t *session, const char *remote_filename, const
     return warn("Could not reserve space for ring buffer");
     #endif
 
-    /* make crude estimate of blocks on the wire if RTT delay is 500ms */
-    xfer->on_wire_estimate = (u_int32_t)(0.5 * param->target_rate/(8*param->block_size));
+    /* size the buffers after the bandwidth-delay product, with the RTT of the file request */
+    bdp = bdp_size(param->target_rate, rtt_usec, 0, param->buffer_max);
+    xfer->udp_buffer  = param->udp_buffer ? param->udp_buffer : max(bdp, MIN_UDP_BUFFER);
+    xfer->ring_slots  = max(bdp, MAX_BLOCKS_QUEUED * (6 + param->block_size)) / (6 + param->block_size);
+    xfer->retransmit.table_size = max(bdp / param->block_size, (u_int32_t) DEFAULT_TABLE_SIZE);
+    if (param->verbose_yn)
+        printf("Buffers for %0.1f Mbps over %0.1f ms: UDP receive %u bytes, ring %u blocks, retransmission table %u entries\n",
+               param->target_rate / 1e6, rtt_usec / 1e3, xfer->udp_buffer, xfer->ring_slots, xfer->retransmit.table_size);
+
+    /* estimate the blocks on the wire before the server reacts to a restart as those of two RTTs */
+    xfer->on_wire_estimate = bdp_size(param->target_rate, max(2 * rtt_usec, TS_RTO_MIN), 0, 0xFFFFFFFF) / param->block_size;
     xfer->on_wire_estimate = min(xfer->block_count, xfer->on_wire_estimate);
 
     /* if we're doing a transcript */
@@ -273,12 +368,22 @@ int ttp_open_port(ttp_session_t *session)
     unsigned int    udp_length = sizeof(udp_address);
     int             status;
     u_int16_t      *port;
+    u_int32_t       granted, limit;
 
     /* open a new datagram socket */
     session->transfer.udp_fd = create_udp_socket(session->parameter);
     if (session->transfer.udp_fd < 0)
 	return warn("Could not create UDP socket");
 
+    /* ask for the receive buffer, and tell if the kernel gave us less */
+    granted = set_socket_buffer(session->transfer.udp_fd, SO_RCVBUF, session->transfer.udp_buffer, &limit);
+    if (granted < session->transfer.udp_buffer) {
+        if (limit > 0)
+            printf("Warning: UDP receive buffer clamped to %u of %u bytes by net.core.rmem_max = %u\n", granted, session->transfer.udp_buffer, limit);
+        else
+            printf("Warning: UDP receive buffer clamped to %u of %u bytes by the kernel\n", granted, session->transfer.udp_buffer);
+    }
+
     /* find out the port number we're using */
     memset(&udp_address, 0, sizeof(udp_address));
     getsockname(session->transfer.udp_fd, (struct sockaddr *) &udp_address, &udp_length);
@@ -298,14 +403,120 @@ int ttp_open_port(ttp_session_t *session)
 }
 
 
+/*------------------------------------------------------------------------
+ * int ttp_open_paths(ttp_session_t *session);
+ *
+ * Creates a UDP socket for each of the extra data paths given with
+ * 'set paths', bound to the given local IPv4 address, and asks the
+ * server with REQUEST_PATH to stripe the transfer over them too.  The
+ * server starts using a path once ttp_confirm_path() answered its
+ * probe.  The socket of ttp_open_port() becomes path 0.  An address
+ * that cannot be used is left out with a warning.  Returns 0 on
+ * success and non-zero on failure.
+ *------------------------------------------------------------------------*/
+int ttp_open_paths(ttp_session_t *session)
+{
+    ttp_transfer_t     *xfer = &session->transfer;
+    retransmission_t    retransmission;
+    struct sockaddr_in  address;
+    socklen_t           length;
+    char                copy[1024];
+    char               *item, *save;
+    u_int32_t           granted, limit;
+    int                 fd, status;
+
+    xfer->path_count = 0;
+    if (session->parameter->paths == NULL)
+        return 0;
+    xfer->path_fd[0] = xfer->udp_fd;
+    xfer->path_count = 1;
+
+    snprintf(copy, sizeof(copy), "%s", session->parameter->paths);
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        if (xfer->path_count == TS_MAX_PATHS) {
+            sprintf(g_error, "Only %d extra data paths are supported", TS_MAX_PATHS - 1);
+            return warn(g_error);
+        }
+
+        /* open a socket on our address of the path */
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        if (inet_pton(AF_INET, item, &address.sin_addr) != 1) {
+            sprintf(g_error, "Invalid data path address '%s'", item);
+            warn(g_error);
+            continue;
+        }
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if ((fd < 0) || (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0)) {
+            if (fd >= 0)
+                close(fd);
+            sprintf(g_error, "Could not open data path on %s", item);
+            warn(g_error);
+            continue;
+        }
+        granted = set_socket_buffer(fd, SO_RCVBUF, xfer->udp_buffer, &limit);
+        if (granted < xfer->udp_buffer)
+            printf("Warning: UDP receive buffer of data path %u clamped to %u of %u bytes\n", xfer->path_count, granted, xfer->udp_buffer);
+        length = sizeof(address);
+        getsockname(fd, (struct sockaddr *) &address, &length);
+
+        /* and have the server send there too */
+        retransmission.request_type = htons(REQUEST_PATH);
+        retransmission.block        = address.sin_addr.s_addr;  /* already in network byte order */
+        retransmission.error_rate   = htonl((xfer->path_count << 16) | ntohs(address.sin_port));
+        status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
+        if ((status <= 0) || fflush(session->server)) {
+            close(fd);
+            return warn("Could not request data path");
+        }
+        xfer->path_address[xfer->path_count] = address.sin_addr;
+        xfer->path_fd[xfer->path_count++]    = fd;
+    }
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int ttp_confirm_path(ttp_session_t *session, u_int32_t path,
+ *                      u_int32_t nonce);
+ *
+ * Answers the TS_BLOCK_PATH_PROBE with the given nonce that arrived on
+ * the data path with the given index, by echoing the nonce with a
+ * REQUEST_PATH_CONFIRM.  This shows the server that we receive on the
+ * path.  Returns 0 on success and non-zero on failure.
+ *------------------------------------------------------------------------*/
+int ttp_confirm_path(ttp_session_t *session, u_int32_t path, u_int32_t nonce)
+{
+    retransmission_t retransmission;
+    int              status;
+
+    retransmission.request_type = htons(REQUEST_PATH_CONFIRM);
+    retransmission.block        = htonl(nonce);
+    retransmission.error_rate   = htonl(path);
+
+    status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
+    if ((status <= 0) || fflush(session->server))
+        return warn("Could not confirm data path");
+
+    /* we succeeded */
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------
  * int ttp_repeat_retransmit(ttp_session_t *session);
  *
- * Tries to repeat all of the outstanding retransmit requests for the
- * current transfer on the given session.  Returns 0 on success and
- * non-zero on error.  This also takes care of maintanence operations
- * on the transmission table, such as relocating the entries toward the
- * bottom of the array.
+ * Tries to repeat the outstanding retransmit requests for the current
+ * transfer on the given session.  New entries are requested right away,
+ * and entries that were requested before only once their retransmission
+ * timeout has expired, so that a request is not repeated before its
+ * reply could have arrived.  The timeout of each request starts when the
+ * server should get to it at the current rate, behind the requests it
+ * still has to work through.  Returns 0 on success and non-zero on error.
+ * This also takes care of maintanence operations on the transmission
+ * table, such as relocating the entries toward the bottom of the array.
  *------------------------------------------------------------------------*/
 int ttp_repeat_retransmit(ttp_session_t *session)
 {
@@ -314,6 +525,11 @@ int ttp_repeat_retransmit(ttp_session_t *session)
     int               status;
     int               block;
     int               count = 0;
+    int               sent = 0;                                   /* the number of requests sent this time    */
+    struct timeval    now_tv;
+    u_int64_t         now;                                        /* the current time (usec)                  */
+    double            spacing = request_spacing(session);         /* the time between the replies (usec)      */
+    u_int64_t         due;                                        /* when the server should get to a request  */
     retransmit_t     *rexmit = &(session->transfer.retransmit);
     ttp_transfer_t   *xfer = &session->transfer;
 
@@ -325,6 +541,10 @@ int ttp_repeat_retransmit(ttp_session_t *session)
     memset(retransmission, 0, sizeof(retransmission));
     xfer->stats.this_retransmits = 0;
     count = 0;
+    gettimeofday(&now_tv, NULL);
+    now = (u_int64_t) now_tv.tv_sec * 1000000 + now_tv.tv_usec;
+    due = max(now, rexmit->server_busy);
+    rexmit->last_repeat = now_tv;
 
     /* discard received blocks from the list and prepare retransmit requests */
     for (entry = 0; (entry<rexmit->index_max) && (count<MAX_RETRANSMISSION_BUFFER); ++entry) {
@@ -336,11 +556,27 @@ int ttp_repeat_retransmit(ttp_session_t *session)
         if (block && !got_block(session, block)) {
 
             /* save it */
-            rexmit->table[count] = block;
-
-            /* insert retransmit request */
-            retransmission[count].request_type = htons(REQUEST_RETRANSMIT);
-            retransmission[count].block        = htonl(block);
+            rexmit->table[count]     = block;
+            rexmit->requested[count] = rexmit->requested[entry];
+
+            /* insert retransmit request if it is new or its timeout expired */
+            if ((rexmit->requested[count] == 0) || (now >= rexmit->requested[count] + rexmit->rtt.rto)) {
+
+                /* time one block that was not requested before, back off when it needs a repeat */
+                if (block == rexmit->probe_block) {
+                    rexmit->probe_block = 0;
+                    ratecontrol_rtt_backoff(&rexmit->rtt);
+                } else if ((rexmit->probe_block == 0) && (rexmit->requested[count] == 0)) {
+                    rexmit->probe_block = block;
+                    rexmit->probe_time  = now_tv;
+                }
+
+                due                              += (u_int64_t) spacing;
+                rexmit->requested[count]          = due;
+                retransmission[sent].request_type = htons(REQUEST_RETRANSMIT);
+                retransmission[sent].block        = htonl(block);
+                ++sent;
+            }
             ++count;
 
             #ifdef DEBUG_RETX
@@ -352,6 +588,10 @@ int ttp_repeat_retransmit(ttp_session_t *session)
     /* if there are too many entries, restart transfer from earlier point */
     if (count >= MAX_RETRANSMISSION_BUFFER) {
 
+        /* so that the server can skip what we already have */
+        if (ttp_acknowledge(session) < 0)
+            return warn("Could not acknowledge blocks before restart");
+
         /* restart from first missing block */
         block                          = min(xfer->block_count, xfer->gapless_to_block + 1);
         retransmission[0].request_type = htons(REQUEST_RESTART);
@@ -374,8 +614,12 @@ int ttp_repeat_retransmit(ttp_session_t *session)
         #endif
 
         /* reset the retransmission table and head block */
-        rexmit->index_max = 0;
-        xfer->next_block  = block;
+        for (entry = 0; entry < rexmit->index_max; ++entry)
+            rexmit->queued[rexmit->table[entry] / 8] &= ~(1 << (rexmit->table[entry] % 8));
+        rexmit->index_max   = 0;
+        rexmit->probe_block = 0;
+        xfer->reorder.count = 0;
+        xfer->next_block    = block;
 
        xfer->stats.this_retransmits = MAX_RETRANSMISSION_BUFFER;
 
@@ -383,15 +627,16 @@ int ttp_repeat_retransmit(ttp_session_t *session)
     } else {
 
         /* update to shrunken size */
-        rexmit->index_max = count;
+        rexmit->index_max   = count;
+        rexmit->server_busy = due;
 
-        /* update the statistics */
+        /* update the statistics, the error rate counts all outstanding requests */
         xfer->stats.this_retransmits   = count;
-        xfer->stats.total_retransmits += count;
+        xfer->stats.total_retransmits += sent;
 
         /* send out the requests */
-        if (count > 0) {
-            status = fwrite(retransmission, sizeof(retransmission_t), count, session->server);
+        if (sent > 0) {
+            status = fwrite(retransmission, sizeof(retransmission_t), sent, session->server);
             if (status <= 0) {
                 return warn("Could not send retransmit requests");
             }
@@ -412,6 +657,103 @@ int ttp_repeat_retransmit(ttp_session_t *session)
 }
 
 
+/*------------------------------------------------------------------------
+ * int ttp_request_queue_notices(ttp_session_t *session);
+ *
+ * Tells the server, before the first file request of the session, that
+ * we take TS_QUEUED replies with our place in its transfer queue while
+ * it holds a request back.  This is done with the TS_QUEUE_CMD "file
+ * name", which servers that don't know it merely answer as a file that
+ * does not exist.  Returns 0 if the server takes the notice and
+ * non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int ttp_request_queue_notices(ttp_session_t *session)
+{
+    u_char result;
+    int    status;
+
+    /* send out the request */
+    status = fprintf(session->server, "%s\n", TS_QUEUE_CMD);
+    if ((status <= 0) || fflush(session->server))
+	return warn("Could not request queue notices");
+
+    /* and see if the server knows it */
+    if (fread(&result, 1, 1, session->server) < 1)
+	return warn("Could not read response to queue notice request");
+    session->queue_notices = (result == 0);
+    return session->queue_notices ? 0 : -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * int ttp_request_range(ttp_session_t *session, u_int32_t first,
+ *                       u_int32_t last);
+ *
+ * Requests the retransmission of the blocks from first to last that we
+ * neither have nor asked for yet, as up to MAX_RANGE_REQUESTS runs of
+ * missing blocks in requests of type REQUEST_RETRANSMIT_RANGE.  This is
+ * how the missing tail of a transfer is asked for in one go.  The blocks
+ * go into the retransmission table as requested when the server should
+ * get to them at the current rate, behind the requests it already has,
+ * so that their timeouts cover the loss of the ranges.  Returns 0 on
+ * success and non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int ttp_request_range(ttp_session_t *session, u_int32_t first, u_int32_t last)
+{
+    retransmission_t  ranges[MAX_RANGE_REQUESTS];
+    retransmit_t     *rexmit = &(session->transfer.retransmit);
+    struct timeval    now_tv;
+    u_int64_t         now;
+    double            spacing = request_spacing(session);     /* the time between blocks (usec) */
+    u_int64_t         due;                                    /* when the server gets to one    */
+    u_int32_t         block   = first;
+    u_int32_t         start;
+    int               count = 0;
+    int               status;
+
+    gettimeofday(&now_tv, NULL);
+    now = (u_int64_t) now_tv.tv_sec * 1000000 + now_tv.tv_usec;
+    due = max(now, rexmit->server_busy);
+
+    while ((block <= last) && (count < MAX_RANGE_REQUESTS)) {
+
+        /* skip what we have or asked for already */
+        if (got_block(session, block) || (rexmit->queued[block / 8] & (1 << (block % 8)))) {
+            ++block;
+            continue;
+        }
+
+        /* put the run of missing blocks into the table */
+        for (start = block; (block <= last) && !got_block(session, block) && !(rexmit->queued[block / 8] & (1 << (block % 8))); ++block)
+            if (request_block(session, block, due += (u_int64_t) spacing) < 0)
+                return -1;
+
+        /* time the first of them if no request is being timed */
+        if (rexmit->probe_block == 0) {
+            rexmit->probe_block = start;
+            rexmit->probe_time  = now_tv;
+        }
+
+        ranges[count].request_type = htons(REQUEST_RETRANSMIT_RANGE);
+        ranges[count].block        = htonl(start);
+        ranges[count].error_rate   = htonl(block - 1);
+        session->transfer.stats.total_retransmits += block - start;
+        ++count;
+    }
+
+    /* send out the ranges */
+    rexmit->server_busy = due;
+    if (count > 0) {
+        status = fwrite(ranges, sizeof(retransmission_t), count, session->server);
+        if ((status <= 0) || fflush(session->server))
+            return warn("Could not send retransmit range requests");
+    }
+
+    /* we succeeded */
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------
  * int ttp_request_retransmit(ttp_session_t *session, u_int32_t block);
  *
@@ -419,17 +761,33 @@ int ttp_repeat_retransmit(ttp_session_t *session)
  * Returns 0 on success and non-zero otherwise.
  *------------------------------------------------------------------------*/
 int ttp_request_retransmit(ttp_session_t *session, u_int32_t block)
+{
+    return request_block(session, block, 0);
+}
+
+
+/*------------------------------------------------------------------------
+ * int request_block(ttp_session_t *session, u_int32_t block,
+ *                   u_int64_t requested);
+ *
+ * Adds the given block to the retransmission table, as requested at the
+ * given time (in usec), or as not requested yet if that is 0.  Returns
+ * 0 on success and non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int request_block(ttp_session_t *session, u_int32_t block, u_int64_t requested)
 {
    #ifdef RETX_REQBLOCK_SORTING
    u_int32_t     tmp32_ins = 0, tmp32_up;
+   u_int64_t     tmp64_ins = 0, tmp64_up;
    u_int32_t     idx = 0;
    #endif
 
    u_int32_t    *ptr;
+   u_int64_t    *times;
    retransmit_t *rexmit = &(session->transfer.retransmit);
 
-   /* double checking: if we already got the block, don't add it */
-   if (got_block(session, block)) {
+   /* double checking: if we already got the block, or it is in the table, don't add it */
+   if (got_block(session, block) || (rexmit->queued[block / 8] & (1 << (block % 8)))) {
       return 0;
    }
 
@@ -445,9 +803,17 @@ int ttp_request_retransmit(ttp_session_t *session, u_int32_t block)
       if (ptr == NULL)
          return warn("Could not grow retransmission table");
 
-      /* prepare the new table space */
       rexmit->table = ptr;
+
+      /* and the request times along with it */
+      times = (u_int64_t *) realloc(rexmit->requested, 2 * sizeof(u_int64_t)*rexmit->table_size);
+      if (times == NULL)
+         return warn("Could not grow retransmission table");
+      rexmit->requested = times;
+
+      /* prepare the new table space */
       memset(rexmit->table + rexmit->table_size, 0, sizeof(u_int32_t) * rexmit->table_size);
+      memset(rexmit->requested + rexmit->table_size, 0, sizeof(u_int64_t) * rexmit->table_size);
       rexmit->table_size *= 2;
 
       #if DEBUG_RETX
@@ -458,7 +824,8 @@ int ttp_request_retransmit(ttp_session_t *session, u_int32_t block)
    #ifndef RETX_REQBLOCK_SORTING
 
    /* store the request */
-   rexmit->table[rexmit->index_max] = block;
+   rexmit->table[rexmit->index_max]     = block;
+   rexmit->requested[rexmit->index_max] = requested;
    rexmit->index_max++;
 
    #else
@@ -478,27 +845,108 @@ int ttp_request_retransmit(ttp_session_t *session, u_int32_t block)
 
    /* insert the entry */
    if (idx == rexmit->index_max) { 
-      rexmit->table[rexmit->index_max] = block;
+      rexmit->table[rexmit->index_max]     = block;
+      rexmit->requested[rexmit->index_max] = requested;
       rexmit->index_max++;
    } else if (rexmit->table[idx] == block) { 
       // fprintf(stderr, "duplicate retransmit req for block %d discarded\n", block);
    } else { 
       /* insert and shift remaining table upwards - linked list could be nice... */
       tmp32_ins = block;
+      tmp64_ins = requested;
       do {
          tmp32_up = rexmit->table[idx];
-         rexmit->table[idx++] = tmp32_ins;
+         tmp64_up = rexmit->requested[idx];
+         rexmit->table[idx] = tmp32_ins;
+         rexmit->requested[idx++] = tmp64_ins;
          tmp32_ins = tmp32_up;
+         tmp64_ins = tmp64_up;
       } while(idx <= rexmit->index_max);
       rexmit->index_max++;
    }
    #endif
 
+   /* remember that the block is in the table */
+   rexmit->queued[block / 8] |= (1 << (block % 8));
+
    /* we succeeded */
    return 0;
 }
 
 
+/*------------------------------------------------------------------------
+ * double request_spacing(ttp_session_t *session);
+ *
+ * Returns the mean time (in usec) between two blocks of the transfer so
+ * far, or 0 before any have arrived.  Unlike the rate of the last stats
+ * interval this does not collapse when the server runs out of blocks to
+ * send at the end of the transfer.
+ *------------------------------------------------------------------------*/
+double request_spacing(ttp_session_t *session)
+{
+    statistics_t *stats = &(session->transfer.stats);
+
+    if (stats->total_blocks == 0)
+        return 0.0;
+    return (double) get_usec_since(&stats->start_time) / stats->total_blocks;
+}
+
+
+/*------------------------------------------------------------------------
+ * int ttp_request_start_rate(ttp_session_t *session, u_int32_t rate);
+ *
+ * Asks the server to start the current transfer at the given rate (in
+ * bps) instead of at a third of the target rate.  This is done by
+ * sending a request with a type of REQUEST_START_RATE that carries
+ * the rate in kbps in its error rate field.  Returns 0 on success and
+ * non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int ttp_request_start_rate(ttp_session_t *session, u_int32_t rate)
+{
+    retransmission_t retransmission = { 0, 0, 0 };
+    int              status;
+
+    /* initialize the retransmission structure */
+    retransmission.request_type = htons(REQUEST_START_RATE);
+    retransmission.error_rate   = htonl(rate / 1000);
+
+    /* send out the request */
+    status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
+    if ((status <= 0) || fflush(session->server))
+       return warn("Could not request start rate");
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int ttp_request_stall_notices(ttp_session_t *session);
+ *
+ * Asks the server to send a TS_BLOCK_STALL datagram whenever it stalls
+ * in reading the file, so that the silence is not taken for loss.  This
+ * is done by sending a request with a type of REQUEST_STALL_NOTICE,
+ * which servers that don't know it merely warn about.  Returns 0 on
+ * success and non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int ttp_request_stall_notices(ttp_session_t *session)
+{
+    retransmission_t retransmission = { 0, 0, 0 };
+    int              status;
+
+    /* initialize the retransmission structure */
+    retransmission.request_type = htons(REQUEST_STALL_NOTICE);
+
+    /* send out the request */
+    status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
+    if ((status <= 0) || fflush(session->server))
+       return warn("Could not request read stall notices");
+
+    /* we succeeded */
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------
  * int ttp_request_stop(ttp_session_t *session);
  *
@@ -533,6 +981,93 @@ int ttp_request_stop(ttp_session_t *session)
 }
 
 
+/*------------------------------------------------------------------------
+ * int ttp_acknowledge(ttp_session_t *session);
+ *
+ * Tells the server which blocks of the current transfer we already
+ * have, so that it can leave them out when it restarts the transfer at
+ * an earlier block and ignore stale retransmission requests for them.
+ * This is done by sending requests with a type of REQUEST_SACK, each of
+ * which carries the first and the last block of a received range in its
+ * block and error rate fields: one for everything up to the gapless
+ * block, and up to MAX_SACK_RANGES for the ranges received above it.
+ * Only lossless transfers are acknowledged, as the gapless block of the
+ * lossy modes also covers blocks that were given up.  Returns 0 on
+ * success and non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int ttp_acknowledge(ttp_session_t *session)
+{
+    retransmission_t  ack[MAX_SACK_RANGES + 1];
+    ttp_transfer_t   *xfer  = &session->transfer;
+    u_int32_t         last  = min(xfer->next_block, xfer->block_count);
+    u_int32_t         block, first;
+    int               count = 0;
+    int               status;
+
+    if (!session->parameter->lossless)
+        return 0;
+    memset(ack, 0, sizeof(ack));
+
+    /* everything up to the gapless block */
+    if (xfer->gapless_to_block > 0) {
+        ack[count].request_type = htons(REQUEST_SACK);
+        ack[count].block        = htonl(1);
+        ack[count].error_rate   = htonl(xfer->gapless_to_block);
+        ++count;
+    }
+
+    /* and the runs of received blocks above it, the block after it is missing */
+    for (block = xfer->gapless_to_block + 2; (block <= last) && (count <= MAX_SACK_RANGES); ++block) {
+        if (!got_block(session, block))
+            continue;
+        for (first = block; (block < last) && got_block(session, block + 1); ++block)
+            ;
+        ack[count].request_type = htons(REQUEST_SACK);
+        ack[count].block        = htonl(first);
+        ack[count].error_rate   = htonl(block);
+        ++count;
+    }
+
+    /* send out the ranges */
+    if (count > 0) {
+        status = fwrite(ack, sizeof(retransmission_t), count, session->server);
+        if ((status <= 0) || fflush(session->server))
+            return warn("Could not acknowledge received blocks");
+    }
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int ttp_request_timestamps(ttp_session_t *session);
+ *
+ * Asks the server to stamp the time it sends each block at into the
+ * block, so that the one-way delay of the path can be followed.  This
+ * is done by sending a request with a type of REQUEST_TIMESTAMPS,
+ * which servers that don't know it merely warn about; their blocks
+ * then simply come without the stamp.  Returns 0 on success and
+ * non-zero otherwise.
+ *------------------------------------------------------------------------*/
+int ttp_request_timestamps(ttp_session_t *session)
+{
+    retransmission_t retransmission = { 0, 0, 0 };
+    int              status;
+
+    /* initialize the retransmission structure */
+    retransmission.request_type = htons(REQUEST_TIMESTAMPS);
+
+    /* send out the request */
+    status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
+    if ((status <= 0) || fflush(session->server))
+       return warn("Could not request block time stamps");
+
+    /* we succeeded */
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------
  * int ttp_update_stats(ttp_session_t *session);
  *
@@ -557,11 +1092,19 @@ int ttp_update_stats(ttp_session_t *session)
     double            retransmits_fraction;                   /* how many retransmit requests there were vs received blocks */
     double            total_retransmits_fraction;
     double            ringfill_fraction;
+    double            this_disk_rate;                         /* the rate the disk wrote at this interval (bps) */
+    double            queueing;                               /* the queueing delay of this interval (usec)     */
+    double            delay_error = 0.0;                      /* that delay as an error rate (% x 1000)         */
+    u_int32_t         disk_blocks;
+    u_int64_t         disk_usec;
+    ring_buffer_t    *ring = session->transfer.ring_buffer;
+    int               ring_count = 0;       /* blocks in the ring, none for the null sink */
+    int               ring_space = 1;       /* 0 while the ring is full                   */
     statistics_t     *stats = &(session->transfer.stats);
     retransmission_t  retransmission;
     int               status;
     static u_int32_t  iteration = 0;
-    static char       stats_line[128];
+    static char       stats_line[160];
     static char       stats_flags[8];
 
     double ff, fb;
@@ -590,9 +1133,15 @@ int ttp_update_stats(ttp_session_t *session)
     /* get the current UDP receive error count reported by the operating system */
     stats->this_udp_errors = get_udp_in_errors();
 
+    /* look at the ring buffer, if the sink has one */
+    if (ring != NULL) {
+        ring_count = ring->count_data;
+        ring_space = ring->space_ready;
+    }
+
     /* precalculate some fractions */
     retransmits_fraction = stats->this_retransmits / (1.0 + stats->this_retransmits + stats->total_blocks - stats->this_blocks);
-    ringfill_fraction    = session->transfer.ring_buffer->count_data / MAX_BLOCKS_QUEUED;
+    ringfill_fraction    = (ring != NULL) ? ring_count / (double) ring->slots : 0.0;
     total_retransmits_fraction = stats->total_retransmits / (stats->total_retransmits + stats->total_blocks);
 
     /* update the rate statistics */
@@ -607,26 +1156,63 @@ int ttp_update_stats(ttp_session_t *session)
     // IIR filter rate R
     stats->transmit_rate = fb * stats->transmit_rate + ff * stats->this_transmit_rate;
 
-    // IIR filtered composite error and loss, some sort of knee function
-    stats->error_rate = fb * stats->error_rate + ff * 500*100 * (retransmits_fraction + ringfill_fraction);
-        
+    // IIR filter the rate the disk can write, from the time the disk thread spent on its blocks
+    if (ring != NULL) {
+        disk_blocks = ring->disk_blocks - stats->this_disk_blocks;
+        disk_usec   = ring->disk_usec   - stats->this_disk_usec;
+        if ((disk_blocks >= DISK_SAMPLE_BLOCKS) && (disk_usec > 0)) {
+            this_disk_rate   = 8e6 * session->parameter->block_size * disk_blocks / disk_usec;
+            stats->disk_rate = (stats->disk_rate > 0) ? fb * stats->disk_rate + ff * this_disk_rate : this_disk_rate;
+            stats->this_disk_blocks += disk_blocks;
+            stats->this_disk_usec   += disk_usec;
+        }
+    }
+
+    // IIR filtered composite error and loss, see ratecontrol.c, without the requests repeated while the server stalled
+    stats->error_rate = ratecontrol_error(stats->error_rate, session->parameter->history,
+                                          (stats->this_stalls > 0) ? 0.0 : retransmits_fraction, ringfill_fraction);
+
+    // queueing delay from the one-way delay of the stamped blocks, a growing queue counts as error before it overflows
+    queueing = ratecontrol_owd_update(&stats->owd, now_epoch);
+    if (queueing >= 0) {
+        stats->queueing_delay = queueing;
+        stats->queueing_sum  += queueing;
+        stats->queueing_max   = max(stats->queueing_max, queueing);
+        stats->queueing_intervals++;
+        delay_error = ratecontrol_delay_error(queueing, 1000 * session->parameter->delay_target, session->parameter->error_rate);
+    }
+
     /* send the current error rate information to the server */
     memset(&retransmission, 0, sizeof(retransmission));
     retransmission.request_type = htons(REQUEST_ERROR_RATE);
-    retransmission.error_rate   = htonl((u_int64_t) session->transfer.stats.error_rate);
+    retransmission.error_rate   = htonl((u_int64_t) max(stats->error_rate, delay_error));
     status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
     if ((status <= 0) || fflush(session->server))
         return warn("Could not send error rate information");
 
+    /* and the rate the disk can keep up with, as a ceiling of the server rate */
+    if (stats->disk_rate > 0) {
+        stats->disk_ceiling = ratecontrol_disk_ceiling(stats->disk_rate, ringfill_fraction);
+        memset(&retransmission, 0, sizeof(retransmission));
+        retransmission.request_type = htons(REQUEST_DISK_RATE);
+        retransmission.error_rate   = htonl(stats->disk_ceiling);
+        status = fwrite(&retransmission, sizeof(retransmission), 1, session->server);
+        if ((status <= 0) || fflush(session->server))
+            return warn("Could not send disk rate information");
+    }
+
     /* build the stats string */    
-    sprintf(stats_flags, "%c%c",
+    sprintf(stats_flags, "%c%c%c%c%c",
                ((session->transfer.restart_pending) ? 'R' : '-'),
-               (!(session->transfer.ring_buffer->space_ready) ? 'F' : '-')
+               (!ring_space ? 'F' : '-'),
+               ((stats->disk_ceiling > 0) && (1000.0 * stats->disk_ceiling < 1.1 * stats->this_transmit_rate * u_mega) ? 'D' : '-'),
+               ((stats->this_stalls > 0) ? 'S' : '-'),
+               ((delay_error > stats->error_rate) ? 'Q' : '-')
     );
     #ifdef STATS_MATLABFORMAT
-    sprintf(stats_line, "%02d\t%02d\t%02d\t%03d\t%4u\t%6.2f\t%6.1f\t%5.1f\t%7u\t%6.1f\t%6.1f\t%5.1f\t%5d\t%5d\t%7u\t%8u\t%8Lu\t%s\n",
+    sprintf(stats_line, "%02d\t%02d\t%02d\t%03d\t%4u\t%6.2f\t%6.1f\t%5.1f\t%7u\t%6.1f\t%6.1f\t%5.1f\t%5d\t%5d\t%7u\t%8u\t%8Lu\t%5u\t%s\n",
     #else
-    sprintf(stats_line, "%02d:%02d:%02d.%03d %4u %6.2fM %6.1fMbps %5.1f%% %7u %6.1fG %6.1fMbps %5.1f%% %5d %5d %7u %8u %8Lu %s\n",
+    sprintf(stats_line, "%02d:%02d:%02d.%03d %4u %6.2fM %6.1fMbps %5.1f%% %7u %6.1fG %6.1fMbps %5.1f%% %5d %5d %7u %8u %8Lu %5u %s\n",
     #endif
         hours, minutes, seconds, milliseconds,
         stats->total_blocks - stats->this_blocks,
@@ -638,10 +1224,11 @@ int ttp_update_stats(ttp_session_t *session)
         data_total_rate,
         100.0 * total_retransmits_fraction,
         session->transfer.retransmit.index_max,
-        session->transfer.ring_buffer->count_data,
+        ring_count,
         session->transfer.blocks_left, 
         stats->this_retransmits,
         (ull_t)(stats->this_udp_errors - stats->start_udp_errors),
+        stats->this_spurious,
         stats_flags
         );
 
@@ -657,12 +1244,15 @@ int ttp_update_stats(ttp_session_t *session)
             printf("Blocks count:     %u\n",             stats->total_blocks - stats->this_blocks);
             printf("Data transferred: %0.2f GB\n",       data_this  / u_giga);
             printf("Transfer rate:    %0.2f Mbps\n",     stats->this_transmit_rate);
-            printf("Retransmissions:  %u (%0.2f%%)\n\n", stats->this_retransmits, 100.0*retransmits_fraction);
+            printf("Retransmissions:  %u (%0.2f%%)\n",   stats->this_retransmits, 100.0*retransmits_fraction);
+            printf("Spurious:         %u\n",             stats->this_spurious);
+            printf("Queueing delay:   %0.2f ms\n\n",     stats->queueing_delay / 1e3);
             printf("Cumulative\n--------------------------------------------------\n");
             printf("Blocks count:     %u\n",             session->transfer.stats.total_blocks);
             printf("Data transferred: %0.2f GB\n",       data_total / u_giga);
             printf("Transfer rate:    %0.2f Mbps\n",     data_total_rate);
             printf("Retransmissions:  %u (%0.2f%%)\n",   stats->total_retransmits, 100.0*total_retransmits_fraction);
+            printf("Spurious:         %u (%u blocks late)\n", stats->total_spurious, stats->total_reordered);
             printf("Flags          :  %s\n\n",           stats_flags);
             printf("OS UDP rx errors: %llu\n",           (ull_t)(stats->this_udp_errors - stats->start_udp_errors));
 
@@ -673,7 +1263,7 @@ int ttp_update_stats(ttp_session_t *session)
             #ifndef STATS_NOHEADER
             if (!(iteration++ % 23)) {
                 printf("             last_interval                   transfer_total                   buffers      transfer_remaining  OS UDP\n");
-                printf("time          blk    data       rate rexmit     blk    data       rate rexmit queue  ring     blk   rt_len      err \n");
+                printf("time          blk    data       rate rexmit     blk    data       rate rexmit queue  ring     blk   rt_len      err  spur\n");
             }
             #endif
             printf("%s", stats_line);
@@ -690,6 +1280,8 @@ int ttp_update_stats(ttp_session_t *session)
     /* reset the statistics for the next interval */
     stats->this_blocks              = stats->total_blocks;
     stats->this_retransmits         = 0;
+    stats->this_spurious            = 0;
+    stats->this_stalls              = 0;
     stats->this_flow_originals      = 0;
     stats->this_flow_retransmitteds = 0;
     gettimeofday(&(stats->this_time), NULL);
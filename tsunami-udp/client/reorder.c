@@ -0,0 +1,190 @@
+/*========================================================================
+ * reorder.c  --  reordering-tolerant loss detection for the Tsunami client.
+ *
+ * Gaps in the sequence of original blocks are held here as suspected
+ * loss until enough later blocks, or enough time, have gone by for a
+ * reordered block to have turned up.  Only then are the blocks that are
+ * still missing put into the retransmission table.  The window adapts to
+ * the amount of reordering that is actually seen on the path.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <stdlib.h>    /* for malloc(), free(), etc.   */
+#include <string.h>    /* for memcpy()                 */
+#include <sys/time.h>  /* for gettimeofday()           */
+
+#include <tsunami-client.h>
+
+
+/*------------------------------------------------------------------------
+ * int reorder_suspect(ttp_session_t *session, u_int32_t first,
+ *                     u_int32_t last);
+ *
+ * Holds the blocks from first to last, which were skipped by a later
+ * original block, as suspected loss.  Returns 0 on success and nonzero
+ * on failure.
+ *------------------------------------------------------------------------*/
+int reorder_suspect(ttp_session_t *session, u_int32_t first, u_int32_t last)
+{
+    reorder_t *reorder = &session->transfer.reorder;
+    suspect_t *gaps;
+    u_int32_t  index;
+
+    /* grow the ring, oldest gap first */
+    if (reorder->count == reorder->size) {
+        gaps = (suspect_t *) malloc(2 * reorder->size * sizeof(suspect_t));
+        if (gaps == NULL)
+            return warn("Could not grow the table of suspected gaps");
+        for (index = 0; index < reorder->count; ++index)
+            gaps[index] = reorder->gaps[(reorder->head + index) % reorder->size];
+        free(reorder->gaps);
+        reorder->gaps  = gaps;
+        reorder->head  = 0;
+        reorder->size *= 2;
+    }
+
+    /* add the gap */
+    index = (reorder->head + reorder->count) % reorder->size;
+    reorder->gaps[index].first    = first;
+    reorder->gaps[index].last     = last;
+    reorder->gaps[index].arrivals = session->transfer.stats.total_blocks;
+    gettimeofday(&reorder->gaps[index].seen, NULL);
+    ++reorder->count;
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int reorder_release(ttp_session_t *session, int all);
+ *
+ * Moves the blocks of the suspected gaps that were followed by the
+ * window of later blocks, or were held for the reorder wait time, into
+ * the retransmission table if they are still missing.  With a nonzero
+ * 'all' every gap is released, e.g. at the end of the transfer.
+ * Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int reorder_release(ttp_session_t *session, int all)
+{
+    ttp_transfer_t *xfer    = &session->transfer;
+    reorder_t      *reorder = &xfer->reorder;
+    suspect_t      *gap;
+    u_int32_t       block;
+
+    while (reorder->count > 0) {
+        gap = &reorder->gaps[reorder->head];
+
+        /* stop at the first gap that may still be reordering */
+        if (!all && (xfer->stats.total_blocks - gap->arrivals < reorder->window) &&
+            (get_usec_since(&gap->seen) < 1000LL * session->parameter->reorder_ms))
+            break;
+
+        /* request what is still missing */
+        for (block = gap->first; block <= gap->last; ++block)
+            if (ttp_request_retransmit(session, block) < 0)
+                return warn("Retransmission request failed");
+
+        reorder->head = (reorder->head + 1) % reorder->size;
+        --reorder->count;
+    }
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void reorder_arrival(ttp_session_t *session, u_int32_t block);
+ *
+ * Notes an original block that arrived after a later original block,
+ * and widens the window to half again the largest such distance seen
+ * recently, up to MAX_REORDER_WINDOW blocks.
+ *------------------------------------------------------------------------*/
+void reorder_arrival(ttp_session_t *session, u_int32_t block)
+{
+    ttp_transfer_t *xfer     = &session->transfer;
+    reorder_t      *reorder  = &xfer->reorder;
+    u_int32_t       distance = xfer->next_block - 1 - block;
+
+    ++xfer->stats.total_reordered;
+    if (distance > reorder->extent) {
+        reorder->extent = distance;
+        reorder->window = max(reorder->window, min(distance + distance / 2, MAX_REORDER_WINDOW));
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * void reorder_decay(ttp_session_t *session);
+ *
+ * Lets the measured reordering extent fade by an eighth every update
+ * period, so that the window shrinks back towards the configured one
+ * once the path stops reordering.
+ *------------------------------------------------------------------------*/
+void reorder_decay(ttp_session_t *session)
+{
+    reorder_t *reorder = &session->transfer.reorder;
+
+    reorder->extent -= reorder->extent / 8;
+    reorder->window  = max((u_int32_t) session->parameter->reorder, min(reorder->extent + reorder->extent / 2, MAX_REORDER_WINDOW));
+}
+
+
+/*========================================================================
+ * $Log$
+ */
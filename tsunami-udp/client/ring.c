@@ -179,7 +179,8 @@ int ring_confirm(ring_buffer_t *ring)
  * Creates the ring buffer data structure for a Tsunami transfer and
  * returns a pointer to the new data structure.  Returns NULL if
  * allocation and initialization failed.  The new ring buffer will hold
- * ([6 + block_size] * MAX_BLOCKS_QUEUED datagrams.
+ * ring_slots datagrams of the transfer, each [6 + block_size] bytes, in
+ * a buffer pool that aligns the block data behind the 6 byte headers.
  *------------------------------------------------------------------------*/
 ring_buffer_t *ring_create(ttp_session_t *session)
 {
@@ -193,9 +194,12 @@ ring_buffer_t *ring_create(ttp_session_t *session)
 
     /* try to allocate the buffer */
     ring->datagram_size = 6 + session->parameter->block_size;
-    ring->datagrams = (u_char *) malloc(ring->datagram_size * MAX_BLOCKS_QUEUED);
-    if (ring->datagrams == NULL)
+    ring->slots     = session->transfer.ring_slots;
+    if (bufpool_create(&ring->pool, ring->slots, session->parameter->block_size, 6) < 0)
 	error("Could not allocate buffer for ring buffer");
+    if (session->parameter->verbose_yn)
+	printf("Ring buffer of %d blocks (%0.1f MB) in %s\n", ring->slots,
+	       ring->pool.length / (1024.0 * 1024.0), bufpool_backing(&ring->pool));
 
     /* create the mutex */
     status = pthread_mutex_init(&ring->mutex, NULL);
@@ -249,7 +253,7 @@ int ring_destroy(ring_buffer_t *ring)
 	return warn("Could not destroy space-ready condition variable");
 
     /* free the memory used */
-    free(ring->datagrams);
+    bufpool_destroy(&ring->pool);
     free(ring);
 
     /* we succeeded */
@@ -285,7 +289,7 @@ int ring_dump(ring_buffer_t *ring, FILE *out)
     /* print out the block list */
     fprintf(out, "block list     = [");
     for (index = ring->base_data; index < ring->base_data + ring->count_data; ++index) {
-	datagram = ring->datagrams + ((index % MAX_BLOCKS_QUEUED) * ring->datagram_size);
+	datagram = bufpool_slot(&ring->pool, index % ring->slots);
 	fprintf(out, "%d ", ntohl(*((u_int32_t *) datagram)));
     }
     fprintf(out, "]\n");
@@ -328,7 +332,7 @@ u_char *ring_peek(ring_buffer_t *ring)
     }
 
     /* find the address we want */
-    address = ring->datagrams + (ring->datagram_size * ring->base_data);
+    address = bufpool_slot(&ring->pool, ring->base_data);
 
     /* release the mutex */
     status = pthread_mutex_unlock(&ring->mutex);
@@ -368,7 +372,7 @@ int ring_pop(ring_buffer_t *ring)
     }
 
     /* perform the pop operation */
-    ring->base_data = (ring->base_data + 1) % MAX_BLOCKS_QUEUED;
+    ring->base_data = (ring->base_data + 1) % ring->slots;
     if (--(ring->count_data) == 0)
 	ring->data_ready = 0;
 
@@ -408,7 +412,7 @@ u_char *ring_reserve(ring_buffer_t *ring)
 	error("Could not get access to ring buffer mutex");
 
     /* figure out which slot comes next */
-    next = (ring->base_data + ring->count_data + ring->count_reserved) % MAX_BLOCKS_QUEUED;
+    next = (ring->base_data + ring->count_data + ring->count_reserved) % ring->slots;
 
     /* wait for the space-ready variable to make us happy */
     while (ring->space_ready == 0) {
@@ -422,11 +426,11 @@ u_char *ring_reserve(ring_buffer_t *ring)
     /* perform the reservation */
     if (++(ring->count_reserved) > 1)
 	error("Attempt made to reserve two slots in ring buffer");
-    if (((next + 1) % MAX_BLOCKS_QUEUED) == ring->base_data)
+    if (((next + 1) % ring->slots) == ring->base_data)
 	ring->space_ready = 0;
 
     /* find the address we want */
-    address = ring->datagrams + (next * ring->datagram_size);
+    address = bufpool_slot(&ring->pool, next);
 
     /* release the mutex */
     status = pthread_mutex_unlock(&ring->mutex);
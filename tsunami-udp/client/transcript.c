@@ -171,6 +171,10 @@ void xscript_open(ttp_session_t *session)
     fprintf(xfer->transcript, "lossless = %u\n",        param->lossless);
     fprintf(xfer->transcript, "losswindow = %u\n",      param->losswindow_ms);
     fprintf(xfer->transcript, "blockdump = %u\n",       param->blockdump);
+    fprintf(xfer->transcript, "faststart = %u\n",       param->faststart);
+    fprintf(xfer->transcript, "reorder = %u\n",         param->reorder);
+    fprintf(xfer->transcript, "reorderwait = %u\n",     param->reorder_ms);
+    fprintf(xfer->transcript, "rtt_usec = %u\n",        xfer->rtt_usec);
     fprintf(xfer->transcript, "update_period = %llu\n", UPDATE_PERIOD);
     fprintf(xfer->transcript, "rexmit_period = %llu\n", UPDATE_PERIOD);
     fprintf(xfer->transcript, "protocol_version = 0x%x\n", PROTOCOL_REVISION);
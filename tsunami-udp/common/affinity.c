@@ -0,0 +1,358 @@
+/*========================================================================
+ * affinity.c  --  CPU and NUMA placement of the transfer threads.
+ *
+ * This pins the receive loop and disk thread of the client and the
+ * sending server process to a set of CPUs.  By default that is the set
+ * of the NUMA node that the network interface of the transfer hangs off,
+ * as the kernel reports it in /sys, so that the blocks are received and
+ * handled next to the NIC.  Buffers that are allocated and first touched
+ * after pinning end up in the memory of the same node.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for sched_setaffinity() and cpu_set_t */
+#endif
+
+#include <ifaddrs.h>    /* for getifaddrs()                  */
+#include <netinet/in.h> /* for struct sockaddr_in, et al.    */
+#include <sched.h>      /* for sched_setaffinity(), etc.     */
+#include <stdlib.h>     /* for strtol()                      */
+#include <string.h>     /* for string-handling routines      */
+#include <unistd.h>     /* for access()                      */
+
+#include "tsunami.h"
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines and variables.
+ *------------------------------------------------------------------------*/
+
+#if defined(CPU_SET) && defined(__linux__)
+static int       parse_cpus   (const char *list, cpu_set_t *set);
+static int       read_sysfs   (const char *path, char *buffer, size_t length);
+static int       device_of    (int fd, char *device, size_t length);
+static int       node_count   (void);
+
+static cpu_set_t original;          /* the CPUs we were allowed to use before pinning */
+static int       original_saved = 0;
+#endif
+
+
+/*------------------------------------------------------------------------
+ * int affinity_resolve(const char *spec, int fd, affinity_t *placement);
+ *
+ * Works out the CPUs that a thread should be pinned to from the given
+ * setting, which is 'none' for no pinning, a CPU list like '0-3,8', a
+ * NUMA node like 'node1', or 'auto' for the node of the network
+ * interface that carries the given connected socket.  On machines with
+ * a single node, or if that interface has no node (e.g. loopback),
+ * 'auto' does not pin.  Returns 0 on success and nonzero if the
+ * setting can not be used.
+ *------------------------------------------------------------------------*/
+int affinity_resolve(const char *spec, int fd, affinity_t *placement)
+{
+    memset(placement, 0, sizeof(*placement));
+    placement->node = -1;
+
+    /* no pinning wanted */
+    if ((spec == NULL) || (*spec == '\0') || !strcmp(spec, "none"))
+        return 0;
+
+    #if defined(CPU_SET) && defined(__linux__)
+    {
+        char      path[128];
+        cpu_set_t set;
+
+        /* the node of the network interface, if it matters */
+        if (!strcmp(spec, "auto")) {
+            if (device_of(fd, placement->device, sizeof(placement->device)) < 0)
+                return 0;
+            sprintf(path, "/sys/class/net/%s/device/numa_node", placement->device);
+            if (read_sysfs(path, placement->cpus, sizeof(placement->cpus)) < 0)
+                return 0;
+            placement->node    = atoi(placement->cpus);
+            placement->cpus[0] = '\0';
+            if ((placement->node < 0) || (node_count() < 2))
+                return 0;
+            spec = NULL;
+
+        /* a node asked for by number */
+        } else if (!strncmp(spec, "node", 4)) {
+            placement->node = atoi(spec + 4);
+            spec = NULL;
+        }
+
+        /* the CPUs of the node */
+        if (spec == NULL) {
+            sprintf(path, "/sys/devices/system/node/node%d/cpulist", placement->node);
+            if (read_sysfs(path, placement->cpus, sizeof(placement->cpus)) < 0) {
+                sprintf(g_error, "NUMA node %d does not exist", placement->node);
+                placement->node = -1;
+                return warn(g_error);
+            }
+            return 0;
+        }
+
+        /* or the given CPU list */
+        if ((strlen(spec) >= sizeof(placement->cpus)) || (parse_cpus(spec, &set) < 0)) {
+            sprintf(g_error, "Invalid CPU list '%s', use e.g. '0-3,8', 'node1', 'auto' or 'none'", spec);
+            return warn(g_error);
+        }
+        strcpy(placement->cpus, spec);
+        return 0;
+    }
+    #else
+    if (!strcmp(spec, "auto"))
+        return 0;
+    return warn("CPU affinity is not supported on this system");
+    #endif
+}
+
+
+/*------------------------------------------------------------------------
+ * int affinity_pin(const affinity_t *placement);
+ *
+ * Pins the calling thread to the CPUs of the given placement, if it
+ * has any.  The CPUs the process could use before are remembered the
+ * first time, for affinity_restore().  Returns 0 on success and
+ * nonzero on failure.
+ *------------------------------------------------------------------------*/
+int affinity_pin(const affinity_t *placement)
+{
+    #if defined(CPU_SET) && defined(__linux__)
+    cpu_set_t set;
+
+    if (placement->cpus[0] == '\0')
+        return 0;
+    if (parse_cpus(placement->cpus, &set) < 0)
+        return warn("Invalid CPU list");
+
+    /* remember where we were allowed to run */
+    if (!original_saved && (sched_getaffinity(0, sizeof(original), &original) == 0))
+        original_saved = 1;
+
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        sprintf(g_error, "Could not pin the thread to CPUs %s", placement->cpus);
+        return warn(g_error);
+    }
+    #endif
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void affinity_restore(void);
+ *
+ * Lets the calling thread run on the CPUs that the process could use
+ * before the first affinity_pin() again.
+ *------------------------------------------------------------------------*/
+void affinity_restore(void)
+{
+    #if defined(CPU_SET) && defined(__linux__)
+    if (original_saved)
+        sched_setaffinity(0, sizeof(original), &original);
+    #endif
+}
+
+
+/*------------------------------------------------------------------------
+ * char *affinity_describe(const affinity_t *placement, char *buffer,
+ *                         size_t length);
+ *
+ * Describes the given placement in the buffer, e.g. "CPUs 0-7 (node 0
+ * of eth2)", and returns the buffer.
+ *------------------------------------------------------------------------*/
+char *affinity_describe(const affinity_t *placement, char *buffer, size_t length)
+{
+    if (placement->cpus[0] == '\0')
+        snprintf(buffer, length, "any CPU");
+    else if (placement->device[0] != '\0')
+        snprintf(buffer, length, "CPUs %s (node %d of %s)", placement->cpus, placement->node, placement->device);
+    else if (placement->node >= 0)
+        snprintf(buffer, length, "CPUs %s (node %d)", placement->cpus, placement->node);
+    else
+        snprintf(buffer, length, "CPUs %s", placement->cpus);
+    return buffer;
+}
+
+
+#if defined(CPU_SET) && defined(__linux__)
+
+/*------------------------------------------------------------------------
+ * int parse_cpus(const char *list, cpu_set_t *set);
+ *
+ * Parses a CPU list in the format of /sys and taskset -c, such as
+ * "0-3,8,10-11", into the given set.  Returns 0 on success and -1 if
+ * the list is malformed or empty.
+ *------------------------------------------------------------------------*/
+int parse_cpus(const char *list, cpu_set_t *set)
+{
+    char *end;
+    long  first, last;
+
+    CPU_ZERO(set);
+    while (*list != '\0') {
+        first = strtol(list, &end, 10);
+        if ((end == list) || (first < 0))
+            return -1;
+        last = first;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if ((end == list) || (last < first))
+                return -1;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (; first <= last; ++first)
+            CPU_SET(first, set);
+        if ((*end != ',') && (*end != '\0') && (*end != '\n'))
+            return -1;
+        list = (*end == ',') ? end + 1 : end + strlen(end);
+    }
+    return (CPU_COUNT(set) > 0) ? 0 : -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * int read_sysfs(const char *path, char *buffer, size_t length);
+ *
+ * Reads the first line of the given /sys file into the buffer, without
+ * the newline.  Returns 0 on success and -1 if there is no such file.
+ *------------------------------------------------------------------------*/
+int read_sysfs(const char *path, char *buffer, size_t length)
+{
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+        return -1;
+    if (fgets(buffer, length, file) == NULL) {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int device_of(int fd, char *device, size_t length);
+ *
+ * Finds the name of the network interface that has the local address
+ * of the given connected socket.  Returns 0 on success and -1 if there
+ * is none.
+ *------------------------------------------------------------------------*/
+int device_of(int fd, char *device, size_t length)
+{
+    struct sockaddr_storage local;
+    socklen_t               local_length = sizeof(local);
+    struct ifaddrs         *interfaces, *entry;
+    int                     found = -1;
+
+    if (getsockname(fd, (struct sockaddr *) &local, &local_length) < 0)
+        return -1;
+    if (getifaddrs(&interfaces) < 0)
+        return -1;
+
+    for (entry = interfaces; (entry != NULL) && (found < 0); entry = entry->ifa_next) {
+        if ((entry->ifa_addr == NULL) || (entry->ifa_addr->sa_family != local.ss_family))
+            continue;
+        if (local.ss_family == AF_INET) {
+            if (((struct sockaddr_in *) entry->ifa_addr)->sin_addr.s_addr != ((struct sockaddr_in *) &local)->sin_addr.s_addr)
+                continue;
+        } else if (local.ss_family == AF_INET6) {
+            if (memcmp(&((struct sockaddr_in6 *) entry->ifa_addr)->sin6_addr, &((struct sockaddr_in6 *) &local)->sin6_addr,
+                       sizeof(struct in6_addr)))
+                continue;
+        } else {
+            continue;
+        }
+        snprintf(device, length, "%s", entry->ifa_name);
+        found = 0;
+    }
+
+    freeifaddrs(interfaces);
+    return found;
+}
+
+
+/*------------------------------------------------------------------------
+ * int node_count(void);
+ *
+ * Returns the number of NUMA nodes of the machine, 1 if it has none.
+ *------------------------------------------------------------------------*/
+int node_count(void)
+{
+    char path[64];
+    int  count = 1;
+
+    for (;;) {
+        sprintf(path, "/sys/devices/system/node/node%d", count);
+        if (access(path, F_OK) < 0)
+            return count;
+        ++count;
+    }
+}
+
+#endif
+
+
+/*========================================================================
+ * $Log$
+ */
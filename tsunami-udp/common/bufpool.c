@@ -0,0 +1,237 @@
+/*========================================================================
+ * bufpool.c  --  Aligned datagram buffer pools shared by client and server.
+ *
+ * This allocates the memory for the datagrams that are received into the
+ * client ring buffer or built by the server, as an array of equal slots.
+ * The 6 byte block header of each datagram is padded in front of its
+ * payload, so that every payload starts on a cache line, or on a page when
+ * the block size is a multiple of the page size (as O_DIRECT wants it).
+ * Large pools are backed by huge pages where the system has them, to keep
+ * the TLB misses of a ring of many megabytes down.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <stdlib.h>     /* for posix_memalign() and free()   */
+#include <string.h>     /* for memset()                      */
+#include <unistd.h>     /* for sysconf()                     */
+#include <sys/mman.h>   /* for mmap(), madvise() and munmap() */
+
+#include "tsunami.h"
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static int    bufpool_map(bufpool_t *pool, u_int32_t slots, u_int32_t payload_size, u_int32_t header_size, int shared);
+static size_t round_up(size_t value, size_t unit);
+
+
+/*------------------------------------------------------------------------
+ * int bufpool_create(bufpool_t *pool, u_int32_t slots,
+ *                    u_int32_t payload_size, u_int32_t header_size);
+ *
+ * Allocates a pool of the given number of slots, each holding a header
+ * of header_size bytes directly in front of a payload of payload_size
+ * bytes.  The payloads are aligned to BUFPOOL_CACHE_LINE bytes, or to
+ * the page size if payload_size is a multiple of it.  Pools of at least
+ * BUFPOOL_HUGE_PAGE bytes are mapped in huge pages if there are any
+ * reserved, and else advised to use transparent huge pages.  Returns 0
+ * on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int bufpool_create(bufpool_t *pool, u_int32_t slots, u_int32_t payload_size, u_int32_t header_size)
+{
+    return bufpool_map(pool, slots, payload_size, header_size, 0);
+}
+
+
+/*------------------------------------------------------------------------
+ * int bufpool_create_shared(bufpool_t *pool, u_int32_t slots,
+ *                           u_int32_t payload_size, u_int32_t header_size);
+ *
+ * Like bufpool_create(), but the pool is mapped shared, so that child
+ * processes forked later see the same memory.  There is no fallback to
+ * the heap.  Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int bufpool_create_shared(bufpool_t *pool, u_int32_t slots, u_int32_t payload_size, u_int32_t header_size)
+{
+    return bufpool_map(pool, slots, payload_size, header_size, 1);
+}
+
+
+/*------------------------------------------------------------------------
+ * int bufpool_map(bufpool_t *pool, u_int32_t slots, u_int32_t payload_size,
+ *                 u_int32_t header_size, int shared);
+ *
+ * Lays out and maps the pool for bufpool_create() and, if shared is
+ * nonzero, bufpool_create_shared().  Returns 0 on success and nonzero
+ * on failure.
+ *------------------------------------------------------------------------*/
+int bufpool_map(bufpool_t *pool, u_int32_t slots, u_int32_t payload_size, u_int32_t header_size, int shared)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t align;
+    size_t header_room;
+
+    memset(pool, 0, sizeof(*pool));
+
+    /* lay out the slots so that every payload is aligned */
+    align = ((payload_size >= page) && (payload_size % page == 0)) ? page : BUFPOOL_CACHE_LINE;
+    header_room     = round_up(header_size, align);
+    pool->slots     = slots;
+    pool->offset    = (u_int32_t) (header_room - header_size);
+    pool->slot_size = header_room + round_up(payload_size, align);
+    pool->length    = round_up((size_t) pool->slot_size * slots, page);
+
+    #if defined(MAP_ANONYMOUS)
+
+    /* try the reserved huge pages first, faulting them all in up front */
+    #if defined(MAP_HUGETLB)
+    if (pool->length >= BUFPOOL_HUGE_PAGE) {
+        size_t length = round_up(pool->length, BUFPOOL_HUGE_PAGE);
+        int    flags  = (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS | MAP_HUGETLB;
+        #if defined(MAP_POPULATE)
+        flags |= MAP_POPULATE;
+        #endif
+        pool->memory = (u_char *) mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (pool->memory != (u_char *) MAP_FAILED) {
+            pool->length  = length;
+            pool->backing = BUFPOOL_HUGE_PAGES;
+            return 0;
+        }
+    }
+    #endif
+
+    /* else map ordinary pages and let the kernel merge them if it can */
+    pool->memory = (u_char *) mmap(NULL, pool->length, PROT_READ | PROT_WRITE,
+                                   (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS, -1, 0);
+    if (pool->memory != (u_char *) MAP_FAILED) {
+        pool->backing = BUFPOOL_PAGES;
+        #if defined(MADV_HUGEPAGE)
+        if ((pool->length >= BUFPOOL_HUGE_PAGE) && (madvise(pool->memory, pool->length, MADV_HUGEPAGE) == 0))
+            pool->backing = BUFPOOL_TRANSPARENT_HUGE_PAGES;
+        #endif
+        return 0;
+    }
+
+    #endif
+
+    /* fall back to the heap, which a child process would not share */
+    if (shared) {
+        pool->memory = NULL;
+        return warn("Could not map shared buffer pool");
+    }
+    if (posix_memalign((void **) &pool->memory, page, pool->length) != 0) {
+        pool->memory = NULL;
+        return warn("Could not allocate buffer pool");
+    }
+    pool->backing = BUFPOOL_HEAP;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void bufpool_destroy(bufpool_t *pool);
+ *
+ * Releases the memory of the given pool, if it has any.
+ *------------------------------------------------------------------------*/
+void bufpool_destroy(bufpool_t *pool)
+{
+    if (pool->memory == NULL)
+        return;
+
+    #if defined(MAP_ANONYMOUS)
+    if (pool->backing != BUFPOOL_HEAP)
+        munmap(pool->memory, pool->length);
+    else
+    #endif
+        free(pool->memory);
+    pool->memory = NULL;
+}
+
+
+/*------------------------------------------------------------------------
+ * const char *bufpool_backing(const bufpool_t *pool);
+ *
+ * Returns a description of the memory that backs the given pool, for
+ * the verbose output.
+ *------------------------------------------------------------------------*/
+const char *bufpool_backing(const bufpool_t *pool)
+{
+    switch (pool->backing) {
+        case BUFPOOL_HUGE_PAGES:             return "huge pages";
+        case BUFPOOL_TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+        case BUFPOOL_PAGES:                  return "pages";
+        default:                             return "heap";
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * size_t round_up(size_t value, size_t unit);
+ *
+ * Returns the smallest multiple of the unit that is at least the value.
+ *------------------------------------------------------------------------*/
+size_t round_up(size_t value, size_t unit)
+{
+    return ((value + unit - 1) / unit) * unit;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
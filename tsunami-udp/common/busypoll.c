@@ -0,0 +1,433 @@
+/*========================================================================
+ * busypoll.c  --  Busy-polling UDP receive with wake-up latency statistics.
+ *
+ * This replaces the blocking recvfrom() of the client receive loop for
+ * latency-sensitive transfers.  After each datagram the loop keeps
+ * polling the socket without blocking for a while, backing off between
+ * attempts, and only sleeps in poll() when the stream went quiet for
+ * longer.  The kernel is asked to busy-poll the NIC queue as well.  It
+ * can also measure the wake-up latency of every datagram, i.e. the time
+ * between the kernel receiving it and the receive loop getting it.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <errno.h>      /* for errno                         */
+#include <fcntl.h>      /* for fcntl()                       */
+#include <poll.h>       /* for poll()                        */
+#include <string.h>     /* for memset()                      */
+#include <time.h>       /* for clock_gettime()               */
+
+#ifdef __linux__
+#include <linux/errqueue.h>  /* for struct scm_timestamping  */
+#include <linux/net_tstamp.h> /* for SOF_TIMESTAMPING_*      */
+#endif
+
+#include "tsunami.h"
+
+
+/*------------------------------------------------------------------------
+ * Module-scope definitions and routines.
+ *------------------------------------------------------------------------*/
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()  __asm__ __volatile__("pause")
+#elif defined(__aarch64__)
+#define cpu_relax()  __asm__ __volatile__("yield")
+#else
+#define cpu_relax()  do { } while (0)
+#endif
+
+static ssize_t receive     (busypoll_t *rx, int fd, void *buffer, size_t length, int flags);
+static void    add_latency (busypoll_t *rx, u_int32_t usec);
+static void    add_stamp   (busypoll_t *rx, const struct timespec *software, const struct timespec *hardware);
+
+
+/*------------------------------------------------------------------------
+ * int busypoll_setup(busypoll_t *rx, int fd, u_int32_t spin_usec,
+ *                    u_char latency, u_char stamps);
+ *
+ * Prepares the given UDP socket for busypoll_recv().  With a nonzero
+ * spin time the socket is made non-blocking and the kernel is asked to
+ * busy-poll the device queue for that long (SO_BUSY_POLL, and
+ * SO_PREFER_BUSY_POLL where it exists); this needs CAP_NET_ADMIN above
+ * net.core.busy_read, without it only the receive loop spins.  With
+ * the latency flag set the kernel stamps the datagrams with their
+ * arrival time.  With the stamps flag set the arrival time of each
+ * datagram is kept in rx->stamp, taken by the NIC where it does that
+ * (SO_TIMESTAMPING), else by the kernel, else after the receive.
+ * Returns 0 on success and nonzero if the kernel turned down one of
+ * the options.
+ *------------------------------------------------------------------------*/
+int busypoll_setup(busypoll_t *rx, int fd, u_int32_t spin_usec, u_char latency, u_char stamps)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->spin_usec = spin_usec;
+    rx->latency   = latency;
+    rx->stamps    = stamps;
+
+    return busypoll_add(rx, fd);
+}
+
+
+/*------------------------------------------------------------------------
+ * int busypoll_add(busypoll_t *rx, int fd);
+ *
+ * Gives another UDP socket the options of the receive mode set up by
+ * busypoll_setup(), so that busypoll_recv_any() can receive on it too.
+ * Returns 0 on success and nonzero if the kernel turned down one of
+ * the options.
+ *------------------------------------------------------------------------*/
+int busypoll_add(busypoll_t *rx, int fd)
+{
+    int value;
+    int status = 0;
+
+    if (rx->spin_usec > 0) {
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+            return warn("Could not make the UDP socket non-blocking");
+
+        #ifdef SO_BUSY_POLL
+        value = (int) rx->spin_usec;
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) == 0)
+            rx->kernel = 1;
+        else
+            status = warn("Kernel busy polling refused (needs CAP_NET_ADMIN), spinning in user space only");
+        #endif
+        #ifdef SO_PREFER_BUSY_POLL
+        value = 1;
+        if (rx->kernel)
+            setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value));
+        #endif
+    }
+
+    if (rx->latency || rx->stamps) {
+        #if defined(SO_TIMESTAMPING) && defined(SOF_TIMESTAMPING_RAW_HARDWARE)
+        value = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &value, sizeof(value)) == 0)
+            return status;
+        #endif
+        #ifdef SO_TIMESTAMPNS
+        value = 1;
+        if ((setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof(value)) < 0) && rx->latency) {
+            rx->latency = 0;
+            status = warn("Could not have the datagrams time stamped, no wake-up latency statistics");
+        }
+        #else
+        if (rx->latency) {
+            rx->latency = 0;
+            status = warn("Datagram time stamps are not supported, no wake-up latency statistics");
+        }
+        #endif
+    }
+
+    return status;
+}
+
+
+/*------------------------------------------------------------------------
+ * ssize_t busypoll_recv(busypoll_t *rx, int fd, void *buffer,
+ *                       size_t length);
+ *
+ * Receives the next datagram like recvfrom() on a blocking socket.  In
+ * busy-poll mode the socket is polled without blocking for up to the
+ * spin time, with a growing number of pause instructions between the
+ * attempts, before the call sleeps in poll().  Returns the length of
+ * the datagram, or -1 on error.
+ *------------------------------------------------------------------------*/
+ssize_t busypoll_recv(busypoll_t *rx, int fd, void *buffer, size_t length)
+{
+    return busypoll_recv_any(rx, &fd, 1, buffer, length, NULL);
+}
+
+
+/*------------------------------------------------------------------------
+ * ssize_t busypoll_recv_any(busypoll_t *rx, const int *fds,
+ *                           u_int32_t count, void *buffer,
+ *                           size_t length, u_int32_t *which);
+ *
+ * Receives the next datagram from any of the given (up to TS_MAX_PATHS)
+ * sockets, like busypoll_recv() does from one.  The sockets are tried
+ * in turn, starting after the one of the last datagram, so that a busy
+ * one doesn't starve the others.  The index of the socket the datagram
+ * came from is stored in 'which' unless that is NULL.  Returns the
+ * length of the datagram, or -1 on error.
+ *------------------------------------------------------------------------*/
+ssize_t busypoll_recv_any(busypoll_t *rx, const int *fds, u_int32_t count, void *buffer, size_t length, u_int32_t *which)
+{
+    struct timespec start, now;
+    struct pollfd   waiter[TS_MAX_PATHS];
+    u_int32_t       pauses = 1;
+    u_int32_t       index, next = 0;
+    int             slept  = 0;
+    ssize_t         status = -1;
+
+    /* the plain blocking receive */
+    count = min(count, TS_MAX_PATHS);
+    if ((rx->spin_usec == 0) && (count == 1)) {
+        if (which != NULL)
+            *which = 0;
+        return receive(rx, fds[0], buffer, length, 0);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (1) {
+
+        /* take a datagram if one of the sockets has one */
+        for (index = 0; index < count; ++index) {
+            next   = (rx->turn + index) % count;
+            status = receive(rx, fds[next], buffer, length, MSG_DONTWAIT);
+            if (status >= 0)
+                break;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+                return -1;
+        }
+        if (status >= 0) {
+            rx->turn = next + 1;
+            if (which != NULL)
+                *which = next;
+            if (rx->spin_usec > 0) {
+                if (slept)
+                    ++(rx->slept);
+                else
+                    ++(rx->spun);
+            }
+            return status;
+        }
+
+        /* spin a little longer each time while the stream is busy */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - start.tv_sec) * 1000000LL + (now.tv_nsec - start.tv_nsec) / 1000 < rx->spin_usec) {
+            for (index = 0; index < pauses; ++index)
+                cpu_relax();
+            if (pauses < BUSYPOLL_PAUSE_MAX)
+                pauses *= 2;
+            continue;
+        }
+
+        /* and sleep once it went quiet */
+        for (index = 0; index < count; ++index) {
+            waiter[index].fd      = fds[index];
+            waiter[index].events  = POLLIN;
+            waiter[index].revents = 0;
+        }
+        if ((poll(waiter, count, -1) < 0) && (errno != EINTR))
+            return -1;
+        slept = 1;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int32_t busypoll_percentile(const busypoll_t *rx, double fraction);
+ *
+ * Returns the wake-up latency (in usec) that the given fraction of the
+ * measured datagrams stayed below, rounded up to a power of two.
+ *------------------------------------------------------------------------*/
+u_int32_t busypoll_percentile(const busypoll_t *rx, double fraction)
+{
+    u_int64_t count = 0;
+    int       bucket;
+
+    for (bucket = 0; bucket < BUSYPOLL_BUCKETS - 1; ++bucket) {
+        count += rx->histogram[bucket];
+        if (count >= fraction * rx->samples)
+            break;
+    }
+    return 1U << bucket;
+}
+
+
+/*------------------------------------------------------------------------
+ * void busypoll_report(const busypoll_t *rx);
+ *
+ * Prints the receive mode and the wake-up latency statistics of the
+ * transfer, in the style of the client transfer summary.
+ *------------------------------------------------------------------------*/
+void busypoll_report(const busypoll_t *rx)
+{
+    if (rx->spin_usec > 0)
+        printf("Receive mode          : busy poll for %u usec%s, %0.1f%% of blocks received while polling\n",
+               rx->spin_usec, rx->kernel ? " (kernel too)" : "",
+               100.0 * rx->spun / max(1, rx->spun + rx->slept));
+    if (rx->samples > 0)
+        printf("Wake-up latency       : mean %0.1f usec, 99%% below %u usec, 99.9%% below %u usec, max %u usec\n",
+               rx->latency_sum / rx->samples, busypoll_percentile(rx, 0.99), busypoll_percentile(rx, 0.999),
+               rx->latency_max);
+}
+
+
+/*------------------------------------------------------------------------
+ * ssize_t receive(busypoll_t *rx, int fd, void *buffer, size_t length,
+ *                 int flags);
+ *
+ * Receives one datagram with the given flags, and passes the time the
+ * kernel or the NIC stamped it with on to add_stamp().  Returns the
+ * length of the datagram, or -1 on error.
+ *------------------------------------------------------------------------*/
+ssize_t receive(busypoll_t *rx, int fd, void *buffer, size_t length, int flags)
+{
+    #ifdef SO_TIMESTAMPNS
+    struct msghdr    message;
+    struct iovec     vector;
+    struct cmsghdr  *control;
+    struct timespec *stamp;
+    struct timespec *hardware = NULL;
+    char             space[CMSG_SPACE(3 * sizeof(struct timespec))];
+    ssize_t          status;
+
+    if (!rx->latency && !rx->stamps)
+        return recv(fd, buffer, length, flags);
+
+    vector.iov_base        = buffer;
+    vector.iov_len         = length;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov        = &vector;
+    message.msg_iovlen     = 1;
+    message.msg_control    = space;
+    message.msg_controllen = sizeof(space);
+
+    status = recvmsg(fd, &message, flags);
+    if (status < 0)
+        return status;
+
+    /* find the software stamp and the hardware one, if any */
+    stamp = NULL;
+    for (control = CMSG_FIRSTHDR(&message); control != NULL; control = CMSG_NXTHDR(&message, control)) {
+        if (control->cmsg_level != SOL_SOCKET)
+            continue;
+        if (control->cmsg_type == SCM_TIMESTAMPNS)
+            stamp = (struct timespec *) CMSG_DATA(control);
+        #if defined(SO_TIMESTAMPING) && defined(SOF_TIMESTAMPING_RAW_HARDWARE)
+        else if (control->cmsg_type == SCM_TIMESTAMPING) {
+            stamp    = &((struct scm_timestamping *) CMSG_DATA(control))->ts[0];
+            hardware = &((struct scm_timestamping *) CMSG_DATA(control))->ts[2];
+        }
+        #endif
+    }
+    if ((stamp != NULL) && (stamp->tv_sec == 0) && (stamp->tv_nsec == 0))
+        stamp = NULL;
+    add_stamp(rx, stamp, hardware);
+    return status;
+    #else
+    struct timeval now;
+    ssize_t        status = recv(fd, buffer, length, flags);
+
+    if ((status >= 0) && rx->stamps) {
+        gettimeofday(&now, NULL);
+        rx->stamp = now.tv_sec * 1000000LL + now.tv_usec;
+    }
+    return status;
+    #endif
+}
+
+
+/*------------------------------------------------------------------------
+ * void add_stamp(busypoll_t *rx, const struct timespec *software,
+ *                const struct timespec *hardware);
+ *
+ * Keeps the arrival time of a datagram, from the NIC if it stamped it,
+ * else from the kernel, else the current time, and adds the time since
+ * the kernel stamped it to the wake-up latency statistics.
+ *------------------------------------------------------------------------*/
+void add_stamp(busypoll_t *rx, const struct timespec *software, const struct timespec *hardware)
+{
+    struct timespec now;
+    int64_t         usec;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (rx->stamps) {
+        if ((hardware != NULL) && ((hardware->tv_sec != 0) || (hardware->tv_nsec != 0))) {
+            rx->stamp = hardware->tv_sec * 1000000LL + hardware->tv_nsec / 1000;
+            ++(rx->hardware);
+        } else if (software != NULL) {
+            rx->stamp = software->tv_sec * 1000000LL + software->tv_nsec / 1000;
+        } else {
+            rx->stamp = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+        }
+    }
+
+    if (rx->latency && (software != NULL)) {
+        usec = (now.tv_sec - software->tv_sec) * 1000000LL + (now.tv_nsec - software->tv_nsec) / 1000;
+        add_latency(rx, (usec > 0) ? (u_int32_t) min(usec, 0xffffffffLL) : 0);
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * void add_latency(busypoll_t *rx, u_int32_t usec);
+ *
+ * Adds one wake-up latency sample to the statistics, into the
+ * histogram bucket of the next power of two.
+ *------------------------------------------------------------------------*/
+void add_latency(busypoll_t *rx, u_int32_t usec)
+{
+    int bucket = 0;
+
+    while ((bucket < BUSYPOLL_BUCKETS - 1) && ((1U << bucket) <= usec))
+        ++bucket;
+    ++(rx->histogram[bucket]);
+    ++(rx->samples);
+    rx->latency_sum += usec;
+    if (usec > rx->latency_max)
+        rx->latency_max = usec;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
@@ -83,6 +83,14 @@ const u_int16_t REQUEST_RETRANSMIT = 0;
 const u_int16_t REQUEST_RESTART    = 1;
 const u_int16_t REQUEST_STOP       = 2;
 const u_int16_t REQUEST_ERROR_RATE = 3;
+const u_int16_t REQUEST_START_RATE = 4;
+const u_int16_t REQUEST_SACK       = 5;
+const u_int16_t REQUEST_RETRANSMIT_RANGE = 6;
+const u_int16_t REQUEST_DISK_RATE  = 7;
+const u_int16_t REQUEST_STALL_NOTICE = 8;
+const u_int16_t REQUEST_TIMESTAMPS = 9;
+const u_int16_t REQUEST_PATH       = 10;
+const u_int16_t REQUEST_PATH_CONFIRM = 11;
 
 
 /*------------------------------------------------------------------------
@@ -346,6 +354,56 @@ u_int64_t get_udp_in_errors()
     return errs;
 }
 
+/*------------------------------------------------------------------------
+ * u_int32_t bdp_size(u_int32_t rate, u_int32_t rtt_usec,
+ *                    u_int32_t least, u_int32_t most);
+ *
+ * Returns the bandwidth-delay product (in bytes) of a path with the
+ * given rate (in bps) and round trip time (in usec), kept between the
+ * given least and most sizes.
+ *------------------------------------------------------------------------*/
+u_int32_t bdp_size(u_int32_t rate, u_int32_t rtt_usec, u_int32_t least, u_int32_t most)
+{
+    u_int64_t bdp = ((u_int64_t) rate * rtt_usec) / 8000000LL;
+
+    return (u_int32_t) max((u_int64_t) least, min(bdp, (u_int64_t) most));
+}
+
+/*------------------------------------------------------------------------
+ * u_int32_t set_socket_buffer(int fd, int option, u_int32_t size,
+ *                             u_int32_t *limit);
+ *
+ * Asks for a socket buffer of the given size, with an option of either
+ * SO_RCVBUF or SO_SNDBUF, and returns the size that the kernel granted.
+ * Linux clamps the request to net.core.rmem_max or wmem_max, which is
+ * stored in limit, or 0 if it can't be read.
+ *------------------------------------------------------------------------*/
+u_int32_t set_socket_buffer(int fd, int option, u_int32_t size, u_int32_t *limit)
+{
+    int       granted = 0;
+    socklen_t length  = sizeof(granted);
+    FILE     *f;
+
+    /* ask for the buffer and see what we got */
+    if (setsockopt(fd, SOL_SOCKET, option, &size, sizeof(size)) < 0)
+        warn("Error in resizing UDP socket buffer");
+    if (getsockopt(fd, SOL_SOCKET, option, &granted, &length) < 0)
+        granted = 0;
+    #ifdef __linux__
+    granted /= 2;  /* Linux reports twice the size, the rest is for its bookkeeping */
+    #endif
+
+    /* and look up the limit of the kernel */
+    *limit = 0;
+    f = fopen((option == SO_RCVBUF) ? "/proc/sys/net/core/rmem_max" : "/proc/sys/net/core/wmem_max", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%u", limit) != 1)
+            *limit = 0;
+        fclose(f);
+    }
+    return (u_int32_t) granted;
+}
+
 /*------------------------------------------------------------------------
  * ssize_t full_write(int fd, const void *buf, size_t count);
  *
@@ -384,6 +442,34 @@ ssize_t full_read(int fd, void *buf, size_t count)
    return nread;
 }
 
+/*------------------------------------------------------------------------
+ * int32_t aggregate_find(const aggregate_t *aggregate, u_int64_t offset);
+ *
+ * Returns the index of the member file of an aggregated transfer that
+ * holds the given byte offset of the stream.  Empty member files are
+ * skipped since they share their offset with the next member.  Returns
+ * -1 if the aggregate has no members.
+ *------------------------------------------------------------------------*/
+int32_t aggregate_find(const aggregate_t *aggregate, u_int64_t offset)
+{
+    int32_t low  = 0;
+    int32_t high = (int32_t) aggregate->count - 1;
+    int32_t mid;
+
+    if (aggregate->count == 0)
+        return -1;
+
+    /* binary search for the last member starting at or before the offset */
+    while (low < high) {
+        mid = (low + high + 1) / 2;
+        if (aggregate->entries[mid].offset <= offset)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
 /*========================================================================
  * $Log$
  * Revision 1.11  2009/12/21 15:08:39  jwagnerhki
@@ -0,0 +1,696 @@
+/*========================================================================
+ * impair.c  --  Network impairment layer of the Tsunami client and server.
+ *
+ * This contains the impairment layer of the UDP data path, which is
+ * compiled into both the client and the server and is off unless it is
+ * set up with 'set impair' or '--impair'.  The server applies loss
+ * (Bernoulli or Gilbert-Elliott), duplication, a rate limited bottleneck
+ * queue, delay, jitter and reordering to the datagrams it sends.  The
+ * client applies the loss models to the datagrams it receives, and can
+ * record the loss pattern of a transfer to a trace file and replay it.
+ * A transfer over several data paths can impair each path differently.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <pthread.h>     /* for the pthreads library        */
+#include <stdlib.h>      /* for malloc(), strtod(), etc.    */
+#include <string.h>      /* for memcpy(), strtok_r(), etc.  */
+#include <sys/socket.h>  /* for the BSD sockets library     */
+#include <sys/time.h>    /* for gettimeofday()              */
+#include <time.h>        /* for struct timespec             */
+
+#include "tsunami.h"
+
+
+/*------------------------------------------------------------------------
+ * Module-scope constants and data structures.
+ *------------------------------------------------------------------------*/
+
+#define IMPAIR_MAX_QUEUED  65536             /* maximum datagrams held in the delay line */
+
+/* impairment settings */
+typedef struct {
+    double              loss;                /* loss probability (in the good state)      */
+    double              ge_p;                /* Gilbert-Elliott good to bad probability   */
+    double              ge_r;                /* Gilbert-Elliott bad to good probability   */
+    double              ge_loss;             /* loss probability in the bad state         */
+    double              duplicate;           /* probability that a datagram is doubled    */
+    double              delay;               /* one-way delay (in usec)                   */
+    double              jitter;              /* maximum extra random delay (in usec)      */
+    double              reorder;             /* probability that a datagram is held back  */
+    double              reorder_delay;       /* extra delay of held back datagrams (usec) */
+    double              rate;                /* bottleneck rate in bps, 0 for unlimited   */
+    u_int64_t           queue;               /* bottleneck queue length (in bytes)        */
+    u_int32_t           seed;                /* the seed of the random generator          */
+    char               *record;              /* the loss trace file to write, or NULL     */
+    char               *replay;              /* the loss trace file to replay, or NULL    */
+} impair_config_t;
+
+/* a datagram waiting in the delay line */
+typedef struct {
+    u_int64_t           due;                 /* when to send the datagram (usec)          */
+    int                 fd;                  /* the socket to send on                     */
+    int                 flags;               /* the sendto() flags                        */
+    struct sockaddr_storage to;              /* the destination of the datagram           */
+    socklen_t           to_length;           /* the length of the destination address     */
+    size_t              length;              /* the length of the datagram                */
+    u_char             *data;                /* the datagram itself                       */
+} impair_packet_t;
+
+/* a range of lost blocks in a loss trace */
+typedef struct {
+    u_int32_t           first;               /* the first lost block                      */
+    u_int32_t           count;               /* the number of lost blocks                 */
+} impair_range_t;
+
+
+/*------------------------------------------------------------------------
+ * Module-scope variables.
+ *------------------------------------------------------------------------*/
+
+static impair_config_t   config[TS_MAX_PATHS];  /* the settings of each data path    */
+static u_int32_t         sections     = 1;      /* the paths with settings of their own */
+static int               enabled      = 0;
+static u_int32_t         random_state = 1;
+static int               ge_bad[TS_MAX_PATHS];  /* nonzero in the Gilbert-Elliott bad state */
+
+static impair_packet_t  *heap         = NULL;   /* the delay line, a min-heap on 'due' */
+static u_int32_t         heap_count   = 0;
+static pthread_mutex_t   heap_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    heap_cond    = PTHREAD_COND_INITIALIZER;
+static int               heap_thread  = 0;      /* nonzero once the delay line runs    */
+static int               heap_stop    = 0;      /* nonzero to make the delay line end  */
+static pthread_t         heap_id;               /* the thread of the delay line        */
+static u_int64_t         bottleneck_free[TS_MAX_PATHS]; /* when each bottleneck is idle again */
+
+static FILE             *record_file  = NULL;   /* the loss trace being recorded       */
+static impair_range_t   *replay       = NULL;   /* the loss trace being replayed       */
+static u_int32_t         replay_count = 0;
+static u_int32_t         replay_next  = 0;      /* the first range not yet passed      */
+static u_int32_t         replay_head  = 0;      /* the highest new block seen so far   */
+static u_int32_t         record_head  = 0;      /* the highest new block recorded      */
+
+static u_int64_t         count_sent, count_lost, count_duplicated, count_queue_drop, count_reordered, count_flushed;
+static u_int64_t         count_received, count_dropped, count_replayed, count_recorded;
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static void      free_names   (impair_config_t *settings);
+static int       impair_loss  (const impair_config_t *setting, int *bad);
+static int       load_replay  (const char *filename);
+static void     *impair_thread(void *arg);
+static double    uniform      (void);
+static u_int64_t now_usec     (void);
+
+
+/*------------------------------------------------------------------------
+ * int impair_setup(const char *spec);
+ *
+ * Sets up the impairment layer from a "key=value,key=value" list, or
+ * turns it off if the list is NULL or "none".  The recognized keys are
+ * loss, dup and reorder (probabilities), gep, ger and gebad (the
+ * Gilbert-Elliott transition and bad state loss probabilities), delay,
+ * jitter and reorderdelay (msec), rate (bps, with optional 'k', 'M' or
+ * 'G' suffix), queue (bytes), seed, and record and replay (loss trace
+ * file names).  Several lists separated by ';' set up the data paths of
+ * a transfer one by one, the last list also applies to the paths after
+ * it; the seed and the loss traces are taken from the first list.
+ * Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int impair_setup(const char *spec)
+{
+    impair_config_t  setting[TS_MAX_PATHS];
+    impair_config_t *current;
+    u_int32_t        count = 1;
+    u_int32_t        path;
+    char            *copy, *list, *item, *outer, *save, *value, *end;
+    double           number;
+
+    /* defaults */
+    memset(setting, 0, sizeof(setting));
+    for (path = 0; path < TS_MAX_PATHS; ++path) {
+        setting[path].ge_loss       = 1.0;
+        setting[path].reorder_delay = 1000.0;
+        setting[path].queue         = 1000000;
+        setting[path].seed          = 1;
+    }
+
+    if ((spec != NULL) && strcmp(spec, "none")) {
+
+        /* parse the list of each path */
+        copy = strdup(spec);
+        if (copy == NULL)
+            return warn("Could not allocate impairment settings");
+        count = 0;
+        for (list = strtok_r(copy, ";", &outer); list != NULL; list = strtok_r(NULL, ";", &outer)) {
+            if (count == TS_MAX_PATHS) {
+                sprintf(g_error, "Impairment settings for more than %d paths", TS_MAX_PATHS);
+                free_names(setting);
+                free(copy);
+                return warn(g_error);
+            }
+            current = &setting[count++];
+            for (item = strtok_r(list, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+                value = strchr(item, '=');
+                if (value == NULL) {
+                    sprintf(g_error, "Impairment setting '%s' has no value", item);
+                    free_names(setting);
+                    free(copy);
+                    return warn(g_error);
+                }
+                *(value++) = '\0';
+
+                /* the trace files are names, everything else is a number */
+                if      (!strcmp(item, "record")) { free(current->record); current->record = strdup(value); continue; }
+                else if (!strcmp(item, "replay")) { free(current->replay); current->replay = strdup(value); continue; }
+
+                number = strtod(value, &end);
+                if      ((*end == 'G') || (*end == 'g')) number *= 1e9;
+                else if ((*end == 'M') || (*end == 'm')) number *= 1e6;
+                else if ((*end == 'K') || (*end == 'k')) number *= 1e3;
+
+                if      (!strcmp(item, "loss"))         current->loss          = number;
+                else if (!strcmp(item, "gep"))          current->ge_p          = number;
+                else if (!strcmp(item, "ger"))          current->ge_r          = number;
+                else if (!strcmp(item, "gebad"))        current->ge_loss       = number;
+                else if (!strcmp(item, "dup"))          current->duplicate     = number;
+                else if (!strcmp(item, "delay"))        current->delay         = number * 1000.0;
+                else if (!strcmp(item, "jitter"))       current->jitter        = number * 1000.0;
+                else if (!strcmp(item, "reorder"))      current->reorder       = number;
+                else if (!strcmp(item, "reorderdelay")) current->reorder_delay = number * 1000.0;
+                else if (!strcmp(item, "rate"))         current->rate          = number;
+                else if (!strcmp(item, "queue"))        current->queue         = (u_int64_t) number;
+                else if (!strcmp(item, "seed"))         current->seed          = (u_int32_t) number;
+                else {
+                    sprintf(g_error, "Unknown impairment setting '%s'", item);
+                    free_names(setting);
+                    free(copy);
+                    return warn(g_error);
+                }
+            }
+        }
+        free(copy);
+        count   = max(count, 1);
+        enabled = 1;
+
+    } else {
+        enabled = 0;
+    }
+
+    /* replace the old settings */
+    free_names(config);
+    memcpy(config, setting, sizeof(config));
+    sections = count;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int impair_start(void);
+ *
+ * Prepares the impairment layer for a new transfer: restarts the random
+ * generator and the counters, opens the loss trace to record and loads
+ * the loss trace to replay.  Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int impair_start(void)
+{
+    impair_config_t *setting;
+    u_int32_t        path;
+
+    if (!enabled)
+        return 0;
+
+    random_state = (config[0].seed != 0) ? config[0].seed : 1;
+    memset(ge_bad, 0, sizeof(ge_bad));
+    count_sent   = count_lost     = count_duplicated = count_queue_drop = count_reordered = count_flushed = 0;
+    count_received = count_dropped = count_replayed  = count_recorded   = 0;
+
+    for (path = 0; path < sections; ++path) {
+        setting = &config[path];
+        if (sections > 1)
+            fprintf(stderr, "impair: path %u%s: ", path, (path == sections - 1) ? " and up" : "");
+        else
+            fprintf(stderr, "impair: ");
+        fprintf(stderr, "loss=%g ge=%g/%g/%g dup=%g delay=%gms jitter=%gms reorder=%g/%gms rate=%gbps queue=%llu\n",
+                setting->loss, setting->ge_p, setting->ge_r, setting->ge_loss, setting->duplicate,
+                setting->delay / 1000.0, setting->jitter / 1000.0, setting->reorder,
+                setting->reorder_delay / 1000.0, setting->rate, (ull_t) setting->queue);
+    }
+
+    /* open the trace to record */
+    if (config[0].record != NULL) {
+        record_file = fopen(config[0].record, "w");
+        if (record_file == NULL) {
+            sprintf(g_error, "Could not open loss trace '%s' for writing", config[0].record);
+            return warn(g_error);
+        }
+        fprintf(record_file, "# tsunami loss trace: first lost block, number of lost blocks\n");
+        record_head = 0;
+    }
+
+    /* load the trace to replay */
+    if ((config[0].replay != NULL) && (load_replay(config[0].replay) < 0))
+        return -1;
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * ssize_t impair_sendto(u_int32_t path, int fd, const void *buf,
+ *                       size_t len, int flags,
+ *                       const struct sockaddr *to, socklen_t tolen);
+ *
+ * Sends a datagram through the impairment layer of the given data path
+ * (0 for the first one): it may be lost or duplicated, and passes the
+ * bottleneck queue of the path and the delay line.  Datagrams that do
+ * not fit into the bottleneck queue are dropped, as a router would do.
+ * Impaired datagrams are always reported as sent.
+ *------------------------------------------------------------------------*/
+ssize_t impair_sendto(u_int32_t path, int fd, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t tolen)
+{
+    impair_config_t *setting;
+    impair_packet_t  packet, swap;
+    u_int64_t        now;
+    u_int32_t        i, parent;
+    int              copies;
+
+    if (!enabled)
+        return sendto(fd, buf, len, flags, to, tolen);
+    path    = min(path, TS_MAX_PATHS - 1);
+    setting = &config[min(path, sections - 1)];
+
+    /* lose or duplicate the datagram */
+    if (impair_loss(setting, &ge_bad[path])) {
+        ++count_lost;
+        return len;
+    }
+    copies = 1;
+    if ((setting->duplicate > 0) && (uniform() < setting->duplicate)) {
+        ++count_duplicated;
+        copies = 2;
+    }
+
+    /* without a bottleneck or delays the datagrams go straight out */
+    if ((setting->rate == 0) && (setting->delay == 0) && (setting->jitter == 0) && (setting->reorder == 0)) {
+        count_sent += copies;
+        while (--copies > 0)
+            sendto(fd, buf, len, flags, to, tolen);
+        return sendto(fd, buf, len, flags, to, tolen);
+    }
+
+    /* start the delay line (in the process that sends, after any fork()) */
+    pthread_mutex_lock(&heap_mutex);
+    if (!heap_thread) {
+        if (heap == NULL)
+            heap = (impair_packet_t *) calloc(IMPAIR_MAX_QUEUED, sizeof(impair_packet_t));
+        heap_stop = 0;
+        if ((heap == NULL) || pthread_create(&heap_id, NULL, impair_thread, NULL)) {
+            pthread_mutex_unlock(&heap_mutex);
+            enabled = 0;
+            return warn("Could not start the impairment delay line");
+        }
+        heap_thread = 1;
+    }
+
+    while (copies-- > 0) {
+
+        /* serialize through the bottleneck, dropping at the tail of a full queue */
+        now        = now_usec();
+        packet.due = now;
+        if (setting->rate > 0) {
+            if (bottleneck_free[path] < now)
+                bottleneck_free[path] = now;
+            if ((bottleneck_free[path] - now) * setting->rate / 8e6 > setting->queue) {
+                ++count_queue_drop;
+                continue;
+            }
+            bottleneck_free[path] += (u_int64_t) (8e6 * len / setting->rate);
+            packet.due = bottleneck_free[path];
+        }
+
+        /* add the propagation delay, jitter and reordering */
+        packet.due += (u_int64_t) (setting->delay + setting->jitter * uniform());
+        if ((setting->reorder > 0) && (uniform() < setting->reorder)) {
+            packet.due += (u_int64_t) setting->reorder_delay;
+            ++count_reordered;
+        }
+
+        /* copy the datagram into the delay line */
+        if ((heap_count >= IMPAIR_MAX_QUEUED) || ((packet.data = (u_char *) malloc(len)) == NULL)) {
+            ++count_queue_drop;
+            continue;
+        }
+        memcpy(packet.data, buf, len);
+        memcpy(&packet.to, to, min(tolen, sizeof(packet.to)));
+        packet.to_length = tolen;
+        packet.fd        = fd;
+        packet.flags     = flags;
+        packet.length    = len;
+
+        /* sift it up the heap */
+        i = heap_count++;
+        heap[i] = packet;
+        while (i > 0) {
+            parent = (i - 1) / 2;
+            if (heap[parent].due <= heap[i].due)
+                break;
+            swap = heap[parent]; heap[parent] = heap[i]; heap[i] = swap;
+            i = parent;
+        }
+        if (i == 0)
+            pthread_cond_signal(&heap_cond);
+    }
+
+    pthread_mutex_unlock(&heap_mutex);
+    return len;
+}
+
+
+/*------------------------------------------------------------------------
+ * int impair_drop(u_int32_t block, u_int16_t type);
+ *
+ * Decides whether a received datagram with the given block number and
+ * type is to be dropped, either by the loss models or because it was
+ * lost in the replayed loss trace.  A trace only drops the first
+ * arrival of new original blocks, so that retransmissions and restarts
+ * get through.  Returns nonzero to drop the datagram.
+ *------------------------------------------------------------------------*/
+int impair_drop(u_int32_t block, u_int16_t type)
+{
+    if (!enabled)
+        return 0;
+    ++count_received;
+
+    /* replay the recorded loss of new original blocks */
+    if ((replay != NULL) && (type != TS_BLOCK_RETRANSMISSION) && (block > replay_head)) {
+        replay_head = block;
+        while ((replay_next < replay_count) && (block >= replay[replay_next].first + replay[replay_next].count))
+            ++replay_next;
+        if ((replay_next < replay_count) && (block >= replay[replay_next].first)) {
+            ++count_replayed;
+            return 1;
+        }
+    }
+
+    /* apply the loss models */
+    if (impair_loss(&config[0], &ge_bad[0])) {
+        ++count_dropped;
+        return 1;
+    }
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void impair_record(u_int32_t block, u_int16_t type);
+ *
+ * Notes the arrival of a datagram in the loss trace being recorded, if
+ * any.  Every original block that has not arrived by the time a later
+ * one does is recorded as lost, even if it turns up late, so that the
+ * trace holds the gaps in the order they were seen.
+ *------------------------------------------------------------------------*/
+void impair_record(u_int32_t block, u_int16_t type)
+{
+    if ((record_file == NULL) || (type == TS_BLOCK_RETRANSMISSION) || (block <= record_head))
+        return;
+    if (block > record_head + 1) {
+        fprintf(record_file, "%u %u\n", record_head + 1, block - record_head - 1);
+        ++count_recorded;
+    }
+    record_head = block;
+}
+
+
+/*------------------------------------------------------------------------
+ * void impair_finish(void);
+ *
+ * Ends the impairment of a transfer: stops the delay line, dropping the
+ * datagrams still in it, so that none is sent on a socket after the
+ * transfer closed it, closes the loss traces and prints the counters.
+ * This has to be called before the sockets of the transfer are closed.
+ *------------------------------------------------------------------------*/
+void impair_finish(void)
+{
+    /* stop the delay line and wait for a send in progress */
+    if (heap_thread) {
+        pthread_mutex_lock(&heap_mutex);
+        heap_stop = 1;
+        pthread_cond_signal(&heap_cond);
+        pthread_mutex_unlock(&heap_mutex);
+        pthread_join(heap_id, NULL);
+        heap_thread = 0;
+    }
+
+    if (!enabled)
+        return;
+
+    if (record_file != NULL) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+    if (replay != NULL) {
+        free(replay);
+        replay = NULL;
+    }
+
+    if (count_sent + count_lost + count_queue_drop > 0)
+        fprintf(stderr, "impair: sent %llu, lost %llu, duplicated %llu, queue drops %llu, reordered %llu\n",
+                (ull_t) count_sent, (ull_t) count_lost, (ull_t) count_duplicated,
+                (ull_t) count_queue_drop, (ull_t) count_reordered);
+    if (count_flushed > 0)
+        fprintf(stderr, "impair: dropped %llu datagrams still in the delay line at the end\n", (ull_t) count_flushed);
+    if (count_received > 0)
+        fprintf(stderr, "impair: received %llu, dropped %llu, replayed losses %llu, recorded gaps %llu\n",
+                (ull_t) count_received, (ull_t) count_dropped, (ull_t) count_replayed, (ull_t) count_recorded);
+}
+
+
+/*------------------------------------------------------------------------
+ * static int impair_loss(const impair_config_t *setting, int *bad);
+ *
+ * Runs the loss model of the given settings for one datagram: a
+ * Gilbert-Elliott channel that loses with probability 'loss' in the
+ * good state and 'gebad' in the bad state, which is kept in 'bad'.
+ * Without transitions this is plain Bernoulli loss.  Returns nonzero
+ * if the datagram is lost.
+ *------------------------------------------------------------------------*/
+static int impair_loss(const impair_config_t *setting, int *bad)
+{
+    if (setting->ge_p > 0) {
+        if (*bad) {
+            if (uniform() < setting->ge_r)
+                *bad = 0;
+        } else if (uniform() < setting->ge_p) {
+            *bad = 1;
+        }
+        if (*bad)
+            return (uniform() < setting->ge_loss);
+    }
+    return (setting->loss > 0) && (uniform() < setting->loss);
+}
+
+
+/*------------------------------------------------------------------------
+ * static int load_replay(const char *filename);
+ *
+ * Reads the lost block ranges of a loss trace, one "first count" pair
+ * per line in increasing order, with '#' starting a comment line.
+ * Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+static int load_replay(const char *filename)
+{
+    FILE           *trace;
+    char            line[128];
+    impair_range_t  range;
+    u_int32_t       size = 0;
+    impair_range_t *grown;
+
+    trace = fopen(filename, "r");
+    if (trace == NULL) {
+        sprintf(g_error, "Could not open loss trace '%s'", filename);
+        return warn(g_error);
+    }
+
+    replay_count = replay_next = replay_head = 0;
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        if ((line[0] == '#') || (sscanf(line, "%u %u", &range.first, &range.count) != 2))
+            continue;
+        if (replay_count == size) {
+            size  = (size == 0) ? 1024 : 2 * size;
+            grown = (impair_range_t *) realloc(replay, size * sizeof(impair_range_t));
+            if (grown == NULL) {
+                fclose(trace);
+                return warn("Could not allocate loss trace");
+            }
+            replay = grown;
+        }
+        replay[replay_count++] = range;
+    }
+    fclose(trace);
+
+    fprintf(stderr, "impair: replaying %u lost ranges from '%s'\n", replay_count, filename);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void *impair_thread(void *arg);
+ *
+ * Sends the datagrams of the delay line once they are due.
+ *------------------------------------------------------------------------*/
+static void *impair_thread(void *arg)
+{
+    impair_packet_t  packet, swap;
+    struct timespec  wakeup;
+    u_int32_t        i, child;
+
+    pthread_mutex_lock(&heap_mutex);
+    while (!heap_stop) {
+
+        /* wait for the earliest datagram to become due */
+        if (heap_count == 0) {
+            pthread_cond_wait(&heap_cond, &heap_mutex);
+            continue;
+        }
+        if (heap[0].due > now_usec()) {
+            wakeup.tv_sec  = heap[0].due / 1000000;
+            wakeup.tv_nsec = (heap[0].due % 1000000) * 1000;
+            pthread_cond_timedwait(&heap_cond, &heap_mutex, &wakeup);
+            continue;
+        }
+
+        /* take it off the heap */
+        packet  = heap[0];
+        heap[0] = heap[--heap_count];
+        for (i = 0; (child = 2 * i + 1) < heap_count; i = child) {
+            if ((child + 1 < heap_count) && (heap[child + 1].due < heap[child].due))
+                ++child;
+            if (heap[i].due <= heap[child].due)
+                break;
+            swap = heap[child]; heap[child] = heap[i]; heap[i] = swap;
+        }
+
+        /* and send it */
+        pthread_mutex_unlock(&heap_mutex);
+        sendto(packet.fd, packet.data, packet.length, packet.flags, (struct sockaddr *) &packet.to, packet.to_length);
+        free(packet.data);
+        pthread_mutex_lock(&heap_mutex);
+        ++count_sent;
+    }
+
+    /* the transfer ended, the datagrams still waiting are not sent */
+    count_flushed += heap_count;
+    while (heap_count > 0)
+        free(heap[--heap_count].data);
+    pthread_mutex_unlock(&heap_mutex);
+    return NULL;
+}
+
+
+/*------------------------------------------------------------------------
+ * static void free_names(impair_config_t *settings);
+ *
+ * Frees the loss trace names in the settings of all data paths.
+ *------------------------------------------------------------------------*/
+static void free_names(impair_config_t *settings)
+{
+    u_int32_t path;
+
+    for (path = 0; path < TS_MAX_PATHS; ++path) {
+        free(settings[path].record);
+        free(settings[path].replay);
+        settings[path].record = settings[path].replay = NULL;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * static double uniform(void);
+ *
+ * Returns a pseudo-random number in [0, 1) from a xorshift generator,
+ * so that a given seed always reproduces the same impairment pattern.
+ *------------------------------------------------------------------------*/
+static double uniform(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state / 4294967296.0;
+}
+
+
+/*------------------------------------------------------------------------
+ * static u_int64_t now_usec(void);
+ *
+ * Returns the current wall clock time in microseconds.
+ *------------------------------------------------------------------------*/
+static u_int64_t now_usec(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return 1000000LL * now.tv_sec + now.tv_usec;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
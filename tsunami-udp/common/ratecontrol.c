@@ -0,0 +1,273 @@
+/*========================================================================
+ * ratecontrol.c  --  Rate control of the Tsunami protocol.
+ *
+ * This contains the two halves of the rate control loop: the smoothed
+ * error rate that the client reports in ttp_update_stats(), and the
+ * inter-packet delay that the server derives from it in
+ * ttp_accept_retransmit().  The retransmission timeout of the client
+ * requests is estimated here as well.  They are kept here so that the
+ * simulator in bench/ runs the very same code.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include "tsunami.h"
+
+
+/*------------------------------------------------------------------------
+ * double ratecontrol_error(double error_rate, u_int16_t history,
+ *                          double retransmits_fraction,
+ *                          double ringfill_fraction);
+ *
+ * Returns the new smoothed error rate (in % x 1000) of the client from
+ * the previous one, the percentage of history to keep, the fraction of
+ * retransmission requests among the blocks of the last interval and
+ * the fill level of the disk ring buffer.
+ *------------------------------------------------------------------------*/
+double ratecontrol_error(double error_rate, u_int16_t history, double retransmits_fraction, double ringfill_fraction)
+{
+    double fb = history / 100.0;  // feedback
+    double ff = 1.0 - fb;         // feedforward
+
+    // IIR filtered composite error and loss, some sort of knee function
+    return fb * error_rate + ff * 500*100 * (retransmits_fraction + ringfill_fraction);
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int32_t ratecontrol_disk_ceiling(double disk_rate,
+ *                                    double ringfill_fraction);
+ *
+ * Returns the rate ceiling (in kbps) that the client asks of the server
+ * when its disk can write the given rate (in bps).  This leaves some
+ * headroom below the disk rate, and more while the ring buffer is
+ * filled, so that the blocks queued up in it can be written out.
+ *------------------------------------------------------------------------*/
+u_int32_t ratecontrol_disk_ceiling(double disk_rate, double ringfill_fraction)
+{
+    double ceiling = disk_rate * (TS_DISK_HEADROOM - 0.5 * ringfill_fraction) / 1000.0;
+
+    return (ceiling < 1.0) ? 1 : (u_int32_t) ceiling;
+}
+
+
+/*------------------------------------------------------------------------
+ * double ratecontrol_ipd(double ipd_current, u_int32_t error_rate,
+ *                        u_int32_t error_target,
+ *                        u_int16_t slower_num, u_int16_t slower_den,
+ *                        u_int16_t faster_num, u_int16_t faster_den,
+ *                        u_int32_t ipd_time);
+ *
+ * Returns the new inter-packet delay (in usec) of the server after the
+ * client reported the given error rate.  Above the target error rate
+ * the delay grows by up to the slowdown factor, below it the delay
+ * shrinks by the speedup factor, and it is kept between the delay of
+ * the target rate (ipd_time) and 10 msec.
+ *------------------------------------------------------------------------*/
+double ratecontrol_ipd(double ipd_current, u_int32_t error_rate, u_int32_t error_target,
+                       u_int16_t slower_num, u_int16_t slower_den,
+                       u_int16_t faster_num, u_int16_t faster_den, u_int32_t ipd_time)
+{
+    /* calculate a new IPD */
+    if (error_rate > error_target) {
+        double factor1 = (1.0 * slower_num / slower_den) - 1.0;
+        double factor2 = (1.0 + error_rate - error_target) / (100000.0 - error_target);
+        ipd_current *= 1.0 + (factor1 * factor2);
+    } else {
+        ipd_current *= (double) faster_num / faster_den;
+    }
+
+    /* make sure the IPD is still in range, for later calculations */
+    return max(min(ipd_current, 10000.0), ipd_time);
+}
+
+
+/*------------------------------------------------------------------------
+ * void ratecontrol_rtt_init(rtt_estimator_t *rtt, double rtt_usec);
+ *
+ * Seeds the retransmission timeout estimator with the given round trip
+ * time (in usec), e.g. the one of the file request, as if it was the
+ * first sample.  Without a round trip time (0) the timeout starts at
+ * TS_RTO_INITIAL, the old fixed repeat period.
+ *------------------------------------------------------------------------*/
+void ratecontrol_rtt_init(rtt_estimator_t *rtt, double rtt_usec)
+{
+    rtt->srtt   = 0.0;
+    rtt->rttvar = 0.0;
+    rtt->rto    = TS_RTO_INITIAL;
+    if (rtt_usec > 0)
+        ratecontrol_rtt_sample(rtt, rtt_usec);
+}
+
+
+/*------------------------------------------------------------------------
+ * void ratecontrol_rtt_sample(rtt_estimator_t *rtt, double sample_usec);
+ *
+ * Folds the measured turnaround of one retransmission request into the
+ * smoothed round trip time and its variation as in TCP (Jacobson and
+ * Karels, RFC 6298), and sets the timeout to SRTT + 4 RTTVAR, kept
+ * between TS_RTO_MIN and TS_RTO_MAX.  Only requests that were sent
+ * once may be sampled, the reply to a repeated one is ambiguous.
+ *------------------------------------------------------------------------*/
+void ratecontrol_rtt_sample(rtt_estimator_t *rtt, double sample_usec)
+{
+    double error = rtt->srtt - sample_usec;
+
+    if (rtt->srtt <= 0.0) {
+        rtt->srtt   = sample_usec;
+        rtt->rttvar = sample_usec / 2;
+    } else {
+        rtt->rttvar = 0.75 * rtt->rttvar + 0.25 * ((error < 0) ? -error : error);
+        rtt->srtt   = 0.875 * rtt->srtt + 0.125 * sample_usec;
+    }
+    rtt->rto = max(min(rtt->srtt + 4 * rtt->rttvar, (double) TS_RTO_MAX), (double) TS_RTO_MIN);
+}
+
+
+/*------------------------------------------------------------------------
+ * void ratecontrol_rtt_backoff(rtt_estimator_t *rtt);
+ *
+ * Doubles the retransmission timeout, up to TS_RTO_MAX, after a timed
+ * request had to be repeated.  Without this a timeout that is too short
+ * would never see a sample that could correct it.
+ *------------------------------------------------------------------------*/
+void ratecontrol_rtt_backoff(rtt_estimator_t *rtt)
+{
+    rtt->rto = min(2 * rtt->rto, (double) TS_RTO_MAX);
+}
+
+
+/*------------------------------------------------------------------------
+ * void ratecontrol_owd_sample(owd_estimator_t *owd, int64_t delay_usec);
+ *
+ * Adds the one-way delay of one data block, i.e. its arrival time less
+ * the send time the server stamped into it, to the current interval.
+ * The clocks of the two hosts need not agree, only the changes of the
+ * delay are used.
+ *------------------------------------------------------------------------*/
+void ratecontrol_owd_sample(owd_estimator_t *owd, int64_t delay_usec)
+{
+    if ((owd->samples == 0) || (delay_usec < owd->current))
+        owd->current = delay_usec;
+    ++(owd->samples);
+}
+
+
+/*------------------------------------------------------------------------
+ * double ratecontrol_owd_update(owd_estimator_t *owd, time_t now);
+ *
+ * Closes the current interval and returns how far its lowest one-way
+ * delay lies above the base delay, i.e. the time (in usec) that the
+ * blocks spent queued on the path, or -1 if there were no samples.  As
+ * in LEDBAT (RFC 6817) the base delay is the lowest delay of each of
+ * the last TS_OWD_BASE_HISTORY minutes, so that a drift of the clocks
+ * or a route change are forgotten after a while.
+ *------------------------------------------------------------------------*/
+double ratecontrol_owd_update(owd_estimator_t *owd, time_t now)
+{
+    time_t  minute = now / 60;
+    int64_t base;
+    int     index;
+
+    if (owd->samples == 0)
+        return -1;
+    owd->samples = 0;
+
+    /* roll the minimum of this interval into the base history */
+    if (!owd->valid) {
+        for (index = 0; index < TS_OWD_BASE_HISTORY; ++index)
+            owd->base[index] = owd->current;
+        owd->base_minute = minute;
+        owd->valid       = 1;
+    } else if (minute != owd->base_minute) {
+        for (index = TS_OWD_BASE_HISTORY - 1; index > 0; --index)
+            owd->base[index] = owd->base[index - 1];
+        owd->base[0]     = owd->current;
+        owd->base_minute = minute;
+    } else if (owd->current < owd->base[0]) {
+        owd->base[0] = owd->current;
+    }
+
+    /* and measure against the lowest delay of them all */
+    base = owd->base[0];
+    for (index = 1; index < TS_OWD_BASE_HISTORY; ++index)
+        if (owd->base[index] < base)
+            base = owd->base[index];
+    return (double) (owd->current - base);
+}
+
+
+/*------------------------------------------------------------------------
+ * double ratecontrol_delay_error(double queueing_usec,
+ *                                u_int32_t target_usec,
+ *                                u_int32_t error_target);
+ *
+ * Returns the queueing delay of the path as an error rate (in % x 1000)
+ * that reaches the error target when the delay reaches the delay
+ * target, so that the server backs off on a growing queue before it
+ * overflows and blocks are lost.  Returns 0 without a delay target.
+ *------------------------------------------------------------------------*/
+double ratecontrol_delay_error(double queueing_usec, u_int32_t target_usec, u_int32_t error_target)
+{
+    if ((target_usec == 0) || (queueing_usec <= 0))
+        return 0.0;
+    return (double) error_target * queueing_usec / target_usec;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
@@ -0,0 +1,226 @@
+/*========================================================================
+ * synthetic.c  --  Synthetic data sources shared by client and server.
+ *
+ * This contains the routines for the virtual files '!zero:SIZE' and
+ * '!random:SIZE[:SEED]', which the server generates on the fly instead
+ * of reading them from disk.  The '!random' data is a deterministic
+ * function of the seed and the byte offset, so that the client can
+ * regenerate and check any block of it.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <stdlib.h>   /* for strtoull()               */
+#include <string.h>   /* for memset(), strchr(), etc. */
+
+#include "tsunami.h"
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static u_int64_t synthetic_word(u_int64_t seed, u_int64_t index);
+static int       parse_size    (const char *text, char **end, u_int64_t *size);
+
+
+/*------------------------------------------------------------------------
+ * int synthetic_parse(const char *filename, u_int64_t *size,
+ *                     u_int64_t *seed);
+ *
+ * Checks whether the given file name names a synthetic data source.
+ * The size takes an optional K, M, G or T suffix (powers of 1024), and
+ * the seed of '!random' defaults to 0.  Returns TS_SYNTHETIC_ZERO or
+ * TS_SYNTHETIC_RANDOM and stores the size and seed, or returns
+ * TS_SYNTHETIC_NONE if the name is an ordinary file name or malformed.
+ *------------------------------------------------------------------------*/
+int synthetic_parse(const char *filename, u_int64_t *size, u_int64_t *seed)
+{
+    char *end;
+    int   kind;
+
+    /* check the prefix */
+    if (!strncmp(filename, TS_SYNTHETIC_ZERO_NAME, strlen(TS_SYNTHETIC_ZERO_NAME))) {
+        kind      = TS_SYNTHETIC_ZERO;
+        filename += strlen(TS_SYNTHETIC_ZERO_NAME);
+    } else if (!strncmp(filename, TS_SYNTHETIC_RANDOM_NAME, strlen(TS_SYNTHETIC_RANDOM_NAME))) {
+        kind      = TS_SYNTHETIC_RANDOM;
+        filename += strlen(TS_SYNTHETIC_RANDOM_NAME);
+    } else {
+        return TS_SYNTHETIC_NONE;
+    }
+
+    /* parse the size and the optional seed */
+    if (parse_size(filename, &end, size) < 0)
+        return TS_SYNTHETIC_NONE;
+    *seed = 0;
+    if ((*end == ':') && (kind == TS_SYNTHETIC_RANDOM)) {
+        filename = end + 1;
+        *seed    = strtoull(filename, &end, 0);
+        if (end == filename)
+            return TS_SYNTHETIC_NONE;
+    }
+    if (*end != '\0')
+        return TS_SYNTHETIC_NONE;
+
+    return kind;
+}
+
+
+/*------------------------------------------------------------------------
+ * void synthetic_fill(int kind, u_int64_t seed, u_int64_t offset,
+ *                     u_char *buffer, u_int32_t length);
+ *
+ * Fills the buffer with the given number of bytes of the synthetic
+ * data stream, starting at the given byte offset.  The '!random'
+ * stream is a sequence of big-endian 64-bit words, each one the
+ * splitmix64 hash of the seed and the word index.
+ *------------------------------------------------------------------------*/
+void synthetic_fill(int kind, u_int64_t seed, u_int64_t offset, u_char *buffer, u_int32_t length)
+{
+    u_int64_t index = offset / 8;
+    u_int32_t skip  = offset % 8;
+    u_int32_t chunk;
+    u_int64_t word;
+
+    if (kind != TS_SYNTHETIC_RANDOM) {
+        memset(buffer, 0, length);
+        return;
+    }
+
+    while (length > 0) {
+        word  = htonll(synthetic_word(seed, index++));
+        chunk = min(8 - skip, length);
+        memcpy(buffer, ((u_char *) &word) + skip, chunk);
+        buffer += chunk;
+        length -= chunk;
+        skip    = 0;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * int synthetic_verify(int kind, u_int64_t seed, u_int64_t offset,
+ *                      const u_char *buffer, u_int32_t length);
+ *
+ * Checks the buffer against the given number of bytes of the synthetic
+ * data stream, starting at the given byte offset.  Returns 0 if all of
+ * them match and nonzero otherwise.
+ *------------------------------------------------------------------------*/
+int synthetic_verify(int kind, u_int64_t seed, u_int64_t offset, const u_char *buffer, u_int32_t length)
+{
+    u_int64_t index = offset / 8;
+    u_int32_t skip  = offset % 8;
+    u_int32_t chunk;
+    u_int64_t word  = 0;
+
+    while (length > 0) {
+        if (kind == TS_SYNTHETIC_RANDOM)
+            word = htonll(synthetic_word(seed, index++));
+        chunk = min(8 - skip, length);
+        if (memcmp(buffer, ((u_char *) &word) + skip, chunk))
+            return -1;
+        buffer += chunk;
+        length -= chunk;
+        skip    = 0;
+    }
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * static u_int64_t synthetic_word(u_int64_t seed, u_int64_t index);
+ *
+ * Returns the word with the given index of the '!random' stream.
+ *------------------------------------------------------------------------*/
+static u_int64_t synthetic_word(u_int64_t seed, u_int64_t index)
+{
+    u_int64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+/*------------------------------------------------------------------------
+ * static int parse_size(const char *text, char **end, u_int64_t *size);
+ *
+ * Parses a byte count with an optional K, M, G or T suffix.  Returns 0
+ * on success and -1 if there is no number.
+ *------------------------------------------------------------------------*/
+static int parse_size(const char *text, char **end, u_int64_t *size)
+{
+    static const char  suffixes[] = "KkMmGgTt";
+    const char        *suffix;
+
+    *size = strtoull(text, end, 10);
+    if (*end == text)
+        return -1;
+
+    /* each suffix is ten more bits than the one before it */
+    if ((**end != '\0') && ((suffix = strchr(suffixes, **end)) != NULL)) {
+        *size <<= 10 * ((suffix - suffixes) / 2 + 1);
+        ++(*end);
+    }
+    return 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
@@ -0,0 +1,788 @@
+/*========================================================================
+ * xdp.c  --  AF_XDP data path for the UDP blocks.
+ *
+ * This moves the data blocks of a transfer past the kernel UDP stack:
+ * the sender writes each block with ready-made Ethernet, IPv4 and UDP
+ * headers into a frame of a UMEM area that it shares with the kernel,
+ * and the receiver attaches a small XDP program to its interface that
+ * redirects the datagrams for its UDP port straight into its frames.
+ * Datagrams that miss the AF_XDP socket, e.g. on another receive queue,
+ * still arrive on the ordinary UDP socket, which is read as well.  The
+ * generic (skb) mode works with any driver, including veth pairs.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <errno.h>      /* for errno                         */
+#include <stdlib.h>     /* for malloc() and free()           */
+#include <string.h>     /* for memset() and memcpy()         */
+#include <strings.h>    /* for strcasecmp()                  */
+
+#include "tsunami.h"
+
+#if defined(HAVE_AF_XDP) && defined(__linux__)
+
+#include <arpa/inet.h>          /* for inet_ntoa()                */
+#include <ifaddrs.h>            /* for getifaddrs()               */
+#include <net/if.h>             /* for struct ifreq, IFF_LOOPBACK */
+#include <netinet/in.h>         /* for struct sockaddr_in         */
+#include <poll.h>               /* for poll()                     */
+#include <sys/ioctl.h>          /* for SIOCGIFHWADDR              */
+#include <sys/mman.h>           /* for mmap()                     */
+#include <sys/syscall.h>        /* for __NR_bpf                   */
+#include <unistd.h>             /* for close() and syscall()      */
+#include <linux/bpf.h>          /* for the BPF instructions       */
+#include <linux/if_link.h>      /* for XDP_FLAGS_SKB_MODE         */
+#include <linux/if_xdp.h>       /* for the AF_XDP socket options  */
+
+#ifndef AF_XDP
+#define AF_XDP  44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+
+/*------------------------------------------------------------------------
+ * Module-scope definitions and routines.
+ *------------------------------------------------------------------------*/
+
+#define XDP_RING_SIZE  (XDP_FRAMES / 2)    /* entries of each ring, a half of the frames */
+#define XDP_NO_FRAME   (~0ULL)             /* no received frame is held                   */
+
+/* one BPF instruction */
+#define INSN(c, d, s, o, i)  ((struct bpf_insn) { .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+
+static int       map_ring      (xdp_socket_t *xsk, xdp_ring_t *ring, const struct xdp_ring_offset *offset,
+                                size_t entry_size, off_t page_offset);
+static int       attach        (xdp_socket_t *xsk, u_int16_t port, int mode);
+static int       bpf_call      (int command, union bpf_attr *attribute);
+static int       find_device   (int fd, char *device, size_t length, struct in_addr *address);
+static int       find_neighbour(const char *device, struct in_addr address, u_char *mac);
+static u_int16_t ip_checksum   (const u_char *header);
+static void      reap          (xdp_socket_t *xsk);
+static void      refill        (xdp_socket_t *xsk);
+
+
+/*------------------------------------------------------------------------
+ * int xdp_open(xdp_socket_t *xsk, int control_fd, int data_fd, int mode,
+ *              u_int32_t queue, u_char receive);
+ *
+ * Opens an AF_XDP socket on the given queue of the network interface
+ * that carries the given control connection, in XDP_MODE_SKB or
+ * XDP_MODE_NATIVE mode, with its UMEM frames in a buffer pool.  For a
+ * receiver an XDP program is attached to the interface that redirects
+ * the IPv4 datagrams for the port of the given UDP socket to it; a
+ * sender needs xdp_target() next.  This needs CAP_NET_ADMIN and
+ * CAP_BPF (or root).  Returns 0 on success and nonzero on failure, in
+ * which case the UDP socket is to be used as before.
+ *------------------------------------------------------------------------*/
+int xdp_open(xdp_socket_t *xsk, int control_fd, int data_fd, int mode, u_int32_t queue, u_char receive)
+{
+    struct xdp_umem_reg     umem;
+    struct xdp_mmap_offsets offsets;
+    struct sockaddr_xdp     address;
+    struct sockaddr_in      local;
+    struct in_addr          ip;
+    socklen_t               length;
+    int                     size = XDP_RING_SIZE;
+    u_int32_t               index;
+
+    memset(xsk, 0, sizeof(*xsk));
+    xsk->fd = xsk->program_fd = xsk->map_fd = xsk->link_fd = -1;
+    xsk->queue = queue;
+    xsk->held  = XDP_NO_FRAME;
+
+    /* find the interface, AF_XDP frames carry IPv4 only here */
+    if (find_device(control_fd, xsk->device, sizeof(xsk->device), &ip) < 0)
+        return warn("No IPv4 network interface found for AF_XDP");
+    xsk->ifindex = if_nametoindex(xsk->device);
+    if ((xsk->ifindex == 0) || (queue >= XDP_QUEUES))
+        return warn("Invalid network interface or queue for AF_XDP");
+    memcpy(xsk->header + 26, &ip, 4);
+
+    /* register the frames with a new socket */
+    xsk->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk->fd < 0)
+        return warn("Could not create AF_XDP socket");
+    if (bufpool_create(&xsk->umem, XDP_FRAMES, XDP_FRAME_SIZE, 0) < 0) {
+        xdp_close(xsk);
+        return warn("Could not allocate AF_XDP frames");
+    }
+    memset(&umem, 0, sizeof(umem));
+    umem.addr       = (u_int64_t) (unsigned long) xsk->umem.memory;
+    umem.len        = (u_int64_t) XDP_FRAMES * XDP_FRAME_SIZE;
+    umem.chunk_size = XDP_FRAME_SIZE;
+    if ((setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &umem, sizeof(umem)) < 0) ||
+        (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0) ||
+        (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) < 0) ||
+        (setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0) ||
+        (setsockopt(xsk->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0)) {
+        xdp_close(xsk);
+        return warn("Could not register AF_XDP frames and rings");
+    }
+
+    /* map the four rings */
+    length = sizeof(offsets);
+    if ((getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) < 0) ||
+        (map_ring(xsk, &xsk->fill,       &offsets.fr, sizeof(u_int64_t),       XDP_UMEM_PGOFF_FILL_RING) < 0) ||
+        (map_ring(xsk, &xsk->completion, &offsets.cr, sizeof(u_int64_t),       XDP_UMEM_PGOFF_COMPLETION_RING) < 0) ||
+        (map_ring(xsk, &xsk->rx,         &offsets.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0) ||
+        (map_ring(xsk, &xsk->tx,         &offsets.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0)) {
+        xdp_close(xsk);
+        return warn("Could not map AF_XDP rings");
+    }
+
+    /* the first half of the frames receives, the second half sends */
+    for (index = 0; index < XDP_RING_SIZE; ++index)
+        ((u_int64_t *) xsk->fill.descriptors)[index] = (u_int64_t) index * XDP_FRAME_SIZE;
+    __atomic_store_n(xsk->fill.producer, XDP_RING_SIZE, __ATOMIC_RELEASE);
+    xsk->free = (u_int64_t *) malloc(XDP_RING_SIZE * sizeof(u_int64_t));
+    if (xsk->free == NULL) {
+        xdp_close(xsk);
+        return warn("Could not allocate AF_XDP frame list");
+    }
+    for (index = 0; index < XDP_RING_SIZE; ++index)
+        xsk->free[xsk->free_count++] = (u_int64_t) (XDP_RING_SIZE + index) * XDP_FRAME_SIZE;
+
+    /* bind to the queue, copying in generic mode */
+    memset(&address, 0, sizeof(address));
+    address.sxdp_family   = AF_XDP;
+    address.sxdp_ifindex  = xsk->ifindex;
+    address.sxdp_queue_id = queue;
+    address.sxdp_flags    = (mode == XDP_MODE_SKB) ? XDP_COPY : 0;
+    if (bind(xsk->fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        sprintf(g_error, "Could not bind AF_XDP socket to %s queue %u (%s)", xsk->device, queue, strerror(errno));
+        xdp_close(xsk);
+        return warn(g_error);
+    }
+
+    /* and have the datagrams for our port redirected to it */
+    if (receive) {
+        length = sizeof(local);
+        if ((getsockname(data_fd, (struct sockaddr *) &local, &length) < 0) || (local.sin_family != AF_INET) ||
+            (attach(xsk, local.sin_port, mode) < 0)) {
+            xdp_close(xsk);
+            return -1;
+        }
+    }
+
+    xsk->active = 1;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int xdp_target(xdp_socket_t *xsk, const struct sockaddr *to,
+ *                int data_fd);
+ *
+ * Builds the Ethernet, IPv4 and UDP headers that xdp_send() puts in
+ * front of each datagram to the given address, from the address of
+ * the interface of xdp_open(), the source port of the given UDP socket
+ * (which gets bound if it was not yet) and the hardware address of the
+ * destination, or of the gateway to it, from the neighbour table of
+ * the kernel.  Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int xdp_target(xdp_socket_t *xsk, const struct sockaddr *to, int data_fd)
+{
+    const struct sockaddr_in *destination = (const struct sockaddr_in *) to;
+    struct sockaddr_in        local;
+    struct ifreq              request;
+    socklen_t                 length = sizeof(local);
+    u_char                   *header = xsk->header;
+    int                       probe;
+
+    if (to->sa_family != AF_INET)
+        return warn("The AF_XDP data path is IPv4 only");
+
+    /* our hardware address, none on the loopback */
+    memset(&request, 0, sizeof(request));
+    snprintf(request.ifr_name, sizeof(request.ifr_name), "%.15s", xsk->device);
+    probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if ((probe < 0) || (ioctl(probe, SIOCGIFFLAGS, &request) < 0)) {
+        if (probe >= 0) close(probe);
+        return warn("Could not look up the AF_XDP interface");
+    }
+    if (!(request.ifr_flags & IFF_LOOPBACK)) {
+        if (ioctl(probe, SIOCGIFHWADDR, &request) < 0) {
+            close(probe);
+            return warn("Could not look up the hardware address of the AF_XDP interface");
+        }
+        memcpy(header + 6, request.ifr_hwaddr.sa_data, 6);
+        if (find_neighbour(xsk->device, destination->sin_addr, header) < 0) {
+            close(probe);
+            sprintf(g_error, "No hardware address of %s or its gateway on %s", inet_ntoa(destination->sin_addr), xsk->device);
+            return warn(g_error);
+        }
+    }
+    close(probe);
+
+    /* a source port of our own */
+    if ((getsockname(data_fd, (struct sockaddr *) &local, &length) < 0) || (local.sin_family != AF_INET))
+        return warn("The AF_XDP data path needs an IPv4 UDP socket");
+    if (local.sin_port == 0) {
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        length = sizeof(local);
+        if ((bind(data_fd, (struct sockaddr *) &local, sizeof(local)) < 0) ||
+            (getsockname(data_fd, (struct sockaddr *) &local, &length) < 0))
+            return warn("Could not bind the UDP socket for the AF_XDP source port");
+    }
+
+    /* Ethernet */
+    header[12] = 0x08;
+    header[13] = 0x00;
+
+    /* IPv4, without fragmentation; length, id and checksum are per datagram */
+    header[14] = 0x45;
+    header[20] = 0x40;
+    header[22] = 64;
+    header[23] = IPPROTO_UDP;
+    memcpy(header + 30, &destination->sin_addr, 4);
+
+    /* UDP, without a checksum */
+    memcpy(header + 34, &local.sin_port, 2);
+    memcpy(header + 36, &destination->sin_port, 2);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * ssize_t xdp_send(xdp_socket_t *xsk, const u_char *datagram,
+ *                  size_t length);
+ *
+ * Sends the given datagram in a free frame with the headers built by
+ * xdp_target(), taking back the frames the kernel is done with first.
+ * Returns the length sent, or -1 on error.
+ *------------------------------------------------------------------------*/
+ssize_t xdp_send(xdp_socket_t *xsk, const u_char *datagram, size_t length)
+{
+    struct xdp_desc *descriptor;
+    struct pollfd    waiter;
+    u_char          *frame;
+    u_int64_t        address;
+    u_int32_t        producer;
+    int              attempt;
+
+    if (length + XDP_HEADERS > XDP_FRAME_SIZE) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    /* get a free frame, waiting for the kernel to send some if need be */
+    reap(xsk);
+    for (attempt = 0; (xsk->free_count == 0) && (attempt < 100); ++attempt) {
+        sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+        waiter.fd      = xsk->fd;
+        waiter.events  = POLLOUT;
+        waiter.revents = 0;
+        poll(&waiter, 1, 10);
+        reap(xsk);
+    }
+    if (xsk->free_count == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    address = xsk->free[--(xsk->free_count)];
+    frame   = xsk->umem.memory + address;
+
+    /* fill in the headers and the datagram */
+    memcpy(frame, xsk->header, XDP_HEADERS);
+    *((u_int16_t *) (frame + 16)) = htons(20 + 8 + length);
+    *((u_int16_t *) (frame + 18)) = htons(xsk->ip_id++);
+    *((u_int16_t *) (frame + 24)) = ip_checksum(frame + 14);
+    *((u_int16_t *) (frame + 38)) = htons(8 + length);
+    memcpy(frame + XDP_HEADERS, datagram, length);
+
+    /* queue it and kick the kernel */
+    producer   = *(xsk->tx.producer);
+    descriptor = &((struct xdp_desc *) xsk->tx.descriptors)[producer & xsk->tx.mask];
+    descriptor->addr    = address;
+    descriptor->len     = XDP_HEADERS + length;
+    descriptor->options = 0;
+    __atomic_store_n(xsk->tx.producer, producer + 1, __ATOMIC_RELEASE);
+    if ((sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0) &&
+        (errno != EAGAIN) && (errno != EBUSY) && (errno != ENOBUFS))
+        return -1;
+
+    ++(xsk->frames);
+    return length;
+}
+
+
+/*------------------------------------------------------------------------
+ * ssize_t xdp_recv(xdp_socket_t *xsk, int data_fd, u_char *buffer,
+ *                  size_t length, u_char **datagram);
+ *
+ * Receives the next datagram, from the AF_XDP socket or else from the
+ * given UDP socket into the given buffer, sleeping in poll() on both
+ * if neither has one.  A datagram from the AF_XDP socket is not copied:
+ * the datagram pointer is set to it in its frame, which stays valid
+ * until the next call.  Returns the length of the datagram, or -1 on
+ * error.
+ *------------------------------------------------------------------------*/
+ssize_t xdp_recv(xdp_socket_t *xsk, int data_fd, u_char *buffer, size_t length, u_char **datagram)
+{
+    struct xdp_desc *descriptor;
+    struct pollfd    waiter[2];
+    u_int32_t        consumer;
+    u_char          *frame;
+    ssize_t          status;
+
+    /* give the frame of the last datagram back to the kernel */
+    refill(xsk);
+
+    while (1) {
+
+        /* a datagram that was redirected to us */
+        consumer = *(xsk->rx.consumer);
+        if (__atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE) != consumer) {
+            descriptor = &((struct xdp_desc *) xsk->rx.descriptors)[consumer & xsk->rx.mask];
+            frame      = xsk->umem.memory + descriptor->addr;
+            xsk->held  = descriptor->addr - (descriptor->addr % XDP_FRAME_SIZE);
+            status     = (descriptor->len >= XDP_HEADERS) ? ntohs(*((u_int16_t *) (frame + 38))) - 8 : -1;
+            __atomic_store_n(xsk->rx.consumer, consumer + 1, __ATOMIC_RELEASE);
+            if ((status < 0) || (status > (ssize_t) (descriptor->len - XDP_HEADERS))) {
+                refill(xsk);   /* a malformed frame must not be lost to the fill ring */
+                continue;
+            }
+            ++(xsk->frames);
+            *datagram = frame + XDP_HEADERS;
+            return status;
+        }
+
+        /* or one that came the ordinary way */
+        status = recv(data_fd, buffer, length, MSG_DONTWAIT);
+        if (status >= 0) {
+            ++(xsk->fallback);
+            *datagram = buffer;
+            return status;
+        }
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            return -1;
+
+        /* sleep until either has one */
+        waiter[0].fd      = xsk->fd;
+        waiter[0].events  = POLLIN;
+        waiter[0].revents = 0;
+        waiter[1].fd      = data_fd;
+        waiter[1].events  = POLLIN;
+        waiter[1].revents = 0;
+        if ((poll(waiter, 2, -1) < 0) && (errno != EINTR))
+            return -1;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * void xdp_close(xdp_socket_t *xsk);
+ *
+ * Detaches the XDP program, if any, closes the AF_XDP socket and frees
+ * its frames and rings.
+ *------------------------------------------------------------------------*/
+void xdp_close(xdp_socket_t *xsk)
+{
+    xdp_ring_t *rings[4] = { &xsk->fill, &xsk->completion, &xsk->rx, &xsk->tx };
+    int         index;
+
+    if (xsk->link_fd    >= 0) close(xsk->link_fd);
+    if (xsk->program_fd >= 0) close(xsk->program_fd);
+    if (xsk->map_fd     >= 0) close(xsk->map_fd);
+    for (index = 0; index < 4; ++index)
+        if (rings[index]->map != NULL)
+            munmap(rings[index]->map, rings[index]->map_length);
+    if (xsk->fd >= 0) close(xsk->fd);
+    if (xsk->umem.memory != NULL) bufpool_destroy(&xsk->umem);
+    if (xsk->free != NULL) free(xsk->free);
+
+    memset(xsk, 0, sizeof(*xsk));
+    xsk->fd = xsk->program_fd = xsk->map_fd = xsk->link_fd = -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * int map_ring(xdp_socket_t *xsk, xdp_ring_t *ring,
+ *              const struct xdp_ring_offset *offset, size_t entry_size,
+ *              off_t page_offset);
+ *
+ * Maps one of the rings of the AF_XDP socket.  Returns 0 on success
+ * and -1 on failure.
+ *------------------------------------------------------------------------*/
+int map_ring(xdp_socket_t *xsk, xdp_ring_t *ring, const struct xdp_ring_offset *offset, size_t entry_size, off_t page_offset)
+{
+    ring->map_length = offset->desc + XDP_RING_SIZE * entry_size;
+    ring->map        = mmap(NULL, ring->map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk->fd, page_offset);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer    = (u_int32_t *) ((u_char *) ring->map + offset->producer);
+    ring->consumer    = (u_int32_t *) ((u_char *) ring->map + offset->consumer);
+    ring->descriptors = (u_char *) ring->map + offset->desc;
+    ring->mask        = XDP_RING_SIZE - 1;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int attach(xdp_socket_t *xsk, u_int16_t port, int mode);
+ *
+ * Puts the AF_XDP socket into a new XSKMAP at its queue, and attaches
+ * an XDP program to its interface that redirects the unfragmented
+ * IPv4 UDP datagrams for the given port (in network byte order) to the
+ * entry of the queue they arrive on, and passes everything else, and
+ * the datagrams on queues without an entry, on to the kernel.  The
+ * program goes away with the socket.  Returns 0 on success and -1 on
+ * failure.
+ *------------------------------------------------------------------------*/
+int attach(xdp_socket_t *xsk, u_int16_t port, int mode)
+{
+    union bpf_attr  attribute;
+    char            log[4096];
+    u_int32_t       key = xsk->queue;
+    u_int32_t       value = xsk->fd;
+    struct bpf_insn program[] = {
+        INSN(BPF_LDX | BPF_MEM | BPF_W,   BPF_REG_2, BPF_REG_1, 0, 0),   /*  0: r2 = ctx->data              */
+        INSN(BPF_LDX | BPF_MEM | BPF_W,   BPF_REG_3, BPF_REG_1, 4, 0),   /*  1: r3 = ctx->data_end          */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),   /*  2: r4 = r2                     */
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, XDP_HEADERS), /*  3: r4 += headers               */
+        INSN(BPF_JMP | BPF_JGT | BPF_X,   BPF_REG_4, BPF_REG_3, 17, 0),  /*  4: too short, pass             */
+        INSN(BPF_LDX | BPF_MEM | BPF_H,   BPF_REG_5, BPF_REG_2, 12, 0),  /*  5: r5 = ethertype              */
+        INSN(BPF_JMP | BPF_JNE | BPF_K,   BPF_REG_5, 0, 15, htons(0x0800)), /* 6: not IPv4, pass        */
+        INSN(BPF_LDX | BPF_MEM | BPF_B,   BPF_REG_5, BPF_REG_2, 14, 0),  /*  7: r5 = version and length     */
+        INSN(BPF_JMP | BPF_JNE | BPF_K,   BPF_REG_5, 0, 13, 0x45),       /*  8: IP options, pass            */
+        INSN(BPF_LDX | BPF_MEM | BPF_H,   BPF_REG_5, BPF_REG_2, 20, 0),  /*  9: r5 = fragment offset        */
+        INSN(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3fff)), /* 10: without DF             */
+        INSN(BPF_JMP | BPF_JNE | BPF_K,   BPF_REG_5, 0, 10, 0),          /* 11: a fragment, pass            */
+        INSN(BPF_LDX | BPF_MEM | BPF_B,   BPF_REG_5, BPF_REG_2, 23, 0),  /* 12: r5 = protocol               */
+        INSN(BPF_JMP | BPF_JNE | BPF_K,   BPF_REG_5, 0, 8, IPPROTO_UDP), /* 13: not UDP, pass               */
+        INSN(BPF_LDX | BPF_MEM | BPF_H,   BPF_REG_5, BPF_REG_2, 36, 0),  /* 14: r5 = destination port       */
+        INSN(BPF_JMP | BPF_JNE | BPF_K,   BPF_REG_5, 0, 6, port),        /* 15: not ours, pass              */
+        INSN(BPF_LDX | BPF_MEM | BPF_W,   BPF_REG_2, BPF_REG_1, 16, 0),  /* 16: r2 = ctx->rx_queue_index    */
+        INSN(BPF_LD | BPF_DW | BPF_IMM,   BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, 0), /* 17: r1 = the map        */
+        INSN(0, 0, 0, 0, 0),                                             /* 18: (second half of 17)         */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),    /* 19: r3 = pass if no entry       */
+        INSN(BPF_JMP | BPF_CALL,          0, 0, 0, BPF_FUNC_redirect_map), /* 20: redirect                  */
+        INSN(BPF_JMP | BPF_EXIT,          0, 0, 0, 0),                   /* 21: return that                 */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),    /* 22: pass                        */
+        INSN(BPF_JMP | BPF_EXIT,          0, 0, 0, 0),                   /* 23: return that                 */
+    };
+
+    /* the map of sockets by queue */
+    memset(&attribute, 0, sizeof(attribute));
+    attribute.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attribute.key_size    = sizeof(u_int32_t);
+    attribute.value_size  = sizeof(u_int32_t);
+    attribute.max_entries = XDP_QUEUES;
+    xsk->map_fd = bpf_call(BPF_MAP_CREATE, &attribute);
+    if (xsk->map_fd < 0)
+        return warn("Could not create XSKMAP (needs CAP_BPF)");
+    memset(&attribute, 0, sizeof(attribute));
+    attribute.map_fd = xsk->map_fd;
+    attribute.key    = (u_int64_t) (unsigned long) &key;
+    attribute.value  = (u_int64_t) (unsigned long) &value;
+    if (bpf_call(BPF_MAP_UPDATE_ELEM, &attribute) < 0)
+        return warn("Could not enter the AF_XDP socket into the XSKMAP");
+
+    /* the program */
+    program[17].imm = xsk->map_fd;
+    memset(&attribute, 0, sizeof(attribute));
+    attribute.prog_type = BPF_PROG_TYPE_XDP;
+    attribute.insns     = (u_int64_t) (unsigned long) program;
+    attribute.insn_cnt  = sizeof(program) / sizeof(program[0]);
+    attribute.license   = (u_int64_t) (unsigned long) "BSD";
+    attribute.log_buf   = (u_int64_t) (unsigned long) log;
+    attribute.log_size  = sizeof(log);
+    attribute.log_level = 1;
+    log[0] = '\0';
+    xsk->program_fd = bpf_call(BPF_PROG_LOAD, &attribute);
+    if (xsk->program_fd < 0) {
+        sprintf(g_error, "Could not load the XDP program (%s) %.200s", strerror(errno), log);
+        return warn(g_error);
+    }
+
+    /* and its attachment to the interface */
+    memset(&attribute, 0, sizeof(attribute));
+    attribute.link_create.prog_fd        = xsk->program_fd;
+    attribute.link_create.target_ifindex = xsk->ifindex;
+    attribute.link_create.attach_type    = BPF_XDP;
+    attribute.link_create.flags          = (mode == XDP_MODE_SKB) ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    xsk->link_fd = bpf_call(BPF_LINK_CREATE, &attribute);
+    if (xsk->link_fd < 0) {
+        sprintf(g_error, "Could not attach the XDP program to %s (%s), is another one there?", xsk->device, strerror(errno));
+        return warn(g_error);
+    }
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int bpf_call(int command, union bpf_attr *attribute);
+ *
+ * Calls the bpf() system call, which the C library has no wrapper for.
+ *------------------------------------------------------------------------*/
+int bpf_call(int command, union bpf_attr *attribute)
+{
+    return (int) syscall(__NR_bpf, command, attribute, sizeof(*attribute));
+}
+
+
+/*------------------------------------------------------------------------
+ * int find_device(int fd, char *device, size_t length,
+ *                 struct in_addr *address);
+ *
+ * Finds the name of the network interface that has the local IPv4
+ * address of the given socket, and that address.  Returns 0 on success
+ * and -1 if there is none.
+ *------------------------------------------------------------------------*/
+int find_device(int fd, char *device, size_t length, struct in_addr *address)
+{
+    struct sockaddr_in  local;
+    socklen_t           local_length = sizeof(local);
+    struct ifaddrs     *interfaces, *entry;
+    int                 found = -1;
+
+    if ((getsockname(fd, (struct sockaddr *) &local, &local_length) < 0) || (local.sin_family != AF_INET))
+        return -1;
+    if (getifaddrs(&interfaces) < 0)
+        return -1;
+
+    for (entry = interfaces; (entry != NULL) && (found < 0); entry = entry->ifa_next) {
+        if ((entry->ifa_addr == NULL) || (entry->ifa_addr->sa_family != AF_INET) ||
+            (((struct sockaddr_in *) entry->ifa_addr)->sin_addr.s_addr != local.sin_addr.s_addr))
+            continue;
+        snprintf(device, length, "%s", entry->ifa_name);
+        *address = local.sin_addr;
+        found = 0;
+    }
+
+    freeifaddrs(interfaces);
+    return found;
+}
+
+
+/*------------------------------------------------------------------------
+ * int find_neighbour(const char *device, struct in_addr address,
+ *                    u_char *mac);
+ *
+ * Looks up the hardware address of the given IPv4 address on the given
+ * interface in the neighbour table of the kernel, or that of the
+ * gateway the kernel routes the address through, if it is not on the
+ * link.  Returns 0 on success and -1 if there is no complete entry.
+ *------------------------------------------------------------------------*/
+int find_neighbour(const char *device, struct in_addr address, u_char *mac)
+{
+    FILE         *table;
+    char          line[256], name[64], ip[64], hardware[64];
+    unsigned int  flags, byte[6];
+    unsigned long destination, gateway, mask, best_mask = 0;
+    struct in_addr next_hop = address;
+    int           found = -1, index;
+
+    /* the gateway of the most specific route to the address, if any */
+    table = fopen("/proc/net/route", "r");
+    if (table != NULL) {
+        while (fgets(line, sizeof(line), table) != NULL) {
+            if ((sscanf(line, "%63s %lx %lx %x %*d %*d %*d %lx", name, &destination, &gateway, &flags, &mask) == 5) &&
+                !strcmp(name, device) && ((address.s_addr & mask) == destination) && (mask >= best_mask)) {
+                best_mask       = mask;
+                next_hop.s_addr = (gateway != 0) ? (in_addr_t) gateway : address.s_addr;
+            }
+        }
+        fclose(table);
+    }
+
+    /* and its hardware address */
+    table = fopen("/proc/net/arp", "r");
+    if (table == NULL)
+        return -1;
+    while ((found < 0) && (fgets(line, sizeof(line), table) != NULL)) {
+        if ((sscanf(line, "%63s %*s %x %63s %*s %63s", ip, &flags, hardware, name) != 4) ||
+            strcmp(name, device) || strcmp(ip, inet_ntoa(next_hop)) || !(flags & 0x2) ||
+            (sscanf(hardware, "%x:%x:%x:%x:%x:%x", &byte[0], &byte[1], &byte[2], &byte[3], &byte[4], &byte[5]) != 6))
+            continue;
+        for (index = 0; index < 6; ++index)
+            mac[index] = (u_char) byte[index];
+        found = 0;
+    }
+    fclose(table);
+    return found;
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int16_t ip_checksum(const u_char *header);
+ *
+ * Returns the checksum of the given 20-byte IPv4 header, with its
+ * checksum field as zero, in network byte order.
+ *------------------------------------------------------------------------*/
+u_int16_t ip_checksum(const u_char *header)
+{
+    u_int32_t sum = 0;
+    int       index;
+
+    for (index = 0; index < 20; index += 2)
+        if (index != 10)
+            sum += (header[index] << 8) | header[index + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return htons((u_int16_t) ~sum);
+}
+
+
+/*------------------------------------------------------------------------
+ * void reap(xdp_socket_t *xsk);
+ *
+ * Takes the frames that the kernel has sent back into the free list.
+ *------------------------------------------------------------------------*/
+void reap(xdp_socket_t *xsk)
+{
+    u_int32_t consumer = *(xsk->completion.consumer);
+    u_int32_t producer = __atomic_load_n(xsk->completion.producer, __ATOMIC_ACQUIRE);
+
+    while (consumer != producer)
+        xsk->free[xsk->free_count++] = ((u_int64_t *) xsk->completion.descriptors)[consumer++ & xsk->completion.mask];
+    __atomic_store_n(xsk->completion.consumer, consumer, __ATOMIC_RELEASE);
+}
+
+
+/*------------------------------------------------------------------------
+ * void refill(xdp_socket_t *xsk);
+ *
+ * Gives the frame of the last received datagram, if one is held, back
+ * to the kernel on the fill ring.
+ *------------------------------------------------------------------------*/
+void refill(xdp_socket_t *xsk)
+{
+    u_int32_t producer;
+
+    if (xsk->held == XDP_NO_FRAME)
+        return;
+    producer = *(xsk->fill.producer);
+    ((u_int64_t *) xsk->fill.descriptors)[producer & xsk->fill.mask] = xsk->held;
+    __atomic_store_n(xsk->fill.producer, producer + 1, __ATOMIC_RELEASE);
+    xsk->held = XDP_NO_FRAME;
+}
+
+#else
+
+/*------------------------------------------------------------------------
+ * Without AF_XDP (no --enable-xdp, or not Linux) the data path always
+ * takes the UDP socket.
+ *------------------------------------------------------------------------*/
+
+int xdp_open(xdp_socket_t *xsk, int control_fd, int data_fd, int mode, u_int32_t queue, u_char receive)
+{
+    memset(xsk, 0, sizeof(*xsk));
+    return warn("AF_XDP support was not compiled in");
+}
+
+int xdp_target(xdp_socket_t *xsk, const struct sockaddr *to, int data_fd)
+{
+    return -1;
+}
+
+ssize_t xdp_send(xdp_socket_t *xsk, const u_char *datagram, size_t length)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+ssize_t xdp_recv(xdp_socket_t *xsk, int data_fd, u_char *buffer, size_t length, u_char **datagram)
+{
+    *datagram = buffer;
+    return recv(data_fd, buffer, length, 0);
+}
+
+void xdp_close(xdp_socket_t *xsk)
+{
+    memset(xsk, 0, sizeof(*xsk));
+}
+
+#endif
+
+
+/*------------------------------------------------------------------------
+ * int xdp_parse_mode(const char *name);
+ *
+ * Returns the XDP_MODE_* of the given name: 'off' (or 'no'), 'skb' (or
+ * 'generic'), or 'native', or -1 if it is none of these.
+ *------------------------------------------------------------------------*/
+int xdp_parse_mode(const char *name)
+{
+    if (!strcasecmp(name, "off") || !strcasecmp(name, "no"))
+        return XDP_MODE_OFF;
+    if (!strcasecmp(name, "skb") || !strcasecmp(name, "generic"))
+        return XDP_MODE_SKB;
+    if (!strcasecmp(name, "native"))
+        return XDP_MODE_NATIVE;
+    return -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * const char *xdp_mode_name(int mode);
+ *
+ * Returns the name of the given XDP_MODE_*.
+ *------------------------------------------------------------------------*/
+const char *xdp_mode_name(int mode)
+{
+    return (mode == XDP_MODE_SKB) ? "skb" : (mode == XDP_MODE_NATIVE) ? "native" : "off";
+}
+
+
+/*========================================================================
+ * $Log$
+ */
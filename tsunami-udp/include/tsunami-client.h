@@ -76,12 +76,14 @@
  *------------------------------------------------------------------------*/
 
 extern const u_int32_t  DEFAULT_BLOCK_SIZE;     /* default size of a single file block          */
+extern const u_char     DEFAULT_BLOCKSIZE_AUTO; /* the default for fitting blocks into the MTU  */
 extern const int        DEFAULT_TABLE_SIZE;     /* initial size of the retransmission table     */
 extern const char      *DEFAULT_SERVER_NAME;    /* default name of the remote server            */
 extern const u_int16_t  DEFAULT_SERVER_PORT;    /* default TCP port of the remote server        */
 extern const u_int16_t  DEFAULT_CLIENT_PORT;    /* default UDP port of the client               */
 extern const u_int16_t  DEFAULT_UDP_PORT;       /* default UDP port of the client               */
 extern const u_int32_t  DEFAULT_UDP_BUFFER;     /* default size of the UDP receive buffer       */
+extern const u_int32_t  DEFAULT_BUFFER_MAX;     /* default cap of each auto-sized buffer        */
 extern const u_char     DEFAULT_VERBOSE_YN;     /* the default verbosity setting                */
 extern const u_char     DEFAULT_TRANSCRIPT_YN;  /* the default transcript setting               */
 extern const u_char     DEFAULT_IPV6_YN;        /* the default IPv6 setting                     */
@@ -97,6 +99,17 @@ extern const u_int16_t  DEFAULT_HISTORY;        /* default percentage of history
 extern const u_char     DEFAULT_LOSSLESS;       /* default client policy for retransmit request */
 extern const u_int32_t  DEFAULT_LOSSWINDOW_MS;  /* default time window (msec) for semi-lossless */
 extern const u_char     DEFAULT_BLOCKDUMP;      /* the default to write bitmap dump to a file   */
+extern const u_char     DEFAULT_AGGREGATE;      /* the default to fetch 'get *' as one stream   */
+extern const u_char     DEFAULT_FASTSTART;      /* the default to start at the cached path rate */
+extern const u_int32_t  DEFAULT_REORDER;        /* default later blocks before a gap is NACKed  */
+extern const u_int32_t  DEFAULT_REORDER_MS;     /* default wait (msec) before a gap is NACKed   */
+extern const char      *DEFAULT_CPUS;           /* default CPUs of the receive and disk threads */
+extern const u_int32_t  DEFAULT_BUSYPOLL;       /* default busy-poll time (usec), 0 to block    */
+extern const u_char     DEFAULT_RXLATENCY;      /* default for measuring the wake-up latency    */
+extern const u_char     DEFAULT_TIMESTAMPS;     /* default for following the one-way delay      */
+extern const u_int32_t  DEFAULT_DELAY_TARGET;   /* default queueing delay (msec) to back off at */
+extern const int        DEFAULT_XDP_MODE;       /* default AF_XDP mode of the data path         */
+extern const u_int32_t  DEFAULT_XDP_QUEUE;      /* default queue to receive on with AF_XDP      */
 
 #define DEFAULT_SECRET             "kitten"     /* the default passphrase for servers */
 
@@ -105,11 +118,33 @@ extern const u_char     DEFAULT_BLOCKDUMP;      /* the default to write bitmap d
 
 #define MAX_COMMAND_WORDS          10           /* maximum number of words in any command       */
 #define MAX_RETRANSMISSION_BUFFER  2048         /* maximum number of requests to send at once   */
-#define MAX_BLOCKS_QUEUED          4096         /* maximum number of blocks in ring buffer      */
+#define MAX_SACK_RANGES            32           /* maximum received ranges reported at once     */
+#define MAX_REORDER_WINDOW         65536        /* maximum later blocks before a gap is NACKed  */
+#define SUSPECT_TABLE_SIZE         1024         /* initial size of the table of suspected gaps  */
+#define MAX_BLOCKS_QUEUED          4096         /* least number of blocks in ring buffer        */
+#define MIN_UDP_BUFFER             20000000     /* least auto-sized UDP receive buffer (bytes)  */
+#define MAX_AUTO_MTU               9216         /* largest frame auto-sized blocks fill, jumbo  */
+#define MTU_PROBES                 4            /* most DF probes to find the path MTU          */
+#define MTU_PROBE_WAIT_MIN         20000        /* least wait (usec) for ICMP after a probe     */
+#define MTU_PROBE_WAIT_MAX         1000000      /* most wait (usec) for ICMP after a probe      */
+#define MTU_PROBE_PORT             9            /* UDP port the probes go to, 'discard'         */
+#define DISK_SAMPLE_BLOCKS         64           /* least blocks written for a disk rate sample  */
 #define UPDATE_PERIOD              350000LL     /* length of the update period in microseconds  */
 
 extern const int        MAX_COMMAND_LENGTH;     /* maximum length of a single command           */
 
+#define SINK_FILE                  0            /* blocks are written to the local file         */
+#define SINK_NULL                  1            /* blocks are dropped, no ring or disk thread   */
+#define SINK_VERIFY                2            /* blocks are checked against synthetic pattern */
+#define SINK_NULL_NAME             "/dev/null"  /* local file name selecting SINK_NULL          */
+#define SINK_VERIFY_NAME           "!verify"    /* local file name selecting SINK_VERIFY        */
+
+#define PROFILE_FILE_NAME          ".tsunami_profile"  /* the path profile cache in $HOME   */
+#define PROFILE_MAX_AGE            (30*24*3600) /* seconds until a cached profile is ignored     */
+#define PROFILE_MIN_SECONDS        1.0          /* shortest transfer that updates the profile   */
+#define PROFILE_START              0.9          /* start at this fraction of the cached rate    */
+#define PROFILE_LOSSY_START        0.75         /* the same if it needed too many retransmits   */
+
 #define RINGBUF_BLOCKS             1            /* Size of ring buffer (disabled now)           */
 #define START_VSIB_PACKET          14500        /* When to start output                         */
                                                 /* 2000 packets per second, now 8 second delay  */
@@ -143,6 +178,21 @@ typedef struct {
     double              error_rate;               /* the smoothed error rate (% x 1000)          */
     u_int64_t           start_udp_errors;         /* the initial UDP error counter value of OS   */
     u_int64_t           this_udp_errors;          /* the current UDP error counter value of OS   */
+    u_int32_t           total_reordered;          /* the number of originals that arrived late   */
+    u_int32_t           this_spurious;            /* the number of duplicates in this interval   */
+    u_int32_t           total_spurious;           /* the total number of duplicate blocks        */
+    u_int32_t           this_disk_blocks;         /* the blocks written before this interval     */
+    u_int64_t           this_disk_usec;           /* the write time before this interval (usec)  */
+    double              disk_rate;                /* the smoothed rate the disk can write (bps)  */
+    u_int32_t           disk_ceiling;             /* the rate ceiling sent to the server (kbps)  */
+    u_int32_t           this_stalls;              /* the server read stalls in this interval     */
+    u_int32_t           total_stalls;             /* the total number of server read stalls      */
+    u_int64_t           total_stall_usec;         /* their total length (usec)                   */
+    owd_estimator_t     owd;                      /* the one-way delay of the stamped blocks     */
+    double              queueing_delay;           /* the queueing delay of the last interval     */
+    double              queueing_sum;             /* the sum of the queueing delays (usec)       */
+    double              queueing_max;             /* the largest queueing delay (usec)           */
+    u_int32_t           queueing_intervals;       /* the intervals with a queueing delay         */
 } statistics_t;
 
 /* state of the retransmission table for a transfer */
@@ -150,11 +200,36 @@ typedef struct {
     u_int32_t          *table;                    /* the table of retransmission blocks          */
     u_int32_t           table_size;               /* the size of the retransmission table        */
     u_int32_t           index_max;                /* the maximum table index in active use       */
+    u_int64_t          *requested;                /* when each entry was last requested, or 0    */
+    u_char             *queued;                   /* bitfield of the blocks in the table         */
+    rtt_estimator_t     rtt;                      /* the turnaround time of the requests         */
+    u_int32_t           probe_block;              /* the block timed for an RTT sample, or 0     */
+    struct timeval      probe_time;               /* when the probe block was requested          */
+    struct timeval      last_repeat;              /* when the requests were last looked at       */
+    u_int64_t           server_busy;              /* when the server should be through them      */
 } retransmit_t;
 
+/* a gap in the original blocks that may yet be filled by reordering */
+typedef struct {
+    u_int32_t           first;                    /* the first missing block                     */
+    u_int32_t           last;                     /* the last missing block                      */
+    u_int32_t           arrivals;                 /* the block count when the gap was seen       */
+    struct timeval      seen;                     /* when the gap was seen                       */
+} suspect_t;
+
+/* state of the reordering-tolerant loss detection for a transfer */
+typedef struct {
+    suspect_t          *gaps;                     /* ring of the suspected gaps, oldest first    */
+    u_int32_t           size;                     /* the size of the ring                        */
+    u_int32_t           head;                     /* the index of the oldest gap                 */
+    u_int32_t           count;                    /* the number of gaps in the ring              */
+    u_int32_t           extent;                   /* the largest recent reordering (in blocks)   */
+    u_int32_t           window;                   /* the later blocks before a gap is NACKed     */
+} reorder_t;
+
 /* ring buffer for queuing blocks to be written to disk */
 typedef struct {
-    u_char             *datagrams;                /* the collection of queued datagrams          */
+    bufpool_t           pool;                     /* the slots of the queued datagrams           */
     int                 datagram_size;            /* the size of a single datagram               */
     int                 base_data;                /* the index of the first slot with data       */
     int                 count_data;               /* the number of slots in use for data         */
@@ -164,6 +239,9 @@ typedef struct {
     int                 data_ready;               /* nonzero when data is ready, else 0          */
     pthread_cond_t      space_ready_cond;         /* condition variable to indicate space ready  */
     int                 space_ready;              /* nonzero when space is available, else 0     */
+    int                 slots;                    /* the number of datagrams the ring holds      */
+    u_int32_t           disk_blocks;              /* the number of blocks written by the thread  */
+    u_int64_t           disk_usec;                /* the time spent writing them (usec)          */
 } ring_buffer_t;
 
 /* Tsunami transfer protocol parameters */
@@ -171,12 +249,14 @@ typedef struct {
     char               *server_name;              /* the name of the host running tsunamid       */
     u_int16_t           server_port;              /* the TCP port on which the server listens    */
     u_int16_t           client_port;              /* the UDP port on which the client receives   */
-    u_int32_t           udp_buffer;               /* the size of the UDP receive buffer in bytes */
+    u_int32_t           udp_buffer;               /* the size of the UDP receive buffer, 0=auto  */
+    u_int32_t           buffer_max;               /* the most bytes for an auto-sized buffer     */
     u_char              verbose_yn;               /* 1 for verbose mode, 0 for quiet             */
     u_char              transcript_yn;            /* 1 for transcripts on, 0 for no transcript   */
     u_char              ipv6_yn;                  /* 1 for IPv6, 0 for IPv4                      */
     u_char              output_mode;              /* either SCREEN_MODE or LINE_MODE             */
     u_int32_t           block_size;               /* the size of each block (in bytes)           */
+    u_char              blocksize_auto;           /* 1 to fit each block into one path MTU frame */
     u_int32_t           target_rate;              /* the transfer rate that we're targetting     */
     u_char              rate_adjust;              /* 1 for adjusting target to achieved rate     */
     u_int32_t           error_rate;               /* the threshhold error rate (in % x 1000)     */
@@ -188,6 +268,20 @@ typedef struct {
     u_char              lossless;                 /* 1 for lossless, 0 for data rate priority    */
     u_int32_t           losswindow_ms;            /* data rate priority: time window for re-tx's */
     u_char              blockdump;                /* 1 to write received block bitmap to a file  */
+    u_char              aggregate;                /* 1 to fetch 'get *' as one aggregated stream */
+    u_char              faststart;                /* 1 to start at the cached rate of the path   */
+    u_int32_t           reorder;                  /* least later blocks before a gap is NACKed   */
+    u_int32_t           reorder_ms;               /* longest wait (msec) before a gap is NACKed  */
+    char                *impair;                  /* the impairment settings of the data path    */
+    char                *rx_cpus;                 /* the CPUs of the receive loop, or 'auto'     */
+    char                *disk_cpus;               /* the CPUs of the disk thread, or 'auto'      */
+    u_int32_t           busypoll;                 /* usec to busy-poll after a block, 0 to block */
+    u_char              rxlatency;                /* 1 to measure the wake-up latency            */
+    u_char              timestamps;               /* 1 to follow the one-way delay of the blocks */
+    u_int32_t           delay_target;             /* queueing delay (msec) to back off at, 0=off */
+    int                 xdp_mode;                 /* the AF_XDP mode of the data path, XDP_MODE_* */
+    u_int32_t           xdp_queue;                /* the queue of the interface to receive on    */
+    char                *paths;                   /* our addresses of the extra data paths, or NULL */
     char                *passphrase;              /* the passphrase to use for authentication    */
     char                *ringbuf;                 /* Pointer to ring buffer start                */
 } ttp_parameter_t;    
@@ -206,6 +300,7 @@ typedef struct {
     u_int32_t           next_block;               /* the index of the next block we expect       */
     u_int32_t           gapless_to_block;         /* the last block in the fully received range  */
     retransmit_t        retransmit;               /* the retransmission data for the transfer    */
+    reorder_t           reorder;                  /* the gaps suspected to be reordering         */
     statistics_t        stats;                    /* the statistical data for the transfer       */
     ring_buffer_t      *ring_buffer;              /* the blocks waiting for a disk write         */
     u_char             *received;                 /* bitfield for the received blocks of data    */
@@ -213,9 +308,33 @@ typedef struct {
     u_char              restart_pending;          /* 1 to ignore too new packets                 */
     u_int32_t           restart_lastidx;          /* the last index in the restart list          */
     u_int32_t           restart_wireclearidx;     /* the max on-wire block number before react   */
-    u_int32_t           on_wire_estimate;         /* the max packets on wire if RTT is 500ms     */
+    u_int32_t           on_wire_estimate;         /* the max packets on wire in two RTTs         */
+    u_int32_t           udp_buffer;               /* the UDP receive buffer to ask for (bytes)   */
+    u_int32_t           ring_slots;               /* the number of blocks the ring buffer holds  */
+    aggregate_t        *aggregate;                /* the member files of an aggregated transfer  */
+    u_char              sink;                     /* SINK_FILE, SINK_NULL or SINK_VERIFY         */
+    int                 synthetic;                /* the synthetic source kind to verify against */
+    u_int64_t           synthetic_seed;           /* the seed of a '!random' source              */
+    u_int32_t           verify_errors;            /* the number of blocks that failed to verify  */
+    u_int32_t           rtt_usec;                 /* the round trip time of the file request     */
+    affinity_t          disk_affinity;            /* the CPUs the disk thread pins itself to     */
+    busypoll_t          rx;                       /* the receive mode and its latency statistics */
+    xdp_socket_t        xdp;                      /* the AF_XDP data path, if active             */
+    int                 path_fd[TS_MAX_PATHS];    /* the UDP socket of each data path            */
+    struct in_addr      path_address[TS_MAX_PATHS]; /* and the address it is bound to           */
+    u_int32_t           path_count;               /* the number of data paths, 0 for just one    */
+    u_int64_t           path_blocks[TS_MAX_PATHS]; /* the datagrams received on each             */
 } ttp_transfer_t;
 
+/* cached operating point of the path to one server */
+typedef struct {
+    u_int32_t           rate;                     /* the file rate reached (in bps)              */
+    u_int32_t           rtt_usec;                 /* the control channel round trip time (usec)  */
+    u_int32_t           loss;                     /* the share of retransmissions (in % x 1000)  */
+    u_int32_t           transfers;                /* the number of transfers folded in           */
+    time_t              updated;                  /* the Unix epoch of the last update           */
+} profile_t;
+
 /* state of a Tsunami session as a whole */
 typedef struct {
     ttp_parameter_t    *parameter;                /* the TTP protocol parameters                 */
@@ -223,6 +342,7 @@ typedef struct {
     FILE               *server;                   /* the connection to the remote server         */
     struct sockaddr    *server_address;           /* the socket address of the remote server     */
     socklen_t           server_address_length;    /* the size of the socket address              */
+    u_char              queue_notices;            /* 1 if the server reports our place in line   */
 } ttp_session_t;
 
 
@@ -230,6 +350,11 @@ typedef struct {
  * Function prototypes.
  *------------------------------------------------------------------------*/
 
+/* aggregate.c */
+int            aggregate_open        (ttp_session_t *session, char *manifest, const char *directory);
+int            aggregate_write       (ttp_session_t *session, u_int32_t block_index, u_char *block, u_int32_t write_size);
+void           aggregate_close       (ttp_session_t *session);
+
 /* command.c */
 int            command_close         (command_t *command, ttp_session_t *session);
 ttp_session_t *command_connect       (command_t *command, ttp_parameter_t *parameter);
@@ -250,17 +375,37 @@ int            accept_block          (ttp_session_t *session, u_int32_t block_in
 /* network.c */
 int            create_tcp_socket     (ttp_session_t *session, const char *server_name, u_int16_t server_port);
 int            create_udp_socket     (ttp_parameter_t *parameter);
+int            probe_path_mtu        (ttp_session_t *session, u_int32_t wait_usec);
+
+/* profile.c */
+int            profile_load          (ttp_session_t *session, profile_t *profile);
+int            profile_save          (ttp_session_t *session, profile_t *sample);
+u_int32_t      profile_start_rate    (ttp_parameter_t *parameter, const profile_t *profile);
 
 /* protocol.c */
+int            ttp_acknowledge       (ttp_session_t *session);
 int            ttp_authenticate      (ttp_session_t *session, u_char *secret);
+int            ttp_confirm_path      (ttp_session_t *session, u_int32_t path, u_int32_t nonce);
 int            ttp_negotiate         (ttp_session_t *session);
 int            ttp_open_port         (ttp_session_t *session);
+int            ttp_open_paths        (ttp_session_t *session);
 int            ttp_open_transfer     (ttp_session_t *session, const char *remote_filename, const char *local_filename);
 int            ttp_repeat_retransmit (ttp_session_t *session);
+int            ttp_request_queue_notices(ttp_session_t *session);
+int            ttp_request_range     (ttp_session_t *session, u_int32_t first, u_int32_t last);
 int            ttp_request_retransmit(ttp_session_t *session, u_int32_t block);
+int            ttp_request_start_rate(ttp_session_t *session, u_int32_t rate);
+int            ttp_request_stall_notices(ttp_session_t *session);
+int            ttp_request_timestamps(ttp_session_t *session);
 int            ttp_request_stop      (ttp_session_t *session);
 int            ttp_update_stats      (ttp_session_t *session);
 
+/* reorder.c */
+int            reorder_suspect       (ttp_session_t *session, u_int32_t first, u_int32_t last);
+int            reorder_release       (ttp_session_t *session, int all);
+void           reorder_arrival       (ttp_session_t *session, u_int32_t block);
+void           reorder_decay         (ttp_session_t *session);
+
 /* ring.c */
 int            ring_cancel           (ring_buffer_t *ring);
 int            ring_confirm          (ring_buffer_t *ring);
@@ -78,14 +78,29 @@ extern const u_int32_t  DEFAULT_BLOCK_SIZE;         /* default size of a single
 extern const u_char    *DEFAULT_SECRET;             /* default shared secret                   */
 extern const u_int16_t  DEFAULT_TCP_PORT;           /* default TCP port to listen on           */
 extern const u_int32_t  DEFAULT_UDP_BUFFER;         /* default size of the UDP transmit buffer */
+extern const u_int32_t  DEFAULT_BUFFER_MAX;         /* default cap of the auto-sized one       */
 extern const u_char     DEFAULT_VERBOSE_YN;         /* the default verbosity setting           */
+extern const char      *DEFAULT_TX_CPUS;            /* the default CPUs of the sending process */
 extern const u_char     DEFAULT_TRANSCRIPT_YN;      /* the default transcript setting          */
 extern const u_char     DEFAULT_IPV6_YN;            /* the default IPv6 setting                */
 extern const u_int16_t  DEFAULT_HEARTBEAT_TIMEOUT;  /* the default timeout after no client heartbeat */
+extern const int        DEFAULT_XDP_MODE;           /* the default AF_XDP mode of the data path */
+extern const u_int32_t  DEFAULT_XDP_QUEUE;          /* the default queue for AF_XDP            */
 
 #define MAX_FILENAME_LENGTH  1024               /* maximum length of a requested filename  */
 #define RINGBUF_BLOCKS  1                       /* Size of ring buffer (disabled now) */
 #define FRAMES_IN_SLOT  40                      /* 0.02s timeslots for computers */
+#define TAIL_PROBE_MIN  2000                    /* first wait (usec) between terminate blocks */
+#define TAIL_PROBE_MAX  20000                   /* longest wait (usec) between them           */
+#define READ_STALL_MIN  5000                    /* shortest block read (usec) that is a stall  */
+#define MIN_UDP_BUFFER  20000000                /* least auto-sized UDP send buffer (bytes)   */
+#define BUDGET_SLOTS    64                      /* most transfers sharing the rate budget     */
+#define BUDGET_STALE    5000000                 /* usec without a report before a transfer no longer counts */
+#define ADMIT_SLOTS     128                     /* most transfers running and queued at once  */
+#define ADMIT_POLL      100                     /* msec between looks at the transfer queue   */
+#define CACHE_CHUNK     262144                  /* bytes of a file read and cached at a time  */
+#define CACHE_WAYS      8                       /* chunks per set of the block cache          */
+#define PATH_PROBES     10                      /* probes of a data path before it is given up */
 
 /*------------------------------------------------------------------------
  * Data structures.
@@ -98,8 +113,19 @@ typedef struct {
     u_char              transcript_yn;  /* transcript mode (0=no, 1=yes)              */
     u_char              ipv6_yn;        /* IPv6 mode (0=no, 1=yes)                    */
     u_int16_t           tcp_port;       /* TCP port number for listening on           */
-    u_int32_t           udp_buffer;     /* size of the UDP send buffer in bytes       */
+    u_int32_t           udp_buffer;     /* size of the UDP send buffer in bytes, 0=auto */
+    u_int32_t           buffer_max;     /* the most bytes for the auto-sized buffer   */
     u_int16_t           hb_timeout;     /* the client heartbeat timeout               */
+    const char         *tx_cpus;        /* the CPUs of the sending process, or 'auto' */
+    int                 xdp_mode;       /* the AF_XDP mode of the data path, XDP_MODE_* */
+    u_int32_t           xdp_queue;      /* the queue of the interface to send on      */
+    u_int32_t           max_paths;      /* the most data paths a client may use, 1=one */
+    struct in_addr      path_source[TS_MAX_PATHS]; /* the address each path sends from */
+    u_int64_t           budget;         /* the rate all transfers share (bps), 0=none */
+    const char         *weights;        /* the 'address=weight' list for the budget   */
+    u_int32_t           max_transfers;  /* the most transfers at once, 0=no limit     */
+    u_int32_t           max_per_volume; /* the most from one source volume, 0=no limit */
+    u_int64_t           cache_size;     /* the shared block cache (bytes), 0=none     */
     const u_char       *secret;         /* the shared secret for users to prove       */
     const char         *client;         /* the alternate client IP to stream to       */
     const u_char       *finishhook;     /* program to run after successful copy       */
@@ -126,6 +152,28 @@ typedef struct {
     long                wait_u_sec;
 } ttp_parameter_t;
 
+/* a range of blocks to retransmit */
+typedef struct {
+    u_int32_t           next;         /* the next block of the range to send        */
+    u_int32_t           last;         /* the last block of the range                */
+} block_range_t;
+
+/* one of several data paths that a transfer is striped over */
+typedef struct {
+    u_char              active;       /* 1 if the client set the path up            */
+    u_char              pending;      /* 1 until the client echoed the probe of it  */
+    u_int32_t           nonce;        /* the random number the probe carries        */
+    u_int32_t           probes;       /* the probes sent on it so far               */
+    int                 fd;           /* its UDP socket (udp_fd for the first one)  */
+    struct sockaddr_in  address;      /* the client address and port it sends to    */
+    double              ipd;          /* its inter-packet delay (usec)              */
+    double              pass;         /* its virtual time in the stride schedule    */
+    u_int32_t           sent;         /* the blocks sent on it this interval        */
+    u_int32_t           lost;         /* the blocks of it the client asked again    */
+    u_int64_t           total_sent;   /* the blocks sent on it in the transfer      */
+    u_int64_t           total_lost;   /* and asked for again                        */
+} ttp_path_t;
+
 /* state of a transfer */
 typedef struct {
     ttp_parameter_t    *parameter;    /* the TTP protocol parameters                */
@@ -136,8 +184,39 @@ typedef struct {
     int                 udp_fd;       /* the file descriptor of our UDP socket      */
     struct sockaddr    *udp_address;  /* the destination for our file data          */
     socklen_t           udp_length;   /* the length of the UDP socket address       */
+    u_int32_t           udp_buffer;   /* the send buffer asked for it (bytes)       */
     double              ipd_current;  /* the inter-packet delay currently in usec   */
+    double              ipd_disk;     /* the least IPD the client's disk keeps up with */
+    double              ipd_read;     /* the least IPD our source keeps up with     */
+    double              ipd_budget;   /* the least IPD of our share of the budget   */
+    int                 budget_slot;  /* our slot in the shared budget, -1 for none */
+    u_int64_t           read_usec;    /* the time spent reading blocks this interval */
+    u_int32_t           read_blocks;  /* the blocks read this interval, not stalled */
+    u_int32_t           read_max;     /* the longest block read this interval (usec) */
+    u_int32_t           read_stall;   /* the length of a stall not yet handled, or 0 */
+    u_int32_t           stalls;       /* the number of read stalls of the transfer  */
+    u_int64_t           stall_usec;   /* their total length (usec)                  */
+    u_char              stall_notices; /* 1 if the client takes TS_BLOCK_STALL blocks */
+    u_char              stamped;       /* 1 if the client wants the send time stamped */
     u_int32_t           block;        /* the current block that we're up to         */
+    aggregate_t        *aggregate;    /* the member files of an aggregated transfer */
+    int                 synthetic;    /* the kind of synthetic source, if any       */
+    u_int64_t           synthetic_seed; /* the seed of a '!random' source           */
+    u_char             *acked;        /* bitfield of the blocks the client has      */
+    u_int32_t           acked_to;     /* the client has every block up to this one  */
+    u_int32_t           skipped;      /* the number of acknowledged blocks not sent */
+    block_range_t       ranges[MAX_RANGE_REQUESTS]; /* the ranges to retransmit     */
+    u_int32_t           range_head;   /* the index of the oldest range              */
+    u_int32_t           range_count;  /* the number of ranges left to send          */
+    struct timeval      tail_probe;   /* when the last terminate block was sent     */
+    u_int32_t           tail_interval; /* the wait (usec) before the next one, or 0 */
+    xdp_socket_t        xdp;          /* the AF_XDP data path, if active            */
+    ttp_path_t          paths[TS_MAX_PATHS]; /* the data paths, if the client added any */
+    u_int32_t           path_count;   /* the number of data paths, 0 for just one   */
+    u_char             *path_of;      /* the path each block was last sent on       */
+    cache_key_t         cache_key;    /* the file in the block cache, if it is used */
+    u_int64_t           cache_hits;   /* the block reads served from the cache      */
+    u_int64_t           cache_misses; /* and those that read a chunk from disk      */
 } ttp_transfer_t;
 
 /* state of a Tsunami session as a whole */
@@ -146,6 +225,7 @@ typedef struct {
     ttp_transfer_t      transfer;     /* the current transfer in progress, if any   */
     int                 client_fd;    /* the connection to the remote client        */
     int                 session_id;   /* the ID of the server session, autonumber   */
+    u_char              queue_notices; /* 1 if the client takes TS_QUEUED replies   */
 } ttp_session_t;
 
 
@@ -153,11 +233,36 @@ typedef struct {
  * Function prototypes.
  *------------------------------------------------------------------------*/
 
+/* admit.c */
+int       admit_create    (ttp_parameter_t *parameter);
+int       admit_wait      (ttp_session_t *session);
+void      admit_leave     (ttp_session_t *session);
+
+/* aggregate.c */
+int       aggregate_open  (ttp_session_t *session);
+int       aggregate_read  (ttp_session_t *session, u_int32_t block_index, u_char *buffer);
+u_int64_t aggregate_size  (ttp_session_t *session);
+void      aggregate_close (ttp_session_t *session);
+
+/* budget.c */
+int       budget_create   (ttp_parameter_t *parameter);
+double    budget_weight   (const char *list, const char *address);
+int       budget_join     (ttp_session_t *session);
+double    budget_ipd      (ttp_session_t *session, double ipd);
+void      budget_leave    (ttp_session_t *session);
+
+/* cache.c */
+int       cache_create    (ttp_parameter_t *parameter);
+int       cache_identify  (FILE *file, cache_key_t *key);
+int       cache_read      (ttp_session_t *session, const cache_key_t *key, FILE *file,
+                           u_int64_t offset, u_char *buffer, u_int32_t length);
+
 /* config.c */
 void reset_server         (ttp_parameter_t *parameter);
 
 /* io.c */
-int  build_datagram       (ttp_session_t *session, u_int32_t block_index, u_int16_t block_type, u_char *datagram);
+int  build_datagram       (ttp_session_t *session, u_int32_t block_index, u_int16_t block_type, u_char *buffer);
+int  send_datagram        (ttp_session_t *session, u_char *buffer);
 
 /* vsibctl.c */
 #ifdef VSIB_REALTIME
@@ -173,12 +278,25 @@ void read_vsib_block(ttp_session_t *session, unsigned char *memblk, size_t blksi
 int  create_tcp_socket    (ttp_parameter_t *parameter);
 int  create_udp_socket    (ttp_parameter_t *parameter);
 
+/* path.c */
+int       path_add        (ttp_session_t *session, u_int32_t index, struct in_addr address, u_int16_t port);
+int       path_confirm    (ttp_session_t *session, u_int32_t index, u_int32_t nonce);
+u_int32_t path_next       (ttp_session_t *session, u_int32_t block);
+void      path_lost       (ttp_session_t *session, u_int32_t block);
+void      path_rate       (ttp_session_t *session, u_int32_t error_rate);
+void      path_start_rate (ttp_session_t *session, double ipd);
+void      path_limit      (ttp_session_t *session);
+void      path_report     (ttp_session_t *session);
+void      path_close      (ttp_session_t *session);
+
 /* protocol.c */
 int  ttp_accept_retransmit(ttp_session_t *session, retransmission_t *retransmission, u_char *datagram);
 int  ttp_authenticate     (ttp_session_t *session, const u_char *secret);
 int  ttp_negotiate        (ttp_session_t *session);
 int  ttp_open_port        (ttp_session_t *session);
 int  ttp_open_transfer    (ttp_session_t *session);
+int  ttp_send_range       (ttp_session_t *session, u_char *datagram);
+int  ttp_send_stall       (ttp_session_t *session);
 
 /* transcript.c */
 void xscript_close        (ttp_session_t *session, u_int64_t delta);
@@ -70,6 +70,7 @@
 
 #include <sys/types.h>  /* for u_char, u_int16_t, etc. */
 #include <sys/time.h>   /* for struct timeval          */
+#include <sys/socket.h> /* for struct sockaddr, etc.   */
 #include <stdio.h>      /* for NULL, FILE *, etc.      */
 
 #include "tsunami-cvs-buildnr.h"   /* for the current TSUNAMI_CVS_BUILDNR */
@@ -87,6 +88,8 @@
 
 #define tv_diff_usec(newer,older) ((newer.tv_sec-older.tv_sec)*1e6 + (newer.tv_usec-older.tv_usec))
 
+#define bufpool_slot(pool,index)  ((pool)->memory + (size_t)(index)*(pool)->slot_size + (pool)->offset)
+
 typedef unsigned long long ull_t;
 
 /*------------------------------------------------------------------------
@@ -95,6 +98,7 @@ typedef unsigned long long ull_t;
 
 #define MAX_ERROR_MESSAGE  512        /* maximum length of an error message */
 #define MAX_BLOCK_SIZE     65530      /* maximum size of a data block       */
+#define MAX_RANGE_REQUESTS 32         /* maximum block ranges asked at once */
 
 extern const u_int32_t PROTOCOL_REVISION;
 
@@ -102,6 +106,14 @@ extern const u_int16_t REQUEST_RETRANSMIT;
 extern const u_int16_t REQUEST_RESTART;
 extern const u_int16_t REQUEST_STOP;
 extern const u_int16_t REQUEST_ERROR_RATE;
+extern const u_int16_t REQUEST_START_RATE;
+extern const u_int16_t REQUEST_SACK;
+extern const u_int16_t REQUEST_RETRANSMIT_RANGE;
+extern const u_int16_t REQUEST_DISK_RATE;
+extern const u_int16_t REQUEST_STALL_NOTICE;
+extern const u_int16_t REQUEST_TIMESTAMPS;
+extern const u_int16_t REQUEST_PATH;
+extern const u_int16_t REQUEST_PATH_CONFIRM;
 
 #define  TS_TCP_PORT    46224   /* default TCP port of the remote server        */
 #define  TS_UDP_PORT    46224   /* default UDP port of the client / 47221       */
@@ -109,8 +121,51 @@ extern const u_int16_t REQUEST_ERROR_RATE;
 #define  TS_BLOCK_ORIGINAL          'O'   /* blocktype "original block" */
 #define  TS_BLOCK_TERMINATE         'X'   /* blocktype "end transmission" */
 #define  TS_BLOCK_RETRANSMISSION    'R'   /* blocktype "retransmitted block" */
+#define  TS_BLOCK_STALL             'S'   /* blocktype "server read stall", the block number holds its usec */
+#define  TS_BLOCK_PATH_PROBE        'P'   /* blocktype "data path probe", the block number holds its nonce */
+#define  TS_BLOCK_STAMPED           0x0100 /* blocktype flag, the send time follows the header */
+#define  TS_STAMP_SIZE              8     /* size of that send time (usec since the epoch)  */
 
 #define  TS_DIRLIST_HACK_CMD        "!#DIR??" /* "file name" sent by the client to request a list of the shared files */
+#define  TS_SYNTHETIC_ZERO_NAME     "!zero:"   /* "file name" prefix of a synthetic all-zero source */
+#define  TS_SYNTHETIC_RANDOM_NAME   "!random:" /* "file name" prefix of a synthetic pseudo-random source */
+
+#define  TS_SYNTHETIC_NONE          0     /* an ordinary file                */
+#define  TS_SYNTHETIC_ZERO          1     /* synthetic source of zero bytes  */
+#define  TS_SYNTHETIC_RANDOM        2     /* synthetic pseudo-random source  */
+
+#define  TS_AGGREGATE_CMD           "!#AGGR??" /* "file name" sent by the client to request all shared files as one stream */
+#define  TS_MANIFEST_MAX            (64*1024*1024) /* longest manifest of an aggregated stream (bytes) */
+#define  TS_QUEUE_CMD               "!#QUEUE??" /* "file name" sent by the client to take reports of its place in the queue */
+#define  TS_QUEUED                  'Q'   /* reply to a file request: still queued, the 4-byte place in the queue follows */
+
+#define  TS_RTO_INITIAL             350000    /* retransmission timeout before any RTT is known (usec) */
+#define  TS_RTO_MIN                 20000     /* lower bound of the retransmission timeout (usec)      */
+#define  TS_RTO_MAX                 3000000   /* upper bound of the retransmission timeout (usec)      */
+#define  TS_DISK_HEADROOM           0.95      /* share of the measured disk write rate asked for       */
+#define  TS_OWD_BASE_HISTORY        10        /* minutes that the base one-way delay is kept for        */
+#define  TS_MAX_PATHS               8         /* most data paths of one transfer, the first included    */
+
+#define  BUFPOOL_CACHE_LINE         64        /* least alignment of the payloads in a buffer pool      */
+#define  BUFPOOL_HUGE_PAGE          (2*1024*1024) /* the huge page size tried for large buffer pools  */
+
+#define  BUSYPOLL_PAUSE_MAX         64        /* most pause instructions between two busy polls        */
+#define  BUSYPOLL_BUCKETS           24        /* power-of-two usec buckets of the wake-up latency      */
+
+#define  XDP_FRAME_SIZE             4096      /* size of one AF_XDP frame (UMEM chunk)                 */
+#define  XDP_FRAMES                 4096      /* frames of UMEM, half for receiving, half for sending  */
+#define  XDP_HEADERS                42        /* Ethernet, IPv4 and UDP header bytes of a frame        */
+#define  XDP_QUEUES                 64        /* highest receive queue number + 1 that can be bound    */
+#define  XDP_DATAGRAM_MAX           3798      /* largest datagram in a frame behind the 256 byte headroom */
+
+#define  XDP_MODE_OFF               0     /* data over the ordinary UDP socket            */
+#define  XDP_MODE_SKB               1     /* AF_XDP in generic (skb) mode, any driver     */
+#define  XDP_MODE_NATIVE            2     /* AF_XDP in driver mode, zero copy if possible */
+
+#define  BUFPOOL_HEAP               0     /* buffer pool allocated on the heap          */
+#define  BUFPOOL_PAGES              1     /* buffer pool mapped in ordinary pages       */
+#define  BUFPOOL_TRANSPARENT_HUGE_PAGES 2 /* buffer pool advised to use huge pages      */
+#define  BUFPOOL_HUGE_PAGES         3     /* buffer pool mapped in reserved huge pages  */
 
 /*------------------------------------------------------------------------
  * Data structures.
@@ -123,6 +178,119 @@ typedef struct {
     u_int32_t           error_rate;    /* the current error rate (in % x 1000)      */
 } retransmission_t;
 
+/* smoothed turnaround time of retransmission requests */
+typedef struct {
+    double              srtt;          /* the smoothed round trip time (usec)       */
+    double              rttvar;        /* the round trip time variation (usec)      */
+    double              rto;           /* the retransmission timeout (usec)         */
+} rtt_estimator_t;
+
+/* one-way delay of the data blocks against the lowest one seen */
+typedef struct {
+    int64_t             base[TS_OWD_BASE_HISTORY]; /* the lowest delay of recent minutes */
+    time_t              base_minute;   /* the minute of the newest base entry       */
+    int64_t             current;       /* the lowest delay of this interval (usec)  */
+    u_int32_t           samples;       /* the samples of this interval              */
+    u_char              valid;         /* 1 once a base delay is known              */
+} owd_estimator_t;
+
+/* identity of a file in the block cache of the server, which changes with the file */
+typedef struct {
+    u_int64_t           device;        /* the device the file is on                 */
+    u_int64_t           inode;         /* its inode number, 0 if it is not cached   */
+    u_int64_t           size;          /* its size (in bytes)                       */
+    int64_t             mtime;         /* its modification time (nsec)              */
+} cache_key_t;
+
+/* one member file of an aggregated multi-file transfer */
+typedef struct {
+    char               *name;          /* the name of the member file               */
+    u_int64_t           offset;        /* the byte offset of the file in the stream */
+    u_int64_t           size;          /* the size of the file (in bytes)           */
+    u_int32_t           mode;          /* the permission bits of the file           */
+} aggregate_entry_t;
+
+/* state of an aggregated multi-file transfer */
+typedef struct {
+    aggregate_entry_t  *entries;       /* the member files in stream order          */
+    u_int32_t           count;         /* the number of member files                */
+    char               *manifest;      /* the manifest text sent to the client      */
+    u_int32_t           manifest_length; /* the length of the manifest text         */
+    FILE               *file;          /* the currently open member file, if any    */
+    int32_t             current;       /* the index of the open member file, or -1  */
+    u_int64_t           position;      /* the file position in the open member file */
+    cache_key_t         key;           /* the open member file in the block cache   */
+} aggregate_t;
+
+
+/* CPUs that a thread of the transfer is pinned to */
+typedef struct {
+    char                cpus[256];     /* the CPU list, empty to run on any CPU     */
+    int                 node;          /* the NUMA node of the CPUs, or -1          */
+    char                device[32];    /* the network interface of the node, if any */
+} affinity_t;
+
+/* state and wake-up latency statistics of the busy-polling receive */
+typedef struct {
+    u_int32_t           spin_usec;     /* how long to poll before sleeping, 0=block */
+    u_char              latency;       /* 1 to measure the wake-up latency          */
+    u_char              kernel;        /* 1 if the kernel busy-polls the device too */
+    u_char              stamps;        /* 1 to keep the arrival time of datagrams   */
+    int64_t             stamp;         /* the arrival time of the last one (usec)   */
+    u_int32_t           turn;          /* the socket to try first of several        */
+    u_int64_t           hardware;      /* the datagrams stamped by the NIC          */
+    u_int64_t           spun;          /* the datagrams received while polling      */
+    u_int64_t           slept;         /* the datagrams received after sleeping     */
+    u_int64_t           samples;       /* the datagrams with a measured latency     */
+    double              latency_sum;   /* the sum of their latencies (usec)         */
+    u_int32_t           latency_max;   /* the largest latency (usec)                */
+    u_int32_t           histogram[BUSYPOLL_BUCKETS]; /* latencies below 2^i usec    */
+} busypoll_t;
+
+/* pool of equal datagram slots with aligned payloads */
+typedef struct {
+    u_char             *memory;        /* the memory of the pool                    */
+    size_t              length;        /* the length of that memory (in bytes)      */
+    u_int32_t           slots;         /* the number of slots in the pool           */
+    size_t              slot_size;     /* the distance between two slots (bytes)    */
+    u_int32_t           offset;        /* the padding in front of each header       */
+    int                 backing;       /* BUFPOOL_HEAP, BUFPOOL_PAGES, etc.         */
+} bufpool_t;
+
+/* one of the rings an AF_XDP socket shares with the kernel */
+typedef struct {
+    u_int32_t          *producer;      /* the producer index                        */
+    u_int32_t          *consumer;      /* the consumer index                        */
+    void               *descriptors;   /* the ring entries                          */
+    u_int32_t           mask;          /* the ring size - 1                         */
+    void               *map;           /* the mapping of the ring                   */
+    size_t              map_length;    /* the length of that mapping                */
+} xdp_ring_t;
+
+/* AF_XDP data path of a transfer */
+typedef struct {
+    u_char              active;        /* 1 if the data goes over AF_XDP            */
+    int                 fd;            /* the AF_XDP socket                         */
+    int                 ifindex;       /* the network interface it is bound to      */
+    char                device[32];    /* the name of that interface                */
+    u_int32_t           queue;         /* the queue it is bound to                  */
+    int                 program_fd;    /* the redirecting XDP program, or -1        */
+    int                 map_fd;        /* the XSKMAP the program redirects to       */
+    int                 link_fd;       /* the attachment of the program, or -1      */
+    bufpool_t           umem;          /* the frames shared with the kernel         */
+    xdp_ring_t          fill;          /* frames handed to the kernel to receive in */
+    xdp_ring_t          completion;    /* frames the kernel has sent                */
+    xdp_ring_t          rx;            /* frames received                           */
+    xdp_ring_t          tx;            /* frames to send                            */
+    u_int64_t          *free;          /* the send frames not in use                */
+    u_int32_t           free_count;    /* the number of those                       */
+    u_int64_t           held;          /* the received frame in use, or ~0          */
+    u_char              header[XDP_HEADERS]; /* the headers to send the blocks with */
+    u_int16_t           ip_id;         /* the IP identification of the next frame   */
+    u_int64_t           frames;        /* the datagrams that went over AF_XDP       */
+    u_int64_t           fallback;      /* the datagrams that took the UDP socket    */
+} xdp_socket_t;
+
 
 /*------------------------------------------------------------------------
  * Global variables.
@@ -135,6 +303,26 @@ extern char g_error[];  /* buffer for the most recent error string    */
  * Function prototypes.
  *------------------------------------------------------------------------*/
 
+/* affinity.c */
+int        affinity_resolve        (const char *spec, int fd, affinity_t *placement);
+int        affinity_pin            (const affinity_t *placement);
+void       affinity_restore        (void);
+char      *affinity_describe       (const affinity_t *placement, char *buffer, size_t length);
+
+/* bufpool.c */
+int        bufpool_create          (bufpool_t *pool, u_int32_t slots, u_int32_t payload_size, u_int32_t header_size);
+int        bufpool_create_shared   (bufpool_t *pool, u_int32_t slots, u_int32_t payload_size, u_int32_t header_size);
+void       bufpool_destroy         (bufpool_t *pool);
+const char *bufpool_backing        (const bufpool_t *pool);
+
+/* busypoll.c */
+int        busypoll_setup          (busypoll_t *rx, int fd, u_int32_t spin_usec, u_char latency, u_char stamps);
+int        busypoll_add            (busypoll_t *rx, int fd);
+ssize_t    busypoll_recv           (busypoll_t *rx, int fd, void *buffer, size_t length);
+ssize_t    busypoll_recv_any       (busypoll_t *rx, const int *fds, u_int32_t count, void *buffer, size_t length, u_int32_t *index);
+u_int32_t  busypoll_percentile     (const busypoll_t *rx, double fraction);
+void       busypoll_report         (const busypoll_t *rx);
+
 /* common.c */
 int        get_random_data         (u_char *buffer, size_t bytes);
 u_int64_t  get_usec_since          (struct timeval *old_time);
@@ -146,8 +334,46 @@ int        read_line               (int fd, char *buffer, size_t buffer_length);
 int        fread_line              (FILE *f, char *buffer, size_t buffer_length);
 void       usleep_that_works       (u_int64_t usec);
 u_int64_t  get_udp_in_errors       ();
+u_int32_t  bdp_size                (u_int32_t rate, u_int32_t rtt_usec, u_int32_t least, u_int32_t most);
+u_int32_t  set_socket_buffer       (int fd, int option, u_int32_t size, u_int32_t *limit);
 ssize_t    full_write              (int, const void*, size_t);
 ssize_t    full_read               (int, void*, size_t);
+int32_t    aggregate_find          (const aggregate_t *aggregate, u_int64_t offset);
+
+/* impair.c */
+int        impair_setup            (const char *spec);
+int        impair_start            (void);
+ssize_t    impair_sendto           (u_int32_t path, int fd, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t tolen);
+int        impair_drop             (u_int32_t block, u_int16_t type);
+void       impair_record           (u_int32_t block, u_int16_t type);
+void       impair_finish           (void);
+
+/* ratecontrol.c */
+double     ratecontrol_error       (double error_rate, u_int16_t history, double retransmits_fraction, double ringfill_fraction);
+u_int32_t  ratecontrol_disk_ceiling(double disk_rate, double ringfill_fraction);
+double     ratecontrol_ipd         (double ipd_current, u_int32_t error_rate, u_int32_t error_target,
+                                    u_int16_t slower_num, u_int16_t slower_den,
+                                    u_int16_t faster_num, u_int16_t faster_den, u_int32_t ipd_time);
+void       ratecontrol_rtt_init    (rtt_estimator_t *rtt, double rtt_usec);
+void       ratecontrol_rtt_sample  (rtt_estimator_t *rtt, double sample_usec);
+void       ratecontrol_rtt_backoff (rtt_estimator_t *rtt);
+void       ratecontrol_owd_sample  (owd_estimator_t *owd, int64_t delay_usec);
+double     ratecontrol_owd_update  (owd_estimator_t *owd, time_t now);
+double     ratecontrol_delay_error (double queueing_usec, u_int32_t target_usec, u_int32_t error_target);
+
+/* xdp.c */
+int        xdp_open                (xdp_socket_t *xsk, int control_fd, int data_fd, int mode, u_int32_t queue, u_char receive);
+int        xdp_target              (xdp_socket_t *xsk, const struct sockaddr *to, int data_fd);
+ssize_t    xdp_send                (xdp_socket_t *xsk, const u_char *datagram, size_t length);
+ssize_t    xdp_recv                (xdp_socket_t *xsk, int data_fd, u_char *buffer, size_t length, u_char **datagram);
+void       xdp_close               (xdp_socket_t *xsk);
+int        xdp_parse_mode          (const char *name);
+const char *xdp_mode_name          (int mode);
+
+/* synthetic.c */
+int        synthetic_parse         (const char *filename, u_int64_t *size, u_int64_t *seed);
+void       synthetic_fill          (int kind, u_int64_t seed, u_int64_t offset, u_char *buffer, u_int32_t length);
+int        synthetic_verify        (int kind, u_int64_t seed, u_int64_t offset, const u_char *buffer, u_int32_t length);
 
 /* error.c */
 int        error_handler           (const char *file, int line, const char *message, int fatal_yn);
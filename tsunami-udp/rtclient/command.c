@@ -271,6 +271,10 @@ int command_get(command_t *command, ttp_session_t *session)
      */
     int             multimode = 0;
     char          **file_names = NULL;
+
+    /* the dedicated CPUs of the receive loop, if any */
+    affinity_t      rx_affinity;
+    char            rx_where[320];
     u_int32_t       f_counter = 0, f_total = 0, f_arrsize = 0;
 
     /* this struct wil hold the RTT time */
@@ -381,6 +385,17 @@ int command_get(command_t *command, ttp_session_t *session)
     if (ttp_open_port(session) < 0)
 	return warn("Creation of data socket failed");
 
+    /* give the receive loop its own CPUs, and busy-poll the data socket if asked to */
+    if ((affinity_resolve(session->parameter->rx_cpus, fileno(session->server), &rx_affinity) < 0) ||
+        (affinity_pin(&rx_affinity) < 0)) {
+        warn("Could not place the receive loop, it runs on any CPU");
+        rx_affinity.cpus[0] = '\0';
+    }
+    if (session->parameter->verbose_yn && (rx_affinity.cpus[0] != '\0'))
+        printf("Receive loop on %s\n", affinity_describe(&rx_affinity, rx_where, sizeof(rx_where)));
+    if (busypoll_setup(&xfer->rx, xfer->udp_fd, session->parameter->busypoll, session->parameter->rxlatency, 0) < 0)
+        warn("Receive mode only partly set up");
+
     /* allocate the retransmission table */
     rexmit->table = (u_int32_t *) calloc(DEFAULT_TABLE_SIZE, sizeof(u_int32_t));
     if (rexmit->table == NULL)
@@ -428,7 +443,7 @@ int command_get(command_t *command, ttp_session_t *session)
    while (1) {
 
       /* try to receive a datagram */
-      status = recvfrom(xfer->udp_fd, local_datagram, 6 + session->parameter->block_size, 0, NULL, 0);
+      status = busypoll_recv(&xfer->rx, xfer->udp_fd, local_datagram, 6 + session->parameter->block_size);
       if (status < 0) {
           warn("UDP data transmission error");
           printf("Apparently frozen transfer, trying to do retransmit request\n");
@@ -661,6 +676,7 @@ int command_get(command_t *command, ttp_session_t *session)
         printf("Data blocks lost      : %Lu (%.2f%% of data) per user-specified time window constraint\n",
                   (ull_t)xfer->stats.total_lost, ( 100.0 * xfer->stats.total_lost ) / xfer->block_count );
     }
+    busypoll_report(&xfer->rx);
     printf("\n");
 
     /* update the transcript */
@@ -694,7 +710,8 @@ int command_get(command_t *command, ttp_session_t *session)
     close(xfer->udp_fd);
     if (xfer->file     != NULL) { fclose(xfer->file);    xfer->file     = NULL; }
 
-    /* deallocate memory */
+    /* deallocate memory, and let the console run anywhere again */
+    affinity_restore();
     ring_destroy(xfer->ring_buffer);
     if (rexmit->table != NULL)  { free(rexmit->table);   rexmit->table  = NULL; }
     if (xfer->received != NULL) { free(xfer->received);  xfer->received = NULL; }
@@ -717,6 +734,7 @@ int command_get(command_t *command, ttp_session_t *session)
  abort:
     fprintf(stderr, "Transfer not successful.  (WARNING: You may need to reconnect.)\n\n");
     close(xfer->udp_fd);
+    affinity_restore();
     ring_destroy(xfer->ring_buffer);
     if (xfer->file     != NULL) { fclose(xfer->file);    xfer->file     = NULL; }
     if (rexmit->table  != NULL) { free(rexmit->table);   rexmit->table  = NULL; }
@@ -870,6 +888,12 @@ int command_set(command_t *command, ttp_parameter_t *parameter)
       else if (!strcasecmp(command->text[1], "lossless"))     parameter->lossless      = (strcmp(command->text[2], "yes") == 0);
       else if (!strcasecmp(command->text[1], "losswindow"))   parameter->losswindow_ms = atol(command->text[2]);
       else if (!strcasecmp(command->text[1], "blockdump"))    parameter->blockdump     = (strcmp(command->text[2], "yes") == 0);    
+      else if (!strcasecmp(command->text[1], "busypoll"))     parameter->busypoll      = atol(command->text[2]);  /* 'off' is 0 */
+      else if (!strcasecmp(command->text[1], "rxlatency"))    parameter->rxlatency     = (strcmp(command->text[2], "yes") == 0);
+      else if (!strcasecmp(command->text[1], "rxcpus")) {
+        if (parameter->rx_cpus != NULL) free(parameter->rx_cpus);
+        parameter->rx_cpus = strcmp(command->text[2], "none") ? strdup(command->text[2]) : NULL;
+      }
       else if (!strcasecmp(command->text[1], "passphrase")) {
         if (parameter->passphrase != NULL) free(parameter->passphrase);
         parameter->passphrase = strdup(command->text[2]);
@@ -895,6 +919,14 @@ int command_set(command_t *command, ttp_parameter_t *parameter)
     if (do_all || !strcasecmp(command->text[1], "lossless"))   printf("lossless = %s\n",    parameter->lossless ? "yes" : "no");
     if (do_all || !strcasecmp(command->text[1], "losswindow")) printf("losswindow = %d msec\n", parameter->losswindow_ms);
     if (do_all || !strcasecmp(command->text[1], "blockdump"))  printf("blockdump = %s\n",   parameter->blockdump ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "busypoll")) {
+        if (parameter->busypoll == 0)
+            printf("busypoll = off\n");
+        else
+            printf("busypoll = %u usec\n", parameter->busypoll);
+    }
+    if (do_all || !strcasecmp(command->text[1], "rxlatency"))  printf("rxlatency = %s\n",   parameter->rxlatency ? "yes" : "no");
+    if (do_all || !strcasecmp(command->text[1], "rxcpus"))     printf("rxcpus = %s\n",      (parameter->rx_cpus == NULL) ? "none" : parameter->rx_cpus);
     if (do_all || !strcasecmp(command->text[1], "passphrase")) printf("passphrase = %s\n",  (parameter->passphrase == NULL) ? "default" : "<user-specified>");
     printf("\n");
 
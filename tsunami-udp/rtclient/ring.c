@@ -180,7 +180,8 @@ int ring_confirm(ring_buffer_t *ring)
  * Creates the ring buffer data structure for a Tsunami transfer and
  * returns a pointer to the new data structure.  Returns NULL if
  * allocation and initialization failed.  The new ring buffer will hold
- * ([6 + block_size] * MAX_BLOCKS_QUEUED datagrams.
+ * ([6 + block_size] * MAX_BLOCKS_QUEUED datagrams, in a buffer pool that
+ * aligns the block data behind the 6 byte headers.
  *------------------------------------------------------------------------*/
 ring_buffer_t *ring_create(ttp_session_t *session)
 {
@@ -194,8 +195,7 @@ ring_buffer_t *ring_create(ttp_session_t *session)
 
     /* try to allocate the buffer */
     ring->datagram_size = 6 + session->parameter->block_size;
-    ring->datagrams = (u_char *) malloc(ring->datagram_size * MAX_BLOCKS_QUEUED);
-    if (ring->datagrams == NULL)
+    if (bufpool_create(&ring->pool, MAX_BLOCKS_QUEUED, session->parameter->block_size, 6) < 0)
 	error("Could not allocate buffer for ring buffer");
 
     /* create the mutex */
@@ -250,7 +250,7 @@ int ring_destroy(ring_buffer_t *ring)
 	return warn("Could not destroy space-ready condition variable");
 
     /* free the memory used */
-    free(ring->datagrams);
+    bufpool_destroy(&ring->pool);
     free(ring);
 
     /* we succeeded */
@@ -286,7 +286,7 @@ int ring_dump(ring_buffer_t *ring, FILE *out)
     /* print out the block list */
     fprintf(out, "block list     = [");
     for (index = ring->base_data; index < ring->base_data + ring->count_data; ++index) {
-	datagram = ring->datagrams + ((index % MAX_BLOCKS_QUEUED) * ring->datagram_size);
+	datagram = bufpool_slot(&ring->pool, index % MAX_BLOCKS_QUEUED);
 	fprintf(out, "%d ", ntohl(*((u_int32_t *) datagram)));
     }
     fprintf(out, "]\n");
@@ -329,7 +329,7 @@ u_char *ring_peek(ring_buffer_t *ring)
     }
 
     /* find the address we want */
-    address = ring->datagrams + (ring->datagram_size * ring->base_data);
+    address = bufpool_slot(&ring->pool, ring->base_data);
 
     /* release the mutex */
     status = pthread_mutex_unlock(&ring->mutex);
@@ -427,7 +427,7 @@ u_char *ring_reserve(ring_buffer_t *ring)
 	ring->space_ready = 0;
 
     /* find the address we want */
-    address = ring->datagrams + (next * ring->datagram_size);
+    address = bufpool_slot(&ring->pool, next);
 
     /* release the mutex */
     status = pthread_mutex_unlock(&ring->mutex);
@@ -0,0 +1,351 @@
+/*========================================================================
+ * admit.c  --  admission control and transfer queue of a Tsunami server.
+ *
+ * Every server child takes a place in a table in shared memory before it
+ * starts a transfer, and waits its turn there while the server already
+ * runs as many transfers as --maxtransfers allows, or as many from the
+ * same volume as --maxpervolume allows.  Waiting transfers are admitted
+ * in the order they came, except that one held back by a busy volume
+ * does not hold up those from other volumes.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <errno.h>       /* for errno                       */
+#include <poll.h>        /* for poll()                      */
+#include <pthread.h>     /* for the process-shared mutex    */
+#include <signal.h>      /* for kill()                      */
+#include <string.h>      /* for memset()                    */
+#include <sys/mman.h>    /* for mmap()                      */
+#include <sys/socket.h>  /* for recv()                      */
+#include <sys/stat.h>    /* for fstat() and stat()          */
+#include <sys/time.h>    /* for gettimeofday()              */
+#include <unistd.h>      /* for getpid()                    */
+
+#include <tsunami-server.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope data structures.
+ *------------------------------------------------------------------------*/
+
+/* one transfer that runs or waits */
+typedef struct {
+    pid_t               pid;          /* the process of the transfer, 0 for a free slot */
+    dev_t               volume;       /* the device its source is on, 0 for none    */
+    u_int64_t           ticket;       /* its number in the order of arrival         */
+    u_char              running;      /* 1 once admitted, 0 while it waits          */
+} admit_slot_t;
+
+/* the table that all children of the server see */
+typedef struct {
+    pthread_mutex_t     lock;         /* guards the slots, shared by the processes  */
+    u_int64_t           tickets;      /* the last ticket handed out                 */
+    admit_slot_t        slots[ADMIT_SLOTS];
+} admit_table_t;
+
+static admit_table_t *admit_table = NULL;     /* the shared table, NULL without limits */
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static void  admit_lock   (void);
+static dev_t admit_volume (ttp_session_t *session);
+static int   admit_turn   (ttp_parameter_t *parameter, int own, u_int32_t *place);
+
+
+/*------------------------------------------------------------------------
+ * int admit_create(ttp_parameter_t *parameter);
+ *
+ * Sets up the shared table of the transfer queue if --maxtransfers or
+ * --maxpervolume limit the transfers.  This has to run before the first
+ * child is forked.  Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int admit_create(ttp_parameter_t *parameter)
+{
+    pthread_mutexattr_t attributes;
+
+    if ((parameter->max_transfers == 0) && (parameter->max_per_volume == 0))
+        return 0;
+
+    admit_table = (admit_table_t *) mmap(NULL, sizeof(admit_table_t), PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (admit_table == MAP_FAILED) {
+        admit_table = NULL;
+        return warn("Could not map the shared transfer queue");
+    }
+    memset(admit_table, 0, sizeof(admit_table_t));
+
+    /* a child that dies holding the lock must not stall the others */
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&admit_table->lock, &attributes) != 0) {
+        pthread_mutexattr_destroy(&attributes);
+        munmap(admit_table, sizeof(admit_table_t));
+        admit_table = NULL;
+        return warn("Could not set up the lock of the shared transfer queue");
+    }
+    pthread_mutexattr_destroy(&attributes);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int admit_wait(ttp_session_t *session);
+ *
+ * Queues the transfer that the given session just opened and waits
+ * until it may start.  While it waits, a client that asked for queue
+ * notices gets a TS_QUEUED reply with its place in line whenever that
+ * changes.  Without limits this returns right away.  Returns 0 once
+ * the transfer is admitted, and nonzero if the queue is full or the
+ * client went away while waiting.
+ *------------------------------------------------------------------------*/
+int admit_wait(ttp_session_t *session)
+{
+    ttp_parameter_t *param = session->parameter;
+    struct pollfd    client;
+    struct timeval   start;
+    admit_slot_t    *slot;
+    u_int32_t        place, told = 0;
+    u_int32_t        position;
+    u_char           reply = TS_QUEUED;
+    u_char           peek;
+    int              own, admitted;
+
+    if (admit_table == NULL)
+        return 0;
+
+    /* a transfer that failed to start may still hold our slot */
+    admit_leave(session);
+
+    /* take a ticket */
+    admit_lock();
+    for (own = 0; own < ADMIT_SLOTS; ++own) {
+        slot = &admit_table->slots[own];
+        if ((slot->pid == 0) || ((kill(slot->pid, 0) < 0) && (errno == ESRCH)))
+            break;
+    }
+    if (own < ADMIT_SLOTS) {
+        slot->pid     = getpid();
+        slot->volume  = admit_volume(session);
+        slot->ticket  = ++admit_table->tickets;
+        slot->running = 0;
+    }
+    pthread_mutex_unlock(&admit_table->lock);
+    if (own == ADMIT_SLOTS)
+        return warn("The transfer queue is full");
+
+    /* and wait for our turn, watching for the client to give up */
+    gettimeofday(&start, NULL);
+    client.fd     = session->client_fd;
+    client.events = POLLIN;
+    while (1) {
+        admit_lock();
+        admitted = admit_turn(param, own, &place);
+        if (admitted)
+            admit_table->slots[own].running = 1;
+        pthread_mutex_unlock(&admit_table->lock);
+        if (admitted)
+            break;
+
+        if (place != told) {
+            if (param->verbose_yn)
+                fprintf(stderr, "Server %d queued, place %u in line\n", session->session_id, place);
+            if (session->queue_notices) {
+                position = htonl(place);
+                if ((full_write(session->client_fd, &reply, 1) < 0) ||
+                    (full_write(session->client_fd, &position, 4) < 0)) {
+                    admit_leave(session);
+                    return warn("Could not tell the client its place in the queue");
+                }
+            }
+            told = place;
+        }
+
+        /* the client sends nothing while it waits, so anything readable ends the wait */
+        if (poll(&client, 1, ADMIT_POLL) > 0) {
+            admit_leave(session);
+            if (recv(session->client_fd, &peek, 1, MSG_PEEK) <= 0)
+                return warn("Client left the transfer queue");
+            return warn("Client spoke out of turn while in the transfer queue");
+        }
+    }
+
+    if ((told > 0) && param->verbose_yn)
+        fprintf(stderr, "Server %d admitted after %0.1f seconds in the queue\n", session->session_id,
+                get_usec_since(&start) / 1e6);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void admit_leave(ttp_session_t *session);
+ *
+ * Gives up the place of this process in the transfer queue, or its
+ * running slot once its transfer is done, so that the next transfer
+ * in line can start.
+ *------------------------------------------------------------------------*/
+void admit_leave(ttp_session_t *session)
+{
+    pid_t pid = getpid();
+    int   i;
+
+    if (admit_table == NULL)
+        return;
+
+    admit_lock();
+    for (i = 0; i < ADMIT_SLOTS; ++i)
+        if (admit_table->slots[i].pid == pid)
+            memset(&admit_table->slots[i], 0, sizeof(admit_slot_t));
+    pthread_mutex_unlock(&admit_table->lock);
+}
+
+
+/*------------------------------------------------------------------------
+ * int admit_turn(ttp_parameter_t *parameter, int own, u_int32_t *place);
+ *
+ * Decides with the table locked whether the waiting transfer in the
+ * given slot may start.  The waiting transfers are admitted in the
+ * order of their tickets as long as the limits allow, skipping those
+ * whose volume is busy.  The place of the transfer in line, counting
+ * from 1, is stored in place.  Returns 1 if it may start and 0 if not.
+ *------------------------------------------------------------------------*/
+int admit_turn(ttp_parameter_t *parameter, int own, u_int32_t *place)
+{
+    admit_slot_t *slots = admit_table->slots;
+    u_char        admitted[ADMIT_SLOTS];
+    u_int32_t     total = 0;
+    u_int32_t     busy;
+    u_int64_t     last = 0;
+    int           i, j, next;
+
+    /* count the running transfers, and forget those whose process is gone */
+    *place = 1;
+    for (i = 0; i < ADMIT_SLOTS; ++i) {
+        if ((slots[i].pid != 0) && (kill(slots[i].pid, 0) < 0) && (errno == ESRCH))
+            memset(&slots[i], 0, sizeof(admit_slot_t));
+        admitted[i] = (slots[i].pid != 0) && slots[i].running;
+        total      += admitted[i];
+        if ((slots[i].pid != 0) && !slots[i].running && (slots[i].ticket < slots[own].ticket))
+            ++*place;
+    }
+
+    /* then let the waiting ones in by their tickets, as far as the limits go */
+    while (1) {
+        next = -1;
+        for (i = 0; i < ADMIT_SLOTS; ++i)
+            if ((slots[i].pid != 0) && !admitted[i] && (slots[i].ticket > last) &&
+                ((next < 0) || (slots[i].ticket < slots[next].ticket)))
+                next = i;
+        if ((next < 0) || ((parameter->max_transfers > 0) && (total >= parameter->max_transfers)))
+            return 0;
+        last = slots[next].ticket;
+
+        busy = 0;
+        if (slots[next].volume != 0)
+            for (j = 0; j < ADMIT_SLOTS; ++j)
+                busy += admitted[j] && (slots[j].volume == slots[next].volume);
+        if ((parameter->max_per_volume > 0) && (busy >= parameter->max_per_volume))
+            continue;
+
+        if (next == own)
+            return 1;
+        admitted[next] = 1;
+        ++total;
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * void admit_lock(void);
+ *
+ * Locks the shared table, taking it over from a process that died
+ * while holding the lock.
+ *------------------------------------------------------------------------*/
+void admit_lock(void)
+{
+    if (pthread_mutex_lock(&admit_table->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&admit_table->lock);
+}
+
+
+/*------------------------------------------------------------------------
+ * dev_t admit_volume(ttp_session_t *session);
+ *
+ * Returns the device that the source of the transfer of the given
+ * session reads from, the one of the first shared file for aggregated
+ * transfers, or 0 for synthetic sources, which read no disk.
+ *------------------------------------------------------------------------*/
+dev_t admit_volume(ttp_session_t *session)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+    struct stat     info;
+
+    if ((xfer->file != NULL) && (fstat(fileno(xfer->file), &info) == 0))
+        return info.st_dev;
+    if ((xfer->aggregate != NULL) && (session->parameter->total_files > 0) &&
+        (stat(session->parameter->file_names[0], &info) == 0))
+        return info.st_dev;
+    return 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
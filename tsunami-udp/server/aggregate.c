@@ -0,0 +1,320 @@
+/*========================================================================
+ * aggregate.c  --  Small-file aggregation routines for Tsunami server.
+ *
+ * This contains the routines that present all of the shared files of
+ * the server as one virtual block stream, so that directories of many
+ * small files can be sent without a handshake per file.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <stdlib.h>    /* for malloc(), free(), etc.   */
+#include <string.h>    /* for string-handling routines */
+#include <sys/stat.h>  /* for stat()                   */
+#include <unistd.h>    /* for access()                 */
+
+#include <tsunami-server.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static int aggregate_add(aggregate_t *aggregate, u_int32_t *allocated, const char *name);
+
+
+/*------------------------------------------------------------------------
+ * int aggregate_open(ttp_session_t *session);
+ *
+ * Collects the shared files of the server (the output of the allhook
+ * program if one was given, else the files listed on the command line)
+ * into an aggregate that is transmitted as a single stream, with each
+ * file starting right after the previous one.  The manifest text that
+ * describes the layout of the stream to the client is built as well,
+ * one line of "offset size mode name" per file.  Returns 0 on success
+ * and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int aggregate_open(ttp_session_t *session)
+{
+    ttp_parameter_t *param     = session->parameter;
+    aggregate_t     *aggregate;
+    u_int32_t        allocated = 0;
+    char             line[MAX_FILENAME_LENGTH + 64];
+    size_t           length;
+    u_int32_t        i;
+    int              l;
+    FILE            *p;
+
+    /* allocate the aggregate */
+    aggregate = (aggregate_t *) calloc(1, sizeof(aggregate_t));
+    if (aggregate == NULL)
+        return warn("Could not allocate aggregate");
+    aggregate->current = -1;
+    session->transfer.aggregate = aggregate;
+
+    /* collect the member files */
+    if (param->allhook != 0) {
+        fprintf(stderr, "Using allhook program: %s\n", param->allhook);
+        p = popen((char *)(param->allhook), "r");
+        if (p != NULL) {
+            while (fgets(line, MAX_FILENAME_LENGTH, p) != NULL) {
+                for (l = 0; line[l] >= ' '; ++l) {}
+                line[l] = '\0';
+                if (l > 0)
+                    aggregate_add(aggregate, &allocated, line);
+            }
+            pclose(p);
+        }
+    } else {
+        for (i = 0; i < param->total_files; ++i)
+            aggregate_add(aggregate, &allocated, param->file_names[i]);
+    }
+
+    if (aggregate->count == 0) {
+        aggregate_close(session);
+        return warn("No files to aggregate");
+    }
+
+    /* build the manifest */
+    length = 0;
+    for (i = 0; i < aggregate->count; ++i)
+        length += strlen(aggregate->entries[i].name) + 64;
+    if (length > TS_MANIFEST_MAX) {
+        aggregate_close(session);
+        return warn("Too many files to aggregate, the manifest would be too long");
+    }
+    aggregate->manifest = (char *) malloc(length + 1);
+    if (aggregate->manifest == NULL) {
+        aggregate_close(session);
+        return warn("Could not allocate aggregate manifest");
+    }
+    length = 0;
+    for (i = 0; i < aggregate->count; ++i) {
+        length += sprintf(aggregate->manifest + length, "%llu %llu %o %s\n",
+                          (ull_t) aggregate->entries[i].offset, (ull_t) aggregate->entries[i].size,
+                          aggregate->entries[i].mode, aggregate->entries[i].name);
+    }
+    aggregate->manifest_length = length;
+
+    if (param->verbose_yn)
+        fprintf(stderr, "Aggregated %u files into one stream\n", aggregate->count);
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int64_t aggregate_size(ttp_session_t *session);
+ *
+ * Returns the total size of the aggregated stream in bytes.
+ *------------------------------------------------------------------------*/
+u_int64_t aggregate_size(ttp_session_t *session)
+{
+    aggregate_t *aggregate = session->transfer.aggregate;
+
+    if (aggregate->count == 0)
+        return 0;
+    return aggregate->entries[aggregate->count - 1].offset + aggregate->entries[aggregate->count - 1].size;
+}
+
+
+/*------------------------------------------------------------------------
+ * int aggregate_read(ttp_session_t *session, u_int32_t block_index,
+ *                    u_char *buffer);
+ *
+ * Reads the given block of the aggregated stream into the buffer,
+ * crossing member file boundaries as needed.  The member file that was
+ * read last is kept open, so consecutive blocks of a large member do
+ * not cost an open and seek each.  With a block cache, the members are
+ * read through it.  Bytes past the end of the stream are zeroed.
+ * Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int aggregate_read(ttp_session_t *session, u_int32_t block_index, u_char *buffer)
+{
+    aggregate_t       *aggregate = session->transfer.aggregate;
+    aggregate_entry_t *entry;
+    u_int64_t          offset    = ((u_int64_t) session->parameter->block_size) * (block_index - 1);
+    u_int64_t          position;
+    u_int32_t          length    = session->parameter->block_size;
+    u_int32_t          chunk;
+    int32_t            i;
+    int                status;
+
+    for (i = aggregate_find(aggregate, offset); (i >= 0) && (i < (int32_t) aggregate->count) && (length > 0); ++i) {
+
+        /* find how much of this member falls into the block */
+        entry = &aggregate->entries[i];
+        if (offset >= entry->offset + entry->size)
+            continue;
+        position = offset - entry->offset;
+        chunk    = (u_int32_t) min((u_int64_t) length, entry->size - position);
+
+        /* switch to the member file if it is not open yet */
+        if (aggregate->current != i) {
+            if (aggregate->file != NULL)
+                fclose(aggregate->file);
+            aggregate->current = i;
+            aggregate->file    = fopen(entry->name, "r");
+            if (aggregate->file == NULL) {
+                aggregate->current = -1;
+                snprintf(g_error, MAX_ERROR_MESSAGE, "Could not open aggregated file '%s'", entry->name);
+                return warn(g_error);
+            }
+            aggregate->position = 0;
+            cache_identify(aggregate->file, &aggregate->key);
+        }
+
+        /* read the part of the block that is in this member */
+        if (aggregate->key.inode != 0) {
+            status = cache_read(session, &aggregate->key, aggregate->file, position, buffer, chunk);
+        } else if ((aggregate->position != position) && (fseeko(aggregate->file, position, SEEK_SET) < 0)) {
+            status = -1;
+        } else {
+            status = (int) fread(buffer, 1, chunk, aggregate->file);
+        }
+        if (status < (int) chunk) {
+            aggregate->current = -1;
+            snprintf(g_error, MAX_ERROR_MESSAGE, "Could not read aggregated file '%s'", entry->name);
+            return warn(g_error);
+        }
+        aggregate->position = position + status;
+
+        offset += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+
+    /* pad the final block */
+    if (length > 0)
+        memset(buffer, 0, length);
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void aggregate_close(ttp_session_t *session);
+ *
+ * Closes the open member file and releases the aggregate of the
+ * current transfer.
+ *------------------------------------------------------------------------*/
+void aggregate_close(ttp_session_t *session)
+{
+    aggregate_t *aggregate = session->transfer.aggregate;
+    u_int32_t    i;
+
+    if (aggregate == NULL)
+        return;
+
+    if (aggregate->file != NULL)
+        fclose(aggregate->file);
+    for (i = 0; i < aggregate->count; ++i)
+        free(aggregate->entries[i].name);
+    free(aggregate->entries);
+    free(aggregate->manifest);
+    free(aggregate);
+
+    session->transfer.aggregate = NULL;
+}
+
+
+/*------------------------------------------------------------------------
+ * static int aggregate_add(aggregate_t *aggregate, u_int32_t *allocated,
+ *                          const char *name);
+ *
+ * Appends the named file to the end of the aggregate if it is a
+ * readable regular file.  Returns 0 on success and nonzero if the file
+ * was skipped.
+ *------------------------------------------------------------------------*/
+static int aggregate_add(aggregate_t *aggregate, u_int32_t *allocated, const char *name)
+{
+    aggregate_entry_t *entry;
+    struct stat        filestat;
+
+    /* only aggregate regular files that we can read */
+    if ((stat(name, &filestat) < 0) || !S_ISREG(filestat.st_mode) || access(name, R_OK)) {
+        fprintf(stderr, "Skipping '%s' in aggregate: not a readable regular file\n", name);
+        return -1;
+    }
+
+    /* grow the member table if needed */
+    if (aggregate->count == *allocated) {
+        *allocated = (*allocated == 0) ? 64 : (2 * *allocated);
+        entry = (aggregate_entry_t *) realloc(aggregate->entries, *allocated * sizeof(aggregate_entry_t));
+        if (entry == NULL)
+            return warn("Could not grow aggregate member table");
+        aggregate->entries = entry;
+    }
+
+    /* append the member behind the previous one */
+    entry         = &aggregate->entries[aggregate->count];
+    entry->name   = strdup(name);
+    if (entry->name == NULL)
+        return warn("Memory allocation error");
+    entry->size   = filestat.st_size;
+    entry->mode   = filestat.st_mode & 07777;
+    entry->offset = (aggregate->count == 0) ? 0 : (entry[-1].offset + entry[-1].size);
+    aggregate->count++;
+
+    return 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
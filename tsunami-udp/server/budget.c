@@ -0,0 +1,358 @@
+/*========================================================================
+ * budget.c  --  rate budget shared by the transfers of a Tsunami server.
+ *
+ * This keeps a table in shared memory, set up before the server forks
+ * its children, in which every transfer posts the rate it would like to
+ * send at and its weight.  From these each transfer works out its
+ * weighted max-min fair share of the aggregate rate given with --budget,
+ * so that the transfers together never exceed it, and a transfer that
+ * needs less than its share leaves the rest to the others.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <arpa/inet.h>   /* for inet_ntop()                 */
+#include <errno.h>       /* for errno                       */
+#include <pthread.h>     /* for the process-shared mutex    */
+#include <signal.h>      /* for kill()                      */
+#include <stdlib.h>      /* for strtod()                    */
+#include <string.h>      /* for memset() and strcmp()       */
+#include <sys/mman.h>    /* for mmap()                      */
+#include <sys/socket.h>  /* for getpeername()               */
+#include <sys/time.h>    /* for gettimeofday()              */
+#include <unistd.h>      /* for getpid()                    */
+
+#include <tsunami-server.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope data structures.
+ *------------------------------------------------------------------------*/
+
+/* one transfer sharing the budget */
+typedef struct {
+    pid_t               pid;          /* the process sending it, 0 for a free slot  */
+    double              weight;       /* its weight in the fair share               */
+    double              demand;       /* the rate it would like to send at (bps)    */
+    u_int64_t           updated;      /* when it last told us so (usec)             */
+} budget_slot_t;
+
+/* the table that all children of the server see */
+typedef struct {
+    pthread_mutex_t     lock;         /* guards the slots, shared by the processes  */
+    budget_slot_t       slots[BUDGET_SLOTS];
+} budget_table_t;
+
+static budget_table_t *budget_table = NULL;   /* the shared table, NULL without a budget */
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static void      budget_lock (void);
+static u_int64_t budget_now  (void);
+
+
+/*------------------------------------------------------------------------
+ * int budget_create(ttp_parameter_t *parameter);
+ *
+ * Sets up the shared table of the rate budget if one was given with
+ * --budget.  This has to run before the first child is forked, which
+ * then all map the same table.  Returns 0 on success and nonzero on
+ * failure.
+ *------------------------------------------------------------------------*/
+int budget_create(ttp_parameter_t *parameter)
+{
+    pthread_mutexattr_t attributes;
+
+    if (parameter->budget == 0)
+        return 0;
+
+    budget_table = (budget_table_t *) mmap(NULL, sizeof(budget_table_t), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (budget_table == MAP_FAILED) {
+        budget_table = NULL;
+        return warn("Could not map the shared rate budget");
+    }
+    memset(budget_table, 0, sizeof(budget_table_t));
+
+    /* a child that dies holding the lock must not stall the others */
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&budget_table->lock, &attributes) != 0) {
+        pthread_mutexattr_destroy(&attributes);
+        munmap(budget_table, sizeof(budget_table_t));
+        budget_table = NULL;
+        return warn("Could not set up the lock of the shared rate budget");
+    }
+    pthread_mutexattr_destroy(&attributes);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * double budget_weight(const char *list, const char *address);
+ *
+ * Looks up the weight of the client with the given address in a comma
+ * separated list of 'address=weight' entries as given with --weights.
+ * Clients that are not listed have a weight of 1.  With a NULL address
+ * this only checks the list.  Returns the weight, or a negative value
+ * if the list is malformed.
+ *------------------------------------------------------------------------*/
+double budget_weight(const char *list, const char *address)
+{
+    char    copy[1024];
+    char   *item, *save, *equals, *end;
+    double  weight;
+    double  found = 1.0;
+
+    if (list == NULL)
+        return found;
+
+    snprintf(copy, sizeof(copy), "%s", list);
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        equals = strchr(item, '=');
+        if (equals == NULL)
+            return -1.0;
+        *equals = '\0';
+        weight  = strtod(equals + 1, &end);
+        if ((end == equals + 1) || (*end != '\0') || (weight <= 0.0))
+            return -1.0;
+        if ((address != NULL) && !strcmp(item, address))
+            found = weight;
+    }
+    return found;
+}
+
+
+/*------------------------------------------------------------------------
+ * int budget_join(ttp_session_t *session);
+ *
+ * Takes a slot in the shared budget for the transfer of the given
+ * session, with the weight of its client, and limits its inter-packet
+ * delay to its share right away.  Without a budget this does nothing.
+ * Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int budget_join(ttp_session_t *session)
+{
+    ttp_transfer_t          *xfer = &session->transfer;
+    struct sockaddr_storage  peer;
+    socklen_t                length = sizeof(peer);
+    char                     address[INET6_ADDRSTRLEN];
+    budget_slot_t           *slot;
+    int                      i;
+
+    xfer->budget_slot = -1;
+    xfer->ipd_budget  = 0.0;
+    if (budget_table == NULL)
+        return 0;
+
+    /* find the weight of the client */
+    address[0] = '\0';
+    if (getpeername(session->client_fd, (struct sockaddr *) &peer, &length) == 0) {
+        if (peer.ss_family == AF_INET6)
+            inet_ntop(AF_INET6, &((struct sockaddr_in6 *) &peer)->sin6_addr, address, sizeof(address));
+        else
+            inet_ntop(AF_INET, &((struct sockaddr_in *) &peer)->sin_addr, address, sizeof(address));
+    }
+
+    /* take a free slot, or that of a process that is gone */
+    budget_lock();
+    for (i = 0; i < BUDGET_SLOTS; ++i) {
+        slot = &budget_table->slots[i];
+        if ((slot->pid == 0) || ((kill(slot->pid, 0) < 0) && (errno == ESRCH)))
+            break;
+    }
+    if (i < BUDGET_SLOTS) {
+        slot->pid     = getpid();
+        slot->weight  = budget_weight(session->parameter->weights, address);
+        slot->demand  = 0.0;
+        slot->updated = budget_now();
+        xfer->budget_slot = i;
+    }
+    pthread_mutex_unlock(&budget_table->lock);
+    if (i == BUDGET_SLOTS)
+        return warn("Too many transfers share the rate budget, this one is not limited by it");
+
+    if (session->parameter->verbose_yn)
+        fprintf(stderr, "Server %d shares the %0.1f Mbps budget with weight %g\n", session->session_id,
+                session->parameter->budget / 1e6, budget_table->slots[i].weight);
+
+    /* and start within our share */
+    xfer->ipd_budget  = budget_ipd(session, xfer->ipd_current);
+    xfer->ipd_current = max(xfer->ipd_current, xfer->ipd_budget);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * double budget_ipd(ttp_session_t *session, double ipd);
+ *
+ * Posts the inter-packet delay that the transfer of the given session
+ * would send at by its own rate control as its demand, and returns the
+ * least inter-packet delay that its share of the budget allows.  The
+ * shares are weighted max-min fair: transfers that want less than
+ * their weighted part of the budget get what they want, and the rest
+ * is split by weight among the others.  Returns 0 without a budget.
+ *------------------------------------------------------------------------*/
+double budget_ipd(ttp_session_t *session, double ipd)
+{
+    ttp_transfer_t  *xfer = &session->transfer;
+    budget_slot_t   *slots;
+    budget_slot_t   *own;
+    u_char           fixed[BUDGET_SLOTS];
+    u_char           live[BUDGET_SLOTS];
+    double           remaining, weights, total, share;
+    u_int64_t        now;
+    int              changed, i;
+
+    if ((budget_table == NULL) || (xfer->budget_slot < 0))
+        return 0.0;
+
+    budget_lock();
+    slots = budget_table->slots;
+    own   = &slots[xfer->budget_slot];
+    now   = budget_now();
+    own->demand  = 8e6 * session->parameter->block_size / ipd;
+    own->updated = now;
+
+    /* the transfers that reported lately count */
+    remaining = (double) session->parameter->budget;
+    weights   = 0.0;
+    for (i = 0; i < BUDGET_SLOTS; ++i) {
+        live[i]  = (slots[i].pid != 0) && (now - slots[i].updated < BUDGET_STALE);
+        fixed[i] = 0;
+        if (live[i])
+            weights += slots[i].weight;
+    }
+    total = weights;
+
+    /* give the transfers below their weighted part what they want, until none is left */
+    do {
+        changed = 0;
+        for (i = 0; (i < BUDGET_SLOTS) && (weights > 0.0); ++i) {
+            if (live[i] && !fixed[i] && (slots[i].demand <= remaining * slots[i].weight / weights)) {
+                fixed[i]   = 1;
+                remaining -= slots[i].demand;
+                weights   -= slots[i].weight;
+                changed    = 1;
+            }
+        }
+    } while (changed && (weights > 0.0));
+
+    /* the others split the rest by weight, and when all are content the headroom is split alike */
+    if (weights > 0.0)
+        share = remaining * own->weight / weights;
+    else
+        share = own->demand + remaining * own->weight / total;
+    pthread_mutex_unlock(&budget_table->lock);
+
+    return 8e6 * session->parameter->block_size / share;
+}
+
+
+/*------------------------------------------------------------------------
+ * void budget_leave(ttp_session_t *session);
+ *
+ * Gives the slot of the transfer of the given session back, so that
+ * its share goes to the other transfers.
+ *------------------------------------------------------------------------*/
+void budget_leave(ttp_session_t *session)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+
+    if ((budget_table == NULL) || (xfer->budget_slot < 0))
+        return;
+
+    budget_lock();
+    memset(&budget_table->slots[xfer->budget_slot], 0, sizeof(budget_slot_t));
+    pthread_mutex_unlock(&budget_table->lock);
+    xfer->budget_slot = -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * void budget_lock(void);
+ *
+ * Locks the shared table, taking it over from a process that died
+ * while holding the lock.
+ *------------------------------------------------------------------------*/
+void budget_lock(void)
+{
+    if (pthread_mutex_lock(&budget_table->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&budget_table->lock);
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int64_t budget_now(void);
+ *
+ * Returns the current time in usec.
+ *------------------------------------------------------------------------*/
+u_int64_t budget_now(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return 1000000ULL * now.tv_sec + now.tv_usec;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
@@ -0,0 +1,300 @@
+/*========================================================================
+ * cache.c  --  block cache shared by the transfers of a Tsunami server.
+ *
+ * This keeps the chunks of the files that the transfers read in a cache
+ * in shared memory, set up before the server forks its children, so that
+ * several clients fetching the same file read it from disk once, and
+ * retransmitted blocks come from memory instead of costing a seek.  Files
+ * are read a CACHE_CHUNK at a time, which keeps the disk reads sequential
+ * and large.  The cache is set associative: a chunk can only live in one
+ * set of CACHE_WAYS slots, picked by a hash of the file and chunk index,
+ * which has its own lock and evicts its least recently used chunk.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <errno.h>       /* for EOWNERDEAD                  */
+#include <pthread.h>     /* for the process-shared mutexes  */
+#include <string.h>      /* for memcmp(), memcpy(), etc.    */
+#include <sys/mman.h>    /* for mmap()                      */
+#include <sys/stat.h>    /* for fstat()                     */
+#include <unistd.h>      /* for pread()                     */
+
+#include <tsunami-server.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope data structures.
+ *------------------------------------------------------------------------*/
+
+/* one cached chunk of a file */
+typedef struct {
+    cache_key_t         key;          /* the file, with a zero inode if unused      */
+    u_int64_t           chunk;        /* the index of the chunk in the file         */
+    u_int32_t           length;       /* the bytes of it the file has               */
+    u_int64_t           used;         /* the cache clock when it was last read      */
+} cache_slot_t;
+
+/* the slots one chunk can live in */
+typedef struct {
+    pthread_mutex_t     lock;         /* guards the slots and their data            */
+    cache_slot_t        slots[CACHE_WAYS];
+} cache_set_t;
+
+/* the table that all children of the server see */
+typedef struct {
+    u_int64_t           clock;        /* counts the reads, for the LRU order        */
+    u_int32_t           count;        /* the number of sets                         */
+    cache_set_t         sets[1];      /* the sets, count of them                    */
+} cache_table_t;
+
+static cache_table_t *cache_table = NULL;     /* the shared table, NULL without a cache */
+static bufpool_t      cache_pool;             /* the chunk data, CACHE_WAYS per set     */
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static u_int32_t cache_hash (const cache_key_t *key, u_int64_t chunk);
+static void      cache_lock (cache_set_t *set);
+
+
+/*------------------------------------------------------------------------
+ * int cache_create(ttp_parameter_t *parameter);
+ *
+ * Sets up the block cache of the size given with --cache, in huge pages
+ * where the system has them.  This has to run before the first child
+ * is forked.  Returns 0 on success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int cache_create(ttp_parameter_t *parameter)
+{
+    pthread_mutexattr_t attributes;
+    size_t              length;
+    u_int32_t           count, i;
+
+    if (parameter->cache_size == 0)
+        return 0;
+
+    /* the chunk data */
+    count = (u_int32_t) max(parameter->cache_size / ((u_int64_t) CACHE_CHUNK * CACHE_WAYS), 1ULL);
+    if (bufpool_create_shared(&cache_pool, count * CACHE_WAYS, CACHE_CHUNK, 0) < 0)
+        return warn("Could not allocate the block cache");
+
+    /* and the table of what is where */
+    length      = sizeof(cache_table_t) + (count - 1) * sizeof(cache_set_t);
+    cache_table = (cache_table_t *) mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cache_table == MAP_FAILED) {
+        cache_table = NULL;
+        bufpool_destroy(&cache_pool);
+        return warn("Could not map the table of the block cache");
+    }
+    memset(cache_table, 0, length);
+    cache_table->count = count;
+
+    /* a child that dies holding a lock must not stall the others */
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    for (i = 0; i < count; ++i)
+        pthread_mutex_init(&cache_table->sets[i].lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    if (parameter->verbose_yn)
+        fprintf(stderr, "Block cache of %llu MB in %s, %u chunks of %u kB\n",
+                (ull_t) count * CACHE_WAYS * CACHE_CHUNK / (1024 * 1024), bufpool_backing(&cache_pool),
+                count * CACHE_WAYS, CACHE_CHUNK / 1024);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int cache_identify(FILE *file, cache_key_t *key);
+ *
+ * Fills in the key of the given open file for cache_read().  Returns 0
+ * if the file can be read through the block cache, and nonzero if there
+ * is no cache or the file is not a regular one, in which case the key
+ * is all zero.
+ *------------------------------------------------------------------------*/
+int cache_identify(FILE *file, cache_key_t *key)
+{
+    struct stat info;
+
+    memset(key, 0, sizeof(*key));
+    if ((cache_table == NULL) || (file == NULL) || (fstat(fileno(file), &info) < 0) || !S_ISREG(info.st_mode))
+        return -1;
+
+    key->device = (u_int64_t) info.st_dev;
+    key->inode  = (u_int64_t) info.st_ino;
+    key->size   = (u_int64_t) info.st_size;
+    key->mtime  = (int64_t) info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    return (key->inode != 0) ? 0 : -1;
+}
+
+
+/*------------------------------------------------------------------------
+ * int cache_read(ttp_session_t *session, const cache_key_t *key,
+ *                FILE *file, u_int64_t offset, u_char *buffer,
+ *                u_int32_t length);
+ *
+ * Reads length bytes at the given offset of the file with the given key
+ * into the buffer, from the cached chunks where they are, and else by
+ * reading the whole chunk from the file into the cache first.  Another
+ * transfer that wants the same chunk meanwhile waits for that read and
+ * then finds it cached.  The file position is not used.  Returns the
+ * number of bytes read, which is less than length at the end of the
+ * file, or a negative value on failure.
+ *------------------------------------------------------------------------*/
+int cache_read(ttp_session_t *session, const cache_key_t *key, FILE *file,
+               u_int64_t offset, u_char *buffer, u_int32_t length)
+{
+    ttp_transfer_t *xfer  = &session->transfer;
+    cache_set_t    *set;
+    cache_slot_t   *slot;
+    u_char         *data;
+    u_int64_t       chunk;
+    u_int32_t       within, part, index, way;
+    ssize_t         status;
+    int             done = 0;
+    int             missed = 0;
+
+    while (length > 0) {
+        chunk  = offset / CACHE_CHUNK;
+        within = (u_int32_t) (offset % CACHE_CHUNK);
+        index  = cache_hash(key, chunk) % cache_table->count;
+        set    = &cache_table->sets[index];
+        cache_lock(set);
+
+        /* look for the chunk, else make room for it in place of the least recently used one */
+        for (way = 0; way < CACHE_WAYS; ++way)
+            if ((set->slots[way].chunk == chunk) && !memcmp(&set->slots[way].key, key, sizeof(*key)))
+                break;
+        if (way == CACHE_WAYS) {
+            for (way = 0, part = 1; part < CACHE_WAYS; ++part)
+                if (set->slots[part].used < set->slots[way].used)
+                    way = part;
+            slot = &set->slots[way];
+            data = bufpool_slot(&cache_pool, index * CACHE_WAYS + way);
+            memset(slot, 0, sizeof(*slot));
+            status = pread(fileno(file), data, CACHE_CHUNK, (off_t) (chunk * CACHE_CHUNK));
+            if (status < 0) {
+                pthread_mutex_unlock(&set->lock);
+                snprintf(g_error, MAX_ERROR_MESSAGE, "Could not read chunk %llu of '%s'", (ull_t) chunk, xfer->filename);
+                return warn(g_error);
+            }
+            slot->key    = *key;
+            slot->chunk  = chunk;
+            slot->length = (u_int32_t) status;
+            missed       = 1;
+        }
+        slot = &set->slots[way];
+        data = bufpool_slot(&cache_pool, index * CACHE_WAYS + way);
+        slot->used = __sync_add_and_fetch(&cache_table->clock, 1);
+
+        /* copy out the part of the block that is in this chunk */
+        part = (slot->length > within) ? min(length, slot->length - within) : 0;
+        memcpy(buffer, data + within, part);
+        pthread_mutex_unlock(&set->lock);
+
+        done   += part;
+        offset += part;
+        buffer += part;
+        length -= part;
+        if (within + part < CACHE_CHUNK)
+            break;
+    }
+
+    if (missed)
+        ++xfer->cache_misses;
+    else
+        ++xfer->cache_hits;
+    return done;
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int32_t cache_hash(const cache_key_t *key, u_int64_t chunk);
+ *
+ * Returns the hash of the given chunk of the file with the given key,
+ * which picks the set the chunk lives in.
+ *------------------------------------------------------------------------*/
+u_int32_t cache_hash(const cache_key_t *key, u_int64_t chunk)
+{
+    u_int64_t z = key->inode * 0x9E3779B97F4A7C15ULL + key->device + (u_int64_t) key->mtime + chunk * 0xBF58476D1CE4E5B9ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (u_int32_t) (z ^ (z >> 31));
+}
+
+
+/*------------------------------------------------------------------------
+ * void cache_lock(cache_set_t *set);
+ *
+ * Locks the given set, taking it over from a process that died while
+ * holding the lock.  A chunk that process was reading has no key yet,
+ * so it is never found.
+ *------------------------------------------------------------------------*/
+void cache_lock(cache_set_t *set)
+{
+    if (pthread_mutex_lock(&set->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&set->lock);
+}
+
+
+/*========================================================================
+ * $Log$
+ */
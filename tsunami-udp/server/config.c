@@ -72,11 +72,15 @@
 const u_int32_t  DEFAULT_BLOCK_SIZE    = 1024;      /* default size of a single file block     */
 const u_char    *DEFAULT_SECRET        = (u_char*)"kitten";  /* default shared secret          */
 const u_int16_t  DEFAULT_TCP_PORT      = TS_TCP_PORT;/* default TCP port to listen on          */
-const u_int32_t  DEFAULT_UDP_BUFFER    = 20000000;  /* default size of the UDP transmit buffer */
+const u_int32_t  DEFAULT_UDP_BUFFER    = 0;         /* size the UDP transmit buffer from the BDP */
+const u_int32_t  DEFAULT_BUFFER_MAX    = 268435456; /* to 256 MB at most                       */
 const u_char     DEFAULT_VERBOSE_YN    = 1;         /* the default verbosity setting           */
+const char      *DEFAULT_TX_CPUS       = "auto";    /* on the NUMA node of the network interface */
 const u_char     DEFAULT_TRANSCRIPT_YN = 0;         /* the default transcript setting          */
 const u_char     DEFAULT_IPV6_YN       = 0;         /* the default IPv6 setting                */
 const u_int16_t  DEFAULT_HEARTBEAT_TIMEOUT = 15;    /* the timeout to disconnect after no client feedback */
+const int        DEFAULT_XDP_MODE      = XDP_MODE_OFF; /* send over the UDP socket             */
+const u_int32_t  DEFAULT_XDP_QUEUE     = 0;         /* the first queue of the interface        */
 
 /*------------------------------------------------------------------------
  * void reset_server(ttp_parameter_t *parameter);
@@ -94,7 +98,17 @@ void reset_server(ttp_parameter_t *parameter)
     parameter->client        = NULL;
     parameter->tcp_port      = DEFAULT_TCP_PORT;
     parameter->udp_buffer    = DEFAULT_UDP_BUFFER;
+    parameter->buffer_max    = DEFAULT_BUFFER_MAX;
     parameter->hb_timeout    = DEFAULT_HEARTBEAT_TIMEOUT;
+    parameter->tx_cpus       = DEFAULT_TX_CPUS;
+    parameter->xdp_mode      = DEFAULT_XDP_MODE;
+    parameter->xdp_queue     = DEFAULT_XDP_QUEUE;
+    parameter->max_paths     = 1;               /* only the path of ttp_open_port() */
+    parameter->budget        = 0;               /* every transfer at its own rate */
+    parameter->weights       = NULL;
+    parameter->max_transfers = 0;               /* start every transfer right away */
+    parameter->max_per_volume = 0;
+    parameter->cache_size    = 0;               /* every transfer reads its own file */
     parameter->verbose_yn    = DEFAULT_VERBOSE_YN;
     parameter->transcript_yn = DEFAULT_TRANSCRIPT_YN;
     parameter->ipv6_yn       = DEFAULT_IPV6_YN;
@@ -65,7 +65,7 @@
 
 /*------------------------------------------------------------------------
  * int build_datagram(ttp_session_t *session, u_int32_t block_index,
- *                    u_int16_t block_type, u_char *datagram);
+ *                    u_int16_t block_type, u_char *buffer);
  *
  * Constructs to hold the given block of data, with the given type
  * stored in it.  The format of the datagram is:
@@ -79,13 +79,29 @@
  *     :     :          :    :
  *     +---------------------+
  *
+ * If the client asked for REQUEST_TIMESTAMPS, the type carries the
+ * TS_BLOCK_STAMPED flag and the send time, which send_datagram() fills
+ * in, sits between the type and the data.
+ *
  * The datagram is stored in the given buffer, which must be at least
- * six bytes longer than the block size for the transfer.  Returns 0 on
- * success and non-zero on failure.
+ * 6 + TS_STAMP_SIZE bytes longer than the block size for the transfer.
+ * The data always starts at that offset, so that it stays aligned, and
+ * a datagram without the send time starts TS_STAMP_SIZE bytes into the
+ * buffer.  Files are read through the block cache where there is one.
+ * The time the read took goes into the read statistics of the transfer,
+ * and a read that took much longer than a packet interval is noted as a
+ * stall.
+ * Returns 0 on success and non-zero on failure.
  *------------------------------------------------------------------------*/
 int build_datagram(ttp_session_t *session, u_int32_t block_index,
-		   u_int16_t block_type, u_char *datagram)
+		   u_int16_t block_type, u_char *buffer)
 {
+    u_char          *datagram = buffer + (session->transfer.stamped ? 0 : TS_STAMP_SIZE);
+    u_char          *data     = buffer + 6 + TS_STAMP_SIZE;
+
+    if (session->transfer.stamped)
+	block_type |= TS_BLOCK_STAMPED;
+
 #ifdef DEBUG_DISKLESS
     /* build the datagram header */
     *((u_int32_t *) (datagram + 0)) = htonl(block_index);
@@ -93,20 +109,58 @@ int build_datagram(ttp_session_t *session, u_int32_t block_index,
 
    return 0;
 #else
+    ttp_transfer_t  *xfer = &session->transfer;
     static u_int32_t last_block = 0;
     int              status;
+    struct timeval   read_start;
+    u_int32_t        read_usec;
+
+    gettimeofday(&read_start, NULL);
+
+    if (session->transfer.aggregate != NULL) {
+
+	/* aggregated transfers read the block from the member files */
+	status = aggregate_read(session, block_index, data);
 
-    /* move the file pointer to the appropriate location */
-    if (block_index != (last_block + 1))
-	fseeko(session->transfer.file, ((u_int64_t) session->parameter->block_size) * (block_index - 1), SEEK_SET);
+    } else if (session->transfer.synthetic != TS_SYNTHETIC_NONE) {
 
-    /* try to read in the block */
-    status = fread(datagram + 6, 1, session->parameter->block_size, session->transfer.file);
+	/* synthetic sources generate the block without any disk I/O */
+	synthetic_fill(session->transfer.synthetic, session->transfer.synthetic_seed,
+		       ((u_int64_t) session->parameter->block_size) * (block_index - 1),
+		       data, session->parameter->block_size);
+	status = session->parameter->block_size;
+
+    } else if (session->transfer.cache_key.inode != 0) {
+
+	/* files the block cache knows are read through it */
+	status = cache_read(session, &session->transfer.cache_key, session->transfer.file,
+			    ((u_int64_t) session->parameter->block_size) * (block_index - 1),
+			    data, session->parameter->block_size);
+
+    } else {
+
+	/* move the file pointer to the appropriate location */
+	if (block_index != (last_block + 1))
+	    fseeko(session->transfer.file, ((u_int64_t) session->parameter->block_size) * (block_index - 1), SEEK_SET);
+
+	/* try to read in the block */
+	status = fread(data, 1, session->parameter->block_size, session->transfer.file);
+    }
     if (status < 0) {
 	sprintf(g_error, "Could not read block #%u", block_index);
 	return warn(g_error);
     }
 
+    /* keep the read statistics, leaving stalls out of the sustained read time */
+    read_usec      = (u_int32_t) get_usec_since(&read_start);
+    xfer->read_max = max(xfer->read_max, read_usec);
+    if (read_usec > max(READ_STALL_MIN, 4 * xfer->ipd_current)) {
+	xfer->read_stall += read_usec;
+    } else {
+	xfer->read_usec += read_usec;
+	xfer->read_blocks++;
+    }
+
     /* build the datagram header */
     *((u_int32_t *) (datagram + 0)) = htonl(block_index);
     *((u_int16_t *) (datagram + 4)) = htons(block_type);
@@ -118,6 +172,48 @@ int build_datagram(ttp_session_t *session, u_int32_t block_index,
 }
 
 
+/*------------------------------------------------------------------------
+ * int send_datagram(ttp_session_t *session, u_char *buffer);
+ *
+ * Sends the datagram that build_datagram() built in the given buffer
+ * to the client.  If the client asked for REQUEST_TIMESTAMPS, the time
+ * of day (in usec) goes into the datagram right before it is handed to
+ * the kernel, so that the client can follow the one-way delay of the
+ * path.  The datagram goes out on the data path that path_next() picks
+ * if the client set up several, else through the AF_XDP socket of the
+ * transfer if there is one, else through the impairment layer and the
+ * UDP socket.  Returns 0 on success and non-zero on failure.
+ *------------------------------------------------------------------------*/
+int send_datagram(ttp_session_t *session, u_char *buffer)
+{
+    ttp_transfer_t  *xfer = &session->transfer;
+    u_char          *datagram;
+    struct timeval   now;
+    size_t           length;
+    u_int32_t        path;
+
+    if (xfer->stamped) {
+	datagram = buffer;
+	length   = 6 + TS_STAMP_SIZE + session->parameter->block_size;
+	gettimeofday(&now, NULL);
+	*((u_int64_t *) (datagram + 6)) = htonll(now.tv_sec * 1000000ULL + now.tv_usec);
+    } else {
+	datagram = buffer + TS_STAMP_SIZE;
+	length   = 6 + session->parameter->block_size;
+    }
+
+    /* spread the blocks over the data paths, if the client set up several */
+    path = (xfer->path_count > 1) ? path_next(session, ntohl(*((u_int32_t *) datagram))) : 0;
+    if (path > 0)
+	return (impair_sendto(path, xfer->paths[path].fd, datagram, length, 0, (struct sockaddr *) &xfer->paths[path].address,
+	                      sizeof(struct sockaddr_in)) < 0) ? -1 : 0;
+
+    if (xfer->xdp.active)
+	return (xdp_send(&xfer->xdp, datagram, length) < 0) ? -1 : 0;
+    return (impair_sendto(0, xfer->udp_fd, datagram, length, 0, xfer->udp_address, xfer->udp_length) < 0) ? -1 : 0;
+}
+
+
 /*========================================================================
  * $Log$
  * Revision 1.2  2006/10/24 19:14:28  jwagnerhki
@@ -71,6 +71,7 @@
 #include <stdlib.h>      /* for memory allocation, exit(), etc.   */
 #include <string.h>      /* for memset(), sprintf(), etc.         */
 #include <sys/types.h>   /* for standard system data types        */
+#include <sys/select.h>  /* for select()                           */
 #include <sys/socket.h>  /* for the BSD sockets library           */
 #include <sys/stat.h>
 #include <arpa/inet.h>   /* for inet_ntoa()                       */
@@ -87,8 +88,13 @@
  *------------------------------------------------------------------------*/
 
 void client_handler (ttp_session_t *session);
+int  parse_paths    (ttp_parameter_t *parameter, const char *list);
+int  parse_budget   (ttp_parameter_t *parameter, const char *rate);
+int  parse_cache    (ttp_parameter_t *parameter, const char *size);
 void process_options(int argc, char *argv[], ttp_parameter_t *parameter);
 void reap           (int signum);
+void run_finishhook (ttp_parameter_t *parameter, const char *filename);
+void wait_request   (int client_fd, u_int64_t usec);
 
 
 /*------------------------------------------------------------------------
@@ -117,6 +123,18 @@ int main(int argc, char *argv[])
         return error(g_error);
     }
 
+    /* set up the rate budget that all children share */
+    if (budget_create(&parameter) < 0)
+        return error("Could not set up the rate budget");
+
+    /* and the queue of the transfers waiting for their turn */
+    if (admit_create(&parameter) < 0)
+        return error("Could not set up the transfer queue");
+
+    /* and the block cache that all children read files through */
+    if (cache_create(&parameter) < 0)
+        return error("Could not set up the block cache");
+
     /* install a signal handler for our children */
     signal(SIGCHLD, reap);
 
@@ -195,10 +213,12 @@ void client_handler(ttp_session_t *session)
     struct timeval    lasthblostreport;              /* the time since last 'heartbeat lost' report    */
     u_int32_t         deadconnection_counter;        /* the counter for checking dead conn timeout     */
     int               retransmitlen;                 /* number of bytes read from retransmission queue */
-    u_char            datagram[MAX_BLOCK_SIZE + 6];  /* the datagram containing the file block         */
+    bufpool_t         pool;                          /* the aligned memory of the datagram             */
+    u_char           *datagram;                      /* the datagram containing the file block         */
+    affinity_t        tx_affinity;                   /* the CPUs the sending process is pinned to      */
+    char              tx_where[320];                 /* the description of that placement              */
     int64_t           ipd_time;                      /* the time to delay/sleep after packet, signed   */
     int64_t           ipd_usleep_diff;               /* the time correction to ipd_time, signed        */
-    int64_t           ipd_time_max;
     int               status;
     ttp_transfer_t   *xfer  = &session->transfer;
     ttp_parameter_t  *param =  session->parameter;
@@ -218,7 +238,7 @@ void client_handler(ttp_session_t *session)
     if (1==param->verbose_yn) {
         fprintf(stderr,"Client authenticated. Negotiated parameters are:\n");
         fprintf(stderr,"Block size: %d\n", param->block_size);
-        fprintf(stderr,"Buffer size: %d\n", param->udp_buffer); 
+        fprintf(stderr, param->udp_buffer ? "Buffer size: %d\n" : "Buffer size: auto\n", param->udp_buffer);
         fprintf(stderr,"Port: %d\n", param->tcp_port);    
     }
 
@@ -233,6 +253,7 @@ void client_handler(ttp_session_t *session)
     /* negotiate another transfer */
     status = ttp_open_transfer(session);
     if (status < 0) {
+        admit_leave(session);
         warn("Invalid file request");
         continue;
     }
@@ -240,10 +261,49 @@ void client_handler(ttp_session_t *session)
     /* negotiate a data transfer port */
     status = ttp_open_port(session);
     if (status < 0) {
+        admit_leave(session);
         warn("UDP socket creation failed");
         continue;
     }
 
+    /* pin the sender before its buffers are touched, next to the NIC unless told otherwise */
+    if ((affinity_resolve(param->tx_cpus, session->client_fd, &tx_affinity) < 0) || (affinity_pin(&tx_affinity) < 0)) {
+        warn("Could not place the sender, it runs on any CPU");
+        tx_affinity.cpus[0] = '\0';
+    }
+    if (param->verbose_yn)
+        fprintf(stderr, "Server %d sending on %s\n", session->session_id,
+                affinity_describe(&tx_affinity, tx_where, sizeof(tx_where)));
+
+    /* bypass the socket layer if asked to, the UDP socket stays for the fallback */
+    if (param->xdp_mode != XDP_MODE_OFF) {
+        if (6 + TS_STAMP_SIZE + param->block_size > XDP_DATAGRAM_MAX) {
+            sprintf(g_error, "Blocks of %u bytes do not fit AF_XDP frames, sending over the UDP socket", param->block_size);
+            warn(g_error);
+        } else if ((xdp_open(&xfer->xdp, session->client_fd, xfer->udp_fd, param->xdp_mode, param->xdp_queue, 0) < 0) ||
+            (xdp_target(&xfer->xdp, xfer->udp_address, xfer->udp_fd) < 0)) {
+            if (xfer->xdp.active)
+                xdp_close(&xfer->xdp);
+            warn("Could not set up AF_XDP, sending over the UDP socket");
+        } else if (param->verbose_yn) {
+            fprintf(stderr, "Server %d sending over AF_XDP on %s queue %u (%s mode)\n", session->session_id,
+                    xfer->xdp.device, xfer->xdp.queue, xdp_mode_name(param->xdp_mode));
+        }
+    }
+
+    /* allocate the datagram with its block data aligned behind the header and send time */
+    if (bufpool_create(&pool, 1, param->block_size, 6 + TS_STAMP_SIZE) < 0)
+        error("Could not allocate the datagram buffer");
+    datagram = bufpool_slot(&pool, 0);
+
+    /* restart the impairment of the data path, if any */
+    if (impair_start() < 0)
+        warn("Could not start the impairment layer");
+
+    /* and send within our share of the rate budget of the server, if any */
+    if (budget_join(session) < 0)
+        warn("Could not join the rate budget");
+
     /* make the client descriptor non-blocking again */
     status = fcntl(session->client_fd, F_SETFL, O_NONBLOCK);
     if (status < 0)
@@ -261,7 +321,6 @@ void client_handler(ttp_session_t *session)
     prevpacketT            = start;
     deadconnection_counter = 0;
     ipd_time               = 0;
-    ipd_time_max           = 0;
     ipd_usleep_diff        = 0;
     retransmitlen          = 0;
 
@@ -279,7 +338,6 @@ void client_handler(ttp_session_t *session)
         if (ipd_usleep_diff > 0 || ipd_time > 0) {
             ipd_time += ipd_usleep_diff;
         }
-        ipd_time_max = (ipd_time > ipd_time_max) ? ipd_time : ipd_time_max;
 
         /* see if transmit requests are available */
         status = read(session->client_fd, ((char*)&retransmission)+retransmitlen, sizeof(retransmission)-retransmitlen);
@@ -308,19 +366,16 @@ void client_handler(ttp_session_t *session)
 
                if(param->finishhook)
                {
-                   const int MaxCommandLength = 1024;
-                   char cmd[MaxCommandLength];
-                   int v;
-
-                   v = snprintf(cmd, MaxCommandLength, "%s %s", param->finishhook, xfer->filename);
-                   if(v >= MaxCommandLength)
+                   /* aggregated transfers run the hook once per member file */
+                   if(xfer->aggregate != NULL)
                    {
-                       fprintf(stderr, "Error: command buffer too short\n");
+                       u_int32_t i;
+                       for(i=0; i<xfer->aggregate->count; i++)
+                           run_finishhook(param, xfer->aggregate->entries[i].name);
                    }
-                   else
+                   else if(xfer->synthetic == TS_SYNTHETIC_NONE)
                    {
-                       fprintf(stderr, "Executing: %s\n", cmd);
-                       system(cmd);
+                       run_finishhook(param, xfer->filename);
                    }
                 }
 
@@ -336,21 +391,54 @@ void client_handler(ttp_session_t *session)
         /* if we have no retransmission */
         } else if (retransmitlen < sizeof(retransmission_t)) {
 
-            /* build the block */
-            xfer->block = min(xfer->block + 1, param->block_count);
-            block_type = (xfer->block == param->block_count) ? TS_BLOCK_TERMINATE : TS_BLOCK_ORIGINAL;
-            status = build_datagram(session, xfer->block, block_type, datagram);
-            if (status < 0) {
-                sprintf(g_error, "Could not read block #%u", xfer->block);
-                error(g_error);
-            }
+            /* serve the ranges the client asked for before anything else */
+            if (xfer->range_count > 0) {
+
+                block_type = TS_BLOCK_RETRANSMISSION;
+                if (ttp_send_range(session, datagram) < 0)
+                    warn("Range retransmission error");
+
+            /* past the last block, wait for requests and probe with the terminate block only now and then */
+            } else if ((xfer->block == param->block_count) && (xfer->tail_interval > 0) &&
+                       ((delta = get_usec_since(&xfer->tail_probe)) < xfer->tail_interval)) {
+
+                block_type = TS_BLOCK_TERMINATE;
+                wait_request(session->client_fd, xfer->tail_interval - delta);
+                gettimeofday(&prevpacketT, NULL);
+                ipd_time = 0;
+
+                /* the heartbeat check counts loop iterations, which are slow here */
+                if (get_usec_since(&lastfeedback) > 500000)
+                    deadconnection_counter = 2048 + 1;
+
+            } else {
 
-            /* transmit the block */
-            status = sendto(xfer->udp_fd, datagram, 6 + param->block_size, 0, xfer->udp_address, xfer->udp_length);
-            if (status < 0) {
-                sprintf(g_error, "Could not transmit block #%u", xfer->block);
-                warn(g_error);
-                continue;
+                /* build the block, skipping the blocks the client acknowledged after a restart */
+                xfer->block = min(xfer->block + 1, param->block_count);
+                while ((xfer->block < param->block_count) && (xfer->acked[xfer->block / 8] & (1 << (xfer->block % 8)))) {
+                    ++xfer->block;
+                    ++xfer->skipped;
+                }
+                block_type = (xfer->block == param->block_count) ? TS_BLOCK_TERMINATE : TS_BLOCK_ORIGINAL;
+                status = build_datagram(session, xfer->block, block_type, datagram);
+                if (status < 0) {
+                    sprintf(g_error, "Could not read block #%u", xfer->block);
+                    error(g_error);
+                }
+
+                /* transmit the block */
+                status = send_datagram(session, datagram);
+                if (status < 0) {
+                    sprintf(g_error, "Could not transmit block #%u", xfer->block);
+                    warn(g_error);
+                    continue;
+                }
+
+                /* back off between the terminate blocks while the client asks for nothing */
+                if (block_type == TS_BLOCK_TERMINATE) {
+                    xfer->tail_probe    = currpacketT;
+                    xfer->tail_interval = (xfer->tail_interval == 0) ? TAIL_PROBE_MIN : min(2 * xfer->tail_interval, TAIL_PROBE_MAX);
+                }
             }
 
         /* if we have too long retransmission message */
@@ -412,10 +500,15 @@ void client_handler(ttp_session_t *session)
             #endif
         }
 
-         /* wait before handling the next packet */
-         if (block_type == TS_BLOCK_TERMINATE) {
-             usleep_that_works(10*ipd_time_max);
+         /* don't make up for a read stall with a burst of blocks, and let the client know */
+         if (xfer->read_stall > 0) {
+             if (ttp_send_stall(session) < 0)
+                 warn("Read stall notice failed");
+             gettimeofday(&prevpacketT, NULL);
+             ipd_time = 0;
          }
+
+         /* wait before handling the next packet */
          if (ipd_time > 0) {
              usleep_that_works(ipd_time);
          }
@@ -435,15 +528,42 @@ void client_handler(ttp_session_t *session)
         fprintf(stderr, "Server %d transferred %llu bytes in %0.2f seconds (%0.1f Mbps)\n",
                 session->session_id, (ull_t)param->file_size, delta / 1000000.0, 
                 8.0 * param->file_size / (delta * 1e-6 * 1024*1024) );
+    if (param->verbose_yn && (xfer->stalls > 0))
+        fprintf(stderr, "Server %d stalled %u times reading the source, %0.2f seconds in total\n",
+                session->session_id, xfer->stalls, xfer->stall_usec / 1e6);
 
     /* close the transcript */
     if (param->transcript_yn)
         xscript_close(session, delta);
 
+    /* report the blocks that did not have to be sent again */
+    if (param->verbose_yn && xfer->skipped)
+        fprintf(stderr, "Server %d skipped %u blocks the client already had\n", session->session_id, xfer->skipped);
+    if (param->verbose_yn && (xfer->path_count > 1))
+        path_report(session);
+    if (param->verbose_yn && xfer->xdp.active)
+        fprintf(stderr, "Server %d sent %llu datagrams over AF_XDP\n", session->session_id, (ull_t) xfer->xdp.frames);
+    if (param->verbose_yn && (xfer->budget_slot >= 0))
+        fprintf(stderr, "Server %d had a share of %0.1f Mbps of the budget at the end\n", session->session_id,
+                8.0 * param->block_size / xfer->ipd_budget);
+    if (param->verbose_yn && (xfer->cache_hits + xfer->cache_misses > 0))
+        fprintf(stderr, "Server %d read %llu blocks from the block cache, %llu from disk\n", session->session_id,
+                (ull_t) xfer->cache_hits, (ull_t) xfer->cache_misses);
+
+    /* leave our share of the budget to the other transfers, and our turn to the next in line */
+    budget_leave(session);
+    admit_leave(session);
+
+    /* report the impairment of the data path, if any */
+    impair_finish();
+
     #ifndef VSIB_REALTIME
 
     /* close the file */
-    fclose(xfer->file);
+    if (xfer->aggregate != NULL)
+        aggregate_close(session);
+    else if (xfer->file != NULL)
+        fclose(xfer->file);
 
     #else
 
@@ -458,8 +578,14 @@ void client_handler(ttp_session_t *session)
 
     #endif
 
-    /* close the UDP socket */
+    /* close the UDP socket and release the datagram */
+    if (xfer->xdp.active)
+        xdp_close(&xfer->xdp);
+    path_close(session);
     close(xfer->udp_fd);
+    bufpool_destroy(&pool);
+    if (xfer->acked != NULL)
+        free(xfer->acked);
     memset(xfer, 0, sizeof(*xfer));
 
     } //while(1)
@@ -482,11 +608,22 @@ void process_options(int argc, char *argv[], ttp_parameter_t *parameter)
                      { "port",       1, NULL, 'p' },
                      { "secret",     1, NULL, 's' },
                      { "buffer",     1, NULL, 'b' },
+                     { "buffermax",  1, NULL, 'B' },
                      { "hbtimeout",  1, NULL, 'h' },
                      { "v",          0, NULL, 'v' },
                      { "client",     1, NULL, 'c' },
                      { "finishhook", 1, NULL, 'f' },
                      { "allhook",    1, NULL, 'a' },
+                     { "impair",     1, NULL, 'i' },
+                     { "txcpus",     1, NULL, 'x' },
+                     { "xdp",        1, NULL, 'X' },
+                     { "xdpqueue",   1, NULL, 'q' },
+                     { "paths",      1, NULL, 'P' },
+                     { "budget",     1, NULL, 'r' },
+                     { "weights",    1, NULL, 'w' },
+                     { "maxtransfers", 1, NULL, 'n' },
+                     { "maxpervolume", 1, NULL, 'V' },
+                     { "cache",      1, NULL, 'C' },
                      #ifdef VSIB_REALTIME
                      { "vsibmode",   1, NULL, 'M' },
                      { "vsibskip",   1, NULL, 'S' },
@@ -533,14 +670,70 @@ void process_options(int argc, char *argv[], ttp_parameter_t *parameter)
         case 'a':  parameter->allhook = (unsigned char*)optarg;
              break;
 
-        /* --buffer=i   : size of socket buffer */
+        /* --buffer=i   : size of socket buffer, 'auto' is 0 */
         case 'b':  parameter->udp_buffer = atoi(optarg);
              break;
 
+        /* --buffermax=i : cap of the auto-sized socket buffer */
+        case 'B':  parameter->buffer_max = atoi(optarg);
+             break;
+
         /* --hbtimeout=i : client heartbeat timeout in seconds */
         case 'h': parameter->hb_timeout = atoi(optarg);
              break;
 
+        /* --txcpus=s   : CPUs of the sending process, 'auto' or 'none' */
+        case 'x':  parameter->tx_cpus = optarg;
+             break;
+
+        /* --xdp=s      : AF_XDP mode of the data path, 'off', 'skb' or 'native' */
+        case 'X':  parameter->xdp_mode = xdp_parse_mode(optarg);
+                   if (parameter->xdp_mode < 0) {
+                       fprintf(stderr, "Invalid AF_XDP mode '%s', use off, skb or native\n", optarg);
+                       exit(1);
+                   }
+             break;
+
+        /* --xdpqueue=i : queue of the interface to send on with AF_XDP */
+        case 'q':  parameter->xdp_queue = atoi(optarg);
+             break;
+
+        /* --paths=s    : source addresses of the extra data paths, 'any' for the default */
+        case 'P':  if (parse_paths(parameter, optarg) < 0)
+                       exit(1);
+             break;
+
+        /* --budget=s   : the rate that all transfers share, with k, M or G suffix */
+        case 'r':  if (parse_budget(parameter, optarg) < 0)
+                       exit(1);
+             break;
+
+        /* --weights=s  : 'address=weight' list of the clients' shares of the budget */
+        case 'w':  if (budget_weight(optarg, NULL) < 0) {
+                       fprintf(stderr, "Invalid weights '%s', use address=weight,...\n", optarg);
+                       exit(1);
+                   }
+                   parameter->weights = optarg;
+             break;
+
+        /* --maxtransfers=i : the most transfers at once, the others queue */
+        case 'n':  parameter->max_transfers = atoi(optarg);
+             break;
+
+        /* --maxpervolume=i : the most transfers at once from one source volume */
+        case 'V':  parameter->max_per_volume = atoi(optarg);
+             break;
+
+        /* --cache=s    : the size of the block cache, with K, M, G or T suffix */
+        case 'C':  if (parse_cache(parameter, optarg) < 0)
+                       exit(1);
+             break;
+
+        /* --impair=s   : impairment of the UDP data path for testing */
+        case 'i':  if (impair_setup(optarg) < 0)
+                       exit(1);
+             break;
+
         #ifdef VSIB_REALTIME
         /* --vsibmode=i   : size of socket buffer */
         case 'M':  vsib_mode = atoi(optarg);
@@ -553,8 +746,11 @@ void process_options(int argc, char *argv[], ttp_parameter_t *parameter)
 
         /* otherwise    : display usage information */
         default: 
-             fprintf(stderr, "Usage: tsunamid [--verbose] [--transcript] [--v6] [--port=n] [--buffer=bytes]\n");
-             fprintf(stderr, "                [--hbtimeout=seconds] [--allhook=cmd] [--finishhook=cmd]\n");
+             fprintf(stderr, "Usage: tsunamid [--verbose] [--transcript] [--v6] [--port=n] [--buffer=bytes|auto] [--buffermax=bytes]\n");
+             fprintf(stderr, "                [--hbtimeout=seconds] [--allhook=cmd] [--finishhook=cmd] [--impair=settings]\n");
+             fprintf(stderr, "                [--txcpus=list|nodeN|auto|none] [--xdp=off|skb|native] [--xdpqueue=n]\n");
+             fprintf(stderr, "                [--paths=address,address,...] [--budget=bps] [--weights=address=weight,...]\n");
+             fprintf(stderr, "                [--maxtransfers=n] [--maxpervolume=n] [--cache=bytes]\n");
 			 fprintf(stderr, "                ");
              #ifdef VSIB_REALTIME
              fprintf(stderr, "[--vsibmode=mode] [--vsibskip=skip] [filename1 filename2 ...]\n\n");
@@ -567,10 +763,27 @@ void process_options(int argc, char *argv[], ttp_parameter_t *parameter)
              fprintf(stderr, "port         : specifies which TCP port on which to listen to incoming connections\n");
              fprintf(stderr, "secret       : specifies the shared secret for the client and server\n");
              fprintf(stderr, "client       : specifies an alternate client IP or host where to send data\n");
-             fprintf(stderr, "buffer       : specifies the desired size for UDP socket send buffer (in bytes)\n");
+             fprintf(stderr, "buffer       : specifies the desired size for UDP socket send buffer (in bytes), or\n");
+             fprintf(stderr, "               'auto' to size it from the bandwidth-delay product of each transfer\n");
+             fprintf(stderr, "buffermax    : specifies the largest auto-sized UDP socket send buffer (in bytes)\n");
              fprintf(stderr, "hbtimeout    : specifies the timeout in seconds for disconnect after client heartbeat lost\n");
 			 fprintf(stderr, "finishhook   : run command on transfer completion, file name is appended automatically\n");
 			 fprintf(stderr, "allhook      : run command on 'get *' to produce a custom file list for client downloads\n");			 
+             fprintf(stderr, "impair       : impairs the sent data for testing, e.g. loss=0.01,delay=20,rate=800M (see USAGE.txt)\n");
+             fprintf(stderr, "txcpus       : pins the sending process to a CPU list like 0-3,8 or a NUMA node like node1, 'auto'\n");
+             fprintf(stderr, "               for the node of the network interface of each client, or 'none'\n");
+             fprintf(stderr, "xdp          : sends the blocks through an AF_XDP socket in 'skb' (generic) or 'native' (driver)\n");
+             fprintf(stderr, "               mode instead of the UDP socket, IPv4 only and needs root, or 'off'\n");
+             fprintf(stderr, "xdpqueue     : specifies the queue of the network interface that the AF_XDP socket sends on\n");
+             fprintf(stderr, "paths        : lets clients stripe a transfer over up to %d more data paths, sent from these\n", TS_MAX_PATHS - 1);
+             fprintf(stderr, "               local IPv4 addresses in turn, or 'any' to leave the choice to the routing table\n");
+             fprintf(stderr, "budget       : caps the rate of all transfers together (bps, with k, M or G suffix), each\n");
+             fprintf(stderr, "               getting a fair share by the weight of its client\n");
+             fprintf(stderr, "weights      : gives clients other weights than 1 in the budget, e.g. 10.0.0.5=2,10.0.0.6=0.5\n");
+             fprintf(stderr, "maxtransfers : runs at most this many transfers at once, further requests wait in line\n");
+             fprintf(stderr, "maxpervolume : runs at most this many transfers at once from files on the same volume\n");
+             fprintf(stderr, "cache        : keeps this much of the served files (bytes, with K, M, G or T suffix) in memory\n");
+             fprintf(stderr, "               shared by all transfers, in huge pages where there are any\n");
              #ifdef VSIB_REALTIME
              fprintf(stderr, "vsibmode     : specifies the VSIB mode to use (see VSIB documentation for modes)\n");
              fprintf(stderr, "vsibskip     : a value N other than 0 will skip N samples after every 1 sample\n");
@@ -581,8 +794,17 @@ void process_options(int argc, char *argv[], ttp_parameter_t *parameter)
              fprintf(stderr, "          transcript = %d\n",   DEFAULT_TRANSCRIPT_YN);
              fprintf(stderr, "          v6         = %d\n",   DEFAULT_IPV6_YN);
              fprintf(stderr, "          port       = %d\n",   DEFAULT_TCP_PORT);
-             fprintf(stderr, "          buffer     = %d bytes\n",   DEFAULT_UDP_BUFFER);
+             fprintf(stderr, "          buffer     = auto\n");
+             fprintf(stderr, "          buffermax  = %d bytes\n",   DEFAULT_BUFFER_MAX);
              fprintf(stderr, "          hbtimeout  = %d seconds\n",   DEFAULT_HEARTBEAT_TIMEOUT);
+             fprintf(stderr, "          txcpus     = %s\n",   DEFAULT_TX_CPUS);
+             fprintf(stderr, "          xdp        = %s\n",   xdp_mode_name(DEFAULT_XDP_MODE));
+             fprintf(stderr, "          xdpqueue   = %u\n",   DEFAULT_XDP_QUEUE);
+             fprintf(stderr, "          paths      = none\n");
+             fprintf(stderr, "          budget     = none\n");
+             fprintf(stderr, "          maxtransfers = none\n");
+             fprintf(stderr, "          maxpervolume = none\n");
+             fprintf(stderr, "          cache      = none\n");
              #ifdef VSIB_REALTIME
              fprintf(stderr, "          vsibmode   = %d\n",   0);
              fprintf(stderr, "          vsibskip   = %d\n",   0);
@@ -610,12 +832,142 @@ void process_options(int argc, char *argv[], ttp_parameter_t *parameter)
 
     if (1==parameter->verbose_yn) {
        fprintf(stderr,"Block size: %d\n", parameter->block_size);
-       fprintf(stderr,"Buffer size: %d\n", parameter->udp_buffer);
+       fprintf(stderr, parameter->udp_buffer ? "Buffer size: %d\n" : "Buffer size: auto\n", parameter->udp_buffer);
        fprintf(stderr,"Port: %d\n", parameter->tcp_port);
     }
 }
 
 
+/*------------------------------------------------------------------------
+ * int parse_paths(ttp_parameter_t *parameter, const char *list);
+ *
+ * Takes the comma separated local IPv4 addresses that the extra data
+ * paths of a transfer send from, path 1 first, with 'any' for the one
+ * the routing table picks.  Clients may then set up as many extra
+ * paths as there are addresses.  Returns 0 on success and nonzero on
+ * failure.
+ *------------------------------------------------------------------------*/
+int parse_paths(ttp_parameter_t *parameter, const char *list)
+{
+    char       copy[1024];
+    char      *item, *save;
+    u_int32_t  count = 1;
+
+    snprintf(copy, sizeof(copy), "%s", list);
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        if (count == TS_MAX_PATHS) {
+            fprintf(stderr, "At most %d extra data paths are supported\n", TS_MAX_PATHS - 1);
+            return -1;
+        }
+        if (!strcmp(item, "any")) {
+            parameter->path_source[count].s_addr = htonl(INADDR_ANY);
+        } else if (inet_pton(AF_INET, item, &parameter->path_source[count]) != 1) {
+            fprintf(stderr, "Invalid data path address '%s', use IPv4 addresses or 'any'\n", item);
+            return -1;
+        }
+        ++count;
+    }
+    parameter->max_paths = count;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int parse_budget(ttp_parameter_t *parameter, const char *rate);
+ *
+ * Takes the rate (bps, with an optional 'k', 'M' or 'G' suffix) that
+ * all transfers of the server share.  Returns 0 on success and nonzero
+ * on failure.
+ *------------------------------------------------------------------------*/
+int parse_budget(ttp_parameter_t *parameter, const char *rate)
+{
+    char   *end;
+    double  number;
+
+    number = strtod(rate, &end);
+    if      ((*end == 'G') || (*end == 'g')) { number *= 1e9; ++end; }
+    else if ((*end == 'M') || (*end == 'm')) { number *= 1e6; ++end; }
+    else if ((*end == 'K') || (*end == 'k')) { number *= 1e3; ++end; }
+    if ((end == rate) || (*end != '\0') || (number < 1e3)) {
+        fprintf(stderr, "Invalid budget '%s', use a rate like 800M or 10G\n", rate);
+        return -1;
+    }
+    parameter->budget = (u_int64_t) number;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int parse_cache(ttp_parameter_t *parameter, const char *size);
+ *
+ * Takes the size (bytes, with an optional 'K', 'M', 'G' or 'T' suffix
+ * for powers of 1024) of the block cache.  Returns 0 on success and
+ * nonzero on failure.
+ *------------------------------------------------------------------------*/
+int parse_cache(ttp_parameter_t *parameter, const char *size)
+{
+    char   *end;
+    double  number;
+
+    number = strtod(size, &end);
+    if      ((*end == 'T') || (*end == 't')) { number *= 1099511627776.0; ++end; }
+    else if ((*end == 'G') || (*end == 'g')) { number *= 1073741824.0;    ++end; }
+    else if ((*end == 'M') || (*end == 'm')) { number *= 1048576.0;       ++end; }
+    else if ((*end == 'K') || (*end == 'k')) { number *= 1024.0;          ++end; }
+    if ((end == size) || (*end != '\0') || (number < CACHE_CHUNK * CACHE_WAYS)) {
+        fprintf(stderr, "Invalid cache size '%s', use a size of at least %u MB like 512M or 4G\n",
+                size, CACHE_CHUNK * CACHE_WAYS / (1024 * 1024));
+        return -1;
+    }
+    parameter->cache_size = (u_int64_t) number;
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void run_finishhook(ttp_parameter_t *parameter, const char *filename);
+ *
+ * Runs the finishhook program with the name of a completely sent file
+ * appended to it.
+ *------------------------------------------------------------------------*/
+void run_finishhook(ttp_parameter_t *parameter, const char *filename)
+{
+    const int MaxCommandLength = 1024;
+    char cmd[MaxCommandLength];
+    int v;
+
+    v = snprintf(cmd, MaxCommandLength, "%s %s", parameter->finishhook, filename);
+    if(v >= MaxCommandLength)
+    {
+        fprintf(stderr, "Error: command buffer too short\n");
+    }
+    else
+    {
+        fprintf(stderr, "Executing: %s\n", cmd);
+        system(cmd);
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * void wait_request(int client_fd, u_int64_t usec);
+ *
+ * Waits for up to the given time (in usec) for a request from the client
+ * to arrive on the given control connection.
+ *------------------------------------------------------------------------*/
+void wait_request(int client_fd, u_int64_t usec)
+{
+    fd_set         readable;
+    struct timeval timeout;
+
+    FD_ZERO(&readable);
+    FD_SET(client_fd, &readable);
+    timeout.tv_sec  = usec / 1000000;
+    timeout.tv_usec = usec % 1000000;
+    select(client_fd + 1, &readable, NULL, NULL, &timeout);
+}
+
+
 /*------------------------------------------------------------------------
  * void reap(int signum);
  *
@@ -144,7 +144,7 @@ int create_tcp_socket(ttp_parameter_t *parameter)
  * Establishes a new UDP socket for data transfer, returning the file
  * descriptor of the socket on success and a negative value on error.
  * This will be an IPv6 socket if ipv6_yn is true and an IPv4 socket
- * otherwise.
+ * otherwise.  The size of the UDP send buffer is set by ttp_open_port().
  *------------------------------------------------------------------------*/
 int create_udp_socket(ttp_parameter_t *parameter)
 {
@@ -164,12 +164,6 @@ int create_udp_socket(ttp_parameter_t *parameter)
 	return warn("Error in configuring UDP socket");
     }
 
-    /* set the transmit buffer size */
-    status = setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &parameter->udp_buffer, sizeof(parameter->udp_buffer));
-    if (status < 0) {
-	warn("Error in resizing UDP transmit buffer");
-    }
-
     /* return the file desscriptor */
     return socket_fd;
 }
@@ -0,0 +1,462 @@
+/*========================================================================
+ * path.c  --  Data path striping routines for Tsunami server.
+ *
+ * This contains the routines that spread the blocks of a transfer over
+ * several data paths, e.g. pairs of network interfaces of the server
+ * and the client.  Each path has its own UDP socket and inter-packet
+ * delay, and a stride schedule sends on each path in proportion to its
+ * rate.  The blocks that the client asks for again are charged to the
+ * path they were last sent on, which gives each path its own share of
+ * the error rate the client reports.
+ *
+ * Copyright (C) 2002 The Trustees of Indiana University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1) All redistributions of source code must retain the above
+ *    copyright notice, the list of authors in the original source
+ *    code, this list of conditions and the disclaimer listed in this
+ *    license;
+ *
+ * 2) All redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the disclaimer
+ *    listed in this license in the documentation and/or other
+ *    materials provided with the distribution;
+ *
+ * 3) Any documentation included with all redistributions must include
+ *    the following acknowledgement:
+ *
+ *      "This product includes software developed by Indiana
+ *      University`s Advanced Network Management Lab. For further
+ *      information, contact Steven Wallace at 812-855-0960."
+ *
+ *    Alternatively, this acknowledgment may appear in the software
+ *    itself, and wherever such third-party acknowledgments normally
+ *    appear.
+ *
+ * 4) The name "tsunami" shall not be used to endorse or promote
+ *    products derived from this software without prior written
+ *    permission from Indiana University.  For written permission,
+ *    please contact Steven Wallace at 812-855-0960.
+ *
+ * 5) Products derived from this software may not be called "tsunami",
+ *    nor may "tsunami" appear in their name, without prior written
+ *    permission of Indiana University.
+ *
+ * Indiana University provides no reassurances that the source code
+ * provided does not infringe the patent or any other intellectual
+ * property rights of any other entity.  Indiana University disclaims
+ * any liability to any recipient for claims brought by any other
+ * entity based on infringement of intellectual property rights or
+ * otherwise.
+ *
+ * LICENSEE UNDERSTANDS THAT SOFTWARE IS PROVIDED "AS IS" FOR WHICH
+ * NO WARRANTIES AS TO CAPABILITIES OR ACCURACY ARE MADE. INDIANA
+ * UNIVERSITY GIVES NO WARRANTIES AND MAKES NO REPRESENTATION THAT
+ * SOFTWARE IS FREE OF INFRINGEMENT OF THIRD PARTY PATENT, COPYRIGHT,
+ * OR OTHER PROPRIETARY RIGHTS. INDIANA UNIVERSITY MAKES NO
+ * WARRANTIES THAT SOFTWARE IS FREE FROM "BUGS", "VIRUSES", "TROJAN
+ * HORSES", "TRAP DOORS", "WORMS", OR OTHER HARMFUL CODE.  LICENSEE
+ * ASSUMES THE ENTIRE RISK AS TO THE PERFORMANCE OF SOFTWARE AND/OR
+ * ASSOCIATED MATERIALS, AND TO THE PERFORMANCE AND VALIDITY OF
+ * INFORMATION GENERATED USING SOFTWARE.
+ *========================================================================*/
+
+#include <arpa/inet.h>   /* for inet_ntop()                 */
+#include <stdlib.h>      /* for calloc() and free()         */
+#include <string.h>      /* for memset()                    */
+#include <sys/socket.h>  /* for the BSD sockets library     */
+#include <unistd.h>      /* for close()                     */
+
+#include <tsunami-server.h>
+
+
+/*------------------------------------------------------------------------
+ * Module-scope routines.
+ *------------------------------------------------------------------------*/
+
+static int  path_probe(ttp_session_t *session, u_int32_t index);
+static void path_drop (ttp_session_t *session, u_int32_t index);
+
+
+/*------------------------------------------------------------------------
+ * int path_add(ttp_session_t *session, u_int32_t index,
+ *              struct in_addr address, u_int16_t port);
+ *
+ * Sets up the data path with the given index (1 and up, the path of
+ * the UDP socket from ttp_open_port() is path 0) to the given client
+ * address and port, which the client asked for with REQUEST_PATH.  The
+ * path sends from the address given for it with --paths.  It carries no
+ * data until the client echoed the random nonce of the probe we send on
+ * it with REQUEST_PATH_CONFIRM, so that a client cannot have the server
+ * flood a host that does not take part in the transfer.  Returns 0 on
+ * success and nonzero on failure.
+ *------------------------------------------------------------------------*/
+int path_add(ttp_session_t *session, u_int32_t index, struct in_addr address, u_int16_t port)
+{
+    ttp_transfer_t     *xfer  = &session->transfer;
+    ttp_parameter_t    *param = session->parameter;
+    ttp_path_t         *path;
+    struct sockaddr_in  source;
+    char                from[INET_ADDRSTRLEN], to[INET_ADDRSTRLEN];
+    u_int32_t           granted, limit;
+
+    /* the client may only use as many paths as we were told to serve */
+    if ((index == 0) || (index >= param->max_paths)) {
+        sprintf(g_error, "Client asked for data path %u, but only %u are served (see --paths)", index, param->max_paths);
+        return warn(g_error);
+    }
+    if ((index < xfer->path_count) && (xfer->paths[index].active || xfer->paths[index].pending)) {
+        sprintf(g_error, "Client asked for data path %u twice", index);
+        return warn(g_error);
+    }
+
+    /* the first extra path turns the UDP socket into path 0 */
+    if (xfer->path_count == 0) {
+        xfer->path_of = (u_char *) calloc(param->block_count + 1, sizeof(u_char));
+        if (xfer->path_of == NULL)
+            return warn("Could not allocate the data path of each block");
+        memset(xfer->paths, 0, sizeof(xfer->paths));
+        xfer->paths[0].active = 1;
+        xfer->paths[0].fd     = xfer->udp_fd;
+        xfer->paths[0].ipd    = xfer->ipd_current;
+        xfer->path_count      = 1;
+    }
+
+    /* open the socket of the path, bound to the source address for it */
+    path = &xfer->paths[index];
+    memset(path, 0, sizeof(*path));
+    path->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (path->fd < 0)
+        return warn("Could not create UDP socket for data path");
+    memset(&source, 0, sizeof(source));
+    source.sin_family = AF_INET;
+    source.sin_addr   = param->path_source[index];
+    if (bind(path->fd, (struct sockaddr *) &source, sizeof(source)) < 0) {
+        close(path->fd);
+        inet_ntop(AF_INET, &source.sin_addr, from, sizeof(from));
+        sprintf(g_error, "Could not bind data path %u to %s", index, from);
+        return warn(g_error);
+    }
+    granted = set_socket_buffer(path->fd, SO_SNDBUF, xfer->udp_buffer, &limit);
+    if (granted < xfer->udp_buffer)
+        printf("Warning: UDP send buffer of data path %u clamped to %u of %u bytes\n", index, granted, xfer->udp_buffer);
+
+    /* and probe it until the client answers */
+    path->address.sin_family = AF_INET;
+    path->address.sin_addr   = address;
+    path->address.sin_port   = htons(port);
+    if (get_random_data((u_char *) &path->nonce, sizeof(path->nonce)) < 0) {
+        close(path->fd);
+        return warn("Could not generate the nonce of a data path");
+    }
+    path->pending    = 1;
+    xfer->path_count = max(xfer->path_count, index + 1);
+
+    if (param->verbose_yn) {
+        inet_ntop(AF_INET, &param->path_source[index], from, sizeof(from));
+        inet_ntop(AF_INET, &address, to, sizeof(to));
+        printf("Data path %u from %s to %s:%u, waiting for the client to answer its probe\n", index, from, to, port);
+    }
+    return path_probe(session, index);
+}
+
+
+/*------------------------------------------------------------------------
+ * int path_confirm(ttp_session_t *session, u_int32_t index,
+ *                  u_int32_t nonce);
+ *
+ * Starts sending on the data path with the given index once the client
+ * echoed the nonce of its probe with REQUEST_PATH_CONFIRM.  The path
+ * starts out at the rate of the first path.  A wrong nonce drops the
+ * path, so that it cannot be guessed.  Returns 0 on success and nonzero
+ * on failure.
+ *------------------------------------------------------------------------*/
+int path_confirm(ttp_session_t *session, u_int32_t index, u_int32_t nonce)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+    ttp_path_t     *path;
+    u_int32_t       i;
+
+    if ((index == 0) || (index >= xfer->path_count) || !xfer->paths[index].pending) {
+        sprintf(g_error, "Client confirmed data path %u, which is not waiting for it", index);
+        return warn(g_error);
+    }
+    path = &xfer->paths[index];
+    if (nonce != path->nonce) {
+        path_drop(session, index);
+        sprintf(g_error, "Client answered the probe of data path %u wrongly, dropping the path", index);
+        return warn(g_error);
+    }
+
+    /* start at the rate of the first path, and at the front of the schedule */
+    path->ipd  = xfer->paths[0].ipd;
+    path->pass = xfer->paths[0].pass;
+    for (i = 1; i < xfer->path_count; ++i)
+        if (xfer->paths[i].active)
+            path->pass = min(path->pass, xfer->paths[i].pass);
+    path->pending = 0;
+    path->active  = 1;
+    path_limit(session);
+
+    if (session->parameter->verbose_yn)
+        printf("Data path %u confirmed by the client\n", index);
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * u_int32_t path_next(ttp_session_t *session, u_int32_t block);
+ *
+ * Picks the data path to send the given block on: the one that is
+ * furthest behind in the stride schedule, where each block moves its
+ * path ahead by the inter-packet delay of the path.  So each path gets
+ * the share of the blocks that its rate is of the aggregate rate.
+ * Returns the index of the path.
+ *------------------------------------------------------------------------*/
+u_int32_t path_next(ttp_session_t *session, u_int32_t block)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+    u_int32_t       best = 0;
+    u_int32_t       i;
+
+    for (i = 1; i < xfer->path_count; ++i)
+        if (xfer->paths[i].active && (xfer->paths[i].pass < xfer->paths[best].pass))
+            best = i;
+
+    xfer->paths[best].pass += xfer->paths[best].ipd;
+    ++xfer->paths[best].sent;
+    if (block <= session->parameter->block_count)
+        xfer->path_of[block] = (u_char) best;
+    return best;
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_lost(ttp_session_t *session, u_int32_t block);
+ *
+ * Charges a block that the client asked for again to the data path it
+ * was last sent on.
+ *------------------------------------------------------------------------*/
+void path_lost(ttp_session_t *session, u_int32_t block)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+
+    if ((xfer->path_of != NULL) && (block <= session->parameter->block_count))
+        ++xfer->paths[xfer->path_of[block]].lost;
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_rate(ttp_session_t *session, u_int32_t error_rate);
+ *
+ * Adjusts the inter-packet delay of each data path after the client
+ * reported the given error rate for all of them, and probes the paths
+ * that wait for the client to confirm them again.  A path is given the
+ * error rate scaled by how much more (or less) than its share of the
+ * blocks it lost since the last report, but at least the share of its
+ * own blocks that were asked for again, so a lossy path slows down
+ * while the others keep their rate.  Without any charged losses, e.g.
+ * when the error rate stands for queueing delay, all paths get the
+ * same error rate.
+ *------------------------------------------------------------------------*/
+void path_rate(ttp_session_t *session, u_int32_t error_rate)
+{
+    ttp_transfer_t  *xfer  = &session->transfer;
+    ttp_parameter_t *param = session->parameter;
+    ttp_path_t      *path;
+    u_int64_t        sent  = 0;
+    u_int64_t        lost  = 0;
+    double           error;
+    u_int32_t        i;
+
+    for (i = 0; i < xfer->path_count; ++i) {
+        sent += xfer->paths[i].sent;
+        lost += xfer->paths[i].lost;
+    }
+
+    for (i = 0; i < xfer->path_count; ++i) {
+        path = &xfer->paths[i];
+
+        /* probe the paths the client did not answer for yet again, but not forever */
+        if (path->pending) {
+            if (path->probes < PATH_PROBES) {
+                path_probe(session, i);
+            } else {
+                path_drop(session, i);
+                sprintf(g_error, "Client did not answer the probes of data path %u, dropping the path", i);
+                warn(g_error);
+            }
+        }
+        if (!path->active)
+            continue;
+        error = error_rate;
+        if ((lost > 0) && (path->sent > 0))
+            error = min(max(error_rate * ((double) path->lost / lost) * ((double) sent / path->sent),
+                            100000.0 * path->lost / path->sent), 100000.0);
+        path->ipd = ratecontrol_ipd(path->ipd, (u_int32_t) error, param->error_rate,
+                                    param->slower_num, param->slower_den,
+                                    param->faster_num, param->faster_den, param->ipd_time);
+        path->total_sent += path->sent;
+        path->total_lost += path->lost;
+        path->sent = path->lost = 0;
+    }
+
+    path_limit(session);
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_start_rate(ttp_session_t *session, double ipd);
+ *
+ * Splits the given aggregate inter-packet delay, e.g. that of a start
+ * rate the client asked for, evenly over the data paths.
+ *------------------------------------------------------------------------*/
+void path_start_rate(ttp_session_t *session, double ipd)
+{
+    ttp_transfer_t *xfer   = &session->transfer;
+    u_int32_t       active = 0;
+    u_int32_t       i;
+
+    for (i = 0; i < xfer->path_count; ++i)
+        active += xfer->paths[i].active;
+    for (i = 0; i < xfer->path_count; ++i)
+        if (xfer->paths[i].active)
+            xfer->paths[i].ipd = min(max(ipd * active, session->parameter->ipd_time), 10000.0);
+
+    path_limit(session);
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_limit(ttp_session_t *session);
+ *
+ * Sets the inter-packet delay of the transfer as a whole, which paces
+ * the send loop, from the rates of the data paths.  Where that is
+ * faster than the disk of the client or our source keep up with, or
+ * than our share of the rate budget, all paths are slowed down alike.
+ *------------------------------------------------------------------------*/
+void path_limit(ttp_session_t *session)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+    double          rate = 0.0;
+    double          ipd, floor;
+    u_int32_t       i;
+
+    for (i = 0; i < xfer->path_count; ++i)
+        if (xfer->paths[i].active)
+            rate += 1.0 / xfer->paths[i].ipd;
+    ipd   = 1.0 / rate;
+    floor = max(xfer->ipd_disk, xfer->ipd_read);
+    xfer->ipd_budget = budget_ipd(session, max(ipd, floor));
+    floor = max(floor, xfer->ipd_budget);
+
+    if (ipd < floor) {
+        for (i = 0; i < xfer->path_count; ++i)
+            xfer->paths[i].ipd *= floor / ipd;
+        ipd = floor;
+    }
+    xfer->ipd_current = ipd;
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_report(ttp_session_t *session);
+ *
+ * Prints the blocks that each data path carried and lost, and the rate
+ * it ended at.
+ *------------------------------------------------------------------------*/
+void path_report(ttp_session_t *session)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+    ttp_path_t     *path;
+    char            from[INET_ADDRSTRLEN], to[INET_ADDRSTRLEN];
+    u_int32_t       i;
+
+    for (i = 0; i < xfer->path_count; ++i) {
+        path = &xfer->paths[i];
+        if (!path->active)
+            continue;
+        path->total_sent += path->sent;
+        path->total_lost += path->lost;
+        path->sent = path->lost = 0;
+        if (i == 0) {
+            fprintf(stderr, "Server %d path 0 (primary): ", session->session_id);
+        } else {
+            inet_ntop(AF_INET, &session->parameter->path_source[i], from, sizeof(from));
+            inet_ntop(AF_INET, &path->address.sin_addr, to, sizeof(to));
+            fprintf(stderr, "Server %d path %u (%s to %s): ", session->session_id, i, from, to);
+        }
+        fprintf(stderr, "%llu blocks, %llu asked for again, %0.1f Mbps at the end\n",
+                (ull_t) path->total_sent, (ull_t) path->total_lost,
+                8.0 * session->parameter->block_size / path->ipd);
+    }
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_close(ttp_session_t *session);
+ *
+ * Closes the sockets of the extra data paths of the transfer and frees
+ * their state.  The UDP socket of path 0 is left alone.
+ *------------------------------------------------------------------------*/
+void path_close(ttp_session_t *session)
+{
+    ttp_transfer_t *xfer = &session->transfer;
+    u_int32_t       i;
+
+    for (i = 1; i < xfer->path_count; ++i)
+        if (xfer->paths[i].active || xfer->paths[i].pending)
+            close(xfer->paths[i].fd);
+    if (xfer->path_of != NULL)
+        free(xfer->path_of);
+    xfer->path_of    = NULL;
+    xfer->path_count = 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int path_probe(ttp_session_t *session, u_int32_t index);
+ *
+ * Sends a TS_BLOCK_PATH_PROBE datagram with the nonce of the data path
+ * with the given index on that path.  Returns 0 on success and nonzero
+ * on failure.
+ *------------------------------------------------------------------------*/
+int path_probe(ttp_session_t *session, u_int32_t index)
+{
+    ttp_path_t *path = &session->transfer.paths[index];
+    u_char      datagram[6];
+
+    *((u_int32_t *) (datagram + 0)) = htonl(path->nonce);
+    *((u_int16_t *) (datagram + 4)) = htons(TS_BLOCK_PATH_PROBE);
+    ++path->probes;
+    if (sendto(path->fd, datagram, sizeof(datagram), 0, (struct sockaddr *) &path->address, sizeof(path->address)) < 0) {
+        sprintf(g_error, "Could not send the probe of data path %u", index);
+        return warn(g_error);
+    }
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * void path_drop(ttp_session_t *session, u_int32_t index);
+ *
+ * Closes the data path with the given index, which the client did not
+ * confirm.
+ *------------------------------------------------------------------------*/
+void path_drop(ttp_session_t *session, u_int32_t index)
+{
+    ttp_path_t *path = &session->transfer.paths[index];
+
+    close(path->fd);
+    path->pending = 0;
+    path->active  = 0;
+}
+
+
+/*========================================================================
+ * $Log$
+ */
@@ -69,6 +69,8 @@
 #include <sys/socket.h>  /* for the BSD sockets library    */
 #include <sys/time.h>    /* gettimeofday()                 */
 #include <netdb.h>       /* needed on OS X                 */
+#include <netinet/in.h>  /* for IPPROTO_TCP                */
+#include <netinet/tcp.h> /* for TCP_INFO                   */
 #include <time.h>        /* for time()                     */
 #include <unistd.h>      /* for standard Unix system calls */
 #include <assert.h>
@@ -92,10 +94,28 @@
  *   REQUEST_RETRANSMIT -- Retransmit the given block.
  *   REQUEST_RESTART    -- Restart the transfer at the given block.
  *   REQUEST_ERROR_RATE -- Use the given error rate to adjust the IPD.
+ *   REQUEST_START_RATE -- Set the IPD to the given rate (in kbps).
+ *   REQUEST_SACK       -- The client has the blocks from the given one
+ *                         to the one in the error rate field.
+ *   REQUEST_RETRANSMIT_RANGE -- Queue the blocks from the given one to
+ *                         the one in the error rate field, which are
+ *                         then sent by ttp_send_range().
+ *   REQUEST_DISK_RATE  -- Keep the rate below the given one (in kbps),
+ *                         which the disk of the client can write.
+ *   REQUEST_STALL_NOTICE -- The client takes TS_BLOCK_STALL notices of
+ *                         the stalls in reading the source.
+ *   REQUEST_TIMESTAMPS -- Stamp the send time into the data blocks.
+ *   REQUEST_PATH       -- Add a data path to the IPv4 address in the
+ *                         block field, with the path index in the high
+ *                         and the UDP port in the low 16 bits of the
+ *                         error rate field.
+ *   REQUEST_PATH_CONFIRM -- Start sending on the data path with the
+ *                         index in the error rate field, whose probe
+ *                         nonce the client echoes in the block field.
  *
  * For REQUEST_RETRANSMIT messsages, the given buffer must be large
- * enough to hold (block_size + 6) bytes.  For other messages, the
- * datagram parameter is ignored.
+ * enough to hold (block_size + 6 + TS_STAMP_SIZE) bytes.  For other
+ * messages, the datagram parameter is ignored.
  *
  * Returns 0 on success and non-zero on failure.
  *------------------------------------------------------------------------*/
@@ -105,8 +125,11 @@ int ttp_accept_retransmit(ttp_session_t *session, retransmission_t *retransmissi
     ttp_parameter_t *param     = session->parameter;
     static int       iteration = 0;
     static char      stats_line[80];
+    double           read_time;
     int              status;
     u_int16_t        type;
+    u_int32_t        block;
+    struct in_addr   address;
 
     /* convert the retransmission fields to host byte order */
     retransmission->block      = ntohl(retransmission->block);
@@ -116,32 +139,107 @@ int ttp_accept_retransmit(ttp_session_t *session, retransmission_t *retransmissi
     /* if it's an error rate notification */
     if (type == REQUEST_ERROR_RATE) {
 
-	/* calculate a new IPD */
-	if (retransmission->error_rate > param->error_rate) {
-	    double factor1 = (1.0 * param->slower_num / param->slower_den) - 1.0;
-	    double factor2 = (1.0 + retransmission->error_rate - param->error_rate) / (100000.0 - param->error_rate);
-	    xfer->ipd_current *= 1.0 + (factor1 * factor2);
-	} else {
-	    xfer->ipd_current *= (double) param->faster_num / param->faster_den;
+	/* the mean time a block took to read since the last report is what our source sustains */
+	if (xfer->read_blocks > 0) {
+	    read_time      = (double) xfer->read_usec / xfer->read_blocks;
+	    xfer->ipd_read = (xfer->ipd_read > 0) ? (xfer->ipd_read + read_time) / 2 : read_time;
 	}
 
-    /* make sure the IPD is still in range, for later calculations */
-    xfer->ipd_current = max(min(xfer->ipd_current, 10000.0), param->ipd_time);
+	/* calculate a new IPD, kept in range for later calculations and no faster than either disk */
+	if (xfer->path_count > 1) {
+	    path_rate(session, retransmission->error_rate);
+	} else {
+	    xfer->ipd_current = ratecontrol_ipd(xfer->ipd_current, retransmission->error_rate, param->error_rate,
+	                                        param->slower_num, param->slower_den,
+	                                        param->faster_num, param->faster_den, param->ipd_time);
+	    xfer->ipd_current = max(xfer->ipd_current, max(xfer->ipd_disk, xfer->ipd_read));
+	    xfer->ipd_budget  = budget_ipd(session, xfer->ipd_current);
+	    xfer->ipd_current = max(xfer->ipd_current, xfer->ipd_budget);
+	}
 
     /* build the stats string */
-    sprintf(stats_line, "%6u %3.2fus %5uus %7u %6.2f %3u\n",
+    sprintf(stats_line, "%6u %3.2fus %5uus %7u %6.2f %3u %7.1f %7u\n",
         retransmission->error_rate, (float)xfer->ipd_current, param->ipd_time, xfer->block,
-        100.0 * xfer->block / param->block_count, session->session_id);
+        100.0 * xfer->block / param->block_count, session->session_id,
+        (xfer->ipd_read > 0) ? 8.0 * param->block_size / xfer->ipd_read : 0.0, xfer->read_max);
+	xfer->read_usec   = 0;
+	xfer->read_blocks = 0;
+	xfer->read_max    = 0;
 
 	/* print a status report */
 	if (!(iteration++ % 23))
-	    printf(" erate     ipd  target   block   %%done srvNr\n");
+	    printf(" erate     ipd  target   block   %%done srvNr  rdMbps rdmaxus\n");
 	printf("%s", stats_line);
 
 	/* print to the transcript if the user wants */
 	if (param->transcript_yn)
 	    xscript_data_log(session, stats_line);
 
+    /* if it's a start rate hint, kept in the range of ratecontrol_ipd() */
+    } else if (type == REQUEST_START_RATE) {
+
+	if (retransmission->error_rate > 0) {
+	    xfer->ipd_current = (8000.0 * param->block_size) / retransmission->error_rate;
+	    xfer->ipd_current = max(xfer->ipd_current, param->ipd_time);
+	    xfer->ipd_current = min(xfer->ipd_current, 10000.0);
+	    xfer->ipd_current = max(xfer->ipd_current, xfer->ipd_disk);
+	    if (xfer->path_count > 1) {
+	        path_start_rate(session, xfer->ipd_current);
+	    } else {
+	        xfer->ipd_budget  = budget_ipd(session, xfer->ipd_current);
+	        xfer->ipd_current = max(xfer->ipd_current, xfer->ipd_budget);
+	    }
+	    printf("Client requested a start rate of %u Mbps, IPD set to %0.2f us\n",
+	           retransmission->error_rate / 1000, xfer->ipd_current);
+	}
+
+    /* if it's the rate the disk of the client keeps up with, never go faster */
+    } else if (type == REQUEST_DISK_RATE) {
+
+	if (retransmission->error_rate > 0) {
+	    xfer->ipd_disk    = (8000.0 * param->block_size) / retransmission->error_rate;
+	    xfer->ipd_current = max(xfer->ipd_current, max(xfer->ipd_disk, xfer->ipd_budget));
+	    if (xfer->path_count > 1)
+	        path_limit(session);
+	}
+
+    /* if the client wants to hear about our read stalls */
+    } else if (type == REQUEST_STALL_NOTICE) {
+
+	xfer->stall_notices = 1;
+
+    /* if the client follows the one-way delay of the blocks */
+    } else if (type == REQUEST_TIMESTAMPS) {
+
+	xfer->stamped = 1;
+
+    /* if the client receives on another data path too */
+    } else if (type == REQUEST_PATH) {
+
+	address.s_addr = htonl(retransmission->block);
+	return path_add(session, retransmission->error_rate >> 16, address, retransmission->error_rate & 0xffff);
+
+    /* if the client proves that it receives on a data path */
+    } else if (type == REQUEST_PATH_CONFIRM) {
+
+	return path_confirm(session, retransmission->error_rate, retransmission->block);
+
+    /* if it's a range of blocks the client has, mark it off */
+    } else if (type == REQUEST_SACK) {
+
+	/* do range-checking first */
+	if ((retransmission->block == 0) || (retransmission->block > retransmission->error_rate) ||
+	    (retransmission->error_rate > param->block_count)) {
+	    sprintf(g_error, "Attempt to acknowledge illegal blocks %u to %u", retransmission->block, retransmission->error_rate);
+	    return warn(g_error);
+	}
+
+	/* only the part above the blocks known to be acknowledged is new */
+	for (block = max(retransmission->block, xfer->acked_to + 1); block <= retransmission->error_rate; ++block)
+	    xfer->acked[block / 8] |= (1 << (block % 8));
+	while ((xfer->acked_to < param->block_count) && (xfer->acked[(xfer->acked_to + 1) / 8] & (1 << ((xfer->acked_to + 1) % 8))))
+	    ++xfer->acked_to;
+
     /* if it's a restart request */
     } else if (type == REQUEST_RESTART) {
 
@@ -149,12 +247,48 @@ int ttp_accept_retransmit(ttp_session_t *session, retransmission_t *retransmissi
 	if ((retransmission->block == 0) || (retransmission->block > param->block_count)) {
 	    sprintf(g_error, "Attempt to restart at illegal block %u", retransmission->block);
 	    return warn(g_error);
-	} else
-	    xfer->block = retransmission->block;
+	} else {
+	    xfer->block       = retransmission->block;
+	    xfer->range_count = 0;
+	}
+
+    /* if it's a range of blocks to retransmit, queue it */
+    } else if (type == REQUEST_RETRANSMIT_RANGE) {
+
+	/* do range-checking first */
+	if ((retransmission->block == 0) || (retransmission->block > retransmission->error_rate) ||
+	    (retransmission->error_rate > param->block_count)) {
+	    sprintf(g_error, "Attempt to retransmit illegal blocks %u to %u", retransmission->block, retransmission->error_rate);
+	    return warn(g_error);
+	}
+	if (xfer->range_count == MAX_RANGE_REQUESTS)
+	    return warn("Too many retransmission ranges, the client will ask again");
+
+	/* the blocks were lost on the paths they were sent on */
+	if (xfer->path_count > 1)
+	    for (block = retransmission->block; block <= retransmission->error_rate; ++block)
+		path_lost(session, block);
+
+	block = (xfer->range_head + xfer->range_count++) % MAX_RANGE_REQUESTS;
+	xfer->ranges[block].next = retransmission->block;
+	xfer->ranges[block].last = retransmission->error_rate;
+	xfer->tail_interval      = min(xfer->tail_interval, TAIL_PROBE_MIN);
 
     /* if it's a retransmit request */
     } else if (type == REQUEST_RETRANSMIT) {
 
+        /* a stale request for a block the client has already acknowledged */
+        if ((retransmission->block <= param->block_count) &&
+            (xfer->acked[retransmission->block / 8] & (1 << (retransmission->block % 8)))) {
+            ++xfer->skipped;
+            return 0;
+        }
+
+        /* the client is waiting on us, so probe the tail early again */
+        xfer->tail_interval = min(xfer->tail_interval, TAIL_PROBE_MIN);
+        if (xfer->path_count > 1)
+            path_lost(session, retransmission->block);
+
         /* build the retransmission */
         status = build_datagram(session, retransmission->block, TS_BLOCK_RETRANSMISSION, datagram);
         if (status < 0) {
@@ -163,7 +297,7 @@ int ttp_accept_retransmit(ttp_session_t *session, retransmission_t *retransmissi
         }
       
         /* try to send out the block */
-        status = sendto(xfer->udp_fd, datagram, 6 + param->block_size, 0, xfer->udp_address, xfer->udp_length);
+        status = send_datagram(session, datagram);
         if (status < 0) {
             sprintf(g_error, "Could not retransmit block %u", retransmission->block);
             return warn(g_error);
@@ -180,6 +314,95 @@ int ttp_accept_retransmit(ttp_session_t *session, retransmission_t *retransmissi
 }
 
 
+/*------------------------------------------------------------------------
+ * int ttp_send_range(ttp_session_t *session, u_char *datagram);
+ *
+ * Sends the next block of the oldest range queued by a request of type
+ * REQUEST_RETRANSMIT_RANGE as a retransmission, leaving out the blocks
+ * the client has acknowledged since.  The given buffer must be large
+ * enough to hold (block_size + 6 + TS_STAMP_SIZE) bytes.  Returns 0 on
+ * success and non-zero on failure.
+ *------------------------------------------------------------------------*/
+int ttp_send_range(ttp_session_t *session, u_char *datagram)
+{
+    ttp_transfer_t  *xfer  = &session->transfer;
+    block_range_t   *range = &xfer->ranges[xfer->range_head];
+    u_int32_t        block;
+    int              status;
+
+    /* find the next block the client still lacks */
+    while ((range->next <= range->last) && (xfer->acked[range->next / 8] & (1 << (range->next % 8)))) {
+        ++range->next;
+        ++xfer->skipped;
+    }
+    block = range->next++;
+
+    /* move on to the next range when this one is done */
+    if (range->next > range->last) {
+        xfer->range_head = (xfer->range_head + 1) % MAX_RANGE_REQUESTS;
+        --xfer->range_count;
+    }
+    if (block > range->last)
+        return 0;
+
+    /* build the retransmission */
+    status = build_datagram(session, block, TS_BLOCK_RETRANSMISSION, datagram);
+    if (status < 0) {
+        sprintf(g_error, "Could not build retransmission for block %u", block);
+        return warn(g_error);
+    }
+
+    /* try to send out the block */
+    status = send_datagram(session, datagram);
+    if (status < 0) {
+        sprintf(g_error, "Could not retransmit block %u", block);
+        return warn(g_error);
+    }
+
+    /* we succeeded */
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------
+ * int ttp_send_stall(ttp_session_t *session);
+ *
+ * Handles a stall in reading the source that build_datagram() noted:
+ * counts it, and tells the client about it with a TS_BLOCK_STALL
+ * datagram that carries the length of the stall (in usec) in place of
+ * the block number, if the client asked for such notices.  The client
+ * then doesn't take the silence for loss.  Returns 0 on success and
+ * non-zero on failure.
+ *------------------------------------------------------------------------*/
+int ttp_send_stall(ttp_session_t *session)
+{
+    ttp_transfer_t  *xfer = &session->transfer;
+    u_char           notice[6];
+    int              status;
+
+    /* count the stall */
+    ++xfer->stalls;
+    xfer->stall_usec += xfer->read_stall;
+    if (session->parameter->verbose_yn)
+        printf("Read stall of %0.1f ms at block %u\n", xfer->read_stall / 1e3, xfer->block);
+
+    /* and tell the client about it */
+    if (xfer->stall_notices) {
+        *((u_int32_t *) (notice + 0)) = htonl(xfer->read_stall);
+        *((u_int16_t *) (notice + 4)) = htons(TS_BLOCK_STALL);
+        status = impair_sendto(0, xfer->udp_fd, notice, sizeof(notice), 0, xfer->udp_address, xfer->udp_length);
+        if (status < 0) {
+            xfer->read_stall = 0;
+            return warn("Could not send read stall notice");
+        }
+    }
+
+    /* we succeeded */
+    xfer->read_stall = 0;
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------
  * int ttp_authenticate(ttp_session_t *session, const u_char *secret);
  *
@@ -285,6 +508,13 @@ int ttp_open_port(ttp_session_t *session)
     int                 status;
     u_int16_t           port;
     u_char              ipv6_yn = session->parameter->ipv6_yn;
+    ttp_parameter_t    *param   = session->parameter;
+    u_int32_t           rtt_usec = 0;
+    u_int32_t           buffer, granted, limit;
+    #ifdef TCP_INFO
+    struct tcp_info     tcp;
+    socklen_t           tcp_length = sizeof(tcp);
+    #endif
 
     /* create the address structure */
     if (session->parameter->client == NULL) { // Connect back to IP address of TCP connection
@@ -347,6 +577,24 @@ int ttp_open_port(ttp_session_t *session)
     if (session->transfer.udp_fd < 0)
 	return warn("Could not create UDP socket");
 
+    /* size its send buffer after the bandwidth-delay product, with the RTT the kernel measured on the control connection */
+    #ifdef TCP_INFO
+    if (getsockopt(session->client_fd, IPPROTO_TCP, TCP_INFO, &tcp, &tcp_length) == 0)
+	rtt_usec = tcp.tcpi_rtt;
+    #endif
+    buffer = param->udp_buffer ? param->udp_buffer : bdp_size(param->target_rate, rtt_usec, MIN_UDP_BUFFER, max(param->buffer_max, MIN_UDP_BUFFER));
+    granted = set_socket_buffer(session->transfer.udp_fd, SO_SNDBUF, buffer, &limit);
+    session->transfer.udp_buffer = buffer;
+    if (param->verbose_yn)
+	printf("UDP send buffer of %u bytes for %0.1f Mbps over %0.1f ms, %u granted\n",
+	       buffer, param->target_rate / 1e6, rtt_usec / 1e3, granted);
+    if (granted < buffer) {
+	if (limit > 0)
+	    printf("Warning: UDP send buffer clamped to %u of %u bytes by net.core.wmem_max = %u\n", granted, buffer, limit);
+	else
+	    printf("Warning: UDP send buffer clamped to %u of %u bytes by the kernel\n", granted, buffer);
+    }
+
     /* we succeeded */
     session->transfer.udp_address = address;
     return 0;
@@ -371,6 +619,7 @@ int ttp_open_transfer(ttp_session_t *session)
     u_int64_t        file_size;                      /* network-order version of file size   */
     u_int32_t        block_size;                     /* network-order version of block size  */
     u_int32_t        block_count;                    /* network-order version of block count */
+    u_int32_t        manifest_length;                /* network-order aggregate manifest size */
     time_t           epoch;
     int              status;
     ttp_transfer_t  *xfer  = &session->transfer;
@@ -398,6 +647,17 @@ int ttp_open_transfer(ttp_session_t *session)
         error("Could not read filename from client");
     filename[MAX_FILENAME_LENGTH - 1] = '\0';
 
+    /* a client that takes reports of its place in the transfer queue says so before its first request */
+    if (!strcmp(filename, TS_QUEUE_CMD)) {
+        session->queue_notices = 1;
+        if (full_write(session->client_fd, "\000", 1) < 0)
+            return warn("Could not acknowledge queue notices");
+        status = read_line(session->client_fd, filename, MAX_FILENAME_LENGTH);
+        if (status < 0)
+            error("Could not read filename from client");
+        filename[MAX_FILENAME_LENGTH - 1] = '\0';
+    }
+
     if(!strcmp(filename, TS_DIRLIST_HACK_CMD)) {
 
        /* The client requested listing of files and their sizes (dir command)
@@ -532,15 +792,35 @@ int ttp_open_transfer(ttp_session_t *session)
 
     #ifndef VSIB_REALTIME
 
-    /* try to open the file for reading */
-    xfer->file = fopen(filename, "r");
-    if (xfer->file == NULL) {
-        sprintf(g_error, "File '%s' does not exist or cannot be read", filename);
-        /* signal failure to the client */
-        status = full_write(session->client_fd, "\x008", 1);
-        if (status < 0)
-            warn("Could not signal request failure to client");
-        return warn(g_error);
+    if (!strcmp(filename, TS_AGGREGATE_CMD)) {
+
+        /* the client requested all shared files as one aggregated stream */
+        if (aggregate_open(session) < 0) {
+            status = full_write(session->client_fd, "\x008", 1);
+            if (status < 0)
+                warn("Could not signal request failure to client");
+            return warn("Could not aggregate the shared files");
+        }
+
+    } else if ((xfer->synthetic = synthetic_parse(filename, &param->file_size, &xfer->synthetic_seed)) != TS_SYNTHETIC_NONE) {
+
+        /* the client requested a synthetic source, which needs no file */
+        if (param->verbose_yn)
+            printf("Generating %Lu bytes of synthetic data\n", (ull_t) param->file_size);
+
+    } else {
+
+        /* try to open the file for reading */
+        xfer->file = fopen(filename, "r");
+        if (xfer->file == NULL) {
+            sprintf(g_error, "File '%s' does not exist or cannot be read", filename);
+            /* signal failure to the client */
+            status = full_write(session->client_fd, "\x008", 1);
+            if (status < 0)
+                warn("Could not signal request failure to client");
+            return warn(g_error);
+        }
+        cache_identify(xfer->file, &xfer->cache_key);
     }
 
     #else
@@ -621,6 +901,17 @@ int ttp_open_transfer(ttp_session_t *session)
 
     #endif // end of VSIB_REALTIME section
 
+    /* wait our turn if the server already runs as many transfers as it may */
+    if (admit_wait(session) < 0) {
+        full_write(session->client_fd, "\x008", 1);
+        if (xfer->aggregate != NULL)
+            aggregate_close(session);
+        else if (xfer->file != NULL)
+            fclose(xfer->file);
+        xfer->file = NULL;
+        return warn("Transfer not admitted");
+    }
+
     /* begin round trip time estimation */
     gettimeofday(&ping_s,NULL);
 
@@ -645,9 +936,15 @@ int ttp_open_transfer(ttp_session_t *session)
 
     #ifndef VSIB_REALTIME
     /* try to find the file statistics */
-    fseeko(xfer->file, 0, SEEK_END);
-    param->file_size   = ftello(xfer->file);
-    fseeko(xfer->file, 0, SEEK_SET);
+    if (xfer->aggregate != NULL) {
+        param->file_size = aggregate_size(session);
+    } else if (xfer->synthetic != TS_SYNTHETIC_NONE) {
+        /* the size was given in the synthetic file name */
+    } else {
+        fseeko(xfer->file, 0, SEEK_END);
+        param->file_size   = ftello(xfer->file);
+        fseeko(xfer->file, 0, SEEK_SET);
+    }
     #else
     /* get length of recording in bytes from filename */
     if (get_aux_entry("flen", ef->auxinfo, ef->nr_auxinfo) != 0) {
@@ -669,14 +966,42 @@ int ttp_open_transfer(ttp_session_t *session)
     block_count = htonl (param->block_count);  if (full_write(session->client_fd, &block_count, 4) < 0) return warn("Could not submit block count");
     epoch       = htonl (param->epoch);        if (full_write(session->client_fd, &epoch,       4) < 0) return warn("Could not submit run epoch");
 
+    /* an aggregated stream is followed by the manifest of its member files */
+    if (xfer->aggregate != NULL) {
+        manifest_length = htonl(xfer->aggregate->manifest_length);
+        if (full_write(session->client_fd, &manifest_length, 4) < 0) return warn("Could not submit manifest length");
+        if (full_write(session->client_fd, xfer->aggregate->manifest, xfer->aggregate->manifest_length) < 0) return warn("Could not submit manifest");
+    }
+
     /*calculate and convert RTT to u_sec*/
     session->parameter->wait_u_sec=(ping_e.tv_sec - ping_s.tv_sec)*1000000+(ping_e.tv_usec-ping_s.tv_usec);
     /*add a 10% safety margin*/
     session->parameter->wait_u_sec = session->parameter->wait_u_sec + ((int)(session->parameter->wait_u_sec* 0.1));  
 
+    /* no block has been acknowledged yet */
+    xfer->acked = (u_char *) calloc(param->block_count / 8 + 2, sizeof(u_char));
+    if (xfer->acked == NULL)
+        return warn("Could not allocate the bitfield of acknowledged blocks");
+    xfer->acked_to = 0;
+    xfer->skipped  = 0;
+
     /* and store the inter-packet delay */
     param->ipd_time   = (u_int32_t) ((1000000LL * 8 * param->block_size) / param->target_rate);
     xfer->ipd_current = param->ipd_time * 3;
+    xfer->ipd_disk    = 0.0;
+    xfer->ipd_budget  = 0.0;
+    xfer->budget_slot = -1;
+
+    /* and nothing was read yet */
+    xfer->ipd_read      = 0.0;
+    xfer->read_usec     = 0;
+    xfer->read_blocks   = 0;
+    xfer->read_max      = 0;
+    xfer->read_stall    = 0;
+    xfer->stalls        = 0;
+    xfer->stall_usec    = 0;
+    xfer->stall_notices = 0;
+    xfer->stamped       = 0;
 
     /* if we're doing a transcript */
     if (param->transcript_yn)